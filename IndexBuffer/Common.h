@@ -36,6 +36,8 @@ extern ID3D11DepthStencilView* gDepthStencil;            // The depth buffer con
 // render anything. Very simple shaders are used in this tutorial
 extern ID3D11PixelShader*  gSimplePixelShader;
 extern ID3D11VertexShader* gSimpleVertexShader;
+extern ID3D11VertexShader* gDepthOnlyVertexShader;
+extern ID3D11VertexShader* gInstancedVertexShader;
 
 
 // A global error message to help track down fatal errors - set it to a useful message
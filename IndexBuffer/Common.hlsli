@@ -20,6 +20,11 @@
 // >>> Your exercise is to update the *cpp* file to provide that extra data. You will
 // >>> need to update the vertex structure and the cube vertex data in the cpp file.
 // >>> No changes are actually required in this file...
+//
+// The C++ side of this structure is now described by kSimpleVertexElements in VertexFormats.h.
+// MakeHlslVertexStruct (VertexLayout.h) generates the HLSL for that description - paste its
+// output here if the C++ vertex structure changes. "MeshCheck --hlsl Common.hlsli" checks the
+// vertex structures in this file against the C++ descriptions and fails if any differ.
 
 struct SimpleVertex
 {
@@ -28,6 +33,30 @@ struct SimpleVertex
 };
 
 
+// Vertex data for the depth-only pass. When the mesh uses split streams (see MeshStreams.h)
+// this pass only binds the position buffer, so the shader must not ask for anything else.
+// Matches kPositionVertexElements in VertexFormats.h
+struct PositionOnlyVertex
+{
+    float3 position : position;
+};
+
+
+// Vertex data for instanced drawing: the mesh vertex from the usual stream(s) plus the data for
+// the copy being drawn from the per-instance stream. The world matrix arrives as four rows.
+// Matches kSimpleVertexElements and kInstanceDataElements in VertexFormats.h
+struct InstancedVertex
+{
+    float3 position  : position;
+    float4 colour    : colour;
+    float4 worldRow0 : world0;
+    float4 worldRow1 : world1;
+    float4 worldRow2 : world2;
+    float4 worldRow3 : world3;
+    float4 tint      : tint;
+};
+
+
 // This structure describes what data the pixel shader receives. It typically gets whatever
 // data is output from the vertex shader - i.e. the vertex shader output is the pixel shader
 // input. In this example, the vertex shader outputs a projected 2D position (we'll see later
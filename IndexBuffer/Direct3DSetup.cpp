@@ -30,6 +30,8 @@ ID3D11DepthStencilView* gDepthStencil        = nullptr; // The depth buffer refe
 // render anything. Very simple shaders are used in this tutorial
 ID3D11PixelShader*  gSimplePixelShader  = nullptr;
 ID3D11VertexShader* gSimpleVertexShader = nullptr;
+ID3D11VertexShader* gDepthOnlyVertexShader = nullptr; // Reads positions only, used for the depth-only pass
+ID3D11VertexShader* gInstancedVertexShader = nullptr; // Reads the world matrix from per-instance vertex data
 
 
 //--------------------------------------------------------------------------------------
@@ -45,9 +47,13 @@ bool LoadShaders()
     // Ensure you release the shaders in the ShutdownDirect3D function below
     gSimpleVertexShader = LoadVertexShader("TransformColour_vs"); // Note how the shaders are named to show what type they are
     gSimplePixelShader  = LoadPixelShader ("OneColour_ps"); 
+    gDepthOnlyVertexShader = LoadVertexShader("TransformPosition_vs");
+    gInstancedVertexShader = LoadVertexShader("TransformInstanced_vs");
 
-    if (gSimpleVertexShader == nullptr ||
-        gSimplePixelShader  == nullptr)
+    if (gSimpleVertexShader    == nullptr ||
+        gSimplePixelShader     == nullptr ||
+        gDepthOnlyVertexShader == nullptr ||
+        gInstancedVertexShader == nullptr)
     {
         gLastError = "Error loading shaders";
         return false;
@@ -169,6 +175,8 @@ void ShutdownDirect3D()
     // own projects.
     if (gSimplePixelShader)  gSimplePixelShader->Release();
     if (gSimpleVertexShader) gSimpleVertexShader->Release();
+    if (gDepthOnlyVertexShader) gDepthOnlyVertexShader->Release();
+    if (gInstancedVertexShader) gInstancedVertexShader->Release();
     if (gD3DContext)
     {
         gD3DContext->ClearState(); // This line is also needed to reset the GPU before shutting down DirectX
@@ -0,0 +1,199 @@
+//--------------------------------------------------------------------------------------
+// Recording and checking draw calls without a GPU
+//--------------------------------------------------------------------------------------
+
+#include "DrawRecorder.h"
+#include <sstream>
+
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+
+uint32_t DrawRecorder::AddBuffer(const char* name, uint64_t size)
+{
+    mBuffers.push_back({ name, size });
+    return static_cast<uint32_t>(mBuffers.size() - 1);
+}
+
+void DrawRecorder::ResizeBuffer(uint32_t buffer, uint64_t size)
+{
+    if (buffer < mBuffers.size())  mBuffers[buffer].size = size;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Calls
+//--------------------------------------------------------------------------------------
+
+void DrawRecorder::BeginFrame()
+{
+    mCounts = DrawCallCounts();
+    mErrors.clear();
+}
+
+
+void DrawRecorder::WriteBuffer(uint32_t buffer, uint64_t numBytes, uint64_t offset)
+{
+    ++mCounts.numBufferWrites;
+    mCounts.bytesWritten += numBytes;
+    if (buffer >= mBuffers.size())
+    {
+        AddError("Write to unknown buffer " + std::to_string(buffer));
+    }
+    else if (offset + numBytes > mBuffers[buffer].size)
+    {
+        AddError("Write of " + std::to_string(numBytes) + " bytes at " + std::to_string(offset) + " overruns " +
+                 mBuffers[buffer].name + " (" + std::to_string(mBuffers[buffer].size) + " bytes)");
+    }
+}
+
+
+void DrawRecorder::SetInputLayout(const VertexStream* streams, int numStreams)
+{
+    ++mCounts.numBindings;
+    mLayout.assign(streams, streams + numStreams);
+    mLayoutSet = true;
+    for (auto& stream : mLayout)
+    {
+        if (stream.slot >= kMaxSlots)  AddError("Input layout uses slot " + std::to_string(stream.slot));
+    }
+}
+
+
+void DrawRecorder::SetVertexBuffers(uint32_t startSlot, uint32_t numBuffers, const uint32_t* buffers,
+                                    const uint32_t* strides, const uint32_t* offsets)
+{
+    ++mCounts.numBindings;
+    for (uint32_t i = 0; i < numBuffers; ++i)
+    {
+        uint32_t slot = startSlot + i;
+        if (slot >= kMaxSlots)
+        {
+            AddError("Vertex buffer bound to slot " + std::to_string(slot));
+            return;
+        }
+        mVertexBuffers[slot].buffer = buffers[i];
+        mVertexBuffers[slot].stride = strides[i];
+        mVertexBuffers[slot].offset = offsets[i];
+    }
+}
+
+
+void DrawRecorder::SetIndexBuffer(uint32_t buffer, uint32_t indexSize, uint32_t offset)
+{
+    ++mCounts.numBindings;
+    if (indexSize != 2 && indexSize != 4)  AddError("Index size " + std::to_string(indexSize) + " is not 2 or 4");
+    mIndexBuffer = buffer;
+    mIndexSize   = indexSize;
+    mIndexOffset = offset;
+}
+
+
+void DrawRecorder::DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex, uint32_t numVertices)
+{
+    ++mCounts.numDraws;
+    ++mCounts.numInstances;
+    mCounts.numIndices += indexCount;
+    CheckDraw(indexCount, 1, startIndex, baseVertex, 0, numVertices);
+}
+
+void DrawRecorder::DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex,
+                                        int32_t baseVertex, uint32_t startInstance, uint32_t numVertices)
+{
+    ++mCounts.numDraws;
+    ++mCounts.numInstancedDraws;
+    mCounts.numInstances += instanceCount;
+    mCounts.numIndices += static_cast<uint64_t>(indexCount) * instanceCount;
+    if (instanceCount == 0)  AddError("Instanced draw " + std::to_string(mCounts.numDraws) + " has no instances");
+    CheckDraw(indexCount, instanceCount, startIndex, baseVertex, startInstance, numVertices);
+}
+
+
+// Check the bound state for a draw, adding any problems to the error list
+void DrawRecorder::CheckDraw(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex,
+                             uint32_t startInstance, uint32_t numVertices)
+{
+    // Error messages start with the draw number, only built when there is an error
+    auto draw = [&]() { return "Draw " + std::to_string(mCounts.numDraws) + ": "; };
+
+    // Indices
+    if (mIndexBuffer >= mBuffers.size())
+    {
+        AddError(draw() + "no index buffer bound");
+    }
+    else
+    {
+        uint64_t end = mIndexOffset + (static_cast<uint64_t>(startIndex) + indexCount) * mIndexSize;
+        if (end > mBuffers[mIndexBuffer].size)
+        {
+            AddError(draw() + "indices " + std::to_string(startIndex) + "-" + std::to_string(startIndex + indexCount) +
+                     " overrun " + mBuffers[mIndexBuffer].name);
+        }
+    }
+
+    // Each stream of the layout needs a buffer in its slot, large enough for the vertices or instances it reads
+    if (!mLayoutSet)
+    {
+        AddError(draw() + "no input layout set");
+        return;
+    }
+    if (baseVertex < 0 && numVertices > 0)
+    {
+        AddError(draw() + "negative base vertex");
+        return;
+    }
+    for (auto& stream : mLayout)
+    {
+        if (stream.slot >= kMaxSlots)  continue;
+        const VertexBufferBinding& binding = mVertexBuffers[stream.slot];
+        auto slot = [&]() { return "slot " + std::to_string(stream.slot) + " "; };
+        if (binding.buffer >= mBuffers.size())
+        {
+            AddError(draw() + slot() + "has no vertex buffer");
+            continue;
+        }
+        const Buffer& buffer = mBuffers[binding.buffer];
+        if (binding.stride != stream.stride)
+        {
+            AddError(draw() + slot() + buffer.name + " stride " + std::to_string(binding.stride) + " does not match layout stride " +
+                     std::to_string(stream.stride));
+            continue;
+        }
+
+        uint64_t end = 0;
+        if (stream.perInstance)
+        {
+            end = binding.offset + (static_cast<uint64_t>(startInstance) + instanceCount) * binding.stride;
+        }
+        else if (numVertices > 0)
+        {
+            end = binding.offset + (static_cast<uint64_t>(baseVertex) + numVertices) * binding.stride;
+        }
+        if (end > buffer.size)
+        {
+            AddError(draw() + slot() + (stream.perInstance ? "instances " : "vertices ") + "overrun " + buffer.name);
+        }
+    }
+}
+
+
+void DrawRecorder::AddError(const std::string& error)
+{
+    if (mErrors.size() < kMaxErrors)  mErrors.push_back(error);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Results
+//--------------------------------------------------------------------------------------
+
+std::string DrawRecorder::Report() const
+{
+    std::ostringstream report;
+    report << mCounts.numDraws << " draws (" << mCounts.numInstancedDraws << " instanced), " << mCounts.numInstances
+           << " instances, " << mCounts.numIndices << " indices, " << mCounts.numBufferWrites << " buffer writes ("
+           << mCounts.bytesWritten << " bytes), " << mCounts.numBindings << " bindings\n";
+    for (auto& error : mErrors)  report << error << "\n";
+    return report.str();
+}
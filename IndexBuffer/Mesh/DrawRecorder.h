@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------------------------
+// Recording and checking draw calls without a GPU
+//--------------------------------------------------------------------------------------
+// Every Map/Unmap, buffer binding and draw call costs CPU time in the driver, so the number of
+// calls per frame matters as much as the amount of geometry. Drawing a thousand objects one by
+// one is a thousand constant buffer updates and a thousand draws; drawing them as instances of
+// one mesh is one buffer update and one draw.
+//
+// DrawRecorder follows the calls made to the input assembler and the draw calls, mirroring the
+// Direct3D 11 functions of the same names, and keeps count of them. It also checks each draw
+// against the bound state the way the debug layer would: that every stream of the input layout
+// has a buffer with a matching stride, and that the indices, vertices and instances read are
+// inside the buffers. The renderer calls it beside the real calls, and tools can record the
+// same sequence of calls with no GPU at all. This file does not use DirectX.
+//
+// Buffers are known to the recorder by an id from AddBuffer, given with the buffer's size.
+
+#ifndef _DRAW_RECORDER_H_INCLUDED_
+#define _DRAW_RECORDER_H_INCLUDED_
+
+#include "VertexLayout.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Counts of the calls recorded since BeginFrame
+struct DrawCallCounts
+{
+    uint32_t numDraws          = 0; // DrawIndexed and DrawIndexedInstanced calls
+    uint32_t numInstancedDraws = 0; // DrawIndexedInstanced calls
+    uint64_t numInstances      = 0; // Copies of meshes drawn, one for each DrawIndexed
+    uint64_t numIndices        = 0; // Indices read, counting each instance
+    uint32_t numBufferWrites   = 0; // Map/Unmap pairs or UpdateSubresource calls
+    uint64_t bytesWritten      = 0;
+    uint32_t numBindings       = 0; // Input layout, vertex buffer and index buffer changes
+};
+
+
+class DrawRecorder
+{
+public:
+    static const uint32_t kNoBuffer = ~0u;
+    static const int      kMaxSlots = 16; // D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT is larger, but 16 is plenty here
+
+    // Buffers //
+
+    // Tell the recorder about a buffer. Returns the id to use for it in the calls below
+    uint32_t AddBuffer(const char* name, uint64_t size);
+
+    // Change the size of a buffer, e.g. when it is created again larger
+    void ResizeBuffer(uint32_t buffer, uint64_t size);
+
+
+    // Calls //
+
+    // Start a new frame, clearing the counts and errors. The bound state is kept, as it is on the GPU
+    void BeginFrame();
+
+    // Record writing to part of a buffer with Map/Unmap or UpdateSubresource
+    void WriteBuffer(uint32_t buffer, uint64_t numBytes, uint64_t offset = 0);
+
+    // Record IASetInputLayout with a layout made from the given streams. The streams are copied
+    void SetInputLayout(const VertexStream* streams, int numStreams);
+
+    // Record IASetVertexBuffers for consecutive slots
+    void SetVertexBuffers(uint32_t startSlot, uint32_t numBuffers, const uint32_t* buffers, const uint32_t* strides,
+                          const uint32_t* offsets);
+
+    // Record IASetIndexBuffer. indexSize is 2 or 4 bytes
+    void SetIndexBuffer(uint32_t buffer, uint32_t indexSize, uint32_t offset = 0);
+
+    // Record a draw. numVertices is how many vertices from baseVertex the indices use, if known, so the vertex
+    // buffers can be checked too (e.g. PoolMeshRange::numVertices), otherwise pass 0
+    void DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex, uint32_t numVertices = 0);
+    void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex,
+                              uint32_t startInstance, uint32_t numVertices = 0);
+
+
+    // Results //
+
+    const DrawCallCounts&           Counts() const { return mCounts; }
+    const std::vector<std::string>& Errors() const { return mErrors; }
+
+    // The counts on one line, followed by any errors one per line
+    std::string Report() const;
+
+
+private:
+    struct Buffer
+    {
+        std::string name;
+        uint64_t    size;
+    };
+
+    struct VertexBufferBinding
+    {
+        uint32_t buffer = kNoBuffer;
+        uint32_t stride = 0;
+        uint32_t offset = 0;
+    };
+
+    // Check the bound state for a draw, adding any problems to the error list
+    void CheckDraw(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex,
+                   uint32_t startInstance, uint32_t numVertices);
+    void AddError(const std::string& error);
+
+    static const size_t kMaxErrors = 100; // Further errors in a frame are not recorded
+
+    std::vector<Buffer>       mBuffers;
+    std::vector<VertexStream> mLayout;
+    bool                      mLayoutSet = false;
+    VertexBufferBinding       mVertexBuffers[kMaxSlots];
+    uint32_t                  mIndexBuffer = kNoBuffer;
+    uint32_t                  mIndexSize = 4;
+    uint32_t                  mIndexOffset = 0;
+
+    DrawCallCounts           mCounts;
+    std::vector<std::string> mErrors;
+};
+
+
+#endif //_DRAW_RECORDER_H_INCLUDED_
@@ -0,0 +1,381 @@
+//--------------------------------------------------------------------------------------
+// Many meshes packed into shared vertex and index buffers
+//--------------------------------------------------------------------------------------
+
+#include "GeometryPool.h"
+#include <algorithm>
+#include <cstring>
+
+const uint32_t RangeAllocator::kInvalidOffset;
+const int GeometryPool::kMaxStreams;
+
+
+//--------------------------------------------------------------------------------------
+// Free-list allocator
+//--------------------------------------------------------------------------------------
+
+// Start with the given amount of space, all free
+void RangeAllocator::Reset(uint32_t capacity)
+{
+    mFreeBlocks.clear();
+    if (capacity > 0)  mFreeBlocks.push_back({ 0, capacity });
+    mCapacity  = capacity;
+    mFreeSpace = capacity;
+}
+
+
+// Allocate a range of the given size, returns its offset or kInvalidOffset if no free block is large enough
+uint32_t RangeAllocator::Allocate(uint32_t size)
+{
+    if (size == 0)  return kInvalidOffset;
+
+    // Best fit - the smallest block that is large enough, stopping early on an exact fit
+    size_t best = mFreeBlocks.size();
+    for (size_t i = 0; i < mFreeBlocks.size(); ++i)
+    {
+        if (mFreeBlocks[i].size >= size && (best == mFreeBlocks.size() || mFreeBlocks[i].size < mFreeBlocks[best].size))
+        {
+            best = i;
+            if (mFreeBlocks[i].size == size)  break;
+        }
+    }
+    if (best == mFreeBlocks.size())  return kInvalidOffset;
+
+    // Take the range from the start of the block
+    Block& block = mFreeBlocks[best];
+    uint32_t offset = block.offset;
+    block.offset += size;
+    block.size   -= size;
+    if (block.size == 0)  mFreeBlocks.erase(mFreeBlocks.begin() + best);
+    mFreeSpace -= size;
+    return offset;
+}
+
+
+// Return a range given by an earlier Allocate
+void RangeAllocator::Free(uint32_t offset, uint32_t size)
+{
+    if (size == 0)  return;
+    mFreeSpace += size;
+
+    // Find the first free block after the range, then join the range to the blocks either side if they touch it
+    auto next = std::lower_bound(mFreeBlocks.begin(), mFreeBlocks.end(), offset,
+                                 [](const Block& block, uint32_t o) { return block.offset < o; });
+    bool joinPrev = (next != mFreeBlocks.begin() && (next - 1)->offset + (next - 1)->size == offset);
+    bool joinNext = (next != mFreeBlocks.end() && offset + size == next->offset);
+
+    if (joinPrev && joinNext)
+    {
+        (next - 1)->size += size + next->size;
+        mFreeBlocks.erase(next);
+    }
+    else if (joinPrev)
+    {
+        (next - 1)->size += size;
+    }
+    else if (joinNext)
+    {
+        next->offset = offset;
+        next->size  += size;
+    }
+    else
+    {
+        mFreeBlocks.insert(next, { offset, size });
+    }
+}
+
+
+// Add space to the end
+void RangeAllocator::Grow(uint32_t newCapacity)
+{
+    if (newCapacity <= mCapacity)  return;
+    uint32_t oldCapacity = mCapacity;
+    mCapacity = newCapacity;
+    Free(oldCapacity, newCapacity - oldCapacity);
+}
+
+
+// Mark the first usedSize units as allocated and the rest free
+void RangeAllocator::SetCompacted(uint32_t usedSize)
+{
+    mFreeBlocks.clear();
+    if (usedSize < mCapacity)  mFreeBlocks.push_back({ usedSize, mCapacity - usedSize });
+    mFreeSpace = mCapacity - usedSize;
+}
+
+
+uint32_t RangeAllocator::LargestFreeBlock() const
+{
+    uint32_t largest = 0;
+    for (auto& block : mFreeBlocks)
+    {
+        if (block.size > largest)  largest = block.size;
+    }
+    return largest;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Geometry pool - construction
+//--------------------------------------------------------------------------------------
+
+// Set up an empty pool for vertices described by the given streams
+bool GeometryPool::Init(const VertexStream* streams, int numStreams, uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+    if (numStreams < 1 || numStreams > kMaxStreams)  return false;
+
+    mNumStreams = numStreams;
+    for (int s = 0; s < kMaxStreams; ++s)
+    {
+        if (s < numStreams)
+        {
+            mStreams[s] = streams[s];
+            mStreamData[s].assign(static_cast<size_t>(vertexCapacity) * streams[s].stride, 0);
+        }
+        else
+        {
+            mStreamData[s].clear();
+        }
+    }
+    mIndexData.assign(indexCapacity, 0);
+
+    mVertexAllocator.Reset(vertexCapacity);
+    mIndexAllocator.Reset(indexCapacity);
+    mMeshes.clear();
+    mFreeIds.clear();
+
+    mCapacityChanged = true;
+    mDirtyVertices = PoolDirtyRange();
+    mDirtyIndices  = PoolDirtyRange();
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Geometry pool - meshes
+//--------------------------------------------------------------------------------------
+
+// Add a mesh, giving a pointer to the vertex data for each stream and the mesh's own indices (starting at 0)
+PoolMeshId GeometryPool::Add(const void* const* streamData, uint32_t numVertices, const MeshIndex* indices, uint32_t numIndices)
+{
+    if (numVertices == 0 || numIndices == 0)  return kInvalidPoolMesh;
+
+    if (!Reserve(mVertexAllocator, numVertices) || !Reserve(mIndexAllocator, numIndices))  return kInvalidPoolMesh;
+
+    PoolMeshRange range;
+    range.numVertices = numVertices;
+    range.numIndices  = numIndices;
+    range.baseVertex  = mVertexAllocator.Allocate(numVertices);
+    range.startIndex  = mIndexAllocator.Allocate(numIndices);
+
+    // Copy the data into the pool, the indices are copied unchanged
+    for (int s = 0; s < mNumStreams; ++s)
+    {
+        size_t stride = mStreams[s].stride;
+        std::memcpy(&mStreamData[s][range.baseVertex * stride], streamData[s], numVertices * stride);
+    }
+    std::memcpy(&mIndexData[range.startIndex], indices, numIndices * sizeof(MeshIndex));
+    MarkDirty(mDirtyVertices, range.baseVertex, numVertices);
+    MarkDirty(mDirtyIndices,  range.startIndex, numIndices);
+
+    PoolMeshId id;
+    if (!mFreeIds.empty())
+    {
+        id = mFreeIds.back();
+        mFreeIds.pop_back();
+        mMeshes[id] = range;
+    }
+    else
+    {
+        id = static_cast<PoolMeshId>(mMeshes.size());
+        mMeshes.push_back(range);
+    }
+    return id;
+}
+
+
+// Add a mesh built by BuildMeshStreams. Its streams must match those the pool was set up with
+PoolMeshId GeometryPool::Add(const MeshStreams& mesh)
+{
+    if (mesh.numStreams != mNumStreams)  return kInvalidPoolMesh;
+
+    const void* streamData[kMaxStreams];
+    for (int s = 0; s < mNumStreams; ++s)
+    {
+        if (mesh.streams[s].stride != mStreams[s].stride)  return kInvalidPoolMesh;
+        streamData[s] = mesh.streamData[s].data();
+    }
+    return Add(streamData, mesh.numVertices, mesh.indices.data(), static_cast<uint32_t>(mesh.indices.size()));
+}
+
+
+// Remove a mesh, its space can be reused by later meshes
+void GeometryPool::Remove(PoolMeshId mesh)
+{
+    PoolMeshRange& range = mMeshes[mesh];
+    if (range.numVertices == 0)  return; // Already removed
+
+    mVertexAllocator.Free(range.baseVertex, range.numVertices);
+    mIndexAllocator.Free(range.startIndex, range.numIndices);
+    range = PoolMeshRange{ 0, 0, 0, 0 };
+    mFreeIds.push_back(mesh);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Geometry pool - fragmentation
+//--------------------------------------------------------------------------------------
+
+// Move all meshes down to the start of the pool, leaving all free space in one block at the end of each buffer
+uint32_t GeometryPool::Defragment()
+{
+    std::vector<PoolMeshId> order;
+    order.reserve(NumMeshes());
+    for (PoolMeshId id = 0; id < mMeshes.size(); ++id)
+    {
+        if (mMeshes[id].numVertices != 0)  order.push_back(id);
+    }
+
+    std::vector<bool> moved(mMeshes.size(), false);
+
+    // Vertices - take meshes in buffer order and slide each one down to the end of the one before. Data only ever
+    // moves towards the start of the buffer so nothing is overwritten before it has been moved
+    std::sort(order.begin(), order.end(), [&](PoolMeshId a, PoolMeshId b) { return mMeshes[a].baseVertex < mMeshes[b].baseVertex; });
+    uint32_t nextVertex = 0;
+    for (PoolMeshId id : order)
+    {
+        PoolMeshRange& range = mMeshes[id];
+        if (range.baseVertex != nextVertex)
+        {
+            for (int s = 0; s < mNumStreams; ++s)
+            {
+                size_t stride = mStreams[s].stride;
+                std::memmove(&mStreamData[s][nextVertex * stride], &mStreamData[s][range.baseVertex * stride],
+                             range.numVertices * stride);
+            }
+            MarkDirty(mDirtyVertices, nextVertex, range.numVertices);
+            range.baseVertex = nextVertex;
+            moved[id] = true;
+        }
+        nextVertex += range.numVertices;
+    }
+    mVertexAllocator.SetCompacted(nextVertex);
+
+    // Indices - the same again. The indices are relative to the base vertex so their values do not change
+    std::sort(order.begin(), order.end(), [&](PoolMeshId a, PoolMeshId b) { return mMeshes[a].startIndex < mMeshes[b].startIndex; });
+    uint32_t nextIndex = 0;
+    for (PoolMeshId id : order)
+    {
+        PoolMeshRange& range = mMeshes[id];
+        if (range.startIndex != nextIndex)
+        {
+            std::memmove(&mIndexData[nextIndex], &mIndexData[range.startIndex], range.numIndices * sizeof(MeshIndex));
+            MarkDirty(mDirtyIndices, nextIndex, range.numIndices);
+            range.startIndex = nextIndex;
+            moved[id] = true;
+        }
+        nextIndex += range.numIndices;
+    }
+    mIndexAllocator.SetCompacted(nextIndex);
+
+    return static_cast<uint32_t>(std::count(moved.begin(), moved.end(), true));
+}
+
+
+// How broken up the free space is: 0 when it is all in one block, approaching 1 when it is in many small blocks
+float GeometryPool::Fragmentation() const
+{
+    float vertexFragmentation = 0.0f;
+    if (mVertexAllocator.FreeSpace() > 0)
+    {
+        vertexFragmentation = 1.0f - static_cast<float>(mVertexAllocator.LargestFreeBlock()) / mVertexAllocator.FreeSpace();
+    }
+    float indexFragmentation = 0.0f;
+    if (mIndexAllocator.FreeSpace() > 0)
+    {
+        indexFragmentation = 1.0f - static_cast<float>(mIndexAllocator.LargestFreeBlock()) / mIndexAllocator.FreeSpace();
+    }
+    return (std::max)(vertexFragmentation, indexFragmentation);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Geometry pool - changes
+//--------------------------------------------------------------------------------------
+
+// Call after updating the GPU buffers
+void GeometryPool::ClearChanges()
+{
+    mCapacityChanged = false;
+    mDirtyVertices = PoolDirtyRange();
+    mDirtyIndices  = PoolDirtyRange();
+}
+
+
+// Extend a changed range to cover the given data. A single range is kept rather than a list - meshes added one
+// after another are usually next to each other in the buffers
+void GeometryPool::MarkDirty(PoolDirtyRange& range, uint32_t first, uint32_t count)
+{
+    if (count == 0)  return;
+    if (range.count == 0)
+    {
+        range.first = first;
+        range.count = count;
+        return;
+    }
+    uint32_t end = (std::max)(range.first + range.count, first + count);
+    range.first  = (std::min)(range.first, first);
+    range.count  = end - range.first;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Geometry pool - growing
+//--------------------------------------------------------------------------------------
+
+// Make room for a range of the given size in one of the buffers, defragmenting or growing if necessary
+bool GeometryPool::Reserve(RangeAllocator& allocator, uint32_t size)
+{
+    if (allocator.LargestFreeBlock() >= size)  return true;
+
+    // Enough space in total but in pieces - compacting is cheaper than growing and keeps the buffers the same size
+    if (allocator.FreeSpace() >= size)
+    {
+        Defragment();
+        return true;
+    }
+
+    // Grow by at least half the current size so that adding many meshes does not grow the pool every time
+    uint64_t used = allocator.Capacity() - allocator.FreeSpace();
+    uint64_t newCapacity = (std::max)(used + size, allocator.Capacity() + allocator.Capacity() / uint64_t(2));
+    if (newCapacity > 0xFFFFFFFEull)
+    {
+        newCapacity = used + size;
+        if (newCapacity > 0xFFFFFFFEull)  return false;
+    }
+
+    if (&allocator == &mVertexAllocator)  GrowVertices(static_cast<uint32_t>(newCapacity));
+    else                                  GrowIndices (static_cast<uint32_t>(newCapacity));
+
+    // The new space joins any free block at the old end, but there could still be gaps earlier on
+    if (allocator.LargestFreeBlock() < size)  Defragment();
+    return true;
+}
+
+
+void GeometryPool::GrowVertices(uint32_t newCapacity)
+{
+    for (int s = 0; s < mNumStreams; ++s)
+    {
+        mStreamData[s].resize(static_cast<size_t>(newCapacity) * mStreams[s].stride, 0);
+    }
+    mVertexAllocator.Grow(newCapacity);
+    mCapacityChanged = true;
+}
+
+void GeometryPool::GrowIndices(uint32_t newCapacity)
+{
+    mIndexData.resize(newCapacity, 0);
+    mIndexAllocator.Grow(newCapacity);
+    mCapacityChanged = true;
+}
@@ -0,0 +1,194 @@
+//--------------------------------------------------------------------------------------
+// Many meshes packed into shared vertex and index buffers
+//--------------------------------------------------------------------------------------
+// Giving every mesh its own vertex and index buffer means rebinding buffers before each draw.
+// A geometry pool holds the data for many meshes in one set of buffers instead. Each mesh
+// gets a range of vertices and a range of indices in the pool, and is drawn with:
+//
+//     DrawIndexed(range.numIndices, range.startIndex, range.baseVertex);
+//
+// The indices of each mesh are stored unchanged (starting at 0 for its first vertex). The GPU
+// adds the base vertex to each index as it reads it, so a mesh can move around in the pool
+// without its indices being rewritten.
+//
+// Ranges are handed out by a free-list allocator. Removing meshes leaves gaps, so Defragment
+// slides the remaining meshes down to the start of the pool. The pool keeps a CPU copy of the
+// buffer contents and records which parts have changed so the GPU buffers can be updated with
+// only the changed data. This file does not use DirectX.
+
+#ifndef _GEOMETRY_POOL_H_INCLUDED_
+#define _GEOMETRY_POOL_H_INCLUDED_
+
+#include "MeshData.h"
+#include "MeshStreams.h"
+#include "VertexLayout.h"
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Free-list allocator
+//--------------------------------------------------------------------------------------
+
+// Hands out ranges of a fixed-size space, e.g. vertices in a vertex buffer. Units are whatever the caller uses
+// (vertices or indices), the allocator never touches any data. Free space is held as a list of blocks sorted by
+// position, adjacent free blocks are joined when a range is freed
+class RangeAllocator
+{
+public:
+    static const uint32_t kInvalidOffset = 0xFFFFFFFF;
+
+    // Start with the given amount of space, all free
+    void Reset(uint32_t capacity);
+
+    // Allocate a range of the given size, returns its offset or kInvalidOffset if no free block is large enough.
+    // Uses the smallest block that fits, which leaves large blocks for large requests
+    uint32_t Allocate(uint32_t size);
+
+    // Return a range given by an earlier Allocate
+    void Free(uint32_t offset, uint32_t size);
+
+    // Add space to the end
+    void Grow(uint32_t newCapacity);
+
+    // Mark the first usedSize units as allocated and the rest free, used after compacting the data
+    void SetCompacted(uint32_t usedSize);
+
+    uint32_t Capacity()         const { return mCapacity; }
+    uint32_t FreeSpace()        const { return mFreeSpace; }
+    uint32_t NumFreeBlocks()    const { return static_cast<uint32_t>(mFreeBlocks.size()); }
+    uint32_t LargestFreeBlock() const;
+
+private:
+    struct Block
+    {
+        uint32_t offset;
+        uint32_t size;
+    };
+    std::vector<Block> mFreeBlocks; // Sorted by offset, never adjacent
+    uint32_t mCapacity  = 0;
+    uint32_t mFreeSpace = 0;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Geometry pool
+//--------------------------------------------------------------------------------------
+
+// Identifies a mesh in a pool. Ids of removed meshes are reused
+typedef uint32_t PoolMeshId;
+const PoolMeshId kInvalidPoolMesh = 0xFFFFFFFF;
+
+// Where a mesh is in the pool, the parameters for DrawIndexed
+struct PoolMeshRange
+{
+    uint32_t baseVertex;
+    uint32_t numVertices;
+    uint32_t startIndex;
+    uint32_t numIndices;
+};
+
+// A range of a buffer that has changed and needs copying to the GPU
+struct PoolDirtyRange
+{
+    uint32_t first = 0; // In vertices or indices
+    uint32_t count = 0; // 0 if nothing has changed
+};
+
+
+class GeometryPool
+{
+public:
+    // Construction //
+
+    // Set up an empty pool for vertices described by the given streams (e.g. one interleaved stream, or separate
+    // position and attribute streams). Every mesh added must use the same streams. The capacities are a starting
+    // size, the pool grows when needed. Returns false if there are too many streams
+    bool Init(const VertexStream* streams, int numStreams, uint32_t vertexCapacity, uint32_t indexCapacity);
+
+
+    // Meshes //
+
+    // Add a mesh, giving a pointer to the vertex data for each stream and the mesh's own indices (starting at 0).
+    // If there is no free range large enough the pool is defragmented or grown. Returns kInvalidPoolMesh for an empty
+    // mesh or if the pool would exceed 32-bit sizes
+    PoolMeshId Add(const void* const* streamData, uint32_t numVertices, const MeshIndex* indices, uint32_t numIndices);
+
+    // Add a mesh built by BuildMeshStreams. Its streams must match those the pool was set up with
+    PoolMeshId Add(const MeshStreams& mesh);
+
+    // Remove a mesh, its space can be reused by later meshes
+    void Remove(PoolMeshId mesh);
+
+    // Where a mesh is in the pool. Changes when the pool is defragmented
+    const PoolMeshRange& GetRange(PoolMeshId mesh) const { return mMeshes[mesh]; }
+
+    uint32_t NumMeshes() const { return static_cast<uint32_t>(mMeshes.size() - mFreeIds.size()); }
+
+
+    // Fragmentation //
+
+    // Move all meshes down to the start of the pool, leaving all free space in one block at the end of each buffer.
+    // Returns the number of meshes moved. Marks the moved data as changed
+    uint32_t Defragment();
+
+    // How broken up the free space is: 0 when it is all in one block, approaching 1 when it is in many small blocks
+    float Fragmentation() const;
+
+
+    // Buffer data //
+
+    // The streams the pool was set up with, the vertex buffer for each stream needs VertexCapacity() * stride bytes
+    int                 NumStreams()            const { return mNumStreams; }
+    const VertexStream& GetStream(int stream)   const { return mStreams[stream]; }
+    const uint8_t*      StreamData(int stream)  const { return mStreamData[stream].data(); }
+    uint32_t            VertexCapacity()        const { return mVertexAllocator.Capacity(); }
+    uint32_t            FreeVertices()          const { return mVertexAllocator.FreeSpace(); }
+
+    // The index buffer needs IndexCapacity() * sizeof(MeshIndex) bytes
+    const MeshIndex*    IndexData()             const { return mIndexData.data(); }
+    uint32_t            IndexCapacity()         const { return mIndexAllocator.Capacity(); }
+    uint32_t            FreeIndices()           const { return mIndexAllocator.FreeSpace(); }
+
+
+    // Changes //
+
+    // True if the pool has grown since ClearChanges, the GPU buffers must be recreated at the new size
+    bool                  CapacityChanged() const { return mCapacityChanged; }
+
+    // The vertices and indices that have changed since ClearChanges, these need copying to the GPU buffers. The same
+    // vertex range applies to every stream
+    const PoolDirtyRange& DirtyVertices()   const { return mDirtyVertices; }
+    const PoolDirtyRange& DirtyIndices()    const { return mDirtyIndices; }
+
+    // Call after updating the GPU buffers
+    void ClearChanges();
+
+
+private:
+    // Make room for a range of the given size in one of the buffers, defragmenting or growing if necessary
+    bool Reserve(RangeAllocator& allocator, uint32_t size);
+    void GrowVertices(uint32_t newCapacity);
+    void GrowIndices(uint32_t newCapacity);
+
+    static void MarkDirty(PoolDirtyRange& range, uint32_t first, uint32_t count);
+
+    static const int kMaxStreams = MeshStreams::kMaxStreams;
+
+    int                  mNumStreams = 0;
+    VertexStream         mStreams[kMaxStreams];
+    std::vector<uint8_t> mStreamData[kMaxStreams];
+    std::vector<MeshIndex> mIndexData;
+
+    RangeAllocator mVertexAllocator;
+    RangeAllocator mIndexAllocator;
+
+    std::vector<PoolMeshRange> mMeshes;  // Indexed by PoolMeshId, removed meshes have numVertices == 0
+    std::vector<PoolMeshId>    mFreeIds; // Ids of removed meshes, for reuse
+
+    bool           mCapacityChanged = false;
+    PoolDirtyRange mDirtyVertices;
+    PoolDirtyRange mDirtyIndices;
+};
+
+
+#endif //_GEOMETRY_POOL_H_INCLUDED_
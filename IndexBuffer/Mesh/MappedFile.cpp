@@ -0,0 +1,257 @@
+//--------------------------------------------------------------------------------------
+// Memory-mapped access to parts of very large files
+//--------------------------------------------------------------------------------------
+
+#include "MappedFile.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// File
+//--------------------------------------------------------------------------------------
+
+// Open a file, creating it at the given size for ReadWrite
+bool MappedFile::Open(const std::string& fileName, Access access, uint64_t size)
+{
+    Close();
+    mAccess = access;
+
+#ifdef _WIN32
+    bool write = (access == Access::ReadWrite);
+    HANDLE file = CreateFileA(fileName.c_str(), write ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+                              FILE_SHARE_READ, nullptr, write ? CREATE_ALWAYS : OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)  return false;
+
+    if (write)
+    {
+        LARGE_INTEGER newSize;
+        newSize.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFilePointerEx(file, newSize, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+        {
+            CloseHandle(file);
+            return false;
+        }
+    }
+    else
+    {
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize))
+        {
+            CloseHandle(file);
+            return false;
+        }
+        size = static_cast<uint64_t>(fileSize.QuadPart);
+    }
+
+    // An empty file cannot have a mapping object, but has nothing to map anyway
+    HANDLE mapping = nullptr;
+    if (size > 0)
+    {
+        mapping = CreateFileMappingA(file, nullptr, write ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+        {
+            CloseHandle(file);
+            return false;
+        }
+    }
+    mFile    = file;
+    mMapping = mapping;
+
+#else
+    int file = (access == Access::ReadWrite) ? open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)
+                                             : open(fileName.c_str(), O_RDONLY);
+    if (file < 0)  return false;
+
+    if (access == Access::ReadWrite)
+    {
+        if (ftruncate(file, static_cast<off_t>(size)) != 0)
+        {
+            close(file);
+            return false;
+        }
+    }
+    else
+    {
+        struct stat fileStat;
+        if (fstat(file, &fileStat) != 0)
+        {
+            close(file);
+            return false;
+        }
+        size = static_cast<uint64_t>(fileStat.st_size);
+    }
+    mFile = file;
+#endif
+
+    mSize   = size;
+    mIsOpen = true;
+    return true;
+}
+
+
+void MappedFile::Close()
+{
+    if (!mIsOpen)  return;
+#ifdef _WIN32
+    if (mMapping != nullptr)  CloseHandle(mMapping);
+    CloseHandle(mFile);
+    mMapping = nullptr;
+    mFile    = nullptr;
+#else
+    close(mFile);
+    mFile = -1;
+#endif
+    mIsOpen = false;
+    mSize   = 0;
+}
+
+
+// Mapping offsets must be a multiple of this
+uint64_t MappedFile::MappingAlignment()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+#else
+    return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------
+// Window
+//--------------------------------------------------------------------------------------
+
+// Map part of a file. The mapping starts at the aligned offset below the one asked for
+bool MappedView::Map(const MappedFile& file, uint64_t offset, size_t size, bool sequential)
+{
+    Unmap();
+    if (!file.IsOpen() || offset >= file.Size())  return false;
+    size = static_cast<size_t>((std::min)(static_cast<uint64_t>(size), file.Size() - offset));
+    if (size == 0)  return false;
+
+    uint64_t alignment   = MappedFile::MappingAlignment();
+    uint64_t mapOffset   = offset - offset % alignment;
+    size_t   leading     = static_cast<size_t>(offset - mapOffset);
+    size_t   mappedSize  = leading + size;
+
+#ifdef _WIN32
+    DWORD access = file.IsWritable() ? (FILE_MAP_READ | FILE_MAP_WRITE) : FILE_MAP_READ;
+    void* base = MapViewOfFile(file.mMapping, access, static_cast<DWORD>(mapOffset >> 32),
+                               static_cast<DWORD>(mapOffset & 0xFFFFFFFF), mappedSize);
+    if (base == nullptr)  return false;
+    (void)sequential; // Windows reads ahead on sequential access by itself
+#else
+    int protection = file.IsWritable() ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void* base = mmap(nullptr, mappedSize, protection, MAP_SHARED, file.mFile, static_cast<off_t>(mapOffset));
+    if (base == MAP_FAILED)  return false;
+    if (sequential)  madvise(base, mappedSize, MADV_SEQUENTIAL);
+#endif
+
+    mMappedBase = static_cast<uint8_t*>(base);
+    mMappedSize = mappedSize;
+    mData   = mMappedBase + leading;
+    mOffset = offset;
+    mSize   = size;
+    return true;
+}
+
+
+// Unmapping releases the pages from this process, modified pages are written back to the file by the operating system
+void MappedView::Unmap()
+{
+    if (mMappedBase == nullptr)  return;
+#ifdef _WIN32
+    UnmapViewOfFile(mMappedBase);
+#else
+    munmap(mMappedBase, mMappedSize);
+#endif
+    mMappedBase = nullptr;
+    mMappedSize = 0;
+    mData   = nullptr;
+    mOffset = 0;
+    mSize   = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Window cache
+//--------------------------------------------------------------------------------------
+
+void MappedWindowCache::Init(const MappedFile& file, int numWindows, size_t windowSize, size_t elementSize)
+{
+    Clear();
+
+    // Windows start at multiples of their size, which must be mappable offsets and fall between elements: a multiple of
+    // the least common multiple of the alignment and element size
+    size_t alignment = static_cast<size_t>(MappedFile::MappingAlignment());
+    elementSize = (std::max)(elementSize, static_cast<size_t>(1));
+    size_t a = alignment, b = elementSize;
+    while (b != 0)
+    {
+        size_t r = a % b;
+        a = b;
+        b = r;
+    }
+    size_t granularity = alignment / a * elementSize;
+
+    mFile = &file;
+    mWindowSize = (std::max)(granularity, windowSize - windowSize % granularity);
+    mWindows = std::vector<Window>((std::max)(numWindows, 1));
+}
+
+
+// Pointer to the byte at the given file offset, mapping the window that contains it if necessary
+uint8_t* MappedWindowCache::Get(uint64_t offset)
+{
+    // Windows always start at a multiple of the window size, so an offset is in at most one of them
+    uint64_t windowStart = offset - offset % mWindowSize;
+    if (mLastWindow != nullptr && mLastWindow->view.Offset() == windowStart && mLastWindow->view.Data() != nullptr)
+    {
+        return mLastWindow->view.Data() + (offset - windowStart);
+    }
+
+    Window* oldest = &mWindows[0];
+    for (auto& window : mWindows)
+    {
+        if (window.view.Data() != nullptr && window.view.Offset() == windowStart)
+        {
+            window.lastUse = ++mUseCounter;
+            mLastWindow = &window;
+            return window.view.Data() + (offset - windowStart);
+        }
+        if (window.lastUse < oldest->lastUse)  oldest = &window;
+    }
+
+    if (!oldest->view.Map(*mFile, windowStart, mWindowSize))
+    {
+        mLastWindow = nullptr;
+        return nullptr;
+    }
+    oldest->lastUse = ++mUseCounter;
+    mLastWindow = oldest;
+    return oldest->view.Data() + (offset - windowStart);
+}
+
+
+void MappedWindowCache::Clear()
+{
+    for (auto& window : mWindows)
+    {
+        window.view.Unmap();
+        window.lastUse = 0;
+    }
+    mLastWindow = nullptr;
+}
@@ -0,0 +1,134 @@
+//--------------------------------------------------------------------------------------
+// Memory-mapped access to parts of very large files
+//--------------------------------------------------------------------------------------
+// Mapping a file makes its contents appear in memory, with the operating system reading pages
+// from disk as they are touched. Mapping a whole 100GB file would let its pages build up in
+// the process's memory, so these classes map a "window" onto part of the file at a time and
+// unmap it when moving on. Memory use is then limited by the window sizes, whatever the size of
+// the file.
+//
+// Uses mmap on Linux / macOS and file mappings on Windows.
+
+#ifndef _MAPPED_FILE_H_INCLUDED_
+#define _MAPPED_FILE_H_INCLUDED_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//--------------------------------------------------------------------------------------
+// File
+//--------------------------------------------------------------------------------------
+
+// An open file that windows can be mapped onto
+class MappedFile
+{
+public:
+    enum class Access
+    {
+        Read,      // Open an existing file for reading
+        ReadWrite, // Create the file (or replace an existing one) at a given size for reading and writing
+    };
+
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Open a file. For ReadWrite the file is created with the given size (contents zero). Returns false on failure
+    bool Open(const std::string& fileName, Access access, uint64_t size = 0);
+    void Close();
+
+    bool     IsOpen()    const { return mIsOpen; }
+    bool     IsWritable()const { return mAccess == Access::ReadWrite; }
+    uint64_t Size()      const { return mSize; }
+
+    // Mapping offsets must be a multiple of this (the page size, or the allocation granularity on Windows)
+    static uint64_t MappingAlignment();
+
+private:
+    friend class MappedView;
+
+    bool     mIsOpen = false;
+    Access   mAccess = Access::Read;
+    uint64_t mSize   = 0;
+#ifdef _WIN32
+    void*    mFile    = nullptr; // HANDLE
+    void*    mMapping = nullptr; // HANDLE
+#else
+    int      mFile    = -1;
+#endif
+};
+
+
+//--------------------------------------------------------------------------------------
+// Window
+//--------------------------------------------------------------------------------------
+
+// A mapped window onto part of a file. Mapping again moves the window, the previous pointer becomes invalid
+class MappedView
+{
+public:
+    MappedView() = default;
+    ~MappedView() { Unmap(); }
+    MappedView(const MappedView&) = delete;
+    MappedView& operator=(const MappedView&) = delete;
+
+    // Map size bytes of the file starting at any offset (the range is clipped to the end of the file). If sequential
+    // is true the operating system is told the data will be read in order so it can read ahead. Returns false on failure
+    bool Map(const MappedFile& file, uint64_t offset, size_t size, bool sequential = false);
+    void Unmap();
+
+    uint8_t* Data()   const { return mData; }   // First byte of the requested range
+    uint64_t Offset() const { return mOffset; } // File offset of Data()
+    size_t   Size()   const { return mSize; }
+
+private:
+    uint8_t* mMappedBase = nullptr; // Start of the mapping, aligned down from mData
+    size_t   mMappedSize = 0;
+    uint8_t* mData       = nullptr;
+    uint64_t mOffset     = 0;
+    size_t   mSize       = 0;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Window cache
+//--------------------------------------------------------------------------------------
+
+// Random access to fixed-size elements of a file through a few mapped windows, least recently used window replaced
+// first. Used for lookup tables too large to keep in memory. Accesses close together are fast, scattered accesses
+// map and unmap windows often
+class MappedWindowCache
+{
+public:
+    // Set up over an open file with the given number and size of windows, for elements of elementSize bytes. windowSize
+    // is rounded down to a multiple of both the mapping alignment and the element size (at least one of that multiple)
+    // so no element crosses a window boundary
+    void Init(const MappedFile& file, int numWindows, size_t windowSize, size_t elementSize);
+
+    // Pointer to the byte at the given file offset, valid until the next call. Returns nullptr if mapping fails
+    uint8_t* Get(uint64_t offset);
+
+    template <class T> T    Read (uint64_t element)             { return *reinterpret_cast<T*>(Get(element * sizeof(T))); }
+    template <class T> void Write(uint64_t element, const T& v) { *reinterpret_cast<T*>(Get(element * sizeof(T))) = v; }
+
+    // Unmap all windows (written data goes back to the file)
+    void Clear();
+
+private:
+    struct Window
+    {
+        MappedView view;
+        uint64_t   lastUse = 0;
+    };
+    const MappedFile*   mFile = nullptr;
+    std::vector<Window> mWindows;
+    size_t              mWindowSize = 0;
+    uint64_t            mUseCounter = 0;
+    Window*             mLastWindow = nullptr; // Most accesses hit the same window as the one before
+};
+
+
+#endif //_MAPPED_FILE_H_INCLUDED_
@@ -0,0 +1,231 @@
+//--------------------------------------------------------------------------------------
+// Triangle adjacency (topology) built from an index buffer
+//--------------------------------------------------------------------------------------
+// The half-edges are radix sorted by end vertex and then, keeping that order, by start vertex.
+// This gives a flat edge list grouped by start vertex (an offset table says where each vertex's
+// group starts) with each group sorted by end vertex. The opposite of half-edge a->b is then
+// found by a binary search of the half-edges leaving b, and the half-edges a->b used to spot an
+// edge used twice the same way are next to it in its own group. Vertices used by many triangles
+// (the centre of a fan) cost a few steps of a search rather than a scan of every triangle around
+// them for each of their half-edges. The two 32-bit sorts make the same passes as one sort of
+// (vertex, vertex) edge keys but over less data. Every step runs on all cores.
+
+#include "MeshAdjacency.h"
+#include "RadixSort.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+const uint32_t MeshAdjacency::kBoundary;
+const uint32_t MeshAdjacency::kNonManifold;
+
+const size_t kMinItemsPerChunk = 65536;
+
+
+//--------------------------------------------------------------------------------------
+// Construction
+//--------------------------------------------------------------------------------------
+
+// Build the adjacency for a triangle list. Returns false if an index is outside 0 to numVertices-1 or there
+// are too many triangles (more than about 1.4 billion) for 32-bit half-edge numbers
+bool MeshAdjacency::Build(const MeshIndex* indices, size_t numIndices, size_t numVertices)
+{
+    size_t numHalfEdges = (numIndices / 3) * 3;
+    mIndices.clear();
+    mOpposite.clear();
+    mVertexStart.clear();
+    mVertexHalfEdges.clear();
+    mNumBoundaryEdges = 0;
+    mNumNonManifoldEdges = 0;
+    if (numHalfEdges >= kNonManifold || numVertices >= kNonManifold)  return false;
+
+    // Check and copy the indices
+    int numThreads = GetThreadPool().GetNumThreads();
+    std::vector<char> badIndex(numThreads, 0); // Flag for each thread, avoids sharing a variable between threads
+    mIndices.resize(numHalfEdges);
+    ParallelFor(numHalfEdges, kMinItemsPerChunk, [&](size_t begin, size_t end, int thread)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (indices[i] >= numVertices)  badIndex[thread] = 1;
+            mIndices[i] = indices[i];
+        }
+    });
+    if (std::find(badIndex.begin(), badIndex.end(), 1) != badIndex.end())
+    {
+        mIndices.clear();
+        return false;
+    }
+
+    int vertexBits = BitsNeeded(numVertices > 0 ? numVertices - 1 : 0);
+
+
+    //// Per-vertex lists ////
+
+    // Radix sort the half-edges by their end vertex, then by their start vertex. The sort is stable, so this gives
+    // the list of half-edges leaving each vertex sorted by the vertex they go to
+    std::vector<uint32_t> vertexKeys(numHalfEdges);
+    mVertexHalfEdges.resize(numHalfEdges);
+    ParallelFor(numHalfEdges, kMinItemsPerChunk, [&](size_t begin, size_t end, int)
+    {
+        for (size_t h = begin; h < end; ++h)
+        {
+            mVertexHalfEdges[h] = static_cast<uint32_t>(h);
+            vertexKeys[h] = EndVertex(static_cast<uint32_t>(h));
+        }
+    });
+    RadixSort(vertexKeys.data(), mVertexHalfEdges.data(), numHalfEdges, vertexBits);
+    ParallelFor(numHalfEdges, kMinItemsPerChunk, [&](size_t begin, size_t end, int)
+    {
+        for (size_t i = begin; i < end; ++i)  vertexKeys[i] = StartVertex(mVertexHalfEdges[i]);
+    });
+    RadixSort(vertexKeys.data(), mVertexHalfEdges.data(), numHalfEdges, vertexBits);
+
+    // Find where each vertex's half-edges start
+    mVertexStart.resize(numVertices + 1);
+    ParallelFor(numHalfEdges, kMinItemsPerChunk, [&](size_t begin, size_t end, int)
+    {
+        // Where the vertex number steps up, all the vertices stepped over (unused ones) start here too
+        for (size_t i = begin; i < end; ++i)
+        {
+            uint32_t firstVertex = (i == 0) ? 0 : vertexKeys[i - 1] + 1;
+            for (uint32_t v = firstVertex; v <= vertexKeys[i]; ++v)
+            {
+                mVertexStart[v] = static_cast<uint32_t>(i);
+            }
+        }
+    });
+    size_t firstUnused = numHalfEdges == 0 ? 0 : vertexKeys[numHalfEdges - 1] + 1;
+    for (size_t v = firstUnused; v <= numVertices; ++v)
+    {
+        mVertexStart[v] = static_cast<uint32_t>(numHalfEdges);
+    }
+
+
+    //// Pair up opposite half-edges ////
+
+    // The opposite of half-edge a->b is the only half-edge b->a, found by a binary search of the half-edges leaving
+    // b. Also count a->b in the list for a to spot edges used twice in the same direction. The end vertices are
+    // copied into the same order as the lists first, so the searches read contiguous memory
+    std::vector<MeshIndex>& endVertices = vertexKeys; // Reuse the sort keys, no longer needed
+    ParallelFor(numHalfEdges, kMinItemsPerChunk, [&](size_t begin, size_t end, int)
+    {
+        for (size_t i = begin; i < end; ++i)  endVertices[i] = EndVertex(mVertexHalfEdges[i]);
+    });
+
+    mOpposite.resize(numHalfEdges);
+    std::vector<size_t> numBoundary(numThreads, 0);
+    std::vector<size_t> numNonManifold(numThreads, 0);
+    ParallelFor(numHalfEdges, kMinItemsPerChunk, [&](size_t begin, size_t end, int thread)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            uint32_t h = static_cast<uint32_t>(i);
+            MeshIndex a = StartVertex(h);
+            MeshIndex b = EndVertex(h);
+            if (a == b)
+            {
+                mOpposite[h] = kNonManifold;
+                ++numNonManifold[thread];
+                continue;
+            }
+
+            auto same = std::equal_range(endVertices.begin() + mVertexStart[a], endVertices.begin() + mVertexStart[a + 1], b);
+            auto sameDirection = same.second - same.first;
+
+            auto reverse = std::equal_range(endVertices.begin() + mVertexStart[b], endVertices.begin() + mVertexStart[b + 1], a);
+            auto oppositeDirection = reverse.second - reverse.first;
+            uint32_t opposite = oppositeDirection == 1 ? mVertexHalfEdges[reverse.first - endVertices.begin()] : kBoundary;
+
+            if (sameDirection == 1 && oppositeDirection == 0)
+            {
+                mOpposite[h] = kBoundary;
+                ++numBoundary[thread];
+            }
+            else if (sameDirection == 1 && oppositeDirection == 1)
+            {
+                mOpposite[h] = opposite;
+            }
+            else
+            {
+                mOpposite[h] = kNonManifold;
+                ++numNonManifold[thread];
+            }
+        }
+    });
+    for (int t = 0; t < numThreads; ++t)
+    {
+        mNumBoundaryEdges    += numBoundary[t];
+        mNumNonManifoldEdges += numNonManifold[t];
+    }
+
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Queries
+//--------------------------------------------------------------------------------------
+
+// Get the distinct vertices joined to the given vertex by an edge (its "one-ring"). Clears the vector first
+void MeshAdjacency::GetVertexNeighbours(MeshIndex vertex, std::vector<MeshIndex>& neighbours) const
+{
+    neighbours.clear();
+    const uint32_t* halfEdges = VertexHalfEdges(vertex);
+    uint32_t valence = VertexValence(vertex);
+    for (uint32_t i = 0; i < valence; ++i)
+    {
+        // Each triangle using the vertex has an edge leaving it and an edge arriving at it
+        neighbours.push_back(EndVertex(halfEdges[i]));
+        neighbours.push_back(StartVertex(PrevHalfEdge(halfEdges[i])));
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    neighbours.erase(std::remove(neighbours.begin(), neighbours.end(), vertex), neighbours.end()); // Degenerate triangles
+}
+
+// Get all boundary half-edges. Clears the vector first
+void MeshAdjacency::GetBoundaryHalfEdges(std::vector<uint32_t>& halfEdges) const
+{
+    halfEdges.clear();
+    halfEdges.reserve(mNumBoundaryEdges);
+    for (size_t h = 0; h < mOpposite.size(); ++h)
+    {
+        if (mOpposite[h] == kBoundary)  halfEdges.push_back(static_cast<uint32_t>(h));
+    }
+}
+
+
+void MeshAdjacency::GetEdges(std::vector<MeshIndex>& lineIndices) const
+{
+    lineIndices.clear();
+    lineIndices.reserve(mOpposite.size() + mNumBoundaryEdges); // Two indices for each pair of half-edges
+    for (uint32_t h = 0; h < mOpposite.size(); ++h)
+    {
+        // An edge between two triangles is listed from the lower numbered of its pair of half-edges
+        uint32_t opposite = mOpposite[h];
+        if (opposite < kNonManifold && opposite < h)  continue;
+
+        MeshIndex start = StartVertex(h), end = EndVertex(h);
+        if (opposite == kNonManifold)
+        {
+            // Any number of half-edges, either way round, may lie on a non-manifold edge. List it from the lowest
+            // numbered. The half-edges from one vertex to another are together in the list for the first, lowest
+            // numbered first, so only the first of each way round needs checking
+            if (start == end)  continue;
+            bool first = true;
+            for (int way = 0; way < 2 && first; ++way)
+            {
+                MeshIndex from = way == 0 ? start : end;
+                MeshIndex to   = way == 0 ? end : start;
+                const uint32_t* halfEdges = VertexHalfEdges(from);
+                const uint32_t* found = std::lower_bound(halfEdges, halfEdges + VertexValence(from), to,
+                                                         [this](uint32_t halfEdge, MeshIndex vertex)
+                                                         { return EndVertex(halfEdge) < vertex; });
+                first = !(found != halfEdges + VertexValence(from) && EndVertex(*found) == to && *found < h);
+            }
+            if (!first)  continue;
+        }
+        lineIndices.push_back(start);
+        lineIndices.push_back(end);
+    }
+}
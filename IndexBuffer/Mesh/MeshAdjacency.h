@@ -0,0 +1,118 @@
+//--------------------------------------------------------------------------------------
+// Triangle adjacency (topology) built from an index buffer
+//--------------------------------------------------------------------------------------
+// An index buffer only says which vertices each triangle uses. Questions such as "which
+// triangle is on the other side of this edge" or "which triangles use this vertex" would
+// need a search of the whole buffer. This class answers them in constant time after a build
+// that radix sorts the half-edges (linear time) and pairs them up with short binary searches. It
+// is used for simplification, stripification, culling and wireframe.
+//
+// Terminology: each triangle t has three "half-edges" numbered 3t, 3t+1 and 3t+2. Half-edge
+// 3t+k runs from the vertex at index buffer position 3t+k to the next vertex of the same
+// triangle. So a half-edge number is also the index buffer position ("corner") it starts at.
+// Two triangles that share an edge have a pair of opposite half-edges running in opposite
+// directions.
+//
+// All data is held in a few flat arrays, there are no per-triangle or per-vertex allocations.
+
+#ifndef _MESH_ADJACENCY_H_INCLUDED_
+#define _MESH_ADJACENCY_H_INCLUDED_
+
+#include "MeshData.h"
+#include <vector>
+
+class MeshAdjacency
+{
+public:
+    // Special values returned by Opposite for edges that do not have a single neighbour
+    static const uint32_t kBoundary    = 0xFFFFFFFF; // No triangle on the other side of the edge
+    static const uint32_t kNonManifold = 0xFFFFFFFE; // Edge shared by more than two triangles, by two that disagree on
+                                                     // winding, or a degenerate edge (both ends at the same vertex)
+
+
+    // Construction //
+
+    // Build the adjacency for a triangle list. Returns false if an index is outside 0 to numVertices-1 or there
+    // are too many triangles (more than about 1.4 billion) for 32-bit half-edge numbers
+    bool Build(const MeshIndex* indices, size_t numIndices, size_t numVertices);
+
+
+    // Sizes //
+
+    size_t NumTriangles() const { return mIndices.size() / 3; }
+    size_t NumVertices()  const { return mVertexStart.empty() ? 0 : mVertexStart.size() - 1; }
+    size_t NumHalfEdges() const { return mIndices.size(); }
+
+    // Number of boundary half-edges / half-edges marked kNonManifold
+    size_t NumBoundaryEdges()    const { return mNumBoundaryEdges; }
+    size_t NumNonManifoldEdges() const { return mNumNonManifoldEdges; }
+
+
+    // Half-edge queries //
+
+    // Vertex at the start and end of a half-edge
+    MeshIndex StartVertex(uint32_t halfEdge) const { return mIndices[halfEdge]; }
+    MeshIndex EndVertex  (uint32_t halfEdge) const { return mIndices[NextHalfEdge(halfEdge)]; }
+
+    // Next and previous half-edge around the same triangle
+    static uint32_t NextHalfEdge(uint32_t halfEdge) { return halfEdge % 3 == 2 ? halfEdge - 2 : halfEdge + 1; }
+    static uint32_t PrevHalfEdge(uint32_t halfEdge) { return halfEdge % 3 == 0 ? halfEdge + 2 : halfEdge - 1; }
+
+    // Triangle that a half-edge belongs to
+    static uint32_t Triangle(uint32_t halfEdge) { return halfEdge / 3; }
+
+    // The half-edge of the neighbouring triangle running the other way along the same edge, or kBoundary /
+    // kNonManifold if there is no single neighbour
+    uint32_t Opposite(uint32_t halfEdge) const { return mOpposite[halfEdge]; }
+
+    // True if the half-edge is on the edge of the mesh (no neighbour)
+    bool IsBoundary(uint32_t halfEdge) const { return mOpposite[halfEdge] == kBoundary; }
+
+
+    // Triangle queries //
+
+    // Triangle on the other side of edge 0, 1 or 2 of the given triangle (edge k runs from corner k to corner k+1),
+    // or kBoundary / kNonManifold
+    uint32_t NeighbourTriangle(uint32_t triangle, int edge) const
+    {
+        uint32_t opposite = mOpposite[triangle * 3 + edge];
+        return opposite >= kNonManifold ? opposite : opposite / 3;
+    }
+
+
+    // Vertex queries //
+
+    // Number of triangle corners using a vertex (i.e. number of triangles using it)
+    uint32_t VertexValence(MeshIndex vertex) const { return mVertexStart[vertex + 1] - mVertexStart[vertex]; }
+
+    // Half-edges leaving a vertex, one for each triangle that uses it. Returns a pointer to VertexValence(vertex)
+    // half-edge numbers, sorted by end vertex (in index buffer order for the same end vertex). Use Triangle() to get
+    // the triangles and EndVertex() to get the neighbouring vertices
+    const uint32_t* VertexHalfEdges(MeshIndex vertex) const { return mVertexHalfEdges.data() + mVertexStart[vertex]; }
+
+    // Get the distinct vertices joined to the given vertex by an edge (its "one-ring"). Clears the vector first
+    void GetVertexNeighbours(MeshIndex vertex, std::vector<MeshIndex>& neighbours) const;
+
+
+    // Whole-mesh queries //
+
+    // Get all boundary half-edges. Clears the vector first
+    void GetBoundaryHalfEdges(std::vector<uint32_t>& halfEdges) const;
+
+    // Get every edge once as a pair of vertex indices - a line list for drawing a wireframe, where an edge shared by
+    // two triangles would otherwise be drawn twice. Degenerate edges are left out. Clears the vector first
+    void GetEdges(std::vector<MeshIndex>& lineIndices) const;
+
+
+private:
+    std::vector<MeshIndex> mIndices;         // Copy of the index buffer
+    std::vector<uint32_t>  mOpposite;        // Opposite half-edge for each half-edge
+    std::vector<uint32_t>  mVertexStart;     // Start of each vertex's list in mVertexHalfEdges (one extra at end)
+    std::vector<uint32_t>  mVertexHalfEdges; // Half-edges leaving each vertex, grouped by vertex
+
+    size_t mNumBoundaryEdges    = 0;
+    size_t mNumNonManifoldEdges = 0;
+};
+
+
+#endif //_MESH_ADJACENCY_H_INCLUDED_
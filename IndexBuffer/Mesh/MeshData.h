@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------
+// Basic types shared by the CPU-side mesh processing code
+//--------------------------------------------------------------------------------------
+
+#ifndef _MESH_DATA_H_INCLUDED_
+#define _MESH_DATA_H_INCLUDED_
+
+#include "CVector3.h"
+#include <cstdint>
+#include <cstddef>
+
+// Type of a single index in an index buffer. All the index buffers in this project use 32-bit indices
+// (DXGI_FORMAT_R32_UINT), so the CPU-side code does too
+typedef uint32_t MeshIndex;
+
+
+// Read-only access to the positions held in an array of vertices. Vertex structures contain more than just a
+// position (e.g. the colour in SimpleVertex), so this steps through the array using the size of the vertex
+// structure (the "stride"). This lets mesh processing functions work on any vertex format.
+class PositionArray
+{
+public:
+    // Construct from a pointer to the first position, the distance in bytes between positions and the vertex count
+    PositionArray(const void* firstPosition, size_t stride, size_t count)
+        : mData(static_cast<const uint8_t*>(firstPosition)), mStride(stride), mCount(count) {}
+
+    // Construct from a plain array of positions
+    PositionArray(const CVector3* positions, size_t count)
+        : mData(reinterpret_cast<const uint8_t*>(positions)), mStride(sizeof(CVector3)), mCount(count) {}
+
+    // Construct from an array of any vertex structure that has a CVector3 member called "position"
+    template <class Vertex>
+    PositionArray(const Vertex* vertices, size_t count)
+        : mData(reinterpret_cast<const uint8_t*>(&vertices[0].position)), mStride(sizeof(Vertex)), mCount(count) {}
+
+    // Number of vertices
+    size_t Size() const { return mCount; }
+
+    // Access a single position
+    const CVector3& operator[](size_t i) const
+    {
+        return *reinterpret_cast<const CVector3*>(mData + i * mStride);
+    }
+
+private:
+    const uint8_t* mData;
+    size_t         mStride;
+    size_t         mCount;
+};
+
+
+#endif //_MESH_DATA_H_INCLUDED_
@@ -0,0 +1,306 @@
+//--------------------------------------------------------------------------------------
+// Loading mesh vertex and index data from files, for tools and tests
+//--------------------------------------------------------------------------------------
+
+#include "MeshFile.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+// Read a whole file into memory. Returns false on failure
+static bool ReadFile(const std::string& fileName, std::vector<char>& contents)
+{
+    FILE* file = std::fopen(fileName.c_str(), "rb");
+    if (file == nullptr)  return false;
+
+    contents.clear();
+    char buffer[65536];
+    size_t bytesRead;
+    while ((bytesRead = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        contents.insert(contents.end(), buffer, buffer + bytesRead);
+    }
+    bool ok = (std::ferror(file) == 0);
+    std::fclose(file);
+    return ok;
+}
+
+
+// Convert triangle strip indices to a triangle list
+void TriangleStripToList(const MeshIndex* stripIndices, size_t numStripIndices, std::vector<MeshIndex>& listIndices)
+{
+    listIndices.clear();
+    if (numStripIndices < 3)  return;
+    listIndices.reserve((numStripIndices - 2) * 3);
+    for (size_t i = 2; i < numStripIndices; ++i)
+    {
+        MeshIndex a = stripIndices[i - 2];
+        MeshIndex b = stripIndices[i - 1];
+        MeshIndex c = stripIndices[i];
+        if (a == b || b == c || c == a)  continue;
+
+        if (i % 2 == 0)
+        {
+            listIndices.push_back(a);
+            listIndices.push_back(b);
+        }
+        else
+        {
+            listIndices.push_back(b);
+            listIndices.push_back(a);
+        }
+        listIndices.push_back(c);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// OBJ files
+//--------------------------------------------------------------------------------------
+
+// Position, texture coordinate and normal numbers of a face corner, 0 for missing ones (OBJ numbers from 1)
+struct ObjCorner
+{
+    long position;
+    long texCoord;
+    long normal;
+};
+
+struct ObjCornerHash
+{
+    size_t operator()(const ObjCorner& c) const
+    {
+        uint64_t h = static_cast<uint64_t>(c.position) * 0x9E3779B97F4A7C15ull;
+        h ^= static_cast<uint64_t>(c.texCoord) * 0xC2B2AE3D27D4EB4Full + (h >> 29);
+        h ^= static_cast<uint64_t>(c.normal)   * 0x165667B19E3779F9ull + (h >> 31);
+        return static_cast<size_t>(h);
+    }
+};
+
+struct ObjCornerEqual
+{
+    bool operator()(const ObjCorner& a, const ObjCorner& b) const
+    {
+        return a.position == b.position && a.texCoord == b.texCoord && a.normal == b.normal;
+    }
+};
+
+// Convert an OBJ reference (1-based, or negative to count back from the most recent element) to 0-based, or -1 if
+// it refers to an element that does not exist yet
+static long ResolveObjReference(long reference, size_t count)
+{
+    if (reference > 0)  return reference <= static_cast<long>(count) ? reference - 1 : -1;
+    if (reference < 0)  return -reference <= static_cast<long>(count) ? static_cast<long>(count) + reference : -1;
+    return -1;
+}
+
+
+// Load a Wavefront OBJ file
+bool LoadObjMesh(const std::string& fileName, LoadedMesh& mesh, std::string& error)
+{
+    std::vector<char> contents;
+    if (!ReadFile(fileName, contents))
+    {
+        error = "Cannot read " + fileName;
+        return false;
+    }
+    contents.push_back('\0'); // So the number parsing below always stops at the end
+
+    std::vector<CVector3> objPositions;
+    size_t numTexCoords = 0;
+    size_t numNormals   = 0;
+    std::unordered_map<ObjCorner, MeshIndex, ObjCornerHash, ObjCornerEqual> cornerVertices;
+    std::vector<ObjCorner> cornerOrder; // Corner for each vertex, to fill in the positions at the end
+    std::vector<MeshIndex> face;
+
+    mesh.positions.clear();
+    mesh.indices.clear();
+
+    const char* p   = contents.data();
+    const char* end = contents.data() + contents.size() - 1;
+    size_t lineNumber = 0;
+    while (p < end)
+    {
+        ++lineNumber;
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (lineEnd == nullptr)  lineEnd = end;
+
+        while (p < lineEnd && (*p == ' ' || *p == '\t'))  ++p;
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            char* next;
+            CVector3 position;
+            position.x = std::strtof(p + 2, &next);
+            position.y = std::strtof(next,  &next);
+            position.z = std::strtof(next,  &next);
+            if (next > lineEnd)
+            {
+                error = fileName + "(" + std::to_string(lineNumber) + "): bad vertex position";
+                return false;
+            }
+            objPositions.push_back(position);
+        }
+        else if (p[0] == 'v' && p[1] == 't')
+        {
+            ++numTexCoords;
+        }
+        else if (p[0] == 'v' && p[1] == 'n')
+        {
+            ++numNormals;
+        }
+        else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            // Each corner is "v", "v/vt", "v//vn" or "v/vt/vn"
+            face.clear();
+            const char* q = p + 2;
+            for (;;)
+            {
+                while (q < lineEnd && (*q == ' ' || *q == '\t' || *q == '\r'))  ++q;
+                if (q >= lineEnd)  break;
+
+                char* next;
+                ObjCorner reference = { std::strtol(q, &next, 10), 0, 0 };
+                if (next == q)
+                {
+                    error = fileName + "(" + std::to_string(lineNumber) + "): bad face";
+                    return false;
+                }
+                if (*next == '/')
+                {
+                    q = next + 1;
+                    if (*q != '/')  reference.texCoord = std::strtol(q, &next, 10);
+                    else            next = const_cast<char*>(q);
+                    if (*next == '/')  reference.normal = std::strtol(next + 1, &next, 10);
+                }
+                q = next;
+
+                // Resolve to 0-based numbers now, relative references depend on how much has been read so far
+                ObjCorner corner;
+                corner.position = ResolveObjReference(reference.position, objPositions.size());
+                corner.texCoord = reference.texCoord == 0 ? 0 : ResolveObjReference(reference.texCoord, numTexCoords) + 1;
+                corner.normal   = reference.normal   == 0 ? 0 : ResolveObjReference(reference.normal,   numNormals)   + 1;
+                if (corner.position < 0 || (reference.texCoord != 0 && corner.texCoord == 0) ||
+                                           (reference.normal   != 0 && corner.normal   == 0))
+                {
+                    face.push_back(kInvalidFileIndex);
+                    continue;
+                }
+
+                auto found = cornerVertices.find(corner);
+                if (found == cornerVertices.end())
+                {
+                    found = cornerVertices.emplace(corner, static_cast<MeshIndex>(cornerOrder.size())).first;
+                    cornerOrder.push_back(corner);
+                }
+                face.push_back(found->second);
+            }
+
+            // Fan triangulation
+            for (size_t i = 2; i < face.size(); ++i)
+            {
+                mesh.indices.push_back(face[0]);
+                mesh.indices.push_back(face[i - 1]);
+                mesh.indices.push_back(face[i]);
+            }
+        }
+
+        p = lineEnd + 1;
+    }
+
+    mesh.positions.resize(cornerOrder.size());
+    std::vector<bool> positionUsed(objPositions.size(), false);
+    for (size_t v = 0; v < cornerOrder.size(); ++v)
+    {
+        mesh.positions[v] = objPositions[cornerOrder[v].position];
+        positionUsed[cornerOrder[v].position] = true;
+    }
+    mesh.numFilePositions       = objPositions.size();
+    mesh.numUnusedFilePositions = static_cast<size_t>(std::count(positionUsed.begin(), positionUsed.end(), false));
+
+    // Vertex size as it would be on the GPU: position, plus texture coordinate and normal if the file has them
+    mesh.vertexSize = sizeof(CVector3) + (numTexCoords > 0 ? 2 * sizeof(float) : 0) + (numNormals > 0 ? sizeof(CVector3) : 0);
+    mesh.indexSize  = sizeof(MeshIndex);
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Raw buffer files
+//--------------------------------------------------------------------------------------
+
+// Load raw vertex and index buffer contents
+bool LoadRawMesh(const std::string& vertexFileName, const std::string& indexFileName, uint32_t vertexStride,
+                 uint32_t positionOffset, uint32_t indexSize, bool isStrip, LoadedMesh& mesh, std::string& error)
+{
+    if (indexSize != 2 && indexSize != 4)
+    {
+        error = "Index size must be 2 or 4";
+        return false;
+    }
+    if (vertexStride < positionOffset + sizeof(CVector3))
+    {
+        error = "Vertex stride is too small to hold a position at the given offset";
+        return false;
+    }
+
+    std::vector<char> vertexData, indexData;
+    if (!ReadFile(vertexFileName, vertexData))
+    {
+        error = "Cannot read " + vertexFileName;
+        return false;
+    }
+    if (!ReadFile(indexFileName, indexData))
+    {
+        error = "Cannot read " + indexFileName;
+        return false;
+    }
+    if (vertexData.size() % vertexStride != 0)
+    {
+        error = vertexFileName + ": size is not a multiple of the vertex stride";
+        return false;
+    }
+    if (indexData.size() % indexSize != 0)
+    {
+        error = indexFileName + ": size is not a multiple of the index size";
+        return false;
+    }
+
+    size_t numVertices = vertexData.size() / vertexStride;
+    mesh.positions.resize(numVertices);
+    for (size_t v = 0; v < numVertices; ++v)
+    {
+        std::memcpy(&mesh.positions[v], &vertexData[v * vertexStride + positionOffset], sizeof(CVector3));
+    }
+
+    size_t numIndices = indexData.size() / indexSize;
+    std::vector<MeshIndex> indices(numIndices);
+    for (size_t i = 0; i < numIndices; ++i)
+    {
+        if (indexSize == 2)
+        {
+            uint16_t index;
+            std::memcpy(&index, &indexData[i * 2], 2);
+            indices[i] = index;
+        }
+        else
+        {
+            std::memcpy(&indices[i], &indexData[i * 4], 4);
+        }
+    }
+
+    if (isStrip)  TriangleStripToList(indices.data(), indices.size(), mesh.indices);
+    else          mesh.indices.swap(indices);
+
+    mesh.vertexSize = vertexStride;
+    mesh.indexSize  = indexSize;
+    mesh.numFilePositions       = numVertices;
+    mesh.numUnusedFilePositions = 0;
+    return true;
+}
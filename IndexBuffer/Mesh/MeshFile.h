@@ -0,0 +1,59 @@
+//--------------------------------------------------------------------------------------
+// Loading mesh vertex and index data from files, for tools and tests
+//--------------------------------------------------------------------------------------
+// Two kinds of file are read:
+// - Wavefront OBJ text files. OBJ faces index positions, texture coordinates and normals
+//   separately, while a GPU vertex has all three together. Each distinct combination used by a
+//   face becomes one vertex, as it would when the mesh is prepared for a vertex buffer. Faces
+//   with more than three corners are split into a fan of triangles.
+// - Raw binary dumps of a vertex buffer and an index buffer, e.g. captured from the GPU, with
+//   the vertex stride and index size given by the caller.
+//
+// Only what the mesh tools need is kept: the positions and the indices, plus the size of a
+// vertex and an index in the original data so that memory use can be reported. An OBJ file's
+// positions that no face uses make no vertex, so they are counted instead to be reported.
+// Bad references are kept rather than rejected, so that validation can report them. For example
+// an OBJ face using a position that does not exist gets the index kInvalidFileIndex.
+
+#ifndef _MESH_FILE_H_INCLUDED_
+#define _MESH_FILE_H_INCLUDED_
+
+#include "MeshData.h"
+#include <vector>
+#include <string>
+
+// Index given to OBJ face corners that refer to data missing from the file
+const MeshIndex kInvalidFileIndex = 0xFFFFFFFF;
+
+// Positions and triangle list indices loaded from a file
+struct LoadedMesh
+{
+    std::vector<CVector3>  positions;
+    std::vector<MeshIndex> indices;     // Triangle list
+    uint32_t               vertexSize;  // Bytes per vertex in the source data
+    uint32_t               indexSize;   // Bytes per index in the source data (2 or 4)
+
+    // Positions listed in the file, and how many of them no face uses. For raw data these are the vertices, which
+    // ValidateMesh checks for use itself, so the unused count is always 0
+    size_t numFilePositions       = 0;
+    size_t numUnusedFilePositions = 0;
+};
+
+
+// Load a Wavefront OBJ file. Returns false and sets error if the file cannot be read or has a syntax error
+bool LoadObjMesh(const std::string& fileName, LoadedMesh& mesh, std::string& error);
+
+// Load raw vertex and index buffer contents. Each vertex is vertexStride bytes with a float x,y,z position at
+// positionOffset. Indices are 16-bit or 32-bit (indexSize 2 or 4). If isStrip is true the indices are a triangle strip
+// and are converted to a list. Returns false and sets error if the files cannot be read or the sizes are wrong
+bool LoadRawMesh(const std::string& vertexFileName, const std::string& indexFileName, uint32_t vertexStride,
+                 uint32_t positionOffset, uint32_t indexSize, bool isStrip, LoadedMesh& mesh, std::string& error);
+
+
+// Convert triangle strip indices to a triangle list. Every second triangle of a strip has the opposite winding, these
+// are flipped so the whole list has the winding of the first triangle. Strip triangles that repeat an index (used to
+// join strips together) are dropped
+void TriangleStripToList(const MeshIndex* stripIndices, size_t numStripIndices, std::vector<MeshIndex>& listIndices);
+
+
+#endif //_MESH_FILE_H_INCLUDED_
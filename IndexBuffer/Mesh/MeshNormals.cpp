@@ -0,0 +1,338 @@
+//--------------------------------------------------------------------------------------
+// Generation of vertex normals and tangents from an index buffer
+//--------------------------------------------------------------------------------------
+// The obvious parallel version - each thread takes some triangles and adds to the normals of
+// their vertices - needs atomics or locks because two threads can share a vertex. Instead the
+// triangle corners are first sorted into "partitions" by the vertex they use (a one-pass
+// counting sort, each thread counting its own triangles). Each thread then owns a range of
+// vertices and only ever writes to those, so no two threads touch the same memory. The order
+// of the additions is fixed, so the results are the same whatever the number of threads.
+
+#include "MeshNormals.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <cmath>
+
+
+//--------------------------------------------------------------------------------------
+// Grouping triangle corners by vertex range
+//--------------------------------------------------------------------------------------
+
+// Triangle corners (positions in the index buffer) grouped by the range of vertices they refer to
+struct CornerBuckets
+{
+    size_t                numVertices;
+    size_t                numTriangles;
+    size_t                verticesPerPartition;
+    int                   numPartitions;
+    std::vector<size_t>   partitionStart; // Where each partition starts in corners (one extra entry for the end)
+    std::vector<uint32_t> corners;        // Index buffer positions, sorted by partition
+};
+
+// Returns true if all three indices of the given triangle refer to existing vertices
+static inline bool IsValidTriangle(const MeshIndex* indices, size_t triangle, size_t numVertices)
+{
+    const MeshIndex* tri = indices + triangle * 3;
+    return tri[0] < numVertices && tri[1] < numVertices && tri[2] < numVertices;
+}
+
+static void BuildCornerBuckets(const MeshIndex* indices, size_t numIndices, size_t numVertices, CornerBuckets& buckets)
+{
+    ThreadPool& pool = GetThreadPool();
+    size_t numTriangles = numIndices / 3;
+
+    // Several partitions and triangle chunks per thread so a thread that finishes early can take up the slack
+    const size_t minTrianglesPerChunk = 16384;
+    int numPartitions = pool.GetNumThreads() * 4;
+    size_t numChunksWanted = numTriangles / minTrianglesPerChunk;
+    int numChunks = static_cast<int>(numChunksWanted < static_cast<size_t>(numPartitions) ? numChunksWanted : numPartitions);
+    if (numChunks < 1)  numChunks = 1;
+
+    buckets.numVertices = numVertices;
+    buckets.numTriangles = numTriangles;
+    buckets.numPartitions = numPartitions;
+    buckets.verticesPerPartition = (numVertices + numPartitions - 1) / numPartitions;
+    if (buckets.verticesPerPartition == 0)  buckets.verticesPerPartition = 1;
+    const size_t verticesPerPartition = buckets.verticesPerPartition;
+
+    // Count the corners that each chunk of triangles has in each partition
+    std::vector<size_t> counts(static_cast<size_t>(numChunks) * numPartitions, 0);
+    pool.Run(numChunks, [&](int chunk, int)
+    {
+        size_t* chunkCounts = &counts[static_cast<size_t>(chunk) * numPartitions];
+        size_t begin = numTriangles *  chunk      / numChunks;
+        size_t end   = numTriangles * (chunk + 1) / numChunks;
+        for (size_t t = begin; t < end; ++t)
+        {
+            if (!IsValidTriangle(indices, t, numVertices))  continue;
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                ++chunkCounts[indices[t * 3 + corner] / verticesPerPartition];
+            }
+        }
+    });
+
+    // Convert counts to the position each chunk starts writing in each partition. Partitions are in vertex order,
+    // and within a partition the chunks are in triangle order
+    buckets.partitionStart.resize(numPartitions + 1);
+    size_t total = 0;
+    for (int p = 0; p < numPartitions; ++p)
+    {
+        buckets.partitionStart[p] = total;
+        for (int chunk = 0; chunk < numChunks; ++chunk)
+        {
+            size_t& count = counts[static_cast<size_t>(chunk) * numPartitions + p];
+            size_t start = total;
+            total += count;
+            count = start;
+        }
+    }
+    buckets.partitionStart[numPartitions] = total;
+
+    // Write the corners into place
+    buckets.corners.resize(total);
+    pool.Run(numChunks, [&](int chunk, int)
+    {
+        size_t* writePos = &counts[static_cast<size_t>(chunk) * numPartitions];
+        size_t begin = numTriangles *  chunk      / numChunks;
+        size_t end   = numTriangles * (chunk + 1) / numChunks;
+        for (size_t t = begin; t < end; ++t)
+        {
+            if (!IsValidTriangle(indices, t, numVertices))  continue;
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                size_t i = t * 3 + corner;
+                buckets.corners[writePos[indices[i] / verticesPerPartition]++] = static_cast<uint32_t>(i);
+            }
+        }
+    });
+}
+
+// Call func(firstVertex, lastVertex, firstCorner, lastCorner) for each partition in parallel. The function may
+// write to vertices firstVertex to lastVertex-1, and the corners that use those vertices are
+// buckets.corners[firstCorner] to buckets.corners[lastCorner-1]
+template <class Func>
+static void ForEachPartition(const CornerBuckets& buckets, Func func)
+{
+    GetThreadPool().Run(buckets.numPartitions, [&](int p, int)
+    {
+        size_t firstVertex = p * buckets.verticesPerPartition;
+        size_t lastVertex  = firstVertex + buckets.verticesPerPartition;
+        if (firstVertex > buckets.numVertices)  firstVertex = buckets.numVertices;
+        if (lastVertex  > buckets.numVertices)  lastVertex  = buckets.numVertices;
+        func(firstVertex, lastVertex, buckets.partitionStart[p], buckets.partitionStart[p + 1]);
+    });
+}
+
+
+//--------------------------------------------------------------------------------------
+// Normals
+//--------------------------------------------------------------------------------------
+
+// Normalise that works with very short vectors. The Normalise function in CVector3.h treats anything shorter
+// than about 1e-3 as zero, but summed normals of small triangles can easily be that short
+static inline CVector3 NormaliseSmall(const CVector3& v)
+{
+    float lengthSq = Dot(v, v);
+    if (lengthSq < 1e-30f)  return CVector3(0.0f, 0.0f, 0.0f);
+    return v * (1.0f / std::sqrt(lengthSq));
+}
+
+// Angle between two edges leaving a vertex
+static inline float CornerAngle(const CVector3& edge1, const CVector3& edge2)
+{
+    float lengths = Length(edge1) * Length(edge2);
+    if (lengths <= 0.0f)  return 0.0f;
+    float cosAngle = Dot(edge1, edge2) / lengths;
+    if (cosAngle >  1.0f)  cosAngle =  1.0f;
+    if (cosAngle < -1.0f)  cosAngle = -1.0f;
+    return std::acos(cosAngle);
+}
+
+static void GenerateNormals(const PositionArray& positions, const MeshIndex* indices, const CornerBuckets& buckets,
+                            NormalWeighting weighting, CVector3* normals)
+{
+    // Face normals first, one per triangle. The length of the cross product is twice the triangle area,
+    // so these are already area weighted
+    size_t numTriangles = buckets.numTriangles;
+    std::vector<CVector3> faceNormals(numTriangles);
+    ParallelFor(numTriangles, 16384, [&](size_t begin, size_t end, int)
+    {
+        for (size_t t = begin; t < end; ++t)
+        {
+            if (!IsValidTriangle(indices, t, buckets.numVertices))  continue;
+            const CVector3& p0 = positions[indices[t * 3    ]];
+            const CVector3& p1 = positions[indices[t * 3 + 1]];
+            const CVector3& p2 = positions[indices[t * 3 + 2]];
+            faceNormals[t] = Cross(p1 - p0, p2 - p0);
+            if (weighting == NormalWeighting::Angle)  faceNormals[t] = NormaliseSmall(faceNormals[t]);
+        }
+    });
+
+    // Then each thread sums the face normals for its own range of vertices
+    ForEachPartition(buckets, [&](size_t firstVertex, size_t lastVertex, size_t firstCorner, size_t lastCorner)
+    {
+        for (size_t v = firstVertex; v < lastVertex; ++v)
+        {
+            normals[v] = CVector3(0.0f, 0.0f, 0.0f);
+        }
+
+        for (size_t c = firstCorner; c < lastCorner; ++c)
+        {
+            uint32_t i = buckets.corners[c];
+            size_t t = i / 3;
+            if (weighting == NormalWeighting::Angle)
+            {
+                // Edges from this corner to the other two corners of the triangle
+                size_t first = t * 3;
+                const CVector3& p  = positions[indices[i]];
+                const CVector3& pA = positions[indices[first + (i - first + 1) % 3]];
+                const CVector3& pB = positions[indices[first + (i - first + 2) % 3]];
+                normals[indices[i]] += faceNormals[t] * CornerAngle(pA - p, pB - p);
+            }
+            else
+            {
+                normals[indices[i]] += faceNormals[t];
+            }
+        }
+
+        for (size_t v = firstVertex; v < lastVertex; ++v)
+        {
+            normals[v] = NormaliseSmall(normals[v]);
+        }
+    });
+}
+
+
+//--------------------------------------------------------------------------------------
+// Tangents
+//--------------------------------------------------------------------------------------
+
+// Any unit vector perpendicular to the given unit normal. Branch-free method from "Building an Orthonormal
+// Basis, Revisited" (Duff et al. 2017), which is continuous everywhere except where the normal is exactly -z
+static inline CVector3 PerpendicularTangent(const CVector3& n)
+{
+    float sign = std::copysign(1.0f, n.z);
+    float a = -1.0f / (sign + n.z);
+    float b = n.x * n.y * a;
+    return CVector3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+}
+
+static void GenerateTangents(const PositionArray& positions, const float* texCoords, const MeshIndex* indices,
+                             const CornerBuckets& buckets, const CVector3* normals, CVector3* tangents)
+{
+    // Without texture coordinates there is no preferred direction, just choose one for each normal
+    if (texCoords == nullptr)
+    {
+        ParallelFor(buckets.numVertices, 65536, [&](size_t begin, size_t end, int)
+        {
+            for (size_t v = begin; v < end; ++v)
+            {
+                tangents[v] = Dot(normals[v], normals[v]) == 0.0f ? CVector3(0.0f, 0.0f, 0.0f) : PerpendicularTangent(normals[v]);
+            }
+        });
+        return;
+    }
+
+    // Face tangents - the direction in which u increases across each triangle. Solves
+    //   edge1 = du1 * T + dv1 * B
+    //   edge2 = du2 * T + dv2 * B
+    // for T. Dividing by the UV area would make tiny triangles dominate, so only its sign is used, leaving the
+    // tangent weighted by the area of the triangle
+    size_t numTriangles = buckets.numTriangles;
+    std::vector<CVector3> faceTangents(numTriangles);
+    ParallelFor(numTriangles, 16384, [&](size_t begin, size_t end, int)
+    {
+        for (size_t t = begin; t < end; ++t)
+        {
+            if (!IsValidTriangle(indices, t, buckets.numVertices))  continue;
+            MeshIndex i0 = indices[t * 3], i1 = indices[t * 3 + 1], i2 = indices[t * 3 + 2];
+            CVector3 edge1 = positions[i1] - positions[i0];
+            CVector3 edge2 = positions[i2] - positions[i0];
+            float du1 = texCoords[i1 * 2] - texCoords[i0 * 2], dv1 = texCoords[i1 * 2 + 1] - texCoords[i0 * 2 + 1];
+            float du2 = texCoords[i2 * 2] - texCoords[i0 * 2], dv2 = texCoords[i2 * 2 + 1] - texCoords[i0 * 2 + 1];
+            float uvArea = du1 * dv2 - du2 * dv1;
+            faceTangents[t] = (edge1 * dv2 - edge2 * dv1) * (uvArea < 0.0f ? -1.0f : 1.0f);
+        }
+    });
+
+    ForEachPartition(buckets, [&](size_t firstVertex, size_t lastVertex, size_t firstCorner, size_t lastCorner)
+    {
+        for (size_t v = firstVertex; v < lastVertex; ++v)
+        {
+            tangents[v] = CVector3(0.0f, 0.0f, 0.0f);
+        }
+
+        for (size_t c = firstCorner; c < lastCorner; ++c)
+        {
+            uint32_t i = buckets.corners[c];
+            tangents[indices[i]] += faceTangents[i / 3];
+        }
+
+        // Make each tangent perpendicular to its normal (Gram-Schmidt). Fall back to any perpendicular direction
+        // where the texture mapping is degenerate
+        for (size_t v = firstVertex; v < lastVertex; ++v)
+        {
+            const CVector3& n = normals[v];
+            if (Dot(n, n) == 0.0f)
+            {
+                tangents[v] = CVector3(0.0f, 0.0f, 0.0f);
+                continue;
+            }
+            CVector3 t = NormaliseSmall(tangents[v] - n * Dot(n, tangents[v]));
+            tangents[v] = Dot(t, t) == 0.0f ? PerpendicularTangent(n) : t;
+        }
+    });
+}
+
+
+//--------------------------------------------------------------------------------------
+// Public functions
+//--------------------------------------------------------------------------------------
+
+// Calculate a normal for each vertex from the triangle list in the index buffer. Writes positions.Size() normals.
+// Vertices not used by any triangle get a zero normal. Triangles with an out-of-range index are ignored
+void GenerateNormals(const PositionArray& positions, const MeshIndex* indices, size_t numIndices,
+                     NormalWeighting weighting, CVector3* normals)
+{
+    CornerBuckets buckets;
+    BuildCornerBuckets(indices, numIndices, positions.Size(), buckets);
+    GenerateNormals(positions, indices, buckets, weighting, normals);
+}
+
+// Calculate a tangent for each vertex, perpendicular to the given normals. texCoords holds a (u,v) pair for each
+// vertex, and the tangent points in the direction of increasing u. If texCoords is nullptr then an arbitrary (but
+// consistent) direction perpendicular to the normal is used. Writes positions.Size() tangents
+void GenerateTangents(const PositionArray& positions, const float* texCoords, const MeshIndex* indices,
+                      size_t numIndices, const CVector3* normals, CVector3* tangents)
+{
+    CornerBuckets buckets;
+    if (texCoords != nullptr)  BuildCornerBuckets(indices, numIndices, positions.Size(), buckets);
+    else                       buckets.numVertices = positions.Size(); // Buckets not needed without texture coordinates
+    GenerateTangents(positions, texCoords, indices, buckets, normals, tangents);
+}
+
+// Convert SimpleVertex geometry to the NormalVertex format, generating normals and tangents from the index buffer
+void MakeNormalVertices(const SimpleVertex* vertices, size_t numVertices, const MeshIndex* indices, size_t numIndices,
+                        NormalWeighting weighting, NormalVertex* normalVertices)
+{
+    PositionArray positions(vertices, numVertices);
+    std::vector<CVector3> normals(numVertices);
+    std::vector<CVector3> tangents(numVertices);
+
+    CornerBuckets buckets;
+    BuildCornerBuckets(indices, numIndices, numVertices, buckets);
+    GenerateNormals(positions, indices, buckets, weighting, normals.data());
+    GenerateTangents(positions, nullptr, indices, buckets, normals.data(), tangents.data());
+
+    ParallelFor(numVertices, 65536, [&](size_t begin, size_t end, int)
+    {
+        for (size_t v = begin; v < end; ++v)
+        {
+            normalVertices[v].position = vertices[v].position;
+            normalVertices[v].normal   = normals[v];
+            normalVertices[v].tangent  = tangents[v];
+            normalVertices[v].colour   = vertices[v].colour;
+        }
+    });
+}
@@ -0,0 +1,38 @@
+//--------------------------------------------------------------------------------------
+// Generation of vertex normals and tangents from an index buffer
+//--------------------------------------------------------------------------------------
+// Each triangle in the index buffer contributes its face normal to the three vertices it
+// uses, and each vertex normal is the normalised sum of the contributions. The work is
+// split across all cores - see MeshNormals.cpp for how this is done without atomics.
+
+#ifndef _MESH_NORMALS_H_INCLUDED_
+#define _MESH_NORMALS_H_INCLUDED_
+
+#include "MeshData.h"
+#include "VertexFormats.h"
+
+// How much each triangle contributes to the normals of its vertices
+enum class NormalWeighting
+{
+    Area,  // Larger triangles contribute more. Cheapest, good for evenly tessellated meshes
+    Angle, // Triangles contribute by the angle they make at the vertex. Not affected by how a surface is split into triangles
+};
+
+
+// Calculate a normal for each vertex from the triangle list in the index buffer. Writes positions.Size() normals.
+// Vertices not used by any triangle get a zero normal. Triangles with an out-of-range index are ignored
+void GenerateNormals(const PositionArray& positions, const MeshIndex* indices, size_t numIndices,
+                     NormalWeighting weighting, CVector3* normals);
+
+// Calculate a tangent for each vertex, perpendicular to the given normals. texCoords holds a (u,v) pair for each
+// vertex, and the tangent points in the direction of increasing u. If texCoords is nullptr then an arbitrary (but
+// consistent) direction perpendicular to the normal is used. Writes positions.Size() tangents
+void GenerateTangents(const PositionArray& positions, const float* texCoords, const MeshIndex* indices,
+                      size_t numIndices, const CVector3* normals, CVector3* tangents);
+
+// Convert SimpleVertex geometry to the NormalVertex format, generating normals and tangents from the index buffer
+void MakeNormalVertices(const SimpleVertex* vertices, size_t numVertices, const MeshIndex* indices, size_t numIndices,
+                        NormalWeighting weighting, NormalVertex* normalVertices);
+
+
+#endif //_MESH_NORMALS_H_INCLUDED_
@@ -0,0 +1,181 @@
+//--------------------------------------------------------------------------------------
+// Spatial reordering of triangles and vertices for large meshes
+//--------------------------------------------------------------------------------------
+
+#include "MeshReorder.h"
+#include "RadixSort.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+const int      kKeyBitsPerAxis = 21; // Three axes fit in a 64-bit key
+const uint32_t kGridMax        = (1u << kKeyBitsPerAxis) - 1;
+
+
+//--------------------------------------------------------------------------------------
+// Curve keys
+//--------------------------------------------------------------------------------------
+
+// Spread the low 21 bits of a value out so there are two zero bits between each
+static uint64_t SpreadBits(uint32_t value)
+{
+    uint64_t x = value & kGridMax;
+    x = (x | x << 32) & 0x001F00000000FFFFull;
+    x = (x | x << 16) & 0x001F0000FF0000FFull;
+    x = (x | x <<  8) & 0x100F00F00F00F00Full;
+    x = (x | x <<  4) & 0x10C30C30C30C30C3ull;
+    x = (x | x <<  2) & 0x1249249249249249ull;
+    return x;
+}
+
+// Morton key - bits of x, y and z interleaved, x highest
+uint64_t MortonKey(uint32_t x, uint32_t y, uint32_t z)
+{
+    return (SpreadBits(x) << 2) | (SpreadBits(y) << 1) | SpreadBits(z);
+}
+
+// Hilbert key. Uses the method from J. Skilling, "Programming the Hilbert curve" (2004): the coordinates are converted
+// in place to the "transposed" Hilbert index, whose bits interleaved in the same way as a Morton key give the distance
+// along the curve
+uint64_t HilbertKey(uint32_t x, uint32_t y, uint32_t z)
+{
+    uint32_t axes[3] = { x & kGridMax, y & kGridMax, z & kGridMax };
+
+    // Undo the excess work of the curve's rotations and reflections, highest bit first
+    for (uint32_t q = 1u << (kKeyBitsPerAxis - 1); q > 1; q >>= 1)
+    {
+        uint32_t p = q - 1;
+        for (int i = 0; i < 3; ++i)
+        {
+            // If bit q of this axis is set invert the low bits of axis 0, otherwise exchange the low bits of axis 0 and
+            // this axis. Done with masks rather than a branch, the bits are random so a branch mispredicts often
+            uint32_t bitSet = 0u - ((axes[i] & q) != 0 ? 1u : 0u);
+            axes[0] ^= p & bitSet;
+            uint32_t t = (axes[0] ^ axes[i]) & p & ~bitSet;
+            axes[0] ^= t;
+            axes[i] ^= t;
+        }
+    }
+
+    // Gray encode
+    axes[1] ^= axes[0];
+    axes[2] ^= axes[1];
+    uint32_t t = 0;
+    for (uint32_t q = 1u << (kKeyBitsPerAxis - 1); q > 1; q >>= 1)
+    {
+        t ^= (q - 1) & (0u - ((axes[2] & q) != 0 ? 1u : 0u));
+    }
+    axes[0] ^= t;
+    axes[1] ^= t;
+    axes[2] ^= t;
+
+    return MortonKey(axes[0], axes[1], axes[2]);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Triangle sorting
+//--------------------------------------------------------------------------------------
+
+// Reorder the triangles of a triangle list along a space-filling curve through their centroids
+void SortTrianglesSpatially(const PositionArray& positions, MeshIndex* indices, size_t numIndices, SpatialOrder order)
+{
+    size_t numTriangles = numIndices / 3;
+    if (numTriangles < 2 || positions.Size() == 0)  return;
+
+    // Bounds of the vertices, each thread taking part of the array
+    int numThreads = GetThreadPool().GetNumThreads();
+    std::vector<CVector3> threadMin(numThreads, positions[0]);
+    std::vector<CVector3> threadMax(numThreads, positions[0]);
+    ParallelFor(positions.Size(), 65536, [&](size_t begin, size_t end, int thread)
+    {
+        CVector3& minimum = threadMin[thread];
+        CVector3& maximum = threadMax[thread];
+        for (size_t v = begin; v < end; ++v)
+        {
+            const CVector3& p = positions[v];
+            minimum.x = (std::min)(minimum.x, p.x);  maximum.x = (std::max)(maximum.x, p.x);
+            minimum.y = (std::min)(minimum.y, p.y);  maximum.y = (std::max)(maximum.y, p.y);
+            minimum.z = (std::min)(minimum.z, p.z);  maximum.z = (std::max)(maximum.z, p.z);
+        }
+    });
+    CVector3 minimum = threadMin[0], maximum = threadMax[0];
+    for (int thread = 1; thread < numThreads; ++thread)
+    {
+        minimum.x = (std::min)(minimum.x, threadMin[thread].x);  maximum.x = (std::max)(maximum.x, threadMax[thread].x);
+        minimum.y = (std::min)(minimum.y, threadMin[thread].y);  maximum.y = (std::max)(maximum.y, threadMax[thread].y);
+        minimum.z = (std::min)(minimum.z, threadMin[thread].z);  maximum.z = (std::max)(maximum.z, threadMax[thread].z);
+    }
+
+    // Same scale on every axis so the curve is not stretched. Centroids are found as the sum of the three corners, so
+    // the scale covers three times the bounds
+    float extent = (std::max)({ maximum.x - minimum.x, maximum.y - minimum.y, maximum.z - minimum.z });
+    float scale = extent > 0.0f ? static_cast<float>(kGridMax) / (3.0f * extent) : 0.0f;
+
+    // Key for each triangle
+    std::vector<uint64_t> keys(numTriangles);
+    std::vector<uint32_t> triangleOrder(numTriangles);
+    ParallelFor(numTriangles, 16384, [&](size_t begin, size_t end, int)
+    {
+        for (size_t t = begin; t < end; ++t)
+        {
+            CVector3 sum = positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]];
+            uint32_t x = (std::min)(static_cast<uint32_t>((sum.x - 3.0f * minimum.x) * scale), kGridMax);
+            uint32_t y = (std::min)(static_cast<uint32_t>((sum.y - 3.0f * minimum.y) * scale), kGridMax);
+            uint32_t z = (std::min)(static_cast<uint32_t>((sum.z - 3.0f * minimum.z) * scale), kGridMax);
+            keys[t] = (order == SpatialOrder::Morton) ? MortonKey(x, y, z) : HilbertKey(x, y, z);
+            triangleOrder[t] = static_cast<uint32_t>(t);
+        }
+    });
+
+    RadixSort(keys.data(), triangleOrder.data(), numTriangles, kKeyBitsPerAxis * 3);
+
+    // Move the triangles into sorted order
+    std::vector<MeshIndex> sourceIndices(indices, indices + numTriangles * 3);
+    ParallelFor(numTriangles, 16384, [&](size_t begin, size_t end, int)
+    {
+        for (size_t t = begin; t < end; ++t)
+        {
+            const MeshIndex* source = &sourceIndices[static_cast<size_t>(triangleOrder[t]) * 3];
+            indices[t * 3    ] = source[0];
+            indices[t * 3 + 1] = source[1];
+            indices[t * 3 + 2] = source[2];
+        }
+    });
+}
+
+
+//--------------------------------------------------------------------------------------
+// Vertex renumbering
+//--------------------------------------------------------------------------------------
+
+// Build a table giving the new number for each vertex if the vertices are renumbered in the order the indices first
+// use them
+size_t MakeFirstUseVertexRemap(const MeshIndex* indices, size_t numIndices, size_t numVertices,
+                               std::vector<MeshIndex>& remap)
+{
+    const MeshIndex kUnused = 0xFFFFFFFF;
+    remap.assign(numVertices, kUnused);
+
+    MeshIndex nextVertex = 0;
+    for (size_t i = 0; i < numIndices; ++i)
+    {
+        if (remap[indices[i]] == kUnused)  remap[indices[i]] = nextVertex++;
+    }
+    size_t numUsed = nextVertex;
+
+    for (size_t v = 0; v < numVertices; ++v)
+    {
+        if (remap[v] == kUnused)  remap[v] = nextVertex++;
+    }
+    return numUsed;
+}
+
+
+// Renumber the indices using a remap table
+void RemapIndices(MeshIndex* indices, size_t numIndices, const std::vector<MeshIndex>& remap)
+{
+    ParallelFor(numIndices, 65536, [&](size_t begin, size_t end, int)
+    {
+        for (size_t i = begin; i < end; ++i)  indices[i] = remap[indices[i]];
+    });
+}
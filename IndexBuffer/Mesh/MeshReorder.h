@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------------------------
+// Spatial reordering of triangles and vertices for large meshes
+//--------------------------------------------------------------------------------------
+// A mesh from a scanner or a merge of many parts can have its triangles in any order. Then
+// neighbouring triangles are far apart in the index buffer and their vertices are far apart in
+// the vertex buffer, so every pass over the mesh (on the GPU or the CPU) jumps around memory.
+//
+// Sorting triangles along a space-filling curve puts triangles that are close in space close
+// in the buffer. Each triangle's centroid is placed in a 2^21 grid over the mesh bounds and
+// given the distance along the curve through that grid as a 63-bit key:
+// - Morton (Z-order) interleaves the bits of x, y and z. Quick to compute, but the curve makes
+//   long jumps at the corners of its blocks
+// - Hilbert never jumps, consecutive cells always touch, so locality is better. Each key takes
+//   several times longer to compute than a Morton key
+// The keys are sorted with the parallel radix sort.
+//
+// This is a coarse, whole-mesh ordering. It is a good starting order for a finer vertex cache
+// optimisation, which works best when it does not have to search far for the next triangle.
+// Reordering the vertices into the order the triangles first use them afterwards makes vertex
+// reads sequential too.
+
+#ifndef _MESH_REORDER_H_INCLUDED_
+#define _MESH_REORDER_H_INCLUDED_
+
+#include "MeshData.h"
+#include <vector>
+
+// Space-filling curve used to order triangles
+enum class SpatialOrder
+{
+    Morton,
+    Hilbert,
+};
+
+
+// Reorder the triangles of a triangle list along a space-filling curve through their centroids. The vertices of each
+// triangle stay in the same order so the winding is unchanged. Uses the shared thread pool
+void SortTrianglesSpatially(const PositionArray& positions, MeshIndex* indices, size_t numIndices, SpatialOrder order);
+
+
+// Build a table giving the new number for each vertex if the vertices are renumbered in the order the indices first
+// use them. Unused vertices go at the end. Returns the number of used vertices
+size_t MakeFirstUseVertexRemap(const MeshIndex* indices, size_t numIndices, size_t numVertices,
+                               std::vector<MeshIndex>& remap);
+
+// Renumber the indices using a remap table
+void RemapIndices(MeshIndex* indices, size_t numIndices, const std::vector<MeshIndex>& remap);
+
+// Copy vertices into their new positions given by a remap table, for any vertex type
+template <class Vertex>
+void RemapVertices(const Vertex* vertices, size_t numVertices, const std::vector<MeshIndex>& remap, Vertex* remappedVertices)
+{
+    for (size_t v = 0; v < numVertices; ++v)
+    {
+        remappedVertices[remap[v]] = vertices[v];
+    }
+}
+
+
+// The curve keys, exposed for tools and tests. Coordinates are 21-bit grid positions (0 to 2^21 - 1)
+uint64_t MortonKey (uint32_t x, uint32_t y, uint32_t z);
+uint64_t HilbertKey(uint32_t x, uint32_t y, uint32_t z);
+
+
+#endif //_MESH_REORDER_H_INCLUDED_
@@ -0,0 +1,130 @@
+//--------------------------------------------------------------------------------------
+// CPU-side mesh data laid out ready for vertex buffers, in interleaved or split streams
+//--------------------------------------------------------------------------------------
+
+#include "MeshStreams.h"
+#include <sstream>
+#include <cstring>
+
+const int MeshStreams::kMaxStreams;
+
+
+//--------------------------------------------------------------------------------------
+// Building streams
+//--------------------------------------------------------------------------------------
+
+// Arrange SimpleVertex geometry and its indices into the given layout
+void BuildMeshStreams(const SimpleVertex* vertices, size_t numVertices, const MeshIndex* indices, size_t numIndices,
+                      VertexStreamLayout layout, MeshStreams& mesh)
+{
+    mesh.layout = layout;
+    mesh.numVertices = static_cast<uint32_t>(numVertices);
+    mesh.indices.assign(indices, indices + numIndices);
+
+    if (layout == VertexStreamLayout::Interleaved)
+    {
+        mesh.numStreams = 1;
+        mesh.streams[0] = MakeVertexStream<SimpleVertex>(kSimpleVertexElements, 0);
+        mesh.streamData[0].resize(numVertices * sizeof(SimpleVertex));
+        std::memcpy(mesh.streamData[0].data(), vertices, numVertices * sizeof(SimpleVertex));
+        mesh.streamData[1].clear();
+    }
+    else
+    {
+        mesh.numStreams = 2;
+        mesh.streams[0] = MakeVertexStream<PositionVertex>  (kPositionVertexElements,   0);
+        mesh.streams[1] = MakeVertexStream<ColourAttributes>(kColourAttributesElements, 1);
+        mesh.streamData[0].resize(numVertices * sizeof(PositionVertex));
+        mesh.streamData[1].resize(numVertices * sizeof(ColourAttributes));
+        PositionVertex*   positions  = reinterpret_cast<PositionVertex*>  (mesh.streamData[0].data());
+        ColourAttributes* attributes = reinterpret_cast<ColourAttributes*>(mesh.streamData[1].data());
+        for (size_t v = 0; v < numVertices; ++v)
+        {
+            positions [v].position = vertices[v].position;
+            attributes[v].colour   = vertices[v].colour;
+        }
+    }
+}
+
+// Streams to bind for a pass and their description, for CreateVertexLayout
+int MeshStreams::GetPassStreams(PassInputs inputs, VertexStream* passStreams) const
+{
+    if (inputs == PassInputs::AllAttributes)
+    {
+        for (int s = 0; s < numStreams; ++s)  passStreams[s] = streams[s];
+        return numStreams;
+    }
+
+    passStreams[0] = streams[0];
+    if (layout == VertexStreamLayout::Interleaved)
+    {
+        passStreams[0].numElements = 1; // Position is the first element of SimpleVertex
+    }
+    return 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Fetch counting
+//--------------------------------------------------------------------------------------
+
+// Clear the totals ready for a new frame
+void VertexFetchCounter::BeginFrame()
+{
+    mPasses.clear();
+}
+
+// Record a draw of a whole mesh in the named pass
+void VertexFetchCounter::RecordDraw(const char* passName, const MeshStreams& mesh, PassInputs inputs)
+{
+    PassTotals* pass = nullptr;
+    for (auto& p : mPasses)
+    {
+        if (p.name == passName)  pass = &p;
+    }
+    if (pass == nullptr)
+    {
+        mPasses.push_back(PassTotals{ passName, 0, 0, 0, 0 });
+        pass = &mPasses.back();
+    }
+
+    VertexStream passStreams[MeshStreams::kMaxStreams];
+    int numPassStreams = mesh.GetPassStreams(inputs, passStreams);
+    for (int s = 0; s < numPassStreams; ++s)
+    {
+        // The whole stride of each bound stream is read, whether or not the pass uses all the elements
+        uint32_t usedBytes = 0;
+        for (uint32_t e = 0; e < passStreams[s].numElements; ++e)
+        {
+            usedBytes += VertexElementSize(passStreams[s].elements[e].format);
+        }
+        pass->vertexBytes       += static_cast<uint64_t>(mesh.numVertices) * passStreams[s].stride;
+        pass->unusedVertexBytes += static_cast<uint64_t>(mesh.numVertices) * (passStreams[s].stride - usedBytes);
+    }
+    pass->indexBytes += mesh.indices.size() * sizeof(MeshIndex);
+    ++pass->numDraws;
+}
+
+// Bytes read by all the passes this frame
+uint64_t VertexFetchCounter::TotalBytes() const
+{
+    uint64_t total = 0;
+    for (auto& p : mPasses)
+    {
+        total += p.vertexBytes + p.indexBytes;
+    }
+    return total;
+}
+
+// One line per pass giving draws, vertex bytes (and how many of them the pass did not need), index bytes
+std::string VertexFetchCounter::Report() const
+{
+    std::ostringstream report;
+    for (auto& p : mPasses)
+    {
+        report << p.name << ": " << p.numDraws << " draws, " << p.vertexBytes << " vertex bytes ("
+               << p.unusedVertexBytes << " unused), " << p.indexBytes << " index bytes\n";
+    }
+    report << "Total: " << TotalBytes() << " bytes\n";
+    return report.str();
+}
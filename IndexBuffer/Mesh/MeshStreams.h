@@ -0,0 +1,89 @@
+//--------------------------------------------------------------------------------------
+// CPU-side mesh data laid out ready for vertex buffers, in interleaved or split streams
+//--------------------------------------------------------------------------------------
+// Interleaved: one vertex buffer of SimpleVertex (position and colour together), slot 0.
+// Split:       a buffer of positions (slot 0) and a buffer of the other attributes (slot 1).
+//
+// The GPU reads whole vertices from a buffer, so with interleaved data a pass that only needs
+// positions (a depth-only or shadow pass) still pulls the colours through the memory system.
+// With split streams such passes bind the position buffer alone. Passes that need everything
+// bind both buffers and read the same amount as before. VertexFetchCounter measures the
+// difference on the CPU by counting the bytes each pass would read.
+
+#ifndef _MESH_STREAMS_H_INCLUDED_
+#define _MESH_STREAMS_H_INCLUDED_
+
+#include "MeshData.h"
+#include "VertexFormats.h"
+#include <vector>
+#include <string>
+
+// How a mesh's vertex data is arranged in vertex buffers
+enum class VertexStreamLayout
+{
+    Interleaved, // One stream of SimpleVertex
+    Split,       // A stream of PositionVertex in slot 0, a stream of ColourAttributes in slot 1
+};
+
+// The vertex data a rendering pass needs
+enum class PassInputs
+{
+    PositionOnly,  // e.g. depth-only or shadow passes
+    AllAttributes, // e.g. the main colour pass
+};
+
+
+// Vertex and index data for a mesh, in either layout, ready to copy into GPU buffers
+struct MeshStreams
+{
+    static const int kMaxStreams = 2;
+
+    VertexStreamLayout     layout;
+    uint32_t               numVertices;
+    int                    numStreams;               // 1 for interleaved, 2 for split
+    std::vector<uint8_t>   streamData[kMaxStreams];  // Contents of each vertex buffer
+    VertexStream           streams[kMaxStreams];     // Description of each stream (elements, stride, slot)
+    std::vector<MeshIndex> indices;
+
+    // Streams to bind for a pass and their description, for CreateVertexLayout. Position-only passes get only the
+    // position stream when split. When interleaved they get the SimpleVertex stream described as holding only a
+    // position - the stride is unchanged, so the colours are still read
+    int GetPassStreams(PassInputs inputs, VertexStream* passStreams) const;
+};
+
+// Arrange SimpleVertex geometry and its indices into the given layout
+void BuildMeshStreams(const SimpleVertex* vertices, size_t numVertices, const MeshIndex* indices, size_t numIndices,
+                      VertexStreamLayout layout, MeshStreams& mesh);
+
+
+// Counts the vertex and index data read by each rendering pass in a frame. Vertex reads are estimated as every vertex
+// in the mesh read once per draw (a post-transform cache hides repeated use of a vertex within a draw)
+class VertexFetchCounter
+{
+public:
+    // Clear the totals ready for a new frame
+    void BeginFrame();
+
+    // Record a draw of a whole mesh in the named pass
+    void RecordDraw(const char* passName, const MeshStreams& mesh, PassInputs inputs);
+
+    // Bytes read by all the passes this frame
+    uint64_t TotalBytes() const;
+
+    // One line per pass giving draws, vertex bytes (and how many of them the pass did not need), index bytes
+    std::string Report() const;
+
+private:
+    struct PassTotals
+    {
+        std::string name;
+        uint32_t    numDraws;
+        uint64_t    vertexBytes;
+        uint64_t    unusedVertexBytes; // Read only because they are interleaved with needed data
+        uint64_t    indexBytes;
+    };
+    std::vector<PassTotals> mPasses;
+};
+
+
+#endif //_MESH_STREAMS_H_INCLUDED_
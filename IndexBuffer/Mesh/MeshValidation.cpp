@@ -0,0 +1,257 @@
+//--------------------------------------------------------------------------------------
+// Checks and statistics for mesh index data
+//--------------------------------------------------------------------------------------
+
+#include "MeshValidation.h"
+#include "RadixSort.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+
+
+//--------------------------------------------------------------------------------------
+// Validation
+//--------------------------------------------------------------------------------------
+
+// Count triangles that use the same three vertices as an earlier triangle, in any order. The vertices of each triangle
+// are sorted into a key, then the keys are sorted so that duplicates are next to each other
+static size_t CountDuplicateTriangles(const std::vector<std::array<MeshIndex, 3>>& triangles, size_t numVertices)
+{
+    if (triangles.size() < 2)  return 0;
+
+    size_t numDuplicates = 0;
+    int vertexBits = BitsNeeded(numVertices);
+    if (vertexBits * 3 <= 64)
+    {
+        // Pack the three indices into one integer and radix sort
+        std::vector<uint64_t> keys(triangles.size());
+        for (size_t t = 0; t < triangles.size(); ++t)
+        {
+            keys[t] = (static_cast<uint64_t>(triangles[t][0]) << (vertexBits * 2)) |
+                      (static_cast<uint64_t>(triangles[t][1]) <<  vertexBits) | triangles[t][2];
+        }
+        RadixSort(keys.data(), nullptr, keys.size(), vertexBits * 3);
+        for (size_t t = 1; t < keys.size(); ++t)
+        {
+            if (keys[t] == keys[t - 1])  ++numDuplicates;
+        }
+    }
+    else
+    {
+        std::vector<std::array<MeshIndex, 3>> sorted = triangles;
+        std::sort(sorted.begin(), sorted.end());
+        for (size_t t = 1; t < sorted.size(); ++t)
+        {
+            if (sorted[t] == sorted[t - 1])  ++numDuplicates;
+        }
+    }
+    return numDuplicates;
+}
+
+
+// Check a triangle list and gather statistics
+void ValidateMesh(const PositionArray& positions, const MeshIndex* indices, size_t numIndices,
+                  const MeshValidationOptions& options, MeshValidationReport& report)
+{
+    report = MeshValidationReport();
+    report.numVertices  = positions.Size();
+    report.numIndices   = numIndices;
+    report.numTriangles = numIndices / 3;
+    report.indexCountNotMultipleOf3 = (numIndices % 3 != 0);
+    report.noTriangles = (report.numTriangles == 0);
+
+    std::vector<bool> vertexUsed(report.numVertices, false);
+    std::vector<std::array<MeshIndex, 3>> sortedTriangles; // Vertices of each non-degenerate triangle in order
+    sortedTriangles.reserve(report.numTriangles);
+
+    for (size_t t = 0; t < report.numTriangles; ++t)
+    {
+        const MeshIndex* corner = indices + t * 3;
+
+        bool inRange = true;
+        for (int c = 0; c < 3; ++c)
+        {
+            if (corner[c] >= report.numVertices)
+            {
+                ++report.numIndicesOutOfRange;
+                inRange = false;
+            }
+            else
+            {
+                vertexUsed[corner[c]] = true;
+            }
+        }
+        if (!inRange)  continue;
+
+        if (corner[0] == corner[1] || corner[1] == corner[2] || corner[2] == corner[0])
+        {
+            ++report.numDegenerateIndexTriangles;
+            continue;
+        }
+
+        // Zero area if the cross product of two edges is tiny compared with the edges themselves. Catches coincident
+        // and collinear vertices while allowing for rounding in the positions
+        CVector3 edge1 = positions[corner[1]] - positions[corner[0]];
+        CVector3 edge2 = positions[corner[2]] - positions[corner[0]];
+        CVector3 normal = Cross(edge1, edge2);
+        float edgeScale = (std::max)(Dot(edge1, edge1), Dot(edge2, edge2));
+        float tolerance = 1e-6f * edgeScale;
+        if (Dot(normal, normal) <= tolerance * tolerance)
+        {
+            ++report.numZeroAreaTriangles;
+        }
+
+        std::array<MeshIndex, 3> sorted = { { corner[0], corner[1], corner[2] } };
+        std::sort(sorted.begin(), sorted.end());
+        sortedTriangles.push_back(sorted);
+    }
+
+    // Indices after the last whole triangle are checked for range too
+    for (size_t i = report.numTriangles * 3; i < numIndices; ++i)
+    {
+        if (indices[i] >= report.numVertices)  ++report.numIndicesOutOfRange;
+    }
+
+    report.numDuplicateTriangles = CountDuplicateTriangles(sortedTriangles, report.numVertices);
+    report.numUnusedVertices = static_cast<size_t>(std::count(vertexUsed.begin(), vertexUsed.end(), false));
+
+    if (report.numTriangles > 0)
+    {
+        report.bytesPerTriangle = static_cast<float>(report.numVertices * options.vertexSize + numIndices * options.indexSize) /
+                                  report.numTriangles;
+    }
+
+    // The remaining statistics read vertex data through the indices so are skipped if any are out of range, and mean
+    // nothing with no triangles
+    if (report.numIndicesOutOfRange > 0 || report.noTriangles)  return;
+
+    size_t numWholeTriangleIndices = report.numTriangles * 3;
+    report.cacheConfigs = options.cacheConfigs;
+    for (auto& config : options.cacheConfigs)
+    {
+        report.cacheStats.push_back(SimulateVertexCache(indices, numWholeTriangleIndices, report.numVertices,
+                                                        config.type, config.size));
+    }
+
+    if (options.overdrawResolution > 0)
+    {
+        report.overdraw = EstimateOverdraw(positions, indices, numWholeTriangleIndices, options.overdrawResolution);
+    }
+}
+
+
+// Multi-line readable summary
+std::string MeshValidationReport::ToString() const
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "  " << numVertices << " vertices, " << numIndices << " indices, " << numTriangles << " triangles\n";
+
+    if (numIndicesOutOfRange > 0)  out << "  ERROR: " << numIndicesOutOfRange << " indices out of range\n";
+    if (indexCountNotMultipleOf3)  out << "  ERROR: index count is not a multiple of 3\n";
+    if (noTriangles)               out << "  ERROR: no triangles\n";
+    if (numDegenerateIndexTriangles > 0)  out << "  WARNING: " << numDegenerateIndexTriangles << " triangles repeat a vertex\n";
+    if (numZeroAreaTriangles > 0)         out << "  WARNING: " << numZeroAreaTriangles << " triangles have zero area\n";
+    if (numDuplicateTriangles > 0)        out << "  WARNING: " << numDuplicateTriangles << " duplicate triangles\n";
+    if (numUnusedVertices > 0)            out << "  WARNING: " << numUnusedVertices << " unused vertices\n";
+
+    for (size_t c = 0; c < cacheStats.size(); ++c)
+    {
+        out << "  " << (cacheConfigs[c].type == VertexCacheType::Fifo ? "FIFO" : "LRU ") << std::setw(3) << cacheConfigs[c].size
+            << ": ACMR " << cacheStats[c].ACMR() << ", ATVR " << cacheStats[c].ATVR() << "\n";
+    }
+    out << std::setprecision(1) << "  " << bytesPerTriangle << " bytes per triangle\n";
+    if (overdraw > 0.0f)  out << std::setprecision(3) << "  Overdraw " << overdraw << "\n";
+    return out.str();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Overdraw estimate
+//--------------------------------------------------------------------------------------
+
+// Draw the triangles viewed along one axis, from the positive or negative side, counting pixels shaded and covered
+static void DrawOverdrawView(const PositionArray& positions, const MeshIndex* indices, size_t numIndices, int axis,
+                             bool fromPositive, int resolution, uint64_t& numShaded, uint64_t& numCovered)
+{
+    // Image axes u and v are the other two axes in cyclic order (x -> y,z; y -> z,x; z -> x,y). With that order the
+    // signed area of a triangle in the image has the sign of its normal's component along the view axis
+    int u = (axis + 1) % 3;
+    int v = (axis + 2) % 3;
+
+    // Fit the mesh bounds to the image, keeping the aspect ratio
+    float minU = 1e30f, maxU = -1e30f, minV = 1e30f, maxV = -1e30f;
+    for (size_t i = 0; i < positions.Size(); ++i)
+    {
+        const CVector3& p = positions[i];
+        minU = (std::min)(minU, (&p.x)[u]);  maxU = (std::max)(maxU, (&p.x)[u]);
+        minV = (std::min)(minV, (&p.x)[v]);  maxV = (std::max)(maxV, (&p.x)[v]);
+    }
+    float extent = (std::max)(maxU - minU, maxV - minV);
+    if (extent <= 0.0f)  return;
+    float scale = resolution / extent;
+
+    std::vector<float> depth(static_cast<size_t>(resolution) * resolution, 1e30f);
+    float depthSign = fromPositive ? -1.0f : 1.0f; // Smaller depth is nearer the viewer
+
+    for (size_t t = 0; t + 2 < numIndices; t += 3)
+    {
+        float x[3], y[3], z[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            const CVector3& p = positions[indices[t + c]];
+            x[c] = ((&p.x)[u] - minU) * scale;
+            y[c] = ((&p.x)[v] - minV) * scale;
+            z[c] = (&p.x)[axis] * depthSign;
+        }
+
+        // Back-face cull. The normal points towards a viewer on the positive side if the area is positive
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (fromPositive ? area <= 0.0f : area >= 0.0f)  continue;
+
+        // Edge functions, sign flipped so that inside is positive for either winding
+        float sign = area > 0.0f ? 1.0f : -1.0f;
+        float invArea = 1.0f / std::fabs(area);
+        int minX = (std::max)(0, static_cast<int>(std::floor((std::min)({ x[0], x[1], x[2] }))));
+        int maxX = (std::min)(resolution - 1, static_cast<int>(std::ceil((std::max)({ x[0], x[1], x[2] }))));
+        int minY = (std::max)(0, static_cast<int>(std::floor((std::min)({ y[0], y[1], y[2] }))));
+        int maxY = (std::min)(resolution - 1, static_cast<int>(std::ceil((std::max)({ y[0], y[1], y[2] }))));
+
+        for (int py = minY; py <= maxY; ++py)
+        {
+            float sy = py + 0.5f;
+            for (int px = minX; px <= maxX; ++px)
+            {
+                float sx = px + 0.5f;
+                float w0 = sign * ((x[2] - x[1]) * (sy - y[1]) - (y[2] - y[1]) * (sx - x[1]));
+                float w1 = sign * ((x[0] - x[2]) * (sy - y[2]) - (y[0] - y[2]) * (sx - x[2]));
+                float w2 = sign * ((x[1] - x[0]) * (sy - y[0]) - (y[1] - y[0]) * (sx - x[0]));
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)  continue;
+
+                float pixelDepth = (w0 * z[0] + w1 * z[1] + w2 * z[2]) * invArea;
+                float& stored = depth[static_cast<size_t>(py) * resolution + px];
+                if (pixelDepth < stored)
+                {
+                    if (stored == 1e30f)  ++numCovered;
+                    stored = pixelDepth;
+                    ++numShaded;
+                }
+            }
+        }
+    }
+}
+
+
+// Estimate overdraw by drawing the triangles in order into a small depth buffer from six directions along the axes
+float EstimateOverdraw(const PositionArray& positions, const MeshIndex* indices, size_t numIndices, int resolution)
+{
+    uint64_t numShaded = 0, numCovered = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        DrawOverdrawView(positions, indices, numIndices, axis, true,  resolution, numShaded, numCovered);
+        DrawOverdrawView(positions, indices, numIndices, axis, false, resolution, numShaded, numCovered);
+    }
+    return numCovered > 0 ? static_cast<float>(numShaded) / numCovered : 0.0f;
+}
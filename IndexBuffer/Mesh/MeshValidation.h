@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// Checks and statistics for mesh index data
+//--------------------------------------------------------------------------------------
+// Problems in an index buffer are easy to make and hard to see: an index past the end of the
+// vertex buffer may draw garbage or nothing, degenerate or repeated triangles waste time, and
+// a poor triangle order runs the vertex shader far more often than needed. ValidateMesh finds
+// these in one pass over a triangle list and also reports:
+// - Vertex cache efficiency (ACMR / ATVR, see VertexCache.h) for a few cache sizes
+// - Memory used per triangle by the vertex and index data
+// - Estimated overdraw - how many times each covered pixel is shaded, from a few viewpoints
+//
+// All the checks take linear time (plus a sort for the duplicate check) so large asset libraries
+// can be checked routinely.
+
+#ifndef _MESH_VALIDATION_H_INCLUDED_
+#define _MESH_VALIDATION_H_INCLUDED_
+
+#include "MeshData.h"
+#include "VertexCache.h"
+#include <vector>
+#include <string>
+
+// Vertex cache configurations reported by ValidateMesh
+struct VertexCacheConfig
+{
+    VertexCacheType type;
+    int             size;
+};
+
+// Results of ValidateMesh
+struct MeshValidationReport
+{
+    // Sizes
+    size_t numVertices  = 0;
+    size_t numIndices   = 0;
+    size_t numTriangles = 0;
+
+    // Errors - the mesh will not render correctly
+    size_t numIndicesOutOfRange = 0; // Index not less than the number of vertices
+    bool   indexCountNotMultipleOf3 = false;
+    bool   noTriangles = false;      // Nothing to draw, e.g. an OBJ file with vertices but no faces
+
+    // Warnings - wasted work or memory
+    size_t numDegenerateIndexTriangles = 0; // Triangles using the same vertex twice
+    size_t numZeroAreaTriangles        = 0; // Different vertices, but at the same place or in a line
+    size_t numDuplicateTriangles       = 0; // Triangles using the same three vertices as an earlier triangle
+    size_t numUnusedVertices           = 0; // Vertices not used by any triangle
+
+    // Vertex cache efficiency for each configuration in the order given (not calculated if any index is out of range)
+    std::vector<VertexCacheConfig> cacheConfigs;
+    std::vector<VertexCacheStats>  cacheStats;
+
+    // Bytes of vertex and index data per triangle
+    float bytesPerTriangle = 0.0f;
+
+    // Average number of times each covered pixel is shaded when the triangles are drawn in order with a depth test,
+    // averaged over six views along the axes. 1 is ideal. 0 if not calculated
+    float overdraw = 0.0f;
+
+    bool HasErrors()   const { return numIndicesOutOfRange > 0 || indexCountNotMultipleOf3 || noTriangles; }
+    bool HasWarnings() const { return numDegenerateIndexTriangles > 0 || numZeroAreaTriangles > 0 ||
+                                      numDuplicateTriangles > 0 || numUnusedVertices > 0; }
+
+    // Multi-line readable summary
+    std::string ToString() const;
+};
+
+
+// Options for ValidateMesh
+struct MeshValidationOptions
+{
+    std::vector<VertexCacheConfig> cacheConfigs = { { VertexCacheType::Fifo, 8 },  { VertexCacheType::Fifo, 16 },
+                                                    { VertexCacheType::Fifo, 32 }, { VertexCacheType::Lru,  16 },
+                                                    { VertexCacheType::Lru,  32 } };
+    uint32_t vertexSize = 28; // Bytes per vertex, for bytesPerTriangle (default is SimpleVertex)
+    uint32_t indexSize  = 4;  // Bytes per index
+    int  overdrawResolution = 256; // Size of the square image used to estimate overdraw, 0 to skip the estimate
+};
+
+// Check a triangle list and gather statistics. Indices out of range are counted and skipped by the other checks
+void ValidateMesh(const PositionArray& positions, const MeshIndex* indices, size_t numIndices,
+                  const MeshValidationOptions& options, MeshValidationReport& report);
+
+
+// Estimate overdraw by drawing the triangles in order into a small depth buffer from six directions along the axes,
+// with back-face culling (clockwise front faces, as in Direct3D) and a less-than depth test. Returns the number of
+// pixels shaded divided by the number of pixels covered. Indices must be in range
+float EstimateOverdraw(const PositionArray& positions, const MeshIndex* indices, size_t numIndices, int resolution);
+
+
+#endif //_MESH_VALIDATION_H_INCLUDED_
@@ -0,0 +1,215 @@
+//--------------------------------------------------------------------------------------
+// Sparse morph targets - blend shapes for SimpleVertex meshes
+//--------------------------------------------------------------------------------------
+
+#include "MorphTargets.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define MORPH_TARGETS_SSE
+#include <emmintrin.h>
+#endif
+
+// The blend works on a vertex as 7 floats: x y z r g b a
+static_assert(sizeof(SimpleVertex) == 7 * sizeof(float), "MorphBlender expects SimpleVertex to be 7 floats");
+
+const int      kDeltaFloats = 8; // Floats stored for each delta, padded for SSE
+const uint32_t kRangeGap    = 8; // Ranges of changed vertices closer than this are joined, fewer but larger copies
+
+
+//--------------------------------------------------------------------------------------
+// Ranges
+//--------------------------------------------------------------------------------------
+
+// Sort ranges and join those that overlap or are within kRangeGap of each other
+static void MergeRanges(std::vector<MorphRange>& ranges)
+{
+    if (ranges.empty())  return;
+    std::sort(ranges.begin(), ranges.end(), [](const MorphRange& a, const MorphRange& b) { return a.first < b.first; });
+
+    size_t numMerged = 0;
+    for (size_t i = 1; i < ranges.size(); ++i)
+    {
+        MorphRange& last = ranges[numMerged];
+        uint32_t lastEnd = last.first + last.count;
+        if (ranges[i].first <= lastEnd + kRangeGap)
+        {
+            last.count = (std::max)(lastEnd, ranges[i].first + ranges[i].count) - last.first;
+        }
+        else
+        {
+            ranges[++numMerged] = ranges[i];
+        }
+    }
+    ranges.resize(numMerged + 1);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Targets
+//--------------------------------------------------------------------------------------
+
+void MorphBlender::Init(const SimpleVertex* vertices, uint32_t numVertices)
+{
+    mBase.assign(vertices, vertices + numVertices);
+    mBlended = mBase;
+    mTargets.clear();
+    mActive.clear();
+    mFrame = 0;
+    for (auto& changes : mChanges)  changes.clear();
+}
+
+
+int MorphBlender::AddTarget(const MorphDelta* deltas, size_t numDeltas)
+{
+    std::vector<MorphDelta> sorted(deltas, deltas + numDeltas);
+    return AddTarget(sorted);
+}
+
+int MorphBlender::AddTarget(const SimpleVertex* targetVertices, float tolerance)
+{
+    std::vector<MorphDelta> deltas;
+    for (uint32_t v = 0; v < mBase.size(); ++v)
+    {
+        const SimpleVertex& base = mBase[v];
+        const SimpleVertex& target = targetVertices[v];
+        MorphDelta delta = { v, target.position - base.position,
+                             ColourRGBA(target.colour.r - base.colour.r, target.colour.g - base.colour.g,
+                                        target.colour.b - base.colour.b, target.colour.a - base.colour.a) };
+        float largest = (std::max)({ std::abs(delta.position.x), std::abs(delta.position.y), std::abs(delta.position.z),
+                                     std::abs(delta.colour.r), std::abs(delta.colour.g), std::abs(delta.colour.b),
+                                     std::abs(delta.colour.a) });
+        if (largest > tolerance)  deltas.push_back(delta);
+    }
+    return AddTarget(deltas);
+}
+
+// Store deltas as a target, sorting them by vertex and joining deltas for the same vertex
+int MorphBlender::AddTarget(std::vector<MorphDelta>& deltas)
+{
+    for (auto& delta : deltas)
+    {
+        if (delta.vertex >= mBase.size())  return -1;
+    }
+    std::stable_sort(deltas.begin(), deltas.end(), [](const MorphDelta& a, const MorphDelta& b) { return a.vertex < b.vertex; });
+
+    Target target;
+    for (auto& delta : deltas)
+    {
+        float values[kDeltaFloats] = { delta.position.x, delta.position.y, delta.position.z, delta.colour.r,
+                                       delta.colour.g,   delta.colour.b,   delta.colour.a,   0.0f };
+        if (!target.vertices.empty() && target.vertices.back() == delta.vertex)
+        {
+            float* last = &target.deltas[target.deltas.size() - kDeltaFloats];
+            for (int i = 0; i < kDeltaFloats; ++i)  last[i] += values[i];
+        }
+        else
+        {
+            target.vertices.push_back(delta.vertex);
+            target.deltas.insert(target.deltas.end(), values, values + kDeltaFloats);
+        }
+    }
+
+    for (uint32_t vertex : target.vertices)  target.ranges.push_back({ vertex, 1 });
+    MergeRanges(target.ranges);
+
+    mTargets.push_back(std::move(target));
+    return static_cast<int>(mTargets.size() - 1);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Blending
+//--------------------------------------------------------------------------------------
+
+// Add weighted deltas to vertices (given as 7 floats each)
+static void AddDeltasScalar(float* vertices, const uint32_t* indices, const float* deltas, size_t numDeltas, float weight)
+{
+    for (size_t i = 0; i < numDeltas; ++i)
+    {
+        float* vertex = vertices + indices[i] * 7;
+        const float* delta = deltas + i * kDeltaFloats;
+        for (int e = 0; e < 7; ++e)  vertex[e] += weight * delta[e];
+    }
+}
+
+#ifdef MORPH_TARGETS_SSE
+// The first four floats of a vertex (x y z r) are one unaligned load and store. The last three (g b a) are read and
+// written as a pair and a single so the neighbouring vertex is not touched
+static void AddDeltasSse(float* vertices, const uint32_t* indices, const float* deltas, size_t numDeltas, float weight)
+{
+    const __m128 w = _mm_set1_ps(weight);
+    for (size_t i = 0; i < numDeltas; ++i)
+    {
+        float* vertex = vertices + indices[i] * 7;
+        const float* delta = deltas + i * kDeltaFloats;
+
+        __m128 xyzr = _mm_loadu_ps(vertex);
+        xyzr = _mm_add_ps(xyzr, _mm_mul_ps(w, _mm_loadu_ps(delta)));
+        _mm_storeu_ps(vertex, xyzr);
+
+        __m128 gb  = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(vertex + 4)));
+        __m128 gba = _mm_movelh_ps(gb, _mm_load_ss(vertex + 6));
+        gba = _mm_add_ps(gba, _mm_mul_ps(w, _mm_loadu_ps(delta + 4)));
+        _mm_store_sd(reinterpret_cast<double*>(vertex + 4), _mm_castps_pd(gba));
+        _mm_store_ss(vertex + 6, _mm_movehl_ps(gba, gba));
+    }
+}
+#endif
+
+
+void MorphBlender::Blend(const float* weights, bool simd)
+{
+    ++mFrame;
+    std::vector<MorphRange>& changes = mChanges[mFrame % kHistory];
+    changes.clear();
+
+    // Put the vertices changed last frame back to the base mesh
+    for (uint32_t t : mActive)
+    {
+        for (uint32_t vertex : mTargets[t].vertices)  mBlended[vertex] = mBase[vertex];
+        changes.insert(changes.end(), mTargets[t].ranges.begin(), mTargets[t].ranges.end());
+    }
+
+    // Add the deltas of this frame's targets
+    mNewActive.clear();
+    float* vertices = &mBlended[0].position.x;
+    for (uint32_t t = 0; t < mTargets.size(); ++t)
+    {
+        if (weights[t] == 0.0f)  continue;
+        mNewActive.push_back(t);
+
+        const Target& target = mTargets[t];
+        if (target.vertices.empty())  continue;
+#ifdef MORPH_TARGETS_SSE
+        if (simd)
+            AddDeltasSse(vertices, target.vertices.data(), target.deltas.data(), target.vertices.size(), weights[t]);
+        else
+#endif
+            AddDeltasScalar(vertices, target.vertices.data(), target.deltas.data(), target.vertices.size(), weights[t]);
+        changes.insert(changes.end(), target.ranges.begin(), target.ranges.end());
+    }
+    mActive.swap(mNewActive);
+
+    MergeRanges(changes);
+}
+
+
+void MorphBlender::ChangedRanges(uint64_t sinceFrame, std::vector<MorphRange>& ranges) const
+{
+    ranges.clear();
+    if (sinceFrame >= mFrame)  return;
+    if (mFrame - sinceFrame > kHistory)
+    {
+        if (!mBlended.empty())  ranges.push_back({ 0, NumVertices() });
+        return;
+    }
+
+    for (uint64_t frame = sinceFrame + 1; frame <= mFrame; ++frame)
+    {
+        const std::vector<MorphRange>& changes = mChanges[frame % kHistory];
+        ranges.insert(ranges.end(), changes.begin(), changes.end());
+    }
+    MergeRanges(ranges);
+}
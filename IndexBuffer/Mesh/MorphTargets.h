@@ -0,0 +1,108 @@
+//--------------------------------------------------------------------------------------
+// Sparse morph targets - blend shapes for SimpleVertex meshes
+//--------------------------------------------------------------------------------------
+// A morph target (blend shape) is a copy of a mesh with some vertices moved or recoloured, e.g.
+// a face with a smile or raised eyebrows. Animation blends the base mesh towards several targets
+// at once with a weight for each:
+//     vertex = base + w0 * (target0 - base) + w1 * (target1 - base) + ...
+// A target usually changes a small part of the mesh, so it is stored as a list of deltas for
+// the vertices it changes only. Blending then touches only the vertices of targets with a
+// non-zero weight, plus the vertices of last frame's targets (which are put back to the base
+// mesh). Each delta is added with two SSE operations, 8 floats: the position and colour deltas.
+//
+// The blended mesh is kept on the CPU. The blender records which ranges of vertices changed in
+// recent frames so that GPU copies of the mesh can be brought up to date with only the changed
+// ranges. With two GPU buffers used alternately (double buffering), the GPU draws from one while
+// the other is updated, and each buffer asks for the changes since it was last written - see
+// ChangedRanges. This file does not use DirectX.
+
+#ifndef _MORPH_TARGETS_H_INCLUDED_
+#define _MORPH_TARGETS_H_INCLUDED_
+
+#include "VertexFormats.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// The change a morph target makes to one vertex
+struct MorphDelta
+{
+    uint32_t   vertex;   // Index of the vertex in the base mesh
+    CVector3   position; // Added to the position at weight 1
+    ColourRGBA colour;   // Added to the colour at weight 1
+};
+
+// A range of vertices that has changed
+struct MorphRange
+{
+    uint32_t first;
+    uint32_t count;
+};
+
+
+class MorphBlender
+{
+public:
+    // Set up with the base mesh, removing any targets. The blended mesh starts as a copy of the base
+    void Init(const SimpleVertex* vertices, uint32_t numVertices);
+
+
+    // Targets //
+
+    // Add a target given as a list of deltas, in any order. Deltas for the same vertex are added together. Returns the
+    // index of the new target, or -1 if a delta's vertex is outside the base mesh
+    int AddTarget(const MorphDelta* deltas, size_t numDeltas);
+
+    // Add a target given as a complete copy of the base mesh with some vertices changed. Only vertices with a position
+    // or colour differing from the base by more than tolerance are kept. Returns the index of the new target
+    int AddTarget(const SimpleVertex* targetVertices, float tolerance = 0.0f);
+
+    uint32_t NumTargets() const { return static_cast<uint32_t>(mTargets.size()); }
+
+    // Number of vertices a target changes
+    size_t NumDeltas(uint32_t target) const { return mTargets[target].vertices.size(); }
+
+
+    // Blending //
+
+    // Blend the base mesh with the targets using one weight per target (NumTargets() weights). Targets with weight
+    // 0 cost nothing. simd false uses plain C++, for comparison. Starts a new frame
+    void Blend(const float* weights, bool simd = true);
+
+    // The blended mesh
+    const SimpleVertex* Vertices()    const { return mBlended.data(); }
+    uint32_t            NumVertices() const { return static_cast<uint32_t>(mBlended.size()); }
+
+    // Frame count, increased by each Blend. Frame 0 is the base mesh as given to Init
+    uint64_t Frame() const { return mFrame; }
+
+    // Get the ranges of vertices that have changed since the given frame, sorted and not overlapping. A copy of the
+    // blended mesh made at that frame is brought up to date by copying these ranges. If the frame is too old for the
+    // recorded history the whole mesh is returned
+    void ChangedRanges(uint64_t sinceFrame, std::vector<MorphRange>& ranges) const;
+
+
+private:
+    struct Target
+    {
+        std::vector<uint32_t>   vertices; // Sorted
+        std::vector<float>      deltas;   // 8 floats for each vertex: dx dy dz dr, dg db da 0
+        std::vector<MorphRange> ranges;   // The vertices as ranges, for recording changes
+    };
+
+    int AddTarget(std::vector<MorphDelta>& deltas);
+
+    static const int kHistory = 4; // Frames of changes recorded
+
+    std::vector<SimpleVertex> mBase;
+    std::vector<SimpleVertex> mBlended;
+    std::vector<Target>       mTargets;
+    std::vector<uint32_t>     mActive; // Targets blended in the last frame
+    std::vector<uint32_t>     mNewActive;
+
+    uint64_t                mFrame = 0;
+    std::vector<MorphRange> mChanges[kHistory]; // Ranges changed by each recent frame, indexed by frame % kHistory
+};
+
+
+#endif //_MORPH_TARGETS_H_INCLUDED_
@@ -0,0 +1,736 @@
+//--------------------------------------------------------------------------------------
+// Out-of-core processing of meshes too large to load into memory
+//--------------------------------------------------------------------------------------
+// The work is limited by disk speed rather than calculation, so this code is single-threaded.
+// Running the steps on several meshes at once (each with its share of the budget) uses the
+// disk better than splitting one step across threads.
+
+#include "OutOfCoreMesh.h"
+#include "MappedFile.h"
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+const size_t   kMinBufferSize = 16 * 1024;
+const int      kMaxBuckets    = 256; // Files open at once when splitting into buckets (Windows C runtime allows 512)
+const int      kMaxMergeFiles = 256; // Files merged at once
+const int      kBucketLevelBits = 8; // Hash bits used at each level of bucket splitting
+const int      kMaxBucketLevels = 6;
+const uint32_t kNoVertex = 0xFFFFFFFF;
+
+
+//--------------------------------------------------------------------------------------
+// File access helpers
+//--------------------------------------------------------------------------------------
+
+// Reads fixed-size elements in order from a file through a mapped window. The window always starts at an element
+// boundary so elements never cross the end of a window
+class SequentialReader
+{
+public:
+    bool Open(const std::string& fileName, uint32_t elementSize, uint64_t windowSize, std::string& error)
+    {
+        if (!mFile.Open(fileName, MappedFile::Access::Read))
+        {
+            error = "Cannot read " + fileName;
+            return false;
+        }
+        if (mFile.Size() % elementSize != 0)
+        {
+            error = fileName + ": size is not a multiple of the element size";
+            return false;
+        }
+        mElementSize = elementSize;
+        mElementsPerWindow = (std::max)(static_cast<uint64_t>(1), windowSize / elementSize);
+        mNumElements = mFile.Size() / elementSize;
+        mNext = mWindowFirst = mWindowCount = 0;
+        return true;
+    }
+
+    uint64_t NumElements() const { return mNumElements; }
+
+    // Pointer to the next element, valid until the next call. Returns nullptr at the end of the file (or if mapping fails)
+    const uint8_t* Next()
+    {
+        if (mNext >= mWindowFirst + mWindowCount)
+        {
+            mView.Unmap();
+            if (mNext >= mNumElements)  return nullptr;
+            mWindowFirst = mNext;
+            mWindowCount = (std::min)(mElementsPerWindow, mNumElements - mNext);
+            if (!mView.Map(mFile, mWindowFirst * mElementSize, static_cast<size_t>(mWindowCount * mElementSize), true))
+            {
+                mWindowCount = 0;
+                return nullptr;
+            }
+        }
+        return mView.Data() + (mNext++ - mWindowFirst) * mElementSize;
+    }
+
+    void Close()
+    {
+        mView.Unmap();
+        mFile.Close();
+    }
+
+private:
+    MappedFile mFile;
+    MappedView mView;
+    uint32_t   mElementSize = 1;
+    uint64_t   mElementsPerWindow = 1;
+    uint64_t   mNumElements = 0;
+    uint64_t   mNext = 0;
+    uint64_t   mWindowFirst = 0;
+    uint64_t   mWindowCount = 0;
+};
+
+
+// Writes a file in order through a fixed-size buffer. Output files grow as they are written so are not mapped
+class BufferedWriter
+{
+public:
+    ~BufferedWriter() { if (mFile != nullptr)  std::fclose(mFile); }
+
+    bool Open(const std::string& fileName, size_t bufferSize, std::string& error)
+    {
+        mFile = std::fopen(fileName.c_str(), "wb");
+        if (mFile == nullptr)
+        {
+            error = "Cannot write " + fileName;
+            return false;
+        }
+        mFileName = fileName;
+        mBuffer.resize((std::max)(bufferSize, static_cast<size_t>(4096)));
+        mUsed = 0;
+        return true;
+    }
+
+    void Write(const void* data, size_t size)
+    {
+        if (mUsed + size > mBuffer.size())  Flush();
+        if (size > mBuffer.size())
+        {
+            mFailed |= (std::fwrite(data, 1, size, mFile) != size);
+            return;
+        }
+        std::memcpy(&mBuffer[mUsed], data, size);
+        mUsed += size;
+    }
+
+    // Write out the buffer and close the file. Returns false if any write failed (e.g. disk full)
+    bool Close(std::string& error)
+    {
+        if (mFile == nullptr)  return !mFailed;
+        Flush();
+        mFailed |= (std::fclose(mFile) != 0);
+        mFile = nullptr;
+        mBuffer = std::vector<uint8_t>();
+        if (mFailed)  error = "Cannot write " + mFileName;
+        return !mFailed;
+    }
+
+private:
+    void Flush()
+    {
+        if (mUsed > 0)  mFailed |= (std::fwrite(mBuffer.data(), 1, mUsed, mFile) != mUsed);
+        mUsed = 0;
+    }
+
+    std::FILE*           mFile = nullptr;
+    std::string          mFileName;
+    std::vector<uint8_t> mBuffer;
+    size_t               mUsed = 0;
+    bool                 mFailed = false;
+};
+
+
+// Buffer size for one of several files sharing part of the memory budget
+static size_t ShareOfBudget(uint64_t budgetPart, size_t numFiles)
+{
+    return static_cast<size_t>((std::max)(static_cast<uint64_t>(kMinBufferSize), budgetPart / (std::max)(numFiles, static_cast<size_t>(1))));
+}
+
+
+// Read the position of a vertex, which may not be aligned in the file
+static CVector3 ReadPosition(const uint8_t* vertex, uint32_t positionOffset)
+{
+    CVector3 position;
+    std::memcpy(&position.x, vertex + positionOffset, sizeof(float) * 3);
+    return position;
+}
+
+static bool CheckVertexFormat(const RawVertexFormat& format, std::string& error)
+{
+    if (format.stride < format.positionOffset + sizeof(float) * 3)
+    {
+        error = "Vertex stride is too small to hold a position at the given offset";
+        return false;
+    }
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Bounds and quantisation
+//--------------------------------------------------------------------------------------
+
+// Find the bounds of the positions in a raw vertex file
+bool ComputeBoundsOutOfCore(const std::string& vertexFileName, const RawVertexFormat& format,
+                            const OutOfCoreOptions& options, MeshBounds& bounds, std::string& error)
+{
+    if (!CheckVertexFormat(format, error))  return false;
+    SequentialReader reader;
+    if (!reader.Open(vertexFileName, format.stride, options.memoryBudget / 2, error))  return false;
+
+    bounds = MeshBounds();
+    bounds.numVertices = reader.NumElements();
+    if (bounds.numVertices == 0)  return true;
+
+    bounds.minimum = CVector3(1e30f, 1e30f, 1e30f);
+    bounds.maximum = CVector3(-1e30f, -1e30f, -1e30f);
+    for (uint64_t v = 0; v < bounds.numVertices; ++v)
+    {
+        const uint8_t* vertex = reader.Next();
+        if (vertex == nullptr)
+        {
+            error = "Cannot read " + vertexFileName;
+            return false;
+        }
+        CVector3 p = ReadPosition(vertex, format.positionOffset);
+        bounds.minimum.x = (std::min)(bounds.minimum.x, p.x);  bounds.maximum.x = (std::max)(bounds.maximum.x, p.x);
+        bounds.minimum.y = (std::min)(bounds.minimum.y, p.y);  bounds.maximum.y = (std::max)(bounds.maximum.y, p.y);
+        bounds.minimum.z = (std::min)(bounds.minimum.z, p.z);  bounds.maximum.z = (std::max)(bounds.maximum.z, p.z);
+    }
+    return true;
+}
+
+
+// Write the positions of a raw vertex file as 16-bit integers spread over the given bounds
+bool QuantizePositionsOutOfCore(const std::string& vertexFileName, const RawVertexFormat& format, const MeshBounds& bounds,
+                                const std::string& outVertexFileName, const OutOfCoreOptions& options, std::string& error)
+{
+    if (!CheckVertexFormat(format, error))  return false;
+    SequentialReader reader;
+    if (!reader.Open(vertexFileName, format.stride, options.memoryBudget / 2, error))  return false;
+    BufferedWriter writer;
+    if (!writer.Open(outVertexFileName, ShareOfBudget(options.memoryBudget / 4, 1), error))  return false;
+
+    CVector3 extent = bounds.maximum - bounds.minimum;
+    float maxExtent = (std::max)({ extent.x, extent.y, extent.z });
+    float scale = maxExtent > 0.0f ? 65535.0f / maxExtent : 0.0f;
+
+    for (uint64_t v = 0; v < reader.NumElements(); ++v)
+    {
+        const uint8_t* vertex = reader.Next();
+        if (vertex == nullptr)
+        {
+            error = "Cannot read " + vertexFileName;
+            return false;
+        }
+        CVector3 p = ReadPosition(vertex, format.positionOffset) - bounds.minimum;
+        uint16_t quantized[4] =
+        {
+            static_cast<uint16_t>((std::min)((std::max)(p.x * scale + 0.5f, 0.0f), 65535.0f)),
+            static_cast<uint16_t>((std::min)((std::max)(p.y * scale + 0.5f, 0.0f), 65535.0f)),
+            static_cast<uint16_t>((std::min)((std::max)(p.z * scale + 0.5f, 0.0f), 65535.0f)),
+            0
+        };
+        writer.Write(quantized, sizeof(quantized));
+    }
+    return writer.Close(error);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Welding
+//--------------------------------------------------------------------------------------
+// 1. The vertices are read in order and each is written with its index to one of several bucket
+//    files chosen by a hash of its bytes, so identical vertices go to the same bucket. Buckets
+//    still too large for the budget are split again using different bits of the hash
+// 2. Each bucket is read in order with a hash table of the distinct vertices seen so far. The
+//    first (lowest numbered) copy of a vertex is its "canonical" vertex. A result file of
+//    (vertex, canonical vertex) pairs is written, in vertex order because the buckets are
+//    written in vertex order
+// 3. The result files are merged back into vertex order, in several rounds if there are many
+// 4. The merged pairs are read along with the vertex file. Canonical vertices are written out
+//    and given the next new index. Other vertices take the new index of their canonical vertex,
+//    read back from the part of the remap file already written
+
+// Hash of the bytes of a vertex
+static uint64_t HashBytes(const uint8_t* data, uint32_t size)
+{
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+    uint32_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t chunk;
+        std::memcpy(&chunk, data + i, 8);
+        hash = (hash ^ chunk) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 0x100000001B3ull;
+    }
+    // Final mix so every bit of the input affects every bit of the hash
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+
+// State shared by the welding steps
+struct WeldContext
+{
+    const OutOfCoreOptions* options;
+    uint32_t    stride;
+    uint32_t    recordSize;   // Bucket records are a 32-bit vertex index followed by the vertex
+    uint64_t    bucketLimit;  // Largest bucket file that can be processed in memory, in bytes
+    int         nextTempFile = 0;
+    std::vector<std::string> resultFiles;
+    std::string error;
+
+    std::string TempFileName()
+    {
+        return options->tempDirectory + "/weld_" + std::to_string(nextTempFile++) + ".tmp";
+    }
+};
+
+
+// Split records (from the vertex file if isVertexFile, otherwise from a bucket file) into buckets using the hash bits
+// for the given level. Returns false on failure
+static bool SplitIntoBuckets(WeldContext& context, const std::string& fileName, bool isVertexFile, int level,
+                             std::vector<std::string>& bucketFiles)
+{
+    uint64_t budget = context.options->memoryBudget;
+    SequentialReader reader;
+    uint32_t elementSize = isVertexFile ? context.stride : context.recordSize;
+    if (!reader.Open(fileName, elementSize, budget / 8, context.error))  return false;
+
+    // Aim for half-full buckets to leave room for an uneven split
+    uint64_t recordBytes = reader.NumElements() * context.recordSize;
+    uint64_t numBuckets = (recordBytes * 2 + context.bucketLimit - 1) / context.bucketLimit;
+    numBuckets = (std::min)((std::max)(numBuckets, static_cast<uint64_t>(2)), static_cast<uint64_t>(kMaxBuckets));
+
+    std::vector<BufferedWriter> writers(static_cast<size_t>(numBuckets));
+    bucketFiles.clear();
+    for (auto& writer : writers)
+    {
+        bucketFiles.push_back(context.TempFileName());
+        if (!writer.Open(bucketFiles.back(), ShareOfBudget(budget / 4, writers.size()), context.error))  return false;
+    }
+
+    int shift = 64 - kBucketLevelBits * (level + 1);
+    for (uint64_t e = 0; e < reader.NumElements(); ++e)
+    {
+        const uint8_t* element = reader.Next();
+        if (element == nullptr)
+        {
+            context.error = "Cannot read " + fileName;
+            return false;
+        }
+        const uint8_t* vertex = isVertexFile ? element : element + sizeof(uint32_t);
+        uint64_t bucket = ((HashBytes(vertex, context.stride) >> shift) & ((1u << kBucketLevelBits) - 1)) % numBuckets;
+        if (isVertexFile)
+        {
+            uint32_t index = static_cast<uint32_t>(e);
+            writers[bucket].Write(&index, sizeof(index));
+            writers[bucket].Write(vertex, context.stride);
+        }
+        else
+        {
+            writers[bucket].Write(element, context.recordSize);
+        }
+    }
+
+    for (auto& writer : writers)
+    {
+        if (!writer.Close(context.error))  return false;
+    }
+    return true;
+}
+
+
+// Find the canonical vertex for each record in a bucket, writing (vertex, canonical vertex) pairs to a result file
+static bool WeldBucket(WeldContext& context, const std::string& bucketFileName)
+{
+    uint64_t budget = context.options->memoryBudget;
+    SequentialReader reader;
+    if (!reader.Open(bucketFileName, context.recordSize, budget / 8, context.error))  return false;
+    BufferedWriter writer;
+    context.resultFiles.push_back(context.TempFileName());
+    if (!writer.Open(context.resultFiles.back(), ShareOfBudget(budget / 16, 1), context.error))  return false;
+
+    // Open addressing hash table of distinct records, at most half full. Grows as needed - a bucket within the limit
+    // will not grow it past the budget, an oversized bucket that could not be split has few distinct vertices
+    std::vector<uint8_t>  distinct;  // Copies of the distinct records
+    std::vector<uint32_t> table(1024, kNoVertex); // Position in distinct / recordSize
+    size_t numDistinct = 0;
+
+    for (uint64_t r = 0; r < reader.NumElements(); ++r)
+    {
+        const uint8_t* record = reader.Next();
+        if (record == nullptr)
+        {
+            context.error = "Cannot read " + bucketFileName;
+            return false;
+        }
+        const uint8_t* vertex = record + sizeof(uint32_t);
+
+        if (numDistinct * 2 >= table.size())
+        {
+            table.assign(table.size() * 2, kNoVertex);
+            for (size_t d = 0; d < numDistinct; ++d)
+            {
+                const uint8_t* stored = &distinct[d * context.recordSize];
+                size_t slot = HashBytes(stored + sizeof(uint32_t), context.stride) & (table.size() - 1);
+                while (table[slot] != kNoVertex)  slot = (slot + 1) & (table.size() - 1);
+                table[slot] = static_cast<uint32_t>(d);
+            }
+        }
+
+        size_t slot = HashBytes(vertex, context.stride) & (table.size() - 1);
+        uint32_t canonical = kNoVertex;
+        while (table[slot] != kNoVertex)
+        {
+            const uint8_t* stored = &distinct[static_cast<size_t>(table[slot]) * context.recordSize];
+            if (std::memcmp(stored + sizeof(uint32_t), vertex, context.stride) == 0)
+            {
+                std::memcpy(&canonical, stored, sizeof(uint32_t));
+                break;
+            }
+            slot = (slot + 1) & (table.size() - 1);
+        }
+        if (canonical == kNoVertex)
+        {
+            // First copy of this vertex
+            table[slot] = static_cast<uint32_t>(numDistinct++);
+            distinct.insert(distinct.end(), record, record + context.recordSize);
+            std::memcpy(&canonical, record, sizeof(uint32_t));
+        }
+
+        uint32_t pair[2];
+        std::memcpy(&pair[0], record, sizeof(uint32_t));
+        pair[1] = canonical;
+        writer.Write(pair, sizeof(pair));
+    }
+    reader.Close();
+    std::remove(bucketFileName.c_str());
+    return writer.Close(context.error);
+}
+
+
+// Weld the records in a bucket file, splitting it further first if it is too large
+static bool WeldBucketFile(WeldContext& context, const std::string& bucketFileName, uint64_t bucketSize, int level)
+{
+    if (bucketSize <= context.bucketLimit || level >= kMaxBucketLevels)
+    {
+        return WeldBucket(context, bucketFileName);
+    }
+
+    std::vector<std::string> subBuckets;
+    if (!SplitIntoBuckets(context, bucketFileName, false, level, subBuckets))  return false;
+    std::remove(bucketFileName.c_str());
+
+    for (auto& subBucket : subBuckets)
+    {
+        MappedFile file;
+        if (!file.Open(subBucket, MappedFile::Access::Read))
+        {
+            context.error = "Cannot read " + subBucket;
+            return false;
+        }
+        uint64_t subBucketSize = file.Size();
+        file.Close();
+
+        // If the split did not help, the records share their hash so are probably all the same vertex
+        bool noProgress = (subBucketSize == bucketSize);
+        if (!WeldBucketFile(context, subBucket, subBucketSize, noProgress ? kMaxBucketLevels : level + 1))  return false;
+    }
+    return true;
+}
+
+
+// Merge files of (vertex, canonical vertex) pairs, each in vertex order, calling output for each pair in vertex order
+static bool MergePairFiles(WeldContext& context, const std::vector<std::string>& fileNames, uint64_t budgetPart,
+                           const std::function<void(const uint32_t* pair)>& output)
+{
+    std::vector<SequentialReader> readers(fileNames.size());
+    std::vector<const uint32_t*>  current(fileNames.size());
+
+    typedef std::pair<uint32_t, size_t> HeapEntry; // Vertex index and file
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+    for (size_t f = 0; f < fileNames.size(); ++f)
+    {
+        if (!readers[f].Open(fileNames[f], sizeof(uint32_t) * 2, ShareOfBudget(budgetPart, fileNames.size()), context.error))
+        {
+            return false;
+        }
+        current[f] = reinterpret_cast<const uint32_t*>(readers[f].Next());
+        if (current[f] != nullptr)  heap.push(HeapEntry(current[f][0], f));
+    }
+
+    while (!heap.empty())
+    {
+        size_t f = heap.top().second;
+        heap.pop();
+        output(current[f]);
+        current[f] = reinterpret_cast<const uint32_t*>(readers[f].Next());
+        if (current[f] != nullptr)  heap.push(HeapEntry(current[f][0], f));
+    }
+
+    for (size_t f = 0; f < fileNames.size(); ++f)
+    {
+        readers[f].Close();
+        std::remove(fileNames[f].c_str());
+    }
+    return true;
+}
+
+
+// Merge vertices whose bytes are identical
+bool WeldVerticesOutOfCore(const std::string& vertexFileName, uint32_t vertexStride, const std::string& outVertexFileName,
+                           const std::string& remapFileName, const OutOfCoreOptions& options,
+                           uint64_t& numWeldedVertices, std::string& error)
+{
+    numWeldedVertices = 0;
+    if (vertexStride == 0)
+    {
+        error = "Vertex stride must not be zero";
+        return false;
+    }
+
+    WeldContext context;
+    context.options    = &options;
+    context.stride     = vertexStride;
+    context.recordSize = vertexStride + sizeof(uint32_t);
+
+    // A bucket needs memory for its distinct records plus a hash table of up to four bytes for each of twice as many
+    // records, in half the budget
+    uint64_t maxRecords = (options.memoryBudget / 2) / (context.recordSize + 8);
+    context.bucketLimit = (std::max)(maxRecords, static_cast<uint64_t>(1)) * context.recordSize;
+
+    uint64_t numVertices = 0;
+    {
+        MappedFile file;
+        if (!file.Open(vertexFileName, MappedFile::Access::Read))
+        {
+            error = "Cannot read " + vertexFileName;
+            return false;
+        }
+        if (file.Size() % vertexStride != 0)
+        {
+            error = vertexFileName + ": size is not a multiple of the vertex stride";
+            return false;
+        }
+        numVertices = file.Size() / vertexStride;
+    }
+    if (numVertices >= kNoVertex)
+    {
+        error = vertexFileName + ": too many vertices for 32-bit indices";
+        return false;
+    }
+
+    // Steps 1 and 2 - buckets
+    std::vector<std::string> buckets;
+    bool ok = SplitIntoBuckets(context, vertexFileName, true, 0, buckets);
+    for (size_t b = 0; ok && b < buckets.size(); ++b)
+    {
+        MappedFile file;
+        ok = file.Open(buckets[b], MappedFile::Access::Read);
+        if (!ok)
+        {
+            context.error = "Cannot read " + buckets[b];
+            break;
+        }
+        uint64_t size = file.Size();
+        file.Close();
+        ok = WeldBucketFile(context, buckets[b], size, 1);
+    }
+
+    // Step 3 - merge result files until few enough remain to merge in the final pass
+    while (ok && context.resultFiles.size() > static_cast<size_t>(kMaxMergeFiles))
+    {
+        std::vector<std::string> merged;
+        for (size_t first = 0; ok && first < context.resultFiles.size(); first += kMaxMergeFiles)
+        {
+            size_t last = (std::min)(first + kMaxMergeFiles, context.resultFiles.size());
+            std::vector<std::string> group(context.resultFiles.begin() + first, context.resultFiles.begin() + last);
+            merged.push_back(context.TempFileName());
+            BufferedWriter writer;
+            ok = writer.Open(merged.back(), ShareOfBudget(options.memoryBudget / 8, 1), context.error) &&
+                 MergePairFiles(context, group, options.memoryBudget / 2,
+                                [&](const uint32_t* pair) { writer.Write(pair, sizeof(uint32_t) * 2); }) &&
+                 writer.Close(context.error);
+        }
+        context.resultFiles.swap(merged);
+    }
+
+    // Step 4 - write the welded vertices and the remap table
+    if (ok)
+    {
+        SequentialReader vertexReader;
+        BufferedWriter   vertexWriter;
+        MappedFile        remapFile;
+        MappedWindowCache remap;
+        ok = vertexReader.Open(vertexFileName, vertexStride, options.memoryBudget / 8, context.error) &&
+             vertexWriter.Open(outVertexFileName, ShareOfBudget(options.memoryBudget / 16, 1), context.error);
+        if (ok && !remapFile.Open(remapFileName, MappedFile::Access::ReadWrite, numVertices * sizeof(uint32_t)))
+        {
+            context.error = "Cannot write " + remapFileName;
+            ok = false;
+        }
+        if (ok && numVertices > 0)
+        {
+            const int kRemapWindows = 16;
+            remap.Init(remapFile, kRemapWindows, ShareOfBudget(options.memoryBudget / 4, kRemapWindows),
+                       sizeof(uint32_t));
+
+            uint32_t nextIndex = 0;
+            uint64_t numMerged = 0;
+            bool mapFailed = false;
+            ok = MergePairFiles(context, context.resultFiles, options.memoryBudget / 4, [&](const uint32_t* pair)
+            {
+                const uint8_t* vertex = vertexReader.Next();
+                uint8_t* canonicalEntry = remap.Get(static_cast<uint64_t>(pair[1]) * sizeof(uint32_t));
+                if (vertex == nullptr || canonicalEntry == nullptr)
+                {
+                    mapFailed = true;
+                    return;
+                }
+                uint32_t newIndex;
+                if (pair[1] == pair[0])
+                {
+                    vertexWriter.Write(vertex, vertexStride);
+                    newIndex = nextIndex++;
+                }
+                else
+                {
+                    std::memcpy(&newIndex, canonicalEntry, sizeof(uint32_t));
+                }
+                remap.Write<uint32_t>(pair[0], newIndex);
+                ++numMerged;
+            });
+            if (ok && (mapFailed || numMerged != numVertices))
+            {
+                context.error = "Cannot access temporary files in " + options.tempDirectory;
+                ok = false;
+            }
+            numWeldedVertices = nextIndex;
+        }
+        remap.Clear();
+        remapFile.Close();
+        vertexReader.Close();
+        ok = vertexWriter.Close(context.error) && ok;
+    }
+
+    // Temporary files left behind by a failure
+    for (auto& fileName : context.resultFiles)  std::remove(fileName.c_str());
+    for (int t = 0; t < context.nextTempFile; ++t)
+    {
+        std::remove((options.tempDirectory + "/weld_" + std::to_string(t) + ".tmp").c_str());
+    }
+
+    if (!ok)  error = context.error;
+    return ok;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Index remapping
+//--------------------------------------------------------------------------------------
+
+// Renumber the indices in a raw index file using a remap file
+bool RemapIndicesOutOfCore(const std::string& indexFileName, uint32_t indexSize, const std::string& remapFileName,
+                           const std::string& outIndexFileName, bool dropDegenerate, const OutOfCoreOptions& options,
+                           uint64_t& numOutIndices, std::string& error)
+{
+    numOutIndices = 0;
+    if (indexSize != 2 && indexSize != 4)
+    {
+        error = "Index size must be 2 or 4";
+        return false;
+    }
+
+    // Whole triangles are read at once when dropping degenerates
+    uint32_t groupSize = dropDegenerate ? 3 : 1;
+    SequentialReader reader;
+    if (!reader.Open(indexFileName, indexSize * groupSize, options.memoryBudget / 4, error))  return false;
+
+    MappedFile remapFile;
+    if (!remapFile.Open(remapFileName, MappedFile::Access::Read))
+    {
+        error = "Cannot read " + remapFileName;
+        return false;
+    }
+    uint64_t numRemap = remapFile.Size() / sizeof(uint32_t);
+    const int kRemapWindows = 16;
+    MappedWindowCache remap;
+    remap.Init(remapFile, kRemapWindows, ShareOfBudget(options.memoryBudget / 2, kRemapWindows), sizeof(uint32_t));
+
+    BufferedWriter writer;
+    if (!writer.Open(outIndexFileName, ShareOfBudget(options.memoryBudget / 8, 1), error))  return false;
+
+    uint64_t maxIndex = (indexSize == 2) ? 0xFFFF : 0xFFFFFFFF;
+    for (uint64_t g = 0; g < reader.NumElements(); ++g)
+    {
+        const uint8_t* group = reader.Next();
+        if (group == nullptr)
+        {
+            error = "Cannot read " + indexFileName;
+            return false;
+        }
+
+        uint32_t remapped[3];
+        for (uint32_t i = 0; i < groupSize; ++i)
+        {
+            uint32_t index = 0;
+            if (indexSize == 2)
+            {
+                uint16_t index16;
+                std::memcpy(&index16, group + i * 2, 2);
+                index = index16;
+            }
+            else
+            {
+                std::memcpy(&index, group + i * 4, 4);
+            }
+            const uint8_t* entry = (index < numRemap) ? remap.Get(static_cast<uint64_t>(index) * sizeof(uint32_t)) : nullptr;
+            if (entry == nullptr)
+            {
+                error = indexFileName + ": index " + std::to_string(index) + " is outside the remap table";
+                return false;
+            }
+            std::memcpy(&remapped[i], entry, sizeof(uint32_t));
+            if (remapped[i] > maxIndex)
+            {
+                error = "Remapped index " + std::to_string(remapped[i]) + " does not fit in the index size";
+                return false;
+            }
+        }
+
+        if (dropDegenerate && (remapped[0] == remapped[1] || remapped[1] == remapped[2] || remapped[2] == remapped[0]))
+        {
+            continue;
+        }
+        for (uint32_t i = 0; i < groupSize; ++i)
+        {
+            if (indexSize == 2)
+            {
+                uint16_t index16 = static_cast<uint16_t>(remapped[i]);
+                writer.Write(&index16, 2);
+            }
+            else
+            {
+                writer.Write(&remapped[i], 4);
+            }
+        }
+        numOutIndices += groupSize;
+    }
+    return writer.Close(error);
+}
@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------------------
+// Out-of-core processing of meshes too large to load into memory
+//--------------------------------------------------------------------------------------
+// Scanned or generated meshes can have vertex and index buffers of tens or hundreds of GB. The
+// functions here work on raw vertex and index buffer files (the same layout as LoadRawMesh) by
+// mapping a bounded window of each file at a time (see MappedFile.h), so the memory used stays
+// within a budget set by the caller whatever the size of the input:
+// - Bounds: one sequential pass over the positions
+// - Quantisation: positions converted to 16-bit integers relative to the bounds, written as a
+//   new vertex file. Welding the quantised file merges vertices that are within one grid step
+//   of each other, which is the usual way to weld with a tolerance
+// - Welding: vertices with identical bytes are merged. Vertices are split by a hash of their
+//   contents into bucket files small enough to hold in memory, duplicates are found in each
+//   bucket, and the results are merged back into vertex order. Produces the welded vertex file
+//   and a remap file giving the new index of each original vertex
+// - Index remapping: indices renumbered through a remap file (from welding or any other step),
+//   optionally dropping triangles that welding has made degenerate
+//
+// Temporary files go in a folder given by the caller and are deleted afterwards. The functions
+// return false and set an error message if a file cannot be read or written.
+
+#ifndef _OUT_OF_CORE_MESH_H_INCLUDED_
+#define _OUT_OF_CORE_MESH_H_INCLUDED_
+
+#include "MeshData.h"
+#include <string>
+
+// Settings shared by the out-of-core functions
+struct OutOfCoreOptions
+{
+    uint64_t    memoryBudget  = 256ull << 20; // Approximate peak memory for file windows and buffers, in bytes
+    std::string tempDirectory = ".";          // Folder for temporary files, needs space for about twice the input
+};
+
+// Layout of a raw vertex buffer file
+struct RawVertexFormat
+{
+    uint32_t stride         = 28; // Bytes per vertex, default is SimpleVertex
+    uint32_t positionOffset = 0;  // Offset of the float x,y,z position in each vertex
+};
+
+// Axis-aligned bounds of a set of positions
+struct MeshBounds
+{
+    CVector3 minimum = CVector3(0.0f, 0.0f, 0.0f);
+    CVector3 maximum = CVector3(0.0f, 0.0f, 0.0f);
+    uint64_t numVertices = 0;
+};
+
+
+// Find the bounds of the positions in a raw vertex file
+bool ComputeBoundsOutOfCore(const std::string& vertexFileName, const RawVertexFormat& format,
+                            const OutOfCoreOptions& options, MeshBounds& bounds, std::string& error);
+
+// Write the positions of a raw vertex file as 16-bit unsigned integers x,y,z,0 (8 bytes per vertex, suitable for
+// DXGI_FORMAT_R16G16B16A16_UNORM) spread over the given bounds. The same scale is used on every axis so the shape is
+// not distorted. The grid step is (largest bounds extent / 65535)
+bool QuantizePositionsOutOfCore(const std::string& vertexFileName, const RawVertexFormat& format, const MeshBounds& bounds,
+                                const std::string& outVertexFileName, const OutOfCoreOptions& options, std::string& error);
+
+// Merge vertices whose bytes are identical. Writes the remaining vertices, in their original order, to outVertexFile and
+// a table of 32-bit indices to remapFile giving the new index of each original vertex. The input can have up to 2^32 - 1
+// vertices. numWeldedVertices is set to the number of vertices written
+bool WeldVerticesOutOfCore(const std::string& vertexFileName, uint32_t vertexStride, const std::string& outVertexFileName,
+                           const std::string& remapFileName, const OutOfCoreOptions& options,
+                           uint64_t& numWeldedVertices, std::string& error);
+
+// Renumber the indices in a raw index file (indexSize 2 or 4) using a remap file of 32-bit indices, writing the result
+// with the same index size. If dropDegenerate is true the indices are a triangle list and triangles left with a
+// repeated vertex are not written. numOutIndices is set to the number of indices written
+bool RemapIndicesOutOfCore(const std::string& indexFileName, uint32_t indexSize, const std::string& remapFileName,
+                           const std::string& outIndexFileName, bool dropDegenerate, const OutOfCoreOptions& options,
+                           uint64_t& numOutIndices, std::string& error);
+
+
+#endif //_OUT_OF_CORE_MESH_H_INCLUDED_
@@ -0,0 +1,148 @@
+//--------------------------------------------------------------------------------------
+// CPU skinning - animating meshes by blending bone matrices
+//--------------------------------------------------------------------------------------
+
+#include "Skinning.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+#include <cstring>
+
+#ifdef CPU_FEATURES_X86
+#include <immintrin.h>
+#endif
+
+const size_t kSkinningChunk = 4096; // Vertices skinned by one task
+const float  kWeightScale   = 1.0f / 255.0f;
+
+
+//--------------------------------------------------------------------------------------
+// Scalar
+//--------------------------------------------------------------------------------------
+
+static void SkinRangeScalar(const SkinnedVertex* vertices, size_t begin, size_t end, const float* boneMatrices,
+                            const SkinningTarget& target)
+{
+    uint8_t* outPositions = static_cast<uint8_t*>(target.positions);
+    uint8_t* outNormals   = static_cast<uint8_t*>(target.normals);
+    for (size_t v = begin; v < end; ++v)
+    {
+        const SkinnedVertex& vertex = vertices[v];
+
+        // Weighted sum of the bone matrices. The fourth column is not used, an affine matrix has 0,0,0,1 there
+        float m[16] = {};
+        for (int b = 0; b < 4; ++b)
+        {
+            float weight = vertex.boneWeights[b] * kWeightScale;
+            const float* bone = boneMatrices + vertex.boneIndices[b] * 16;
+            for (int e = 0; e < 16; ++e)  m[e] += weight * bone[e];
+        }
+
+        const CVector3& p = vertex.position;
+        float position[3] = { p.x * m[0] + p.y * m[4] + p.z * m[8]  + m[12],
+                              p.x * m[1] + p.y * m[5] + p.z * m[9]  + m[13],
+                              p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14] };
+        std::memcpy(outPositions + v * target.stride, position, sizeof(position));
+
+        if (outNormals != nullptr)
+        {
+            const CVector3& n = vertex.normal;
+            float normal[3] = { n.x * m[0] + n.y * m[4] + n.z * m[8],
+                                n.x * m[1] + n.y * m[5] + n.z * m[9],
+                                n.x * m[2] + n.y * m[6] + n.z * m[10] };
+            std::memcpy(outNormals + v * target.stride, normal, sizeof(normal));
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// AVX2
+//--------------------------------------------------------------------------------------
+#ifdef CPU_FEATURES_X86
+
+// A bone matrix is held in two registers: rows 0 and 1 in the first, rows 2 and 3 in the second. The blend is then two
+// fused multiply-adds per bone. To transform a position the first register is multiplied by (x,x,x,x, y,y,y,y) and the
+// second by (z,z,z,z, 1,1,1,1), so adding the two halves of the sum gives x*row0 + y*row1 + z*row2 + row3
+AVX2_FUNCTION
+static void SkinRangeAvx2(const SkinnedVertex* vertices, size_t begin, size_t end, const float* boneMatrices,
+                          const SkinningTarget& target)
+{
+    uint8_t* outPositions = static_cast<uint8_t*>(target.positions);
+    uint8_t* outNormals   = static_cast<uint8_t*>(target.normals);
+    const __m256 one  = _mm256_set1_ps(1.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    for (size_t v = begin; v < end; ++v)
+    {
+        const SkinnedVertex& vertex = vertices[v];
+
+        const float* bone0 = boneMatrices + vertex.boneIndices[0] * 16;
+        const float* bone1 = boneMatrices + vertex.boneIndices[1] * 16;
+        const float* bone2 = boneMatrices + vertex.boneIndices[2] * 16;
+        const float* bone3 = boneMatrices + vertex.boneIndices[3] * 16;
+        __m256 weight0 = _mm256_set1_ps(vertex.boneWeights[0] * kWeightScale);
+        __m256 weight1 = _mm256_set1_ps(vertex.boneWeights[1] * kWeightScale);
+        __m256 weight2 = _mm256_set1_ps(vertex.boneWeights[2] * kWeightScale);
+        __m256 weight3 = _mm256_set1_ps(vertex.boneWeights[3] * kWeightScale);
+
+        __m256 rows01 = _mm256_mul_ps(weight0, _mm256_loadu_ps(bone0));
+        __m256 rows23 = _mm256_mul_ps(weight0, _mm256_loadu_ps(bone0 + 8));
+        rows01 = _mm256_fmadd_ps(weight1, _mm256_loadu_ps(bone1),     rows01);
+        rows23 = _mm256_fmadd_ps(weight1, _mm256_loadu_ps(bone1 + 8), rows23);
+        rows01 = _mm256_fmadd_ps(weight2, _mm256_loadu_ps(bone2),     rows01);
+        rows23 = _mm256_fmadd_ps(weight2, _mm256_loadu_ps(bone2 + 8), rows23);
+        rows01 = _mm256_fmadd_ps(weight3, _mm256_loadu_ps(bone3),     rows01);
+        rows23 = _mm256_fmadd_ps(weight3, _mm256_loadu_ps(bone3 + 8), rows23);
+
+        const CVector3& p = vertex.position;
+        __m256 xy = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(p.x)), _mm_set1_ps(p.y), 1);
+        __m256 z1 = _mm256_blend_ps(_mm256_set1_ps(p.z), one, 0xF0);
+        __m256 sum = _mm256_fmadd_ps(rows01, xy, _mm256_mul_ps(rows23, z1));
+        __m128 position = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        float result[4];
+        _mm_storeu_ps(result, position);
+        std::memcpy(outPositions + v * target.stride, result, sizeof(float) * 3);
+
+        if (outNormals != nullptr)
+        {
+            const CVector3& n = vertex.normal;
+            xy = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(n.x)), _mm_set1_ps(n.y), 1);
+            __m256 z0 = _mm256_blend_ps(_mm256_set1_ps(n.z), zero, 0xF0);
+            sum = _mm256_fmadd_ps(rows01, xy, _mm256_mul_ps(rows23, z0));
+            __m128 normal = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+            _mm_storeu_ps(result, normal);
+            std::memcpy(outNormals + v * target.stride, result, sizeof(float) * 3);
+        }
+    }
+}
+
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Skinning
+//--------------------------------------------------------------------------------------
+
+SkinningPath DefaultSkinningPath()
+{
+    return CpuHasAvx2() ? SkinningPath::Avx2 : SkinningPath::Scalar;
+}
+
+
+// Skin vertices using a palette of bone matrices
+void SkinVertices(const SkinnedVertex* vertices, size_t numVertices, const float* boneMatrices,
+                  const SkinningTarget& target, SkinningPath path)
+{
+    if (path == SkinningPath::Auto)  path = DefaultSkinningPath();
+
+    ParallelFor(numVertices, kSkinningChunk, [&](size_t begin, size_t end, int)
+    {
+#ifdef CPU_FEATURES_X86
+        if (path == SkinningPath::Avx2)
+        {
+            SkinRangeAvx2(vertices, begin, end, boneMatrices, target);
+            return;
+        }
+#endif
+        SkinRangeScalar(vertices, begin, end, boneMatrices, target);
+    });
+}
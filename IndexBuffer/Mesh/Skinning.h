@@ -0,0 +1,57 @@
+//--------------------------------------------------------------------------------------
+// CPU skinning - animating meshes by blending bone matrices
+//--------------------------------------------------------------------------------------
+// A skinned mesh is modelled in a "bind pose" with a skeleton of bones. When the skeleton is
+// animated, each vertex moves with the bones it is attached to (see SkinnedVertex in
+// VertexFormats.h). Linear blend skinning transforms the vertex by each of its bones' matrices
+// and blends the results by the weights, which is the same as transforming by the weighted sum
+// of the matrices:
+//     skinned = position * (w0 * M[b0] + w1 * M[b1] + w2 * M[b2] + w3 * M[b3])
+// Each bone matrix M takes a vertex from the bind pose to the animated pose, i.e.
+//     M = inverse(bone's world matrix in the bind pose) * bone's current world matrix
+// The matrices are in the row vector convention of CMatrix4x4 (16 floats, translation in the
+// last row), so an array of CMatrix4x4 can be passed as &matrices[0].e00.
+//
+// Skinning on the CPU rather than in the vertex shader suits meshes drawn in several passes
+// (skinned once, drawn many times) and CPU work that needs the animated positions (collision,
+// culling). The results are written straight into a mapped dynamic vertex buffer.
+//
+// The blend uses AVX2: one 8-float register holds half a bone matrix, so each bone is two fused
+// multiply-adds. Machines without AVX2 use plain C++. Vertices are split across the shared
+// thread pool. Normals are transformed by the blended matrix without renormalising, which is
+// correct for rotations and uniform scales - normalise them in the shader.
+
+#ifndef _SKINNING_H_INCLUDED_
+#define _SKINNING_H_INCLUDED_
+
+#include "VertexFormats.h"
+#include <cstddef>
+
+// Where skinned positions and normals are written, e.g. the members of a vertex structure in a mapped vertex buffer.
+// Positions and normals are three floats each and need not be aligned
+struct SkinningTarget
+{
+    void*  positions; // First position
+    void*  normals;   // First normal, or nullptr if normals are not needed
+    size_t stride;    // Bytes from one vertex to the next
+};
+
+// Version of the skinning code to use
+enum class SkinningPath
+{
+    Auto,   // AVX2 if the processor supports it, otherwise Scalar
+    Scalar,
+    Avx2,   // Must only be selected if CpuHasAvx2() is true
+};
+
+
+// Skin vertices using a palette of bone matrices (16 floats each). Every bone index in the vertices must be less than
+// the number of matrices. Uses the shared thread pool
+void SkinVertices(const SkinnedVertex* vertices, size_t numVertices, const float* boneMatrices,
+                  const SkinningTarget& target, SkinningPath path = SkinningPath::Auto);
+
+// The path that Auto selects on this machine
+SkinningPath DefaultSkinningPath();
+
+
+#endif //_SKINNING_H_INCLUDED_
@@ -0,0 +1,294 @@
+//--------------------------------------------------------------------------------------
+// CPU triangle culling - removes triangles that cannot produce pixels before drawing
+//--------------------------------------------------------------------------------------
+
+#include "TriangleCulling.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define TRIANGLE_CULLING_SSE
+#include <emmintrin.h>
+#endif
+
+const size_t kChunkTriangles = 16384; // Triangles culled by one task
+const float  kMaxScreenCoord = 1e6f;  // Screen coordinates are clamped to this before rounding to whole pixels
+
+// Why a triangle was removed, in the order the tests are counted
+enum CullResult
+{
+    kVisible,
+    kOffScreen,
+    kFacingAway,
+    kZeroArea,
+    kSmall,
+};
+
+
+TriangleCullStats& TriangleCullStats::operator+=(const TriangleCullStats& other)
+{
+    numTriangles  += other.numTriangles;
+    numOffScreen  += other.numOffScreen;
+    numFacingAway += other.numFacingAway;
+    numZeroArea   += other.numZeroArea;
+    numSmall      += other.numSmall;
+    numVisible    += other.numVisible;
+    return *this;
+}
+
+static void CountResult(CullResult result, TriangleCullStats& stats)
+{
+    switch (result)
+    {
+        case kVisible:    ++stats.numVisible;    break;
+        case kOffScreen:  ++stats.numOffScreen;  break;
+        case kFacingAway: ++stats.numFacingAway; break;
+        case kZeroArea:   ++stats.numZeroArea;   break;
+        case kSmall:      ++stats.numSmall;      break;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Transformation
+//--------------------------------------------------------------------------------------
+
+// Transform positions into clip space
+void TransformToClipSpace(const PositionArray& positions, const float* m, ClipPosition* clipPositions)
+{
+    ParallelFor(positions.Size(), 16384, [&](size_t begin, size_t end, int)
+    {
+        for (size_t v = begin; v < end; ++v)
+        {
+            const CVector3& p = positions[v];
+            ClipPosition& c = clipPositions[v];
+            c.x = p.x * m[0] + p.y * m[4] + p.z * m[8]  + m[12];
+            c.y = p.x * m[1] + p.y * m[5] + p.z * m[9]  + m[13];
+            c.z = p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14];
+            c.w = p.x * m[3] + p.y * m[7] + p.z * m[11] + m[15];
+        }
+    });
+}
+
+
+//--------------------------------------------------------------------------------------
+// Single triangle tests
+//--------------------------------------------------------------------------------------
+// Used for the triangles left over after groups of four, and for all triangles where SSE is not available. Gives exactly
+// the same results as the SSE version, the calculations are done in the same order
+
+static CullResult CullTriangle(const ClipPosition& p0, const ClipPosition& p1, const ClipPosition& p2,
+                               const TriangleCullOptions& options)
+{
+    if (options.cullOffScreen)
+    {
+        if ((p0.x >  p0.w && p1.x >  p1.w && p2.x >  p2.w) || (p0.x < -p0.w && p1.x < -p1.w && p2.x < -p2.w) ||
+            (p0.y >  p0.w && p1.y >  p1.w && p2.y >  p2.w) || (p0.y < -p0.w && p1.y < -p1.w && p2.y < -p2.w) ||
+            (p0.z >  p0.w && p1.z >  p1.w && p2.z >  p2.w) || (p0.z < 0.0f  && p1.z < 0.0f  && p2.z < 0.0f))
+        {
+            return kOffScreen;
+        }
+    }
+
+    // Negative for clockwise (front facing) triangles
+    float det = p0.x * (p1.y * p2.w - p2.y * p1.w) - p1.x * (p0.y * p2.w - p2.y * p0.w) + p2.x * (p0.y * p1.w - p1.y * p0.w);
+    if ((options.cullFace == CullFace::Back && det > 0.0f) || (options.cullFace == CullFace::Front && det < 0.0f))
+    {
+        return kFacingAway;
+    }
+    if (options.cullZeroArea && det == 0.0f)  return kZeroArea;
+
+    if (options.cullSmall && p0.w > 0.0f && p1.w > 0.0f && p2.w > 0.0f)
+    {
+        float halfWidth = options.viewportWidth * 0.5f, halfHeight = options.viewportHeight * 0.5f;
+        float x0 = (p0.x / p0.w) * halfWidth  + halfWidth,  x1 = (p1.x / p1.w) * halfWidth  + halfWidth;
+        float x2 = (p2.x / p2.w) * halfWidth  + halfWidth;
+        float y0 = (p0.y / p0.w) * halfHeight + halfHeight, y1 = (p1.y / p1.w) * halfHeight + halfHeight;
+        float y2 = (p2.y / p2.w) * halfHeight + halfHeight;
+        auto pixelEdge = [](float v) { return std::nearbyint((std::min)((std::max)(v, -kMaxScreenCoord), kMaxScreenCoord)); };
+        if (pixelEdge((std::min)((std::min)(x0, x1), x2)) == pixelEdge((std::max)((std::max)(x0, x1), x2)) ||
+            pixelEdge((std::min)((std::min)(y0, y1), y2)) == pixelEdge((std::max)((std::max)(y0, y1), y2)))
+        {
+            return kSmall;
+        }
+    }
+    return kVisible;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Four triangle tests
+//--------------------------------------------------------------------------------------
+#ifdef TRIANGLE_CULLING_SSE
+
+// Test four triangles. Writes the result for each to results[0..3]
+static void CullFourTriangles(const ClipPosition* clipPositions, const MeshIndex* indices,
+                              const TriangleCullOptions& options, CullResult* results)
+{
+    // Load the corners of the four triangles and rearrange so each register holds one component of one corner for all
+    // four triangles (X[0] holds the x of the first corner of each triangle)
+    __m128 X[3], Y[3], Z[3], W[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        __m128 p0 = _mm_loadu_ps(&clipPositions[indices[c    ]].x);
+        __m128 p1 = _mm_loadu_ps(&clipPositions[indices[c + 3]].x);
+        __m128 p2 = _mm_loadu_ps(&clipPositions[indices[c + 6]].x);
+        __m128 p3 = _mm_loadu_ps(&clipPositions[indices[c + 9]].x);
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        X[c] = p0;  Y[c] = p1;  Z[c] = p2;  W[c] = p3;
+    }
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    __m128 remaining = _mm_castsi128_ps(_mm_set1_epi32(-1)); // Lanes not yet culled
+
+    __m128 offScreen = zero;
+    if (options.cullOffScreen)
+    {
+        __m128 nW[3];
+        for (int c = 0; c < 3; ++c)  nW[c] = _mm_xor_ps(W[c], signBit);
+        auto all3 = [](__m128 a, __m128 b, __m128 c) { return _mm_and_ps(_mm_and_ps(a, b), c); };
+        offScreen = _mm_or_ps(all3(_mm_cmpgt_ps(X[0],  W[0]), _mm_cmpgt_ps(X[1],  W[1]), _mm_cmpgt_ps(X[2],  W[2])),
+                              all3(_mm_cmplt_ps(X[0], nW[0]), _mm_cmplt_ps(X[1], nW[1]), _mm_cmplt_ps(X[2], nW[2])));
+        offScreen = _mm_or_ps(offScreen,
+                    _mm_or_ps(all3(_mm_cmpgt_ps(Y[0],  W[0]), _mm_cmpgt_ps(Y[1],  W[1]), _mm_cmpgt_ps(Y[2],  W[2])),
+                              all3(_mm_cmplt_ps(Y[0], nW[0]), _mm_cmplt_ps(Y[1], nW[1]), _mm_cmplt_ps(Y[2], nW[2]))));
+        offScreen = _mm_or_ps(offScreen,
+                    _mm_or_ps(all3(_mm_cmpgt_ps(Z[0],  W[0]), _mm_cmpgt_ps(Z[1],  W[1]), _mm_cmpgt_ps(Z[2],  W[2])),
+                              all3(_mm_cmplt_ps(Z[0], zero),  _mm_cmplt_ps(Z[1], zero),  _mm_cmplt_ps(Z[2], zero))));
+        remaining = _mm_andnot_ps(offScreen, remaining);
+    }
+
+    // Determinant, negative for clockwise (front facing) triangles
+    __m128 det = _mm_sub_ps(_mm_mul_ps(X[0], _mm_sub_ps(_mm_mul_ps(Y[1], W[2]), _mm_mul_ps(Y[2], W[1]))),
+                            _mm_mul_ps(X[1], _mm_sub_ps(_mm_mul_ps(Y[0], W[2]), _mm_mul_ps(Y[2], W[0]))));
+    det = _mm_add_ps(det, _mm_mul_ps(X[2], _mm_sub_ps(_mm_mul_ps(Y[0], W[1]), _mm_mul_ps(Y[1], W[0]))));
+
+    __m128 facingAway = zero;
+    if      (options.cullFace == CullFace::Back)   facingAway = _mm_and_ps(_mm_cmpgt_ps(det, zero), remaining);
+    else if (options.cullFace == CullFace::Front)  facingAway = _mm_and_ps(_mm_cmplt_ps(det, zero), remaining);
+    remaining = _mm_andnot_ps(facingAway, remaining);
+
+    __m128 zeroArea = zero;
+    if (options.cullZeroArea)
+    {
+        zeroArea = _mm_and_ps(_mm_cmpeq_ps(det, zero), remaining);
+        remaining = _mm_andnot_ps(zeroArea, remaining);
+    }
+
+    __m128 small = zero;
+    if (options.cullSmall)
+    {
+        __m128 inFront = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(W[0], zero), _mm_cmpgt_ps(W[1], zero)), _mm_cmpgt_ps(W[2], zero));
+        __m128 halfWidth  = _mm_set1_ps(options.viewportWidth  * 0.5f);
+        __m128 halfHeight = _mm_set1_ps(options.viewportHeight * 0.5f);
+        __m128 sx[3], sy[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            sx[c] = _mm_add_ps(_mm_mul_ps(_mm_div_ps(X[c], W[c]), halfWidth),  halfWidth);
+            sy[c] = _mm_add_ps(_mm_mul_ps(_mm_div_ps(Y[c], W[c]), halfHeight), halfHeight);
+        }
+        // Round the bounds to the nearest pixel edge, clamped first so that huge values do not overflow the conversion
+        const __m128 minCoord = _mm_set1_ps(-kMaxScreenCoord), maxCoord = _mm_set1_ps(kMaxScreenCoord);
+        auto pixelEdge = [&](__m128 v) { return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, minCoord), maxCoord)); };
+        __m128i minX = pixelEdge(_mm_min_ps(_mm_min_ps(sx[0], sx[1]), sx[2]));
+        __m128i maxX = pixelEdge(_mm_max_ps(_mm_max_ps(sx[0], sx[1]), sx[2]));
+        __m128i minY = pixelEdge(_mm_min_ps(_mm_min_ps(sy[0], sy[1]), sy[2]));
+        __m128i maxY = pixelEdge(_mm_max_ps(_mm_max_ps(sy[0], sy[1]), sy[2]));
+        __m128 noSamples = _mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(minX, maxX), _mm_cmpeq_epi32(minY, maxY)));
+        small = _mm_and_ps(_mm_and_ps(noSamples, inFront), remaining);
+    }
+
+    int offScreenBits = _mm_movemask_ps(offScreen),  facingAwayBits = _mm_movemask_ps(facingAway);
+    int zeroAreaBits  = _mm_movemask_ps(zeroArea),   smallBits      = _mm_movemask_ps(small);
+    for (int t = 0; t < 4; ++t)
+    {
+        int bit = 1 << t;
+        results[t] = (offScreenBits & bit)  ? kOffScreen :
+                     (facingAwayBits & bit) ? kFacingAway :
+                     (zeroAreaBits & bit)   ? kZeroArea :
+                     (smallBits & bit)      ? kSmall : kVisible;
+    }
+}
+
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Culling
+//--------------------------------------------------------------------------------------
+
+// Cull the triangles in one chunk, writing the remaining indices over the start of the chunk's part of outIndices.
+// Returns the number of indices written
+static size_t CullChunk(const ClipPosition* clipPositions, const MeshIndex* indices, size_t numTriangles,
+                        const TriangleCullOptions& options, MeshIndex* outIndices, TriangleCullStats& stats)
+{
+    size_t numOut = 0;
+    size_t t = 0;
+#ifdef TRIANGLE_CULLING_SSE
+    for (; t + 4 <= numTriangles; t += 4)
+    {
+        // Read the indices before writing, the output may overwrite the input
+        MeshIndex triangleIndices[12];
+        std::memcpy(triangleIndices, indices + t * 3, sizeof(triangleIndices));
+        CullResult results[4];
+        CullFourTriangles(clipPositions, triangleIndices, options, results);
+        for (int i = 0; i < 4; ++i)
+        {
+            CountResult(results[i], stats);
+            if (results[i] != kVisible)  continue;
+            outIndices[numOut++] = triangleIndices[i * 3];
+            outIndices[numOut++] = triangleIndices[i * 3 + 1];
+            outIndices[numOut++] = triangleIndices[i * 3 + 2];
+        }
+    }
+#endif
+    for (; t < numTriangles; ++t)
+    {
+        MeshIndex i0 = indices[t * 3], i1 = indices[t * 3 + 1], i2 = indices[t * 3 + 2];
+        CullResult result = CullTriangle(clipPositions[i0], clipPositions[i1], clipPositions[i2], options);
+        CountResult(result, stats);
+        if (result != kVisible)  continue;
+        outIndices[numOut++] = i0;
+        outIndices[numOut++] = i1;
+        outIndices[numOut++] = i2;
+    }
+    stats.numTriangles += numTriangles;
+    return numOut;
+}
+
+
+// Cull the triangles of a triangle list, writing the indices of the remaining triangles to outIndices
+size_t CullTriangles(const ClipPosition* clipPositions, const MeshIndex* indices, size_t numIndices,
+                     const TriangleCullOptions& options, MeshIndex* outIndices, TriangleCullStats* stats)
+{
+    size_t numTriangles = numIndices / 3;
+    size_t numChunks = (numTriangles + kChunkTriangles - 1) / kChunkTriangles;
+
+    // Each chunk writes its visible triangles to the start of its own part of the output, then the parts are moved
+    // together. The moves are small compared with the culling and keep the triangle order independent of threading
+    std::vector<size_t> chunkCounts(numChunks);
+    std::vector<TriangleCullStats> chunkStats(numChunks);
+    GetThreadPool().Run(static_cast<int>(numChunks), [&](int chunk, int)
+    {
+        size_t first = chunk * kChunkTriangles;
+        size_t count = (std::min)(kChunkTriangles, numTriangles - first);
+        chunkCounts[chunk] = CullChunk(clipPositions, indices + first * 3, count, options, outIndices + first * 3, chunkStats[chunk]);
+    });
+
+    size_t numOut = 0;
+    if (stats != nullptr)  *stats = TriangleCullStats();
+    for (size_t chunk = 0; chunk < numChunks; ++chunk)
+    {
+        MeshIndex* chunkOut = outIndices + chunk * kChunkTriangles * 3;
+        if (chunkOut != outIndices + numOut && chunkCounts[chunk] > 0)
+        {
+            std::memmove(outIndices + numOut, chunkOut, chunkCounts[chunk] * sizeof(MeshIndex));
+        }
+        numOut += chunkCounts[chunk];
+        if (stats != nullptr)  *stats += chunkStats[chunk];
+    }
+    return numOut;
+}
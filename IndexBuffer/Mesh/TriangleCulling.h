@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------
+// CPU triangle culling - removes triangles that cannot produce pixels before drawing
+//--------------------------------------------------------------------------------------
+// The GPU sets up every triangle it is given before it finds that the triangle faces away, has
+// no area, is off screen or is too small to cover a pixel centre. In dense meshes most triangles
+// fail one of these tests, and triangle setup becomes the limit rather than pixel shading.
+// Testing triangles on the CPU and drawing from a compacted index buffer of the ones that pass
+// moves that work to cheap, parallel CPU code.
+//
+// The tests work on clip space positions (after the world, view and projection matrices):
+// - Off screen: all three corners are outside the same side of the view frustum
+// - Facing: the sign of the determinant of the x, y, w rows of the three corners gives the
+//   winding on screen. This works even for corners behind the camera, so no clipping is needed.
+//   D3D front faces are clockwise on screen (D3D11_RASTERIZER_DESC::FrontCounterClockwise false)
+// - Zero area: the determinant is zero
+// - Small: the screen bounds of the triangle fall between two rows or columns of pixel centres
+//   so it can cover no samples (only tested when all corners are in front of the camera)
+//
+// Four triangles are tested at once with SSE, and the index list is split into chunks that are
+// culled in parallel on the shared thread pool. The output keeps the triangles in their original
+// order so the result is the same whatever the number of threads.
+
+#ifndef _TRIANGLE_CULLING_H_INCLUDED_
+#define _TRIANGLE_CULLING_H_INCLUDED_
+
+#include "MeshData.h"
+
+// A position after projection, before the divide by w
+struct ClipPosition
+{
+    float x, y, z, w;
+};
+
+// Which side of a triangle is removed
+enum class CullFace
+{
+    None,  // Keep both sides (as gTwoSided in Scene.cpp)
+    Back,  // Remove triangles that are anticlockwise on screen
+    Front, // Remove triangles that are clockwise on screen
+};
+
+struct TriangleCullOptions
+{
+    CullFace cullFace      = CullFace::Back;
+    bool     cullZeroArea  = true;
+    bool     cullOffScreen = true;
+    bool     cullSmall     = true;  // Needs the viewport size
+    float    viewportWidth  = 1280.0f;
+    float    viewportHeight = 960.0f;
+};
+
+// Number of triangles removed by each test. A triangle failing several tests is counted by the first in this order
+struct TriangleCullStats
+{
+    size_t numTriangles = 0;
+    size_t numOffScreen = 0;
+    size_t numFacingAway = 0;
+    size_t numZeroArea  = 0;
+    size_t numSmall     = 0;
+    size_t numVisible   = 0;
+
+    TriangleCullStats& operator+=(const TriangleCullStats& other);
+};
+
+
+// Transform positions by a 4x4 matrix (row vector convention, as CMatrix4x4: pass &matrix.e00) into clip space.
+// clipPositions must have room for positions.Size() entries. Uses the shared thread pool
+void TransformToClipSpace(const PositionArray& positions, const float* matrix, ClipPosition* clipPositions);
+
+// Cull the triangles of a triangle list, writing the indices of the remaining triangles to outIndices in their original
+// order. outIndices must have room for numIndices indices (it may be the same array as indices). Indices must be in
+// range for clipPositions. Returns the number of indices written. Uses the shared thread pool
+size_t CullTriangles(const ClipPosition* clipPositions, const MeshIndex* indices, size_t numIndices,
+                     const TriangleCullOptions& options, MeshIndex* outIndices, TriangleCullStats* stats = nullptr);
+
+
+#endif //_TRIANGLE_CULLING_H_INCLUDED_
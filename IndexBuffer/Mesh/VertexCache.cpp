@@ -0,0 +1,71 @@
+//--------------------------------------------------------------------------------------
+// Post-transform vertex cache simulation
+//--------------------------------------------------------------------------------------
+
+#include "VertexCache.h"
+#include <vector>
+
+
+// Replay a triangle list through a vertex cache of the given type and number of entries
+VertexCacheStats SimulateVertexCache(const MeshIndex* indices, size_t numIndices, size_t numVertices,
+                                     VertexCacheType type, int cacheSize)
+{
+    VertexCacheStats stats;
+    stats.numTriangles = numIndices / 3;
+    if (cacheSize < 1)  cacheSize = 1;
+
+    // Count the distinct vertices used
+    std::vector<bool> used(numVertices, false);
+    for (size_t i = 0; i < numIndices; ++i)
+    {
+        if (!used[indices[i]])
+        {
+            used[indices[i]] = true;
+            ++stats.numUsedVertices;
+        }
+    }
+
+    if (type == VertexCacheType::Fifo)
+    {
+        // A FIFO cache only changes on a miss, so a vertex is still in the cache if fewer than cacheSize misses
+        // have happened since it was added. Storing the miss count when each vertex was added makes each lookup
+        // constant time, whatever the cache size
+        const uint64_t kNotCached = ~uint64_t(0);
+        std::vector<uint64_t> addedAt(numVertices, kNotCached);
+        uint64_t misses = 0;
+        for (size_t i = 0; i < numIndices; ++i)
+        {
+            uint64_t& added = addedAt[indices[i]];
+            if (added == kNotCached || misses - added >= static_cast<uint64_t>(cacheSize))
+            {
+                added = misses++;
+            }
+        }
+        stats.numTransforms = misses;
+    }
+    else
+    {
+        // LRU - the cache is small so a linear search of the entries, most recent first, is fast enough
+        std::vector<MeshIndex> cache;
+        cache.reserve(cacheSize);
+        for (size_t i = 0; i < numIndices; ++i)
+        {
+            MeshIndex vertex = indices[i];
+            size_t position = 0;
+            while (position < cache.size() && cache[position] != vertex)  ++position;
+
+            if (position == cache.size())
+            {
+                ++stats.numTransforms;
+                if (cache.size() < static_cast<size_t>(cacheSize))  cache.push_back(vertex);
+                position = cache.size() - 1; // Replaces the last (least recently used) entry below
+            }
+
+            // Move to the front
+            for (; position > 0; --position)  cache[position] = cache[position - 1];
+            cache[0] = vertex;
+        }
+    }
+
+    return stats;
+}
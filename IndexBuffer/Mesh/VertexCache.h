@@ -0,0 +1,45 @@
+//--------------------------------------------------------------------------------------
+// Post-transform vertex cache simulation
+//--------------------------------------------------------------------------------------
+// The GPU keeps the results of the vertex shader for the last few vertices it processed. If
+// an index refers to a vertex still in this cache the vertex shader does not run again. How
+// well a mesh uses the cache depends only on the order of its indices, so it can be measured
+// on the CPU by replaying the index buffer through a model of the cache. The two usual
+// measures are:
+// - ACMR (average cache miss ratio): vertex shader runs per triangle. 0.5 is the best possible
+//   for a large regular grid, 3 means no reuse at all
+// - ATVR (average transform to vertex ratio): vertex shader runs per vertex used. 1 is perfect
+//
+// Real hardware varies, so results are usually quoted for a few cache sizes. Older GPUs use a
+// first-in first-out cache, a least-recently-used cache is a common optimistic model.
+
+#ifndef _VERTEX_CACHE_H_INCLUDED_
+#define _VERTEX_CACHE_H_INCLUDED_
+
+#include "MeshData.h"
+
+// Replacement policy of the simulated cache
+enum class VertexCacheType
+{
+    Fifo, // A hit does not change the order, the oldest entry is replaced on a miss
+    Lru,  // A hit moves the vertex to the front, the least recently used entry is replaced on a miss
+};
+
+// Results of replaying an index buffer through a vertex cache
+struct VertexCacheStats
+{
+    uint64_t numTriangles    = 0;
+    uint64_t numTransforms   = 0; // Cache misses - each is one run of the vertex shader
+    uint64_t numUsedVertices = 0; // Distinct vertices referred to by the indices
+
+    float ACMR() const { return numTriangles    > 0 ? static_cast<float>(numTransforms) / numTriangles    : 0.0f; }
+    float ATVR() const { return numUsedVertices > 0 ? static_cast<float>(numTransforms) / numUsedVertices : 0.0f; }
+};
+
+// Replay a triangle list through a vertex cache of the given type and number of entries. Indices must be less than
+// numVertices
+VertexCacheStats SimulateVertexCache(const MeshIndex* indices, size_t numIndices, size_t numVertices,
+                                     VertexCacheType type, int cacheSize);
+
+
+#endif //_VERTEX_CACHE_H_INCLUDED_
@@ -0,0 +1,142 @@
+//--------------------------------------------------------------------------------------
+// Vertex structures used for the geometry in the app
+//--------------------------------------------------------------------------------------
+// Each structure is followed by a list of its elements, which is used to generate the DirectX
+// input layout and the matching shader input structure (see VertexLayout.h). If you change a
+// structure, change its element list too - the static_assert will remind you.
+
+#ifndef _VERTEX_FORMATS_H_INCLUDED_
+#define _VERTEX_FORMATS_H_INCLUDED_
+
+#include "VertexLayout.h"
+#include "CVector3.h"
+#include "ColourRGBA.h"
+
+
+// The content of a single vertex in the geometry to render. Currently just stores the position of the vertex (x,y,z). 
+// However, we can store other information for each vertex (for example, a colour for the vertex) so we use a structure.
+struct SimpleVertex
+{
+	CVector3 position;
+	ColourRGBA colour;
+};
+
+// This describes the contents of the SimpleVertex structure above so DirectX will know what to expect when reading
+// vertex data. Each row gives a member of the structure and its "semantic", the name used to match it with the
+// vertex shader input structure. The formats and offsets are worked out from the structure
+constexpr VertexElement kSimpleVertexElements[] =
+{
+	VERTEX_ELEMENT(SimpleVertex, position, "Position"),
+	VERTEX_ELEMENT(SimpleVertex, colour,   "Colour"),
+};
+static_assert(IsCompleteLayout(kSimpleVertexElements, sizeof(SimpleVertex)), "kSimpleVertexElements does not match SimpleVertex");
+
+
+// A vertex for lit geometry. As well as the position and colour of the SimpleVertex, this holds the direction the
+// surface faces at the vertex (the normal) and a direction along the surface (the tangent), which together with
+// Cross(normal, tangent) gives the "tangent space" used for normal mapping. These are usually calculated from the
+// triangles in the index buffer rather than typed in - see MeshNormals.h
+struct NormalVertex
+{
+	CVector3   position;
+	CVector3   normal;
+	CVector3   tangent;
+	ColourRGBA colour;
+};
+
+constexpr VertexElement kNormalVertexElements[] =
+{
+	VERTEX_ELEMENT(NormalVertex, position, "Position"),
+	VERTEX_ELEMENT(NormalVertex, normal,   "Normal"),
+	VERTEX_ELEMENT(NormalVertex, tangent,  "Tangent"),
+	VERTEX_ELEMENT(NormalVertex, colour,   "Colour"),
+};
+static_assert(IsCompleteLayout(kNormalVertexElements, sizeof(NormalVertex)), "kNormalVertexElements does not match NormalVertex");
+
+
+// A vertex for animated (skinned) geometry. Each vertex follows up to four bones of a skeleton: its position and normal
+// are transformed by each bone's matrix and the results blended using the weights. Bone indices are positions in the
+// array of bone matrices (the "palette"). Weights are stored as bytes, 0-255 meaning 0.0-1.0, and should add up to 255.
+// Unused bones have weight 0. See Skinning.h
+struct SkinnedVertex
+{
+	CVector3   position;
+	CVector3   normal;
+	ColourRGBA colour;
+	uint8_t    boneIndices[4];
+	uint8_t    boneWeights[4];
+};
+
+constexpr VertexElement kSkinnedVertexElements[] =
+{
+	VERTEX_ELEMENT(SkinnedVertex, position, "Position"),
+	VERTEX_ELEMENT(SkinnedVertex, normal,   "Normal"),
+	VERTEX_ELEMENT(SkinnedVertex, colour,   "Colour"),
+	VERTEX_ELEMENT_FORMAT(SkinnedVertex, boneIndices, "BoneIndices", 0, VertexElementFormat::UByte4),
+	VERTEX_ELEMENT_FORMAT(SkinnedVertex, boneWeights, "BoneWeights", 0, VertexElementFormat::UByte4Norm),
+};
+static_assert(IsCompleteLayout(kSkinnedVertexElements, sizeof(SkinnedVertex)), "kSkinnedVertexElements does not match SkinnedVertex");
+
+
+// Split vertex formats. Instead of one buffer of SimpleVertex, a mesh can be held as two buffers ("streams") bound to
+// separate input slots: one of positions only and one of the remaining attributes. Passes that only need positions
+// (depth-only, shadows) then read just the position stream, 12 bytes per vertex instead of 28. See MeshStreams.h
+struct PositionVertex
+{
+	CVector3 position;
+};
+
+constexpr VertexElement kPositionVertexElements[] =
+{
+	VERTEX_ELEMENT(PositionVertex, position, "Position"),
+};
+static_assert(IsCompleteLayout(kPositionVertexElements, sizeof(PositionVertex)), "kPositionVertexElements does not match PositionVertex");
+
+// The attributes of a SimpleVertex other than the position
+struct ColourAttributes
+{
+	ColourRGBA colour;
+};
+
+constexpr VertexElement kColourAttributesElements[] =
+{
+	VERTEX_ELEMENT(ColourAttributes, colour, "Colour"),
+};
+static_assert(IsCompleteLayout(kColourAttributesElements, sizeof(ColourAttributes)), "kColourAttributesElements does not match ColourAttributes");
+
+
+// Per-instance data for instanced drawing. An instanced draw renders one mesh many times, reading the mesh's vertices
+// from the usual streams and one of these for each copy from a further stream declared per-instance (see
+// VertexStream::perInstance). The world matrix is held as its four rows, semantics World0-World3, as a vertex element
+// cannot be a whole matrix. The tint multiplies the vertex colours
+struct InstanceData
+{
+	float      worldRow0[4];
+	float      worldRow1[4];
+	float      worldRow2[4];
+	float      worldRow3[4];
+	ColourRGBA tint;
+};
+
+constexpr VertexElement kInstanceDataElements[] =
+{
+	VERTEX_ELEMENT_FORMAT(InstanceData, worldRow0, "World", 0, VertexElementFormat::Float4),
+	VERTEX_ELEMENT_FORMAT(InstanceData, worldRow1, "World", 1, VertexElementFormat::Float4),
+	VERTEX_ELEMENT_FORMAT(InstanceData, worldRow2, "World", 2, VertexElementFormat::Float4),
+	VERTEX_ELEMENT_FORMAT(InstanceData, worldRow3, "World", 3, VertexElementFormat::Float4),
+	VERTEX_ELEMENT(InstanceData, tint, "Tint"),
+};
+static_assert(IsCompleteLayout(kInstanceDataElements, sizeof(InstanceData)), "kInstanceDataElements does not match InstanceData");
+
+
+// The PerModelConstants constant buffer of TransformColour_vs.hlsl, written once per draw when copies of a mesh are
+// drawn one at a time rather than instanced. It holds the same world matrix and tint as InstanceData
+struct PerModelConstants
+{
+	float      worldMatrix[16];
+	ColourRGBA tint;
+};
+static_assert(sizeof(PerModelConstants) == 80, "PerModelConstants does not match the shader's constant buffer");
+
+
+#endif //_VERTEX_FORMATS_H_INCLUDED_
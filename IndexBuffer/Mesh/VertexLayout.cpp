@@ -0,0 +1,149 @@
+//--------------------------------------------------------------------------------------
+// Description of the data in a vertex structure, written once beside the structure
+//--------------------------------------------------------------------------------------
+
+#include "VertexLayout.h"
+#include <vector>
+#include <algorithm>
+#include <cctype>
+
+
+// HLSL type for a vertex element format, e.g. "float3"
+const char* HlslTypeName(VertexElementFormat format)
+{
+    switch (format)
+    {
+    case VertexElementFormat::Float1:     return "float";
+    case VertexElementFormat::Float2:     return "float2";
+    case VertexElementFormat::Float3:     return "float3";
+    case VertexElementFormat::Float4:     return "float4";
+    case VertexElementFormat::UByte4:     return "uint4";
+    case VertexElementFormat::UByte4Norm: return "float4";
+    case VertexElementFormat::UInt1:      return "uint";
+    }
+    return "";
+}
+
+
+// Generate the HLSL vertex shader input structure for the given streams. If there are several streams, all their
+// elements are placed in the one structure
+std::string MakeHlslVertexStruct(const char* structName, const VertexStream* streams, int numStreams)
+{
+    std::string hlsl = "struct ";
+    hlsl += structName;
+    hlsl += "\n{\n";
+    for (int s = 0; s < numStreams; ++s)
+    {
+        for (uint32_t e = 0; e < streams[s].numElements; ++e)
+        {
+            const VertexElement& element = streams[s].elements[e];
+            hlsl += "    ";
+            hlsl += HlslTypeName(element.format);
+            hlsl += " ";
+            hlsl += element.memberName;
+            hlsl += " : ";
+            hlsl += element.semanticName;
+            if (element.semanticIndex != 0)  hlsl += std::to_string(element.semanticIndex);
+            hlsl += ";\n";
+        }
+    }
+    hlsl += "};\n";
+    return hlsl;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Checking HLSL
+//--------------------------------------------------------------------------------------
+
+// Split HLSL source into identifiers (and numbers) and single punctuation characters, leaving out comments and spaces
+static std::vector<std::string> HlslTokens(const std::string& source)
+{
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    while (i < source.size())
+    {
+        char c = source[i];
+        if (source.compare(i, 2, "//") == 0)
+        {
+            i = source.find('\n', i);
+            if (i == std::string::npos)  break;
+        }
+        else if (source.compare(i, 2, "/*") == 0)
+        {
+            i = source.find("*/", i + 2);
+            if (i == std::string::npos)  break;
+            i += 2;
+        }
+        else if (std::isalnum(static_cast<unsigned char>(c)) || c == '_')
+        {
+            size_t start = i;
+            while (i < source.size() && (std::isalnum(static_cast<unsigned char>(source[i])) || source[i] == '_'))  ++i;
+            tokens.push_back(source.substr(start, i - start));
+        }
+        else
+        {
+            if (!std::isspace(static_cast<unsigned char>(c)))  tokens.push_back(std::string(1, c));
+            ++i;
+        }
+    }
+    return tokens;
+}
+
+
+// Find a structure in HLSL source and get each member as a line of text, in lower case with single spaces and a
+// semantic index on every semantic. Returns false if there is no complete structure of that name
+static bool HlslStructMembers(const std::string& source, const std::string& structName, std::vector<std::string>& members)
+{
+    std::vector<std::string> tokens = HlslTokens(source);
+    members.clear();
+    for (size_t t = 0; t + 2 < tokens.size(); ++t)
+    {
+        if (tokens[t] != "struct" || tokens[t + 1] != structName || tokens[t + 2] != "{")  continue;
+
+        std::string member;
+        bool semantic = false; // The token before was the colon before a semantic
+        for (size_t m = t + 3; m < tokens.size(); ++m)
+        {
+            std::string token = tokens[m];
+            if (token == "}")  return true;
+            if (token == ";")
+            {
+                members.push_back(member);
+                member.clear();
+                continue;
+            }
+            std::transform(token.begin(), token.end(), token.begin(),
+                           [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+            if (semantic && !std::isdigit(static_cast<unsigned char>(token.back())))  token += "0";
+            semantic = (token == ":");
+            if (!member.empty())  member += " ";
+            member += token;
+        }
+        return false; // No closing brace
+    }
+    return false;
+}
+
+
+bool CheckHlslVertexStruct(const std::string& hlslSource, const char* structName, const VertexStream* streams,
+                           int numStreams, std::string& error)
+{
+    std::vector<std::string> expected, found;
+    HlslStructMembers(MakeHlslVertexStruct(structName, streams, numStreams), structName, expected);
+    if (!HlslStructMembers(hlslSource, structName, found))
+    {
+        error = std::string("No struct ") + structName + " in the HLSL";
+        return false;
+    }
+
+    for (size_t m = 0; m < (std::max)(expected.size(), found.size()); ++m)
+    {
+        if (m < expected.size() && m < found.size() && expected[m] == found[m])  continue;
+        error = std::string(structName) + " member " + std::to_string(m) + ": the HLSL has \"" +
+                (m < found.size() ? found[m] : "nothing") + "\" where the vertex layout has \"" +
+                (m < expected.size() ? expected[m] : "nothing") + "\"";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,162 @@
+//--------------------------------------------------------------------------------------
+// Description of the data in a vertex structure, written once beside the structure
+//--------------------------------------------------------------------------------------
+// DirectX needs to know what is in each vertex (the "input layout") and the vertex shader
+// needs a matching input structure. Typing these in by hand means the semantic names, formats
+// and byte offsets must be kept in step with the C++ structure by eye. Instead each vertex
+// structure gets a list of its members made with the VERTEX_ELEMENT macro, which takes the
+// offsets and sizes from the structure itself. The D3D11_INPUT_ELEMENT_DESC array, the vertex
+// stride and the HLSL input structure are all generated from that list, and a static_assert
+// checks at compile time that the list covers the structure exactly. The shaders' copies of the
+// HLSL structures are checked against the lists by CheckHlslVertexStruct. For example:
+//
+//     constexpr VertexElement kSimpleVertexElements[] =
+//     {
+//         VERTEX_ELEMENT(SimpleVertex, position, "Position"),
+//         VERTEX_ELEMENT(SimpleVertex, colour,   "Colour"),
+//     };
+//     static_assert(IsCompleteLayout(kSimpleVertexElements, sizeof(SimpleVertex)), "...");
+//
+// This file does not use DirectX so layouts can be checked on any platform. The conversion to
+// D3D11_INPUT_ELEMENT_DESC is in Shader.cpp.
+
+#ifndef _VERTEX_LAYOUT_H_INCLUDED_
+#define _VERTEX_LAYOUT_H_INCLUDED_
+
+#include "CVector3.h"
+#include "ColourRGBA.h"
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+
+//--------------------------------------------------------------------------------------
+// Elements
+//--------------------------------------------------------------------------------------
+
+// Data format of a single vertex element, each maps to a DXGI_FORMAT and an HLSL type
+enum class VertexElementFormat
+{
+    Float1,     // float       DXGI_FORMAT_R32_FLOAT
+    Float2,     // float2      DXGI_FORMAT_R32G32_FLOAT
+    Float3,     // float3      DXGI_FORMAT_R32G32B32_FLOAT
+    Float4,     // float4      DXGI_FORMAT_R32G32B32A32_FLOAT
+    UByte4,     // uint4       DXGI_FORMAT_R8G8B8A8_UINT   (e.g. bone indices)
+    UByte4Norm, // float4      DXGI_FORMAT_R8G8B8A8_UNORM  (0-255 mapped to 0-1, e.g. packed colours or weights)
+    UInt1,      // uint        DXGI_FORMAT_R32_UINT
+};
+
+// Size in bytes of a vertex element of the given format
+constexpr uint32_t VertexElementSize(VertexElementFormat format)
+{
+    return format == VertexElementFormat::Float1     ?  4 :
+           format == VertexElementFormat::Float2     ?  8 :
+           format == VertexElementFormat::Float3     ? 12 :
+           format == VertexElementFormat::Float4     ? 16 :
+           format == VertexElementFormat::UByte4     ?  4 :
+           format == VertexElementFormat::UByte4Norm ?  4 :
+           format == VertexElementFormat::UInt1      ?  4 : 0;
+}
+
+// One member of a vertex structure
+struct VertexElement
+{
+    const char*         memberName;    // C++ member name, also used for the HLSL member
+    const char*         semanticName;  // Semantic used to match the shader input, e.g. "Position"
+    uint32_t            semanticIndex; // For several elements with the same semantic (e.g. texture coordinates 0 and 1)
+    VertexElementFormat format;
+    uint32_t            offset;        // Bytes from the start of the vertex structure
+    uint32_t            memberSize;    // sizeof the C++ member, checked against the format
+};
+
+
+// The default format for each C++ member type. Types that could mean more than one format (e.g. four bytes)
+// have no default, use VERTEX_ELEMENT_FORMAT for those
+template <class T> struct DefaultVertexFormat;
+template <> struct DefaultVertexFormat<float>      { static constexpr VertexElementFormat kFormat = VertexElementFormat::Float1; };
+template <> struct DefaultVertexFormat<float[2]>   { static constexpr VertexElementFormat kFormat = VertexElementFormat::Float2; };
+template <> struct DefaultVertexFormat<CVector3>   { static constexpr VertexElementFormat kFormat = VertexElementFormat::Float3; };
+template <> struct DefaultVertexFormat<float[4]>   { static constexpr VertexElementFormat kFormat = VertexElementFormat::Float4; };
+template <> struct DefaultVertexFormat<ColourRGBA> { static constexpr VertexElementFormat kFormat = VertexElementFormat::Float4; };
+template <> struct DefaultVertexFormat<uint32_t>   { static constexpr VertexElementFormat kFormat = VertexElementFormat::UInt1;  };
+
+// Describe a member of a vertex structure, using the default format for its type (semantic index 0)
+#define VERTEX_ELEMENT(Vertex, member, semantic) \
+    VertexElement{ #member, semantic, 0, DefaultVertexFormat<decltype(Vertex::member)>::kFormat, \
+                   static_cast<uint32_t>(offsetof(Vertex, member)), static_cast<uint32_t>(sizeof(Vertex::member)) }
+
+// Describe a member of a vertex structure giving the format and semantic index explicitly
+#define VERTEX_ELEMENT_FORMAT(Vertex, member, semantic, semanticIndex, format) \
+    VertexElement{ #member, semantic, semanticIndex, format, \
+                   static_cast<uint32_t>(offsetof(Vertex, member)), static_cast<uint32_t>(sizeof(Vertex::member)) }
+
+
+//--------------------------------------------------------------------------------------
+// Compile-time checks
+//--------------------------------------------------------------------------------------
+
+// True if the elements are in memory order, each element's format matches the size of its member, and together
+// they cover every byte of a vertex of the given size with no gaps or overlaps. Use in a static_assert beside
+// each vertex structure so that changing the structure without its description fails to compile
+template <size_t N>
+constexpr bool IsCompleteLayout(const VertexElement (&elements)[N], size_t vertexSize)
+{
+    uint32_t expectedOffset = 0;
+    for (size_t i = 0; i < N; ++i)
+    {
+        if (elements[i].offset != expectedOffset)  return false;
+        if (VertexElementSize(elements[i].format) != elements[i].memberSize)  return false;
+        expectedOffset += elements[i].memberSize;
+    }
+    return expectedOffset == vertexSize;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Streams
+//--------------------------------------------------------------------------------------
+
+// A vertex buffer's worth of elements: the elements of one vertex structure, the input slot its buffer is bound to
+// and whether it steps per vertex or per instance. Most meshes use a single stream in slot 0
+struct VertexStream
+{
+    const VertexElement* elements;
+    uint32_t             numElements;
+    uint32_t             stride;      // Size of the vertex structure, the distance between vertices in the buffer
+    uint32_t             slot;
+    bool                 perInstance;
+};
+
+// Make a stream from an element list, e.g. MakeVertexStream<SimpleVertex>(kSimpleVertexElements)
+template <class Vertex, size_t N>
+VertexStream MakeVertexStream(const VertexElement (&elements)[N], uint32_t slot = 0, bool perInstance = false)
+{
+    return VertexStream{ elements, static_cast<uint32_t>(N), static_cast<uint32_t>(sizeof(Vertex)), slot, perInstance };
+}
+
+
+//--------------------------------------------------------------------------------------
+// Generated text
+//--------------------------------------------------------------------------------------
+
+// HLSL type for a vertex element format, e.g. "float3"
+const char* HlslTypeName(VertexElementFormat format);
+
+// Generate the HLSL vertex shader input structure for the given streams, e.g. for SimpleVertex:
+//   struct SimpleVertex
+//   {
+//       float3 position : Position;
+//       float4 colour : Colour;
+//   };
+// If there are several streams, all their elements are placed in the one structure
+std::string MakeHlslVertexStruct(const char* structName, const VertexStream* streams, int numStreams);
+
+// Check that the structure of the given name in HLSL source (such as the text of Common.hlsli) has the members
+// MakeHlslVertexStruct would generate, in the same order with the same types, names and semantics. Comments, spacing
+// and letter case are ignored, and a semantic with no index is the same as index 0, as in HLSL. Returns false and sets
+// error if the structure is missing or differs. MeshCheck --hlsl runs this over the app's shader structures
+bool CheckHlslVertexStruct(const std::string& hlslSource, const char* structName, const VertexStream* streams,
+                           int numStreams, std::string& error);
+
+
+#endif //_VERTEX_LAYOUT_H_INCLUDED_
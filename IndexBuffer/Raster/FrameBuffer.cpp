@@ -0,0 +1,111 @@
+//--------------------------------------------------------------------------------------
+// Colour and depth buffers in CPU memory, the render target of the software renderer
+//--------------------------------------------------------------------------------------
+
+#include "FrameBuffer.h"
+#include <algorithm>
+
+// Convert one colour component to 0-255
+static uint32_t PackComponent(float value)
+{
+    value = (std::min)((std::max)(0.0f, value), 1.0f); // In this order NaN becomes 0
+    return static_cast<uint32_t>(value * 255.0f + 0.5f);
+}
+
+uint32_t PackColour(float r, float g, float b, float a)
+{
+    return PackComponent(r) | (PackComponent(g) << 8) | (PackComponent(b) << 16) | (PackComponent(a) << 24);
+}
+
+
+void FrameBuffer::Init(int width, int height)
+{
+    mWidth  = width;
+    mHeight = height;
+    mColour.resize(static_cast<size_t>(width) * height);
+    mDepth.resize(static_cast<size_t>(width) * height);
+
+    // The depths are unknown, so the blocks have an unlimited range
+    mDepthBlocksX = (width  + kDepthBlockSize - 1) >> kDepthBlockShift;
+    mDepthBlocksY = (height + kDepthBlockSize - 1) >> kDepthBlockShift;
+    mDepthBlocks.assign(static_cast<size_t>(mDepthBlocksX) * mDepthBlocksY, DepthBlock());
+}
+
+void FrameBuffer::ClearColour(const float colour[4])
+{
+    std::fill(mColour.begin(), mColour.end(), PackColour(colour[0], colour[1], colour[2], colour[3]));
+}
+
+void FrameBuffer::ClearDepth(float depth)
+{
+    DepthBlock cleared;
+    cleared.minDepth = cleared.maxDepth = depth;
+    cleared.clearPending = true;
+    std::fill(mDepthBlocks.begin(), mDepthBlocks.end(), cleared);
+}
+
+
+float FrameBuffer::DepthAt(int x, int y) const
+{
+    const DepthBlock& block = mDepthBlocks[static_cast<size_t>(y >> kDepthBlockShift) * mDepthBlocksX + (x >> kDepthBlockShift)];
+    return block.clearPending ? block.minDepth : mDepth[static_cast<size_t>(y) * mWidth + x];
+}
+
+
+//--------------------------------------------------------------------------------------
+// Depth blocks
+//--------------------------------------------------------------------------------------
+
+void FrameBuffer::FinishDepthClear(int blockX, int blockY) const
+{
+    DepthBlock& block = mDepthBlocks[static_cast<size_t>(blockY) * mDepthBlocksX + blockX];
+    if (!block.clearPending)  return;
+
+    int minX = blockX << kDepthBlockShift, minY = blockY << kDepthBlockShift;
+    int maxX = (std::min)(minX + kDepthBlockSize, mWidth), maxY = (std::min)(minY + kDepthBlockSize, mHeight);
+    for (int y = minY; y < maxY; ++y)
+    {
+        float* row = &mDepth[static_cast<size_t>(y) * mWidth];
+        std::fill(row + minX, row + maxX, block.minDepth);
+    }
+    block.clearPending = false;
+}
+
+void FrameBuffer::FinishDepthClears() const
+{
+    for (int blockY = 0; blockY < mDepthBlocksY; ++blockY)
+    {
+        for (int blockX = 0; blockX < mDepthBlocksX; ++blockX)  FinishDepthClear(blockX, blockY);
+    }
+}
+
+
+void FrameBuffer::UpdateDepthBlock(int blockX, int blockY)
+{
+    DepthBlock& block = mDepthBlocks[static_cast<size_t>(blockY) * mDepthBlocksX + blockX];
+    block.stale = false;
+    if (block.clearPending)  return; // Exact already
+
+    int minX = blockX << kDepthBlockShift, minY = blockY << kDepthBlockShift;
+    int maxX = (std::min)(minX + kDepthBlockSize, mWidth), maxY = (std::min)(minY + kDepthBlockSize, mHeight);
+    float minDepth = std::numeric_limits<float>::infinity(), maxDepth = -minDepth;
+    for (int y = minY; y < maxY; ++y)
+    {
+        const float* row = &mDepth[static_cast<size_t>(y) * mWidth];
+        for (int x = minX; x < maxX; ++x)
+        {
+            minDepth = (std::min)(minDepth, row[x]);
+            maxDepth = (std::max)(maxDepth, row[x]);
+        }
+    }
+    block.minDepth = minDepth;
+    block.maxDepth = maxDepth;
+}
+
+void FrameBuffer::UpdateDepthBlocks()
+{
+    for (int blockY = 0; blockY < mDepthBlocksY; ++blockY)
+    {
+        for (int blockX = 0; blockX < mDepthBlocksX; ++blockX)  UpdateDepthBlock(blockX, blockY);
+    }
+}
@@ -0,0 +1,110 @@
+//--------------------------------------------------------------------------------------
+// Colour and depth buffers in CPU memory, the render target of the software renderer
+//--------------------------------------------------------------------------------------
+// The equivalent of the swap chain's back buffer (DXGI_FORMAT_R8G8B8A8_UNORM) and the depth
+// buffer (DXGI_FORMAT_D32_FLOAT) created in Direct3DSetup.cpp. Colours are stored as four bytes
+// in the order red, green, blue, alpha, the same as the GPU buffer, so the colour data can be
+// copied straight into a texture. Rows run from the top of the image down.
+//
+// The depth buffer also keeps the nearest and farthest depth of each block of 8x8 pixels, a
+// one level hierarchical depth buffer. The software renderer uses it to throw away triangles
+// that are behind everything already drawn in the blocks they touch without reading any pixels,
+// and updates it as it writes depth. Clearing depth only resets the blocks: each block's pixels
+// are filled with the clear value when the renderer first draws to them (or when Depth() is
+// called), so parts of the buffer that are not drawn to are never written.
+
+#ifndef _FRAME_BUFFER_H_INCLUDED_
+#define _FRAME_BUFFER_H_INCLUDED_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+
+
+// Convert a colour with components 0-1 to the 8-bit format of the colour buffer. Components are clamped to 0-1 and
+// rounded to the nearest step, as the GPU does when writing to a UNORM render target
+uint32_t PackColour(float r, float g, float b, float a);
+
+// Get the components of a packed colour (0-255)
+inline uint8_t ColourRed  (uint32_t colour) { return static_cast<uint8_t>(colour); }
+inline uint8_t ColourGreen(uint32_t colour) { return static_cast<uint8_t>(colour >> 8); }
+inline uint8_t ColourBlue (uint32_t colour) { return static_cast<uint8_t>(colour >> 16); }
+inline uint8_t ColourAlpha(uint32_t colour) { return static_cast<uint8_t>(colour >> 24); }
+
+
+// Range of depths in a block of the depth buffer. The range may be wider than the depths actually there, but never
+// narrower: minDepth is at most the nearest pixel and maxDepth at least the farthest
+struct DepthBlock
+{
+    float minDepth = -std::numeric_limits<float>::infinity();
+    float maxDepth =  std::numeric_limits<float>::infinity();
+    bool  clearPending = false; // The pixels are still to be filled with the clear value, which is minDepth and maxDepth
+    bool  stale = false;        // Depth was written since the range was last found from the pixels, so may be too wide
+};
+
+
+class FrameBuffer
+{
+public:
+    static const int kDepthBlockShift = 3;
+    static const int kDepthBlockSize  = 1 << kDepthBlockShift; // Pixels along each side of a depth block
+
+    // Allocate buffers of the given size. Contents are undefined until cleared
+    void Init(int width, int height);
+
+    // Fill the colour buffer with a colour (red, green, blue, alpha 0-1), like ClearRenderTargetView
+    void ClearColour(const float colour[4]);
+
+    // Set the depth buffer to a value, like ClearDepthStencilView. Only the depth blocks are written here
+    void ClearDepth(float depth);
+
+    int Width()  const { return mWidth; }
+    int Height() const { return mHeight; }
+
+    // Rows of Width() values from the top of the image. Getting the depth buffer fills any blocks still waiting for a
+    // clear first. Code writing depth itself must call UpdateDepthBlocks afterwards
+    uint32_t*       Colour()       { return mColour.data(); }
+    const uint32_t* Colour() const { return mColour.data(); }
+    float*          Depth()        { FinishDepthClears(); return mDepth.data(); }
+    const float*    Depth()  const { FinishDepthClears(); return mDepth.data(); }
+
+    uint32_t ColourAt(int x, int y) const { return mColour[static_cast<size_t>(y) * mWidth + x]; }
+    float    DepthAt (int x, int y) const;
+
+
+    // Depth blocks //
+
+    // Blocks in rows of DepthBlocksX() from the top of the image. The blocks in the last row and column may overhang
+    // the edge of the buffer
+    int               DepthBlocksX() const { return mDepthBlocksX; }
+    int               DepthBlocksY() const { return mDepthBlocksY; }
+    DepthBlock*       DepthBlocks()        { return mDepthBlocks.data(); }
+    const DepthBlock* DepthBlocks()  const { return mDepthBlocks.data(); }
+
+    // The depth buffer as it is, for the renderer, which fills blocks waiting for a clear before using them
+    float* DepthPixels() { return mDepth.data(); }
+
+    // Fill the pixels of a block waiting for a clear
+    void FinishDepthClear(int blockX, int blockY) const;
+
+    // Find a block's range exactly from its pixels, or every block's
+    void UpdateDepthBlock(int blockX, int blockY);
+    void UpdateDepthBlocks();
+
+private:
+    void FinishDepthClears() const;
+
+    int                   mWidth = 0;
+    int                   mHeight = 0;
+    std::vector<uint32_t> mColour;
+
+    // Filling pixels waiting for a clear does not change the depths seen, so it is allowed on a const FrameBuffer
+    mutable std::vector<float>      mDepth;
+    mutable std::vector<DepthBlock> mDepthBlocks;
+    int                             mDepthBlocksX = 0;
+    int                             mDepthBlocksY = 0;
+};
+
+
+#endif //_FRAME_BUFFER_H_INCLUDED_
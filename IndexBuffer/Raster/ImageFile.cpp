@@ -0,0 +1,225 @@
+//--------------------------------------------------------------------------------------
+// Saving, loading and comparing rendered frames, for tools and regression checks
+//--------------------------------------------------------------------------------------
+
+#include "ImageFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+// Read a whole file into memory. Returns false on failure
+static bool ReadFile(const std::string& fileName, std::vector<char>& contents)
+{
+    FILE* file = std::fopen(fileName.c_str(), "rb");
+    if (file == nullptr)  return false;
+
+    contents.clear();
+    char buffer[65536];
+    size_t bytesRead;
+    while ((bytesRead = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        contents.insert(contents.end(), buffer, buffer + bytesRead);
+    }
+    bool ok = (std::ferror(file) == 0);
+    std::fclose(file);
+    return ok;
+}
+
+// Write a header and data to a file. Returns false and sets error on failure
+static bool WriteFile(const std::string& fileName, const std::string& header, const void* data, size_t size,
+                      std::string& error)
+{
+    FILE* file = std::fopen(fileName.c_str(), "wb");
+    if (file == nullptr)
+    {
+        error = "Cannot create " + fileName;
+        return false;
+    }
+    bool ok = std::fwrite(header.data(), 1, header.size(), file) == header.size() &&
+              std::fwrite(data, 1, size, file) == size;
+    ok = (std::fclose(file) == 0) && ok;
+    if (!ok)  error = "Error writing " + fileName;
+    return ok;
+}
+
+// Read the next whitespace separated word of a PPM/PFM header, skipping # comments. Returns an empty string at the end
+static std::string HeaderWord(const std::vector<char>& contents, size_t& position)
+{
+    for (;;)
+    {
+        while (position < contents.size() && std::strchr(" \t\r\n", contents[position]) != nullptr)  ++position;
+        if (position >= contents.size() || contents[position] != '#')  break;
+        while (position < contents.size() && contents[position] != '\n')  ++position;
+    }
+    std::string word;
+    while (position < contents.size() && std::strchr(" \t\r\n#", contents[position]) == nullptr)
+    {
+        word += contents[position++];
+    }
+    return word;
+}
+
+// Read the signature, size and last header value (maximum value for PPM, scale for PFM), leaving position on the first
+// byte of pixel data. Returns false if the header is not as expected
+static bool ReadHeader(const std::vector<char>& contents, const char* signature, int& width, int& height,
+                       double& lastValue, size_t& position)
+{
+    position = 0;
+    if (HeaderWord(contents, position) != signature)  return false;
+    std::string widthWord  = HeaderWord(contents, position);
+    std::string heightWord = HeaderWord(contents, position);
+    std::string lastWord   = HeaderWord(contents, position);
+    width  = std::atoi(widthWord.c_str());
+    height = std::atoi(heightWord.c_str());
+    lastValue = std::atof(lastWord.c_str());
+    if (width <= 0 || height <= 0 || lastWord.empty() || position >= contents.size())  return false;
+    ++position; // The single whitespace character after the header
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Saving
+//--------------------------------------------------------------------------------------
+
+bool SaveColourImage(const std::string& fileName, const uint32_t* colours, int width, int height, std::string& error)
+{
+    size_t numPixels = static_cast<size_t>(width) * height;
+    std::vector<uint8_t> rgb(numPixels * 3);
+    for (size_t p = 0; p < numPixels; ++p)
+    {
+        rgb[p * 3 + 0] = static_cast<uint8_t>(colours[p]);
+        rgb[p * 3 + 1] = static_cast<uint8_t>(colours[p] >> 8);
+        rgb[p * 3 + 2] = static_cast<uint8_t>(colours[p] >> 16);
+    }
+    std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+    return WriteFile(fileName, header, rgb.data(), rgb.size(), error);
+}
+
+bool SaveDepthImage(const std::string& fileName, const float* depths, int width, int height, std::string& error)
+{
+    // PFM rows go from the bottom of the image up
+    std::vector<float> flipped(static_cast<size_t>(width) * height);
+    for (int y = 0; y < height; ++y)
+    {
+        std::memcpy(&flipped[static_cast<size_t>(height - 1 - y) * width], depths + static_cast<size_t>(y) * width,
+                    width * sizeof(float));
+    }
+    std::string header = "Pf\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n"; // Negative: little-endian
+    return WriteFile(fileName, header, flipped.data(), flipped.size() * sizeof(float), error);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Loading
+//--------------------------------------------------------------------------------------
+
+bool LoadColourImage(const std::string& fileName, std::vector<uint32_t>& colours, int& width, int& height,
+                     std::string& error)
+{
+    std::vector<char> contents;
+    if (!ReadFile(fileName, contents))
+    {
+        error = "Cannot read " + fileName;
+        return false;
+    }
+    size_t position;
+    double maxValue;
+    if (!ReadHeader(contents, "P6", width, height, maxValue, position) || maxValue != 255.0)
+    {
+        error = fileName + " is not an 8-bit binary PPM file";
+        return false;
+    }
+    size_t numPixels = static_cast<size_t>(width) * height;
+    if (contents.size() - position < numPixels * 3)
+    {
+        error = fileName + " is too short for its size";
+        return false;
+    }
+
+    colours.resize(numPixels);
+    const uint8_t* rgb = reinterpret_cast<const uint8_t*>(contents.data() + position);
+    for (size_t p = 0; p < numPixels; ++p, rgb += 3)
+    {
+        colours[p] = rgb[0] | (rgb[1] << 8) | (rgb[2] << 16) | (0xFFu << 24);
+    }
+    return true;
+}
+
+bool LoadDepthImage(const std::string& fileName, std::vector<float>& depths, int& width, int& height, std::string& error)
+{
+    std::vector<char> contents;
+    if (!ReadFile(fileName, contents))
+    {
+        error = "Cannot read " + fileName;
+        return false;
+    }
+    size_t position;
+    double scale;
+    if (!ReadHeader(contents, "Pf", width, height, scale, position) || scale >= 0.0)
+    {
+        error = fileName + " is not a little-endian single channel PFM file";
+        return false;
+    }
+    size_t rowBytes = static_cast<size_t>(width) * sizeof(float);
+    if (contents.size() - position < rowBytes * height)
+    {
+        error = fileName + " is too short for its size";
+        return false;
+    }
+
+    depths.resize(static_cast<size_t>(width) * height);
+    for (int y = 0; y < height; ++y)
+    {
+        std::memcpy(&depths[static_cast<size_t>(height - 1 - y) * width], contents.data() + position + y * rowBytes, rowBytes);
+    }
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Comparison
+//--------------------------------------------------------------------------------------
+
+ImageDifference CompareColours(const uint32_t* a, const uint32_t* b, size_t numPixels, int tolerance)
+{
+    ImageDifference difference;
+    for (size_t p = 0; p < numPixels; ++p)
+    {
+        if (((a[p] ^ b[p]) & 0xFFFFFF) == 0)  continue;
+
+        int pixelDifference = 0;
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            int componentA = (a[p] >> shift) & 0xFF, componentB = (b[p] >> shift) & 0xFF;
+            pixelDifference = (std::max)(pixelDifference, std::abs(componentA - componentB));
+        }
+        difference.maxColourDifference = (std::max)(difference.maxColourDifference, pixelDifference);
+        if (pixelDifference > tolerance)  ++difference.numDifferent;
+    }
+    return difference;
+}
+
+ImageDifference CompareDepths(const float* a, const float* b, size_t numPixels, float tolerance)
+{
+    ImageDifference difference;
+    for (size_t p = 0; p < numPixels; ++p)
+    {
+        if (std::isnan(a[p]) || std::isnan(b[p]))
+        {
+            if (std::isnan(a[p]) != std::isnan(b[p]))  ++difference.numDifferent;
+            continue;
+        }
+        float pixelDifference = std::abs(a[p] - b[p]);
+        difference.maxDepthDifference = (std::max)(difference.maxDepthDifference, pixelDifference);
+        if (pixelDifference > tolerance)  ++difference.numDifferent;
+    }
+    return difference;
+}
@@ -0,0 +1,55 @@
+//--------------------------------------------------------------------------------------
+// Saving, loading and comparing rendered frames, for tools and regression checks
+//--------------------------------------------------------------------------------------
+// Two simple uncompressed formats are used, which most image viewers and tools can open:
+// - Colour as binary PPM ("P6"): 8-bit red, green, blue. Alpha is not stored and is 255 when
+//   loaded again
+// - Depth as PFM ("Pf"), the float version of PPM: one 32-bit float per pixel, stored bottom
+//   row first as the format requires. Values are written little-endian, the byte order of x86
+//   and ARM PCs
+// Colours are in the packed format of FrameBuffer (red in the low byte), rows run from the top of
+// the image down, as in FrameBuffer.
+//
+// Rendered pictures are compared with a tolerance, since optimised code may round differently
+// to the code it replaces (see SoftwareRenderer.h). A pixel differs if any colour component
+// differs by more than the tolerance, or its depth by more than the depth tolerance.
+
+#ifndef _IMAGE_FILE_H_INCLUDED_
+#define _IMAGE_FILE_H_INCLUDED_
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Save colours as a PPM file. Returns false and sets error if the file cannot be written
+bool SaveColourImage(const std::string& fileName, const uint32_t* colours, int width, int height, std::string& error);
+
+// Save depths as a PFM file. Returns false and sets error if the file cannot be written
+bool SaveDepthImage(const std::string& fileName, const float* depths, int width, int height, std::string& error);
+
+// Load a PPM file saved by SaveColourImage (any 8-bit binary PPM). Returns false and sets error if the file cannot be
+// read or is not a supported PPM
+bool LoadColourImage(const std::string& fileName, std::vector<uint32_t>& colours, int& width, int& height,
+                     std::string& error);
+
+// Load a single channel PFM file. Returns false and sets error if the file cannot be read or is not a supported PFM
+bool LoadDepthImage(const std::string& fileName, std::vector<float>& depths, int& width, int& height, std::string& error);
+
+
+// Result of comparing two images of the same size
+struct ImageDifference
+{
+    size_t numDifferent        = 0;    // Pixels differing by more than the tolerance
+    int    maxColourDifference = 0;    // Largest difference of a red, green or blue component (0-255)
+    float  maxDepthDifference  = 0.0f;
+};
+
+// Compare colours, ignoring alpha (it is not saved)
+ImageDifference CompareColours(const uint32_t* a, const uint32_t* b, size_t numPixels, int tolerance);
+
+// Compare depths. NaN only matches NaN
+ImageDifference CompareDepths(const float* a, const float* b, size_t numPixels, float tolerance);
+
+
+#endif //_IMAGE_FILE_H_INCLUDED_
@@ -0,0 +1,469 @@
+//--------------------------------------------------------------------------------------
+// Software occlusion culling - skipping objects hidden behind large ones
+//--------------------------------------------------------------------------------------
+
+#include "OcclusionCulling.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define OCCLUSION_CULLING_SSE
+#include <emmintrin.h>
+#endif
+
+const size_t kTestChunk = 1024;     // Fewest boxes tested by one task
+const int    kMaxTestTexels = 4;    // A box is tested on the first level where its rectangle is at most 4x4 texels
+const int    kMaxClipVertices = 4;  // A triangle clipped by the near plane has at most 4 corners
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+// result = a * b for 4x4 matrices in the row vector convention (result may not be a or b)
+static void MultiplyMatrices(const float* a, const float* b, float* result)
+{
+    for (int row = 0; row < 4; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            result[row * 4 + column] = a[row * 4 + 0] * b[0 * 4 + column] + a[row * 4 + 1] * b[1 * 4 + column] +
+                                       a[row * 4 + 2] * b[2 * 4 + column] + a[row * 4 + 3] * b[3 * 4 + column];
+        }
+    }
+}
+
+OcclusionBox TransformBox(const OcclusionBox& box, const float* m)
+{
+    // The new centre is the old one transformed. Each new half size is the sum of the old half sizes scaled by the
+    // size of the matrix entries, the extent of the rotated box along each axis
+    CVector3 centre = { (box.min.x + box.max.x) * 0.5f, (box.min.y + box.max.y) * 0.5f, (box.min.z + box.max.z) * 0.5f };
+    CVector3 half   = { (box.max.x - box.min.x) * 0.5f, (box.max.y - box.min.y) * 0.5f, (box.max.z - box.min.z) * 0.5f };
+    OcclusionBox result;
+    float* outMin = &result.min.x;
+    float* outMax = &result.max.x;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float c = centre.x * m[axis] + centre.y * m[4 + axis] + centre.z * m[8 + axis] + m[12 + axis];
+        float h = half.x * std::abs(m[axis]) + half.y * std::abs(m[4 + axis]) + half.z * std::abs(m[8 + axis]);
+        outMin[axis] = c - h;
+        outMax[axis] = c + h;
+    }
+    return result;
+}
+
+#ifdef OCCLUSION_CULLING_SSE
+// Smallest and largest of the four lanes
+static inline float HorizontalMin(__m128 v)
+{
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline float HorizontalMax(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+OcclusionStats& OcclusionStats::operator+=(const OcclusionStats& other)
+{
+    numOccluderTriangles += other.numOccluderTriangles;
+    numTested    += other.numTested;
+    numOffScreen += other.numOffScreen;
+    numOccluded  += other.numOccluded;
+    numVisible   += other.numVisible;
+    return *this;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Occluders
+//--------------------------------------------------------------------------------------
+
+void OcclusionBuffer::Init(int width, int height)
+{
+    // Halve the size until a single texel remains, rounding up so every texel of a level is covered by the next
+    mLevels.clear();
+    for (;;)
+    {
+        Level level;
+        level.width  = width;
+        level.height = height;
+        level.stride = (width + 3) & ~3;
+        level.depth.assign(static_cast<size_t>(level.stride) * height, 1.0f);
+        mLevels.push_back(std::move(level));
+        if (width == 1 && height == 1)  break;
+        width  = (width  + 1) / 2;
+        height = (height + 1) / 2;
+    }
+}
+
+void OcclusionBuffer::BeginFrame(const float* viewProjectionMatrix)
+{
+    std::copy(viewProjectionMatrix, viewProjectionMatrix + 16, mViewProjection);
+    std::fill(mLevels[0].depth.begin(), mLevels[0].depth.end(), 1.0f);
+    mNumOccluderTriangles = 0;
+}
+
+
+void OcclusionBuffer::AddOccluder(const PositionArray& positions, const MeshIndex* indices, size_t numIndices,
+                                  const float* worldMatrix)
+{
+    float worldViewProjection[16];
+    MultiplyMatrices(worldMatrix, mViewProjection, worldViewProjection);
+    mClipPositions.resize(positions.Size());
+    TransformToClipSpace(positions, worldViewProjection, mClipPositions.data());
+
+    const Level& buffer = mLevels[0];
+    float halfWidth  = buffer.width  * 0.5f;
+    float halfHeight = buffer.height * 0.5f;
+    for (size_t i = 0; i + 2 < numIndices; i += 3)
+    {
+        const ClipPosition& p0 = mClipPositions[indices[i]];
+        const ClipPosition& p1 = mClipPositions[indices[i + 1]];
+        const ClipPosition& p2 = mClipPositions[indices[i + 2]];
+
+        // Skip triangles entirely outside one side of the view frustum
+        if ((p0.x >  p0.w && p1.x >  p1.w && p2.x >  p2.w) || (p0.x < -p0.w && p1.x < -p1.w && p2.x < -p2.w) ||
+            (p0.y >  p0.w && p1.y >  p1.w && p2.y >  p2.w) || (p0.y < -p0.w && p1.y < -p1.w && p2.y < -p2.w) ||
+            (p0.z >  p0.w && p1.z >  p1.w && p2.z >  p2.w) || (p0.z < 0.0f  && p1.z < 0.0f  && p2.z < 0.0f))
+        {
+            continue;
+        }
+
+        // Clip against the near plane (z = 0) only. The edge equations cope with corners far off the sides of the
+        // screen, but not with corners behind the camera
+        const ClipPosition* corners[3] = { &p0, &p1, &p2 };
+        ClipPosition clipped[kMaxClipVertices];
+        int numClipped = 0;
+        for (int c = 0; c < 3; ++c)
+        {
+            const ClipPosition& a = *corners[c];
+            const ClipPosition& b = *corners[(c + 1) % 3];
+            if (a.z >= 0.0f)  clipped[numClipped++] = a;
+            if ((a.z >= 0.0f) != (b.z >= 0.0f))
+            {
+                // Always interpolate from the corner in front so shared edges are clipped to the same point
+                const ClipPosition& in  = (a.z >= 0.0f) ? a : b;
+                const ClipPosition& out = (a.z >= 0.0f) ? b : a;
+                float t = in.z / (in.z - out.z);
+                clipped[numClipped++] = { in.x + (out.x - in.x) * t, in.y + (out.y - in.y) * t, 0.0f,
+                                          in.w + (out.w - in.w) * t };
+            }
+        }
+
+        // Divide by w and move to pixels, then draw the clipped polygon as a fan
+        float screen[kMaxClipVertices][3];
+        for (int c = 0; c < numClipped; ++c)
+        {
+            float invW = 1.0f / clipped[c].w;
+            screen[c][0] = (1.0f + clipped[c].x * invW) * halfWidth;
+            screen[c][1] = (1.0f - clipped[c].y * invW) * halfHeight;
+            screen[c][2] = clipped[c].z * invW;
+        }
+        for (int c = 2; c < numClipped; ++c)
+        {
+            RasterizeTriangle(screen[0], screen[c - 1], screen[c]);
+        }
+        ++mNumOccluderTriangles;
+    }
+}
+
+
+// Write the farthest depth of a triangle over each pixel it covers completely, keeping the nearest of that and the depth
+// already in the buffer
+void OcclusionBuffer::RasterizeTriangle(const float* v0, const float* v1, const float* v2)
+{
+    // Either winding is drawn, make it the one with positive area
+    float area = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v1[1] - v0[1]) * (v2[0] - v0[0]);
+    if (area < 0.0f)
+    {
+        std::swap(v1, v2);
+        area = -area;
+    }
+    if (!(area > 0.0f))  return; // Also removes NaN
+
+    // Pixel centres inside the bounds of the triangle, clamped to the buffer
+    Level& buffer = mLevels[0];
+    float minX = std::ceil ((std::min)({ v0[0], v1[0], v2[0] }) - 0.5f);
+    float maxX = std::floor((std::max)({ v0[0], v1[0], v2[0] }) - 0.5f);
+    float minY = std::ceil ((std::min)({ v0[1], v1[1], v2[1] }) - 0.5f);
+    float maxY = std::floor((std::max)({ v0[1], v1[1], v2[1] }) - 0.5f);
+    int x0 = static_cast<int>((std::max)(minX, 0.0f));
+    int y0 = static_cast<int>((std::max)(minY, 0.0f));
+    int x1 = static_cast<int>((std::min)(maxX, buffer.width  - 1.0f));
+    int y1 = static_cast<int>((std::min)(maxY, buffer.height - 1.0f));
+    if (x0 > x1 || y0 > y1)  return;
+
+    // Edge functions a*x + b*y + c, positive inside. Edge i is opposite corner i
+    const float* v[3] = { v0, v1, v2 };
+    float a[3], b[3], c[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        const float* from = v[(i + 1) % 3];
+        const float* to   = v[(i + 2) % 3];
+        a[i] = from[1] - to[1];
+        b[i] = to[0] - from[0];
+        c[i] = -(a[i] * from[0] + b[i] * from[1]);
+    }
+
+    // Depth plane from the edge functions (they are the barycentric coordinates times the area). The farthest depth
+    // over a pixel is half a pixel step in each direction from the centre, but no farther than the farthest corner
+    float invArea = 1.0f / area;
+    float dzdx = (a[0] * v0[2] + a[1] * v1[2] + a[2] * v2[2]) * invArea;
+    float dzdy = (b[0] * v0[2] + b[1] * v1[2] + b[2] * v2[2]) * invArea;
+    float z0   = (c[0] * v0[2] + c[1] * v1[2] + c[2] * v2[2]) * invArea;
+
+    // Move each edge in by half a pixel's extent across it, so testing the centre of a pixel against the moved edge is
+    // testing its nearest corner against the real one: only pixels wholly inside the triangle pass
+    for (int i = 0; i < 3; ++i)
+    {
+        c[i] -= 0.5f * (std::abs(a[i]) + std::abs(b[i]));
+    }
+    float zBias = 0.5f * (std::abs(dzdx) + std::abs(dzdy));
+    float zMax  = (std::max)({ v0[2], v1[2], v2[2] });
+
+#ifdef OCCLUSION_CULLING_SSE
+    // Four pixels of a row at a time, starting on a multiple of four so rows never run past the padding
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 laneX = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 firstX = _mm_set1_ps(x0 + 0.5f);
+    const __m128 lastX  = _mm_set1_ps(x1 + 0.5f);
+    const __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]);
+    const __m128 dzdxs = _mm_set1_ps(dzdx);
+    const __m128 zMaxes = _mm_set1_ps(zMax);
+    for (int y = y0; y <= y1; ++y)
+    {
+        float py = y + 0.5f;
+        __m128 row0 = _mm_set1_ps(b[0] * py + c[0]);
+        __m128 row1 = _mm_set1_ps(b[1] * py + c[1]);
+        __m128 row2 = _mm_set1_ps(b[2] * py + c[2]);
+        __m128 rowZ = _mm_set1_ps(dzdy * py + z0 + zBias);
+        float* depthRow = buffer.depth.data() + static_cast<size_t>(y) * buffer.stride;
+        for (int x = x0 & ~3; x <= x1; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneX);
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(px, firstX), _mm_cmple_ps(px, lastX));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), row0), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), row1), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), row2), zero));
+            if (_mm_movemask_ps(inside) == 0)  continue;
+
+            __m128 z = _mm_min_ps(_mm_add_ps(_mm_mul_ps(dzdxs, px), rowZ), zMaxes);
+            __m128 depth = _mm_loadu_ps(depthRow + x);
+            __m128 nearest = _mm_min_ps(depth, z);
+            _mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, depth)));
+        }
+    }
+#else
+    for (int y = y0; y <= y1; ++y)
+    {
+        float py = y + 0.5f;
+        float rowZ = dzdy * py + z0 + zBias;
+        float* depthRow = buffer.depth.data() + static_cast<size_t>(y) * buffer.stride;
+        for (int x = x0; x <= x1; ++x)
+        {
+            float px = x + 0.5f;
+            if (a[0] * px + b[0] * py + c[0] < 0.0f || a[1] * px + b[1] * py + c[1] < 0.0f ||
+                a[2] * px + b[2] * py + c[2] < 0.0f)
+            {
+                continue;
+            }
+            float z = (std::min)(dzdx * px + rowZ, zMax);
+            depthRow[x] = (std::min)(depthRow[x], z);
+        }
+    }
+#endif
+}
+
+
+void OcclusionBuffer::EndOccluders()
+{
+    // Each texel takes the farthest of the 2x2 texels above it. At the right and bottom of levels with an odd size
+    // the last column or row is used twice
+    for (size_t l = 1; l < mLevels.size(); ++l)
+    {
+        const Level& above = mLevels[l - 1];
+        Level& level = mLevels[l];
+        for (int y = 0; y < level.height; ++y)
+        {
+            const float* row0 = above.depth.data() + static_cast<size_t>(y * 2) * above.stride;
+            const float* row1 = above.depth.data() + static_cast<size_t>((std::min)(y * 2 + 1, above.height - 1)) * above.stride;
+            float* out = level.depth.data() + static_cast<size_t>(y) * level.stride;
+            for (int x = 0; x < level.width; ++x)
+            {
+                int left = x * 2;
+                int right = (std::min)(left + 1, above.width - 1);
+                out[x] = (std::max)((std::max)(row0[left], row0[right]), (std::max)(row1[left], row1[right]));
+            }
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Testing
+//--------------------------------------------------------------------------------------
+
+OcclusionBuffer::TestResult OcclusionBuffer::TestBox(const OcclusionBox& box) const
+{
+    const float* m = mViewProjection;
+    float minX, maxX, minY, maxY, minZ;
+
+#ifdef OCCLUSION_CULLING_SSE
+    // The eight corners in two groups of four: x alternates min and max, y changes every two corners, z is the min for
+    // the first group and the max for the second
+    __m128 cornerX = _mm_setr_ps(box.min.x, box.max.x, box.min.x, box.max.x);
+    __m128 cornerY = _mm_setr_ps(box.min.y, box.min.y, box.max.y, box.max.y);
+    __m128 clip[2][4]; // Groups of x, y, z, w
+    for (int axis = 0; axis < 4; ++axis)
+    {
+        __m128 xy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cornerX, _mm_set1_ps(m[axis])), _mm_mul_ps(cornerY, _mm_set1_ps(m[4 + axis]))),
+                               _mm_set1_ps(m[12 + axis]));
+        clip[0][axis] = _mm_add_ps(xy, _mm_set1_ps(box.min.z * m[8 + axis]));
+        clip[1][axis] = _mm_add_ps(xy, _mm_set1_ps(box.max.z * m[8 + axis]));
+    }
+
+    // Off screen if all corners are outside the same plane, which holds for corners behind the camera too. Each mask
+    // keeps a bit for the corners of a group that are outside in both groups, so 0xF means all eight are outside
+    const __m128 zero = _mm_setzero_ps();
+    int allRight = 0xF, allLeft = 0xF, allAbove = 0xF, allBelow = 0xF, allFar = 0xF, allBehind = 0xF, anyBehind = 0;
+    for (int g = 0; g < 2; ++g)
+    {
+        __m128 x = clip[g][0], y = clip[g][1], z = clip[g][2], w = clip[g][3];
+        __m128 minusW = _mm_sub_ps(zero, w);
+        allRight  &= _mm_movemask_ps(_mm_cmpgt_ps(x, w));
+        allLeft   &= _mm_movemask_ps(_mm_cmplt_ps(x, minusW));
+        allAbove  &= _mm_movemask_ps(_mm_cmpgt_ps(y, w));
+        allBelow  &= _mm_movemask_ps(_mm_cmplt_ps(y, minusW));
+        allFar    &= _mm_movemask_ps(_mm_cmpgt_ps(z, w));
+        int behind = _mm_movemask_ps(_mm_cmplt_ps(z, zero));
+        allBehind &= behind;
+        anyBehind |= behind;
+    }
+    if (allRight == 0xF || allLeft == 0xF || allAbove == 0xF || allBelow == 0xF ||
+        allFar == 0xF || allBehind == 0xF)
+    {
+        return kOffScreen;
+    }
+
+    // A box crossing the near plane covers too much of the screen to be worth testing
+    if (anyBehind != 0)  return kVisible;
+
+    // Screen bounds and nearest depth of the corners
+    __m128 invW0 = _mm_div_ps(_mm_set1_ps(1.0f), clip[0][3]);
+    __m128 invW1 = _mm_div_ps(_mm_set1_ps(1.0f), clip[1][3]);
+    __m128 x0 = _mm_mul_ps(clip[0][0], invW0), x1 = _mm_mul_ps(clip[1][0], invW1);
+    __m128 y0 = _mm_mul_ps(clip[0][1], invW0), y1 = _mm_mul_ps(clip[1][1], invW1);
+    __m128 z0 = _mm_mul_ps(clip[0][2], invW0), z1 = _mm_mul_ps(clip[1][2], invW1);
+    minX = HorizontalMin(_mm_min_ps(x0, x1));
+    maxX = HorizontalMax(_mm_max_ps(x0, x1));
+    minY = HorizontalMin(_mm_min_ps(y0, y1));
+    maxY = HorizontalMax(_mm_max_ps(y0, y1));
+    minZ = HorizontalMin(_mm_min_ps(z0, z1));
+#else
+    ClipPosition clip[8];
+    for (int c = 0; c < 8; ++c)
+    {
+        float x = (c & 1) ? box.max.x : box.min.x;
+        float y = (c & 2) ? box.max.y : box.min.y;
+        float z = (c & 4) ? box.max.z : box.min.z;
+        clip[c].x = x * m[0] + y * m[4] + z * m[8]  + m[12];
+        clip[c].y = x * m[1] + y * m[5] + z * m[9]  + m[13];
+        clip[c].z = x * m[2] + y * m[6] + z * m[10] + m[14];
+        clip[c].w = x * m[3] + y * m[7] + z * m[11] + m[15];
+    }
+    bool allRight = true, allLeft = true, allAbove = true, allBelow = true, allFar = true, allBehind = true;
+    bool anyBehind = false;
+    for (const ClipPosition& p : clip)
+    {
+        allRight  &= p.x >  p.w;
+        allLeft   &= p.x < -p.w;
+        allAbove  &= p.y >  p.w;
+        allBelow  &= p.y < -p.w;
+        allFar    &= p.z >  p.w;
+        allBehind &= p.z < 0.0f;
+        anyBehind |= p.z < 0.0f;
+    }
+    if (allRight || allLeft || allAbove || allBelow || allFar || allBehind)  return kOffScreen;
+    if (anyBehind)  return kVisible;
+
+    minX = minY = minZ = HUGE_VALF;
+    maxX = maxY = -HUGE_VALF;
+    for (const ClipPosition& p : clip)
+    {
+        float invW = 1.0f / p.w;
+        minX = (std::min)(minX, p.x * invW);  maxX = (std::max)(maxX, p.x * invW);
+        minY = (std::min)(minY, p.y * invW);  maxY = (std::max)(maxY, p.y * invW);
+        minZ = (std::min)(minZ, p.z * invW);
+    }
+#endif
+
+    // Pixels of the full size buffer touched by the bounds, clamped to the buffer. Screen y is down
+    const Level& buffer = mLevels[0];
+    float halfWidth  = buffer.width  * 0.5f;
+    float halfHeight = buffer.height * 0.5f;
+    auto toPixel = [](float value, float size) { return static_cast<int>((std::min)((std::max)(value, 0.0f), size - 1.0f)); };
+    int left   = toPixel((1.0f + minX) * halfWidth,  static_cast<float>(buffer.width));
+    int right  = toPixel((1.0f + maxX) * halfWidth,  static_cast<float>(buffer.width));
+    int top    = toPixel((1.0f - maxY) * halfHeight, static_cast<float>(buffer.height));
+    int bottom = toPixel((1.0f - minY) * halfHeight, static_cast<float>(buffer.height));
+
+    // Go down the hierarchy until the rectangle covers only a few texels, then the box is hidden if every one of them
+    // is nearer than the nearest point of the box
+    int l = 0;
+    while (l + 1 < static_cast<int>(mLevels.size()) &&
+           ((right >> l) - (left >> l) >= kMaxTestTexels || (bottom >> l) - (top >> l) >= kMaxTestTexels))
+    {
+        ++l;
+    }
+    const Level& level = mLevels[l];
+    for (int y = top >> l; y <= bottom >> l; ++y)
+    {
+        const float* row = level.depth.data() + static_cast<size_t>(y) * level.stride;
+        for (int x = left >> l; x <= right >> l; ++x)
+        {
+            if (row[x] >= minZ)  return kVisible;
+        }
+    }
+    return kOccluded;
+}
+
+
+bool OcclusionBuffer::IsVisible(const OcclusionBox& box) const
+{
+    return TestBox(box) == kVisible;
+}
+
+void OcclusionBuffer::TestBoxes(const OcclusionBox* boxes, size_t numBoxes, uint8_t* visible, OcclusionStats* stats) const
+{
+    // Each thread counts into its own stats, added together at the end
+    std::vector<OcclusionStats> threadStats(GetThreadPool().GetNumThreads());
+    ParallelFor(numBoxes, kTestChunk, [&](size_t begin, size_t end, int thread)
+    {
+        OcclusionStats& counts = threadStats[thread];
+        for (size_t i = begin; i < end; ++i)
+        {
+            TestResult result = TestBox(boxes[i]);
+            visible[i] = (result == kVisible) ? 1 : 0;
+            switch (result)
+            {
+                case kVisible:   ++counts.numVisible;   break;
+                case kOffScreen: ++counts.numOffScreen; break;
+                case kOccluded:  ++counts.numOccluded;  break;
+            }
+        }
+        counts.numTested += end - begin;
+    });
+
+    if (stats != nullptr)
+    {
+        stats->numOccluderTriangles = mNumOccluderTriangles;
+        for (auto& counts : threadStats)  *stats += counts;
+    }
+}
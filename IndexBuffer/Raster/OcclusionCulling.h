@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------------------------
+// Software occlusion culling - skipping objects hidden behind large ones
+//--------------------------------------------------------------------------------------
+// The depth buffer stops hidden pixels being coloured, but every triangle of a hidden object is
+// still transformed and set up first. Occlusion culling finds whole objects that are hidden
+// before they are drawn, using a small depth buffer on the CPU:
+// - A few large meshes that hide a lot of the scene (walls, buildings, the ground) are chosen as
+//   occluders and rasterized into a low resolution depth buffer - a quarter of the screen size
+//   each way is typical. Only depth is written, no colour
+// - The buffer is reduced into a hierarchy: each level is half the size of the one above and
+//   holds the farthest depth of the 2x2 texels it covers
+// - Every other object's bounding box is projected to the screen, giving a rectangle and the
+//   nearest depth of the box. A level is chosen where the rectangle covers a few texels, and if
+//   all of them are nearer than the box, the box (and so the object) is hidden
+//
+// The test must never hide a visible object, so occluders are rasterized conservatively: a pixel
+// is only covered if it is wholly inside an occluder triangle (not just its centre, as on the
+// GPU), and the depth written is the farthest depth of the occluder over the whole pixel, not
+// the depth at its centre. Occluders thinner than a low resolution pixel hide nothing, and the
+// pixels along the edges between an occluder's triangles are left uncovered, which only means
+// fewer objects are culled. Boxes that cross the near plane are always visible.
+//
+// Occluders are drawn without culling either side, so they need not be closed meshes. Boxes are
+// tested four corners at a time with SSE, and large numbers of boxes are split over the shared
+// thread pool.
+//
+// Matrices are 16 floats in the row vector convention of CMatrix4x4, pass &matrix.e00.
+
+#ifndef _OCCLUSION_CULLING_H_INCLUDED_
+#define _OCCLUSION_CULLING_H_INCLUDED_
+
+#include "TriangleCulling.h"
+#include "MeshData.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// An axis aligned bounding box in world space
+struct OcclusionBox
+{
+    CVector3 min;
+    CVector3 max;
+};
+
+// Get the world space bounding box of a model space box moved by a world matrix (which must not include a projection)
+OcclusionBox TransformBox(const OcclusionBox& box, const float* worldMatrix);
+
+
+// What happened to the boxes given to TestBoxes. Every box is counted once
+struct OcclusionStats
+{
+    size_t numOccluderTriangles = 0; // Drawn into the buffer this frame
+    size_t numTested   = 0;
+    size_t numOffScreen = 0;         // Outside the view frustum
+    size_t numOccluded = 0;          // Hidden behind occluders
+    size_t numVisible  = 0;
+
+    OcclusionStats& operator+=(const OcclusionStats& other);
+};
+
+
+class OcclusionBuffer
+{
+public:
+    // Allocate the depth buffer and its hierarchy. The size is in pixels, usually a fraction of the screen with the
+    // same aspect ratio
+    void Init(int width, int height);
+
+    // Start a frame: clear to the far plane and set the camera matrix (view * projection) used by everything after
+    void BeginFrame(const float* viewProjectionMatrix);
+
+    // Rasterize an occluder, a triangle list with a world matrix
+    void AddOccluder(const PositionArray& positions, const MeshIndex* indices, size_t numIndices, const float* worldMatrix);
+
+    // Build the hierarchy after the last occluder. Must be called before testing
+    void EndOccluders();
+
+    // Test world space boxes against the occluders, setting visible[i] to 1 if box i might be seen and 0 if it is off
+    // screen or hidden. Uses the shared thread pool. The stats are added to, not replaced
+    void TestBoxes(const OcclusionBox* boxes, size_t numBoxes, uint8_t* visible, OcclusionStats* stats = nullptr) const;
+
+    // Test a single box, returns false if it is off screen or hidden
+    bool IsVisible(const OcclusionBox& box) const;
+
+    size_t NumOccluderTriangles() const { return mNumOccluderTriangles; }
+
+    // Depth of the levels of the hierarchy, for display. Level 0 is the full buffer, rows of LevelStride() values
+    int          NumLevels() const { return static_cast<int>(mLevels.size()); }
+    int          LevelWidth (int level) const { return mLevels[level].width; }
+    int          LevelHeight(int level) const { return mLevels[level].height; }
+    int          LevelStride(int level) const { return mLevels[level].stride; }
+    const float* LevelDepth (int level) const { return mLevels[level].depth.data(); }
+
+private:
+    enum TestResult
+    {
+        kVisible,
+        kOffScreen,
+        kOccluded,
+    };
+
+    // Depth values of one level of the hierarchy, rows padded to a multiple of four
+    struct Level
+    {
+        int width = 0, height = 0, stride = 0;
+        std::vector<float> depth;
+    };
+
+    // Rasterize a triangle after the perspective divide and viewport transform (x, y in pixels, z depth)
+    void RasterizeTriangle(const float* v0, const float* v1, const float* v2);
+
+    TestResult TestBox(const OcclusionBox& box) const;
+
+    std::vector<Level> mLevels;
+    float              mViewProjection[16] = {};
+    size_t             mNumOccluderTriangles = 0;
+
+    // Scratch memory
+    std::vector<ClipPosition> mClipPositions;
+};
+
+
+#endif //_OCCLUSION_CULLING_H_INCLUDED_
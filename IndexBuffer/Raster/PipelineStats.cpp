@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------------
+// Counts and times for each stage of the rendering pipeline
+//--------------------------------------------------------------------------------------
+
+#include "PipelineStats.h"
+#include <sstream>
+
+RasterPipelineStats& RasterPipelineStats::operator+=(const RasterPipelineStats& stats)
+{
+    numDraws           += stats.numDraws;
+    numIndices         += stats.numIndices;
+    numShadedVertices  += stats.numShadedVertices;
+    numPrimitives      += stats.numPrimitives;
+    numOutsideView     += stats.numOutsideView;
+    numClipped         += stats.numClipped;
+    numCulled          += stats.numCulled;
+    numEmpty           += stats.numEmpty;
+    numSetUp           += stats.numSetUp;
+    numBinned          += stats.numBinned;
+    numPixelsTested    += stats.numPixelsTested;
+    numPixelsWritten   += stats.numPixelsWritten;
+    numPixelsCovered   += stats.numPixelsCovered;
+    shadeMilliseconds  += stats.shadeMilliseconds;
+    setupMilliseconds  += stats.setupMilliseconds;
+    binMilliseconds    += stats.binMilliseconds;
+    rasterMilliseconds += stats.rasterMilliseconds;
+    return *this;
+}
+
+
+std::string PipelineStatsCsvHeader()
+{
+    return "Frame,Renderer,Draws,Indices,Shaded vertices,Primitives,Outside view,Clipped,Culled,Empty,Set up,Binned,"
+           "Pixels tested,Pixels written,Pixels covered,Fill ratio,Overdraw,Shade ms,Setup ms,Bin ms,Raster ms\n";
+}
+
+std::string PipelineStatsCsvRow(uint64_t frame, const std::string& renderer, const RasterPipelineStats& stats,
+                                size_t numTargetPixels)
+{
+    std::ostringstream row;
+    row << frame << ',' << renderer << ',' << stats.numDraws << ',' << stats.numIndices << ',' << stats.numShadedVertices
+        << ',' << stats.numPrimitives << ',' << stats.numOutsideView << ',' << stats.numClipped << ',' << stats.numCulled
+        << ',' << stats.numEmpty << ',' << stats.numSetUp << ',' << stats.numBinned << ',' << stats.numPixelsTested << ','
+        << stats.numPixelsWritten << ',' << stats.numPixelsCovered << ',' << stats.FillRatio(numTargetPixels) << ','
+        << stats.Overdraw() << ',' << stats.shadeMilliseconds << ',' << stats.setupMilliseconds << ',' << stats.binMilliseconds
+        << ',' << stats.rasterMilliseconds << '\n';
+    return row.str();
+}
@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Counts and times for each stage of the rendering pipeline
+//--------------------------------------------------------------------------------------
+// The software renderer counts the work done at each stage as it draws (SoftwareRenderer::PipelineStats), and the GPU's
+// counts for the same stages come from a D3D11_QUERY_PIPELINE_STATISTICS query (see Scene.cpp). Comparing them before
+// and after a change to the meshes or the render state shows which stage it made cheaper or more expensive: reordering
+// the indices changes the vertices shaded, culling back faces changes the triangles culled and the pixels tested, and
+// drawing front to back changes the pixels written.
+//
+// The stats can be written as comma separated values, a row per frame, to load into a spreadsheet or compare with diff.
+
+#ifndef _PIPELINE_STATS_H_INCLUDED_
+#define _PIPELINE_STATS_H_INCLUDED_
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+struct RasterPipelineStats
+{
+    // Input assembler and vertex shader
+    uint64_t numDraws          = 0; // DrawIndexed calls
+    uint64_t numIndices        = 0; // Vertices read by the draws (IAVertices in the GPU's counts)
+    uint64_t numShadedVertices = 0; // Vertex shader runs (VSInvocations)
+
+    // Primitive setup: clipping, the viewport transform and culling
+    uint64_t numPrimitives  = 0; // Triangles or lines assembled from the indices (IAPrimitives)
+    uint64_t numOutsideView = 0; // Thrown away before clipping, every corner being outside the same side of the view
+    uint64_t numClipped     = 0; // Crossing the near or far plane or the guard band, so clipped
+    uint64_t numCulled      = 0; // Triangles facing the side removed by the cull mode
+    uint64_t numEmpty       = 0; // Zero area, or covering no pixel centres in the viewport
+    uint64_t numSetUp       = 0; // Triangles and lines queued to rasterize. Clipping can cut one into several
+                                 // (CPrimitives, though the GPU counts before culling)
+
+    // Binning and rasterization
+    uint64_t numBinned        = 0; // Triangles and lines sorted into tiles, once for each tile they overlap
+    uint64_t numPixelsTested  = 0; // Pixels covered that reached the depth test. Not those where the hierarchical depth
+                                   // test threw the triangle or block away
+    uint64_t numPixelsWritten = 0; // Pixels that passed the depth test (PSInvocations, with early depth testing)
+    uint64_t numPixelsCovered = 0; // Different pixels written, each counted once however many times it was drawn. The
+                                   // GPU has no such count, so it is 0 in the GPU's stats
+
+    // Time spent in each stage. Most stages are spread over several threads, these are the times the caller waited
+    double shadeMilliseconds  = 0.0; // Finding the vertices to shade and shading them
+    double setupMilliseconds  = 0.0; // Assembling, clipping and setting up triangles and lines
+    double binMilliseconds    = 0.0; // Sorting them into tiles
+    double rasterMilliseconds = 0.0; // Drawing the tiles
+
+    // Pixels written for each pixel of a render target. This is not overdraw: pixels never drawn count too, so a scene
+    // covering half the target with every pixel drawn twice also gives 1 (where Overdraw gives 2)
+    float FillRatio(size_t numTargetPixels) const
+    {
+        return numTargetPixels > 0 ? static_cast<float>(numPixelsWritten) / numTargetPixels : 0.0f;
+    }
+
+    // Overdraw: times each pixel drawn was written on average, 1 if none was drawn twice. 0 if the pixels covered are
+    // not known
+    float Overdraw() const
+    {
+        return numPixelsCovered > 0 ? static_cast<float>(numPixelsWritten) / numPixelsCovered : 0.0f;
+    }
+
+    // Add the counts and times of another frame
+    RasterPipelineStats& operator+=(const RasterPipelineStats& stats);
+};
+
+
+// Column names for comma separated values, and one row for a frame's stats (each ending in a newline). The first two
+// columns are the frame number and which renderer drew it. The fill ratio is for a render target of the given size
+std::string PipelineStatsCsvHeader();
+std::string PipelineStatsCsvRow(uint64_t frame, const std::string& renderer, const RasterPipelineStats& stats,
+                                size_t numTargetPixels);
+
+
+#endif //_PIPELINE_STATS_H_INCLUDED_
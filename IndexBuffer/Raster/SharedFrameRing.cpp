@@ -0,0 +1,383 @@
+//--------------------------------------------------------------------------------------
+// Publishing rendered frames through shared memory for a viewer in another process
+//--------------------------------------------------------------------------------------
+
+#include "SharedFrameRing.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Layout of the shared block
+//--------------------------------------------------------------------------------------
+
+// The counters are used from two processes, so they must be plain lock-free atomics with no hidden lock
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "Shared frame ring needs lock-free atomics");
+
+static const uint32_t kRingMagic   = 0x46425249; // "IRBF"
+static const uint32_t kRingVersion = 1;
+
+// Start of the block. The magic number is written last, so a reader that sees it sees the rest of the header too
+struct RingHeader
+{
+    std::atomic<uint32_t> magic;
+    uint32_t              version;
+    uint32_t              width;
+    uint32_t              height;
+    uint32_t              format;       // SharedFrameFormat
+    uint32_t              numSlots;
+    uint64_t              slotStride;   // Bytes from the start of one slot to the next
+    std::atomic<uint64_t> numPublished; // Frames published so far, the latest is numPublished - 1
+    std::atomic<uint32_t> closed;       // Set by the writer as it goes
+};
+
+// Start of each slot, followed by the frame's colours
+struct SlotHeader
+{
+    std::atomic<uint64_t> sequence; // 2N + 1 while frame N is copied in, 2N + 2 once it is complete, 0 if never used
+};
+
+// The header and the colours of each slot start on their own cache lines, so the reader's polling of the frame count
+// does not share a line with the pixels being written
+static const size_t kCacheLine      = 64;
+static const size_t kHeaderSize     = 128;
+static const size_t kSlotHeaderSize = kCacheLine;
+static_assert(sizeof(RingHeader) <= kHeaderSize && sizeof(SlotHeader) <= kSlotHeaderSize, "Ring layout too small");
+
+// How many times a reader starts a copy again when the writer overtakes it, before giving up until the next call
+static const int kMaxReadAttempts = 4;
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+static inline RingHeader* Header(uint8_t* base)
+{
+    return reinterpret_cast<RingHeader*>(base);
+}
+
+static inline SlotHeader* Slot(uint8_t* base, uint64_t frame)
+{
+    RingHeader* header = Header(base);
+    return reinterpret_cast<SlotHeader*>(base + kHeaderSize + (frame % header->numSlots) * header->slotStride);
+}
+
+static inline uint32_t* SlotColours(SlotHeader* slot)
+{
+    return reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(slot) + kSlotHeaderSize);
+}
+
+// Name of the shared memory object for a plain name
+static std::string SystemName(const std::string& name)
+{
+#ifdef _WIN32
+    return "Local\\" + name; // Visible to this login session
+#else
+    return "/" + name;
+#endif
+}
+
+static double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writer
+//--------------------------------------------------------------------------------------
+
+bool SharedFrameWriter::Create(const std::string& name, int width, int height, int numSlots, bool replace,
+                               std::string& error)
+{
+    Close();
+    if (name.empty() || name.find_first_of("/\\") != std::string::npos || width <= 0 || height <= 0)
+    {
+        error = "Invalid shared memory name or frame size";
+        return false;
+    }
+    numSlots = (std::max)(numSlots, kMinSlots);
+
+    size_t frameSize  = static_cast<size_t>(width) * height * sizeof(uint32_t);
+    size_t slotStride = (kSlotHeaderSize + frameSize + kCacheLine - 1) / kCacheLine * kCacheLine;
+    size_t size = kHeaderSize + slotStride * numSlots;
+    std::string systemName = SystemName(name);
+
+#ifdef _WIN32
+    (void)replace; // A mapping goes when the last process holding it closes, so there is never an old one to remove
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                        static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                                        static_cast<DWORD>(size & 0xFFFFFFFF), systemName.c_str());
+    if (mapping == nullptr)
+    {
+        error = "Cannot create shared memory " + name;
+        return false;
+    }
+    // A reader still holding the block of an earlier writer keeps it alive, and its size may be wrong for this one
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        CloseHandle(mapping);
+        error = "Shared memory " + name + " is still open in another process";
+        return false;
+    }
+    void* base = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (base == nullptr)
+    {
+        CloseHandle(mapping);
+        error = "Cannot map shared memory " + name;
+        return false;
+    }
+    mMapping = mapping;
+#else
+    // Only remove an existing block when asked: it may belong to a writer that is still running. Readers holding a
+    // removed block keep their view of it
+    if (replace)  shm_unlink(systemName.c_str());
+    int file = shm_open(systemName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (file < 0)
+    {
+        if (errno == EEXIST)  error = "Shared memory " + name + " already exists, another writer may be using it";
+        else                  error = "Cannot create shared memory " + name;
+        return false;
+    }
+    void* base = MAP_FAILED;
+    if (ftruncate(file, static_cast<off_t>(size)) == 0)
+    {
+        base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    }
+    close(file); // The mapping keeps the memory
+    if (base == MAP_FAILED)
+    {
+        shm_unlink(systemName.c_str());
+        error = "Cannot map shared memory " + name;
+        return false;
+    }
+#endif
+
+    // New shared memory is zeroed, so every slot's sequence number starts at 0 (never used)
+    mBase = static_cast<uint8_t*>(base);
+    mSize = size;
+    mName = name;
+    mStats = SharedFrameStats();
+
+    RingHeader* header = new (mBase) RingHeader;
+    header->version    = kRingVersion;
+    header->width      = static_cast<uint32_t>(width);
+    header->height     = static_cast<uint32_t>(height);
+    header->format     = static_cast<uint32_t>(SharedFrameFormat::Rgba8);
+    header->numSlots   = static_cast<uint32_t>(numSlots);
+    header->slotStride = slotStride;
+    header->numPublished.store(0, std::memory_order_relaxed);
+    header->closed.store(0, std::memory_order_relaxed);
+    for (int i = 0; i < numSlots; ++i)
+    {
+        new (mBase + kHeaderSize + i * slotStride) SlotHeader{};
+    }
+    header->magic.store(kRingMagic, std::memory_order_release);
+    return true;
+}
+
+
+void SharedFrameWriter::Close()
+{
+    if (mBase == nullptr)  return;
+    Header(mBase)->closed.store(1, std::memory_order_release);
+#ifdef _WIN32
+    UnmapViewOfFile(mBase);
+    CloseHandle(mMapping);
+    mMapping = nullptr;
+#else
+    munmap(mBase, mSize);
+    shm_unlink(SystemName(mName).c_str());
+#endif
+    mBase = nullptr;
+    mSize = 0;
+}
+
+
+// The slot's sequence number is odd while it is written. The release fence keeps the colour writes after that store,
+// and the release store of the even number keeps them before, so a reader that sees the same even number before and
+// after its copy copied a complete frame
+void SharedFrameWriter::Publish(const uint32_t* colours, size_t rowPitch)
+{
+    if (mBase == nullptr)  return;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    RingHeader* header = Header(mBase);
+    size_t width = header->width, height = header->height;
+    if (rowPitch == 0)  rowPitch = width;
+
+    uint64_t frame = mStats.numPublished;
+    SlotHeader* slot = Slot(mBase, frame);
+    slot->sequence.store(frame * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint32_t* copy = SlotColours(slot);
+    if (rowPitch == width)  std::memcpy(copy, colours, width * height * sizeof(uint32_t));
+    else
+    {
+        for (size_t y = 0; y < height; ++y)
+        {
+            std::memcpy(copy + y * width, colours + y * rowPitch, width * sizeof(uint32_t));
+        }
+    }
+
+    slot->sequence.store(frame * 2 + 2, std::memory_order_release);
+    header->numPublished.store(frame + 1, std::memory_order_release);
+
+    ++mStats.numPublished;
+    mStats.copyMilliseconds += MillisecondsSince(start);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reader
+//--------------------------------------------------------------------------------------
+
+bool SharedFrameReader::Open(const std::string& name, std::string& error)
+{
+    Close();
+    std::string systemName = SystemName(name);
+
+#ifdef _WIN32
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, systemName.c_str());
+    if (mapping == nullptr)
+    {
+        error = "No shared memory " + name;
+        return false;
+    }
+    void* base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION region;
+    if (base == nullptr || VirtualQuery(base, &region, sizeof(region)) == 0)
+    {
+        if (base != nullptr)  UnmapViewOfFile(base);
+        CloseHandle(mapping);
+        error = "Cannot map shared memory " + name;
+        return false;
+    }
+    size_t size = region.RegionSize;
+    mMapping = mapping;
+#else
+    int file = shm_open(systemName.c_str(), O_RDONLY, 0);
+    if (file < 0)
+    {
+        error = "No shared memory " + name;
+        return false;
+    }
+    struct stat fileStat;
+    void* base = MAP_FAILED;
+    size_t size = 0;
+    if (fstat(file, &fileStat) == 0 && fileStat.st_size >= static_cast<off_t>(kHeaderSize))
+    {
+        size = static_cast<size_t>(fileStat.st_size);
+        base = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+    }
+    close(file);
+    if (base == MAP_FAILED)
+    {
+        error = "Cannot map shared memory " + name;
+        return false;
+    }
+#endif
+
+    mBase = static_cast<uint8_t*>(base);
+    mSize = size;
+    mStats = SharedFrameStats();
+
+    // Check the header describes a block of the size that was mapped
+    RingHeader* header = Header(mBase);
+    bool valid = header->magic.load(std::memory_order_acquire) == kRingMagic && header->version == kRingVersion &&
+                 header->format == static_cast<uint32_t>(SharedFrameFormat::Rgba8) && header->width > 0 &&
+                 header->height > 0 && header->numSlots > 0 &&
+                 header->slotStride >= kSlotHeaderSize + static_cast<uint64_t>(header->width) * header->height * 4 &&
+                 kHeaderSize + header->slotStride * header->numSlots <= size;
+    if (!valid)
+    {
+        Close();
+        error = "Shared memory " + name + " is not a frame ring this program can read (or is still being created)";
+        return false;
+    }
+
+    mInfo.width    = static_cast<int>(header->width);
+    mInfo.height   = static_cast<int>(header->height);
+    mInfo.format   = static_cast<SharedFrameFormat>(header->format);
+    mInfo.numSlots = static_cast<int>(header->numSlots);
+
+    // The latest frame can still be read, frames before it were published before this reader arrived
+    uint64_t numPublished = header->numPublished.load(std::memory_order_acquire);
+    mNumSeen = numPublished > 0 ? numPublished - 1 : 0;
+    return true;
+}
+
+
+void SharedFrameReader::Close()
+{
+    if (mBase == nullptr)  return;
+#ifdef _WIN32
+    UnmapViewOfFile(mBase);
+    CloseHandle(mMapping);
+    mMapping = nullptr;
+#else
+    munmap(mBase, mSize);
+#endif
+    mBase = nullptr;
+    mSize = 0;
+    mInfo = SharedFrameInfo();
+}
+
+
+// Copy the slot of the latest frame, then check its sequence number again after an acquire fence. If the writer
+// started on the slot during the copy the number has changed and the copy is thrown away
+SharedFrameReader::ReadResult SharedFrameReader::ReadLatest(std::vector<uint32_t>& colours, uint64_t& frame)
+{
+    if (mBase == nullptr)  return ReadResult::Closed;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    RingHeader* header = Header(mBase);
+    size_t frameSize = static_cast<size_t>(mInfo.width) * mInfo.height;
+    colours.resize(frameSize);
+
+    for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt)
+    {
+        uint64_t numPublished = header->numPublished.load(std::memory_order_acquire);
+        if (numPublished <= mNumSeen)
+        {
+            return header->closed.load(std::memory_order_acquire) != 0 ? ReadResult::Closed : ReadResult::NoFrame;
+        }
+
+        uint64_t latest = numPublished - 1;
+        uint64_t complete = latest * 2 + 2;
+        SlotHeader* slot = Slot(mBase, latest);
+        if (slot->sequence.load(std::memory_order_acquire) == complete)
+        {
+            std::memcpy(colours.data(), SlotColours(slot), frameSize * sizeof(uint32_t));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot->sequence.load(std::memory_order_relaxed) == complete)
+            {
+                mStats.numMissed += latest - mNumSeen;
+                ++mStats.numRead;
+                mStats.copyMilliseconds += MillisecondsSince(start);
+                mNumSeen = numPublished;
+                frame = latest;
+                return ReadResult::NewFrame;
+            }
+        }
+        ++mStats.numRetries; // Overtaken by the writer, try the frame it has published since
+    }
+    mStats.copyMilliseconds += MillisecondsSince(start);
+    return ReadResult::NoFrame;
+}
@@ -0,0 +1,150 @@
+//--------------------------------------------------------------------------------------
+// Publishing rendered frames through shared memory for a viewer in another process
+//--------------------------------------------------------------------------------------
+// On a machine with no display (a build or test server running SoftRender) the frames can still
+// be watched as they are drawn: the renderer copies each finished frame into a named block of
+// shared memory and a separate program (Tools/FrameView.cpp) reads them out to show, save or
+// stream on as a video.
+//
+// The block is a header followed by a ring of frame slots:
+// - Header: a magic number and version, the frame size and format, the number of slots, the
+//   number of frames published so far and a flag set when the writer closes
+// - Slot: a sequence number and one frame of packed colours (the FrameBuffer format)
+// Frame N goes in slot N % numSlots. Its sequence number is made odd while the frame is copied in
+// and even (2N + 2) once it is complete, then the header's frame count is moved on. A reader
+// takes the latest frame, copies it out and checks the sequence number is unchanged, so it knows
+// the writer did not start reusing the slot during the copy (a "seqlock").
+//
+// The writer takes no locks and never waits for a reader, so publishing costs the same with or
+// without one, about one memcpy of the frame. A reader that falls behind does not hold up the
+// renderer; it misses frames, which it sees as gaps in the frame numbers. More slots make it
+// less likely a slot is reused while it is being read.
+//
+// Uses POSIX shared memory (shm_open and mmap) on Linux / macOS and named file mappings on
+// Windows. Link with -lrt on older Linux systems.
+
+#ifndef _SHARED_FRAME_RING_H_INCLUDED_
+#define _SHARED_FRAME_RING_H_INCLUDED_
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Pixel format of the frames in the ring
+enum class SharedFrameFormat : uint32_t
+{
+    Rgba8 = 1, // Packed colours as stored in FrameBuffer, red in the low byte
+};
+
+// Frame size and format as read from the header
+struct SharedFrameInfo
+{
+    int width  = 0;
+    int height = 0;
+    SharedFrameFormat format = SharedFrameFormat::Rgba8;
+    int numSlots = 0;
+};
+
+// Counts since the ring was created or opened
+struct SharedFrameStats
+{
+    uint64_t numPublished = 0; // Writer: frames copied into the ring
+    uint64_t numRead      = 0; // Reader: frames copied out
+    uint64_t numMissed    = 0; // Reader: frames published that were never read, overtaken by later ones
+    uint64_t numRetries   = 0; // Reader: copies thrown away because the writer reused the slot meanwhile
+    double   copyMilliseconds = 0.0; // Time spent copying frames in or out
+};
+
+
+//--------------------------------------------------------------------------------------
+// Writer
+//--------------------------------------------------------------------------------------
+
+// Creates the shared block and publishes frames into it. Only one writer can use a name at a time
+class SharedFrameWriter
+{
+public:
+    static const int kMinSlots = 2; // One being read while the next is written
+
+    SharedFrameWriter() = default;
+    ~SharedFrameWriter() { Close(); }
+    SharedFrameWriter(const SharedFrameWriter&) = delete;
+    SharedFrameWriter& operator=(const SharedFrameWriter&) = delete;
+
+    // Create the named block for frames of the given size. The name is a plain word such as "IndexBuffer". Fails if a
+    // block of that name exists, as another writer may be using it, unless replace is set: then a block left behind by
+    // a writer that did not close is removed first (on Linux / macOS - on Windows a block only lasts while a process
+    // has it open, so none is left behind). Returns false and sets error on failure. Any open ring is closed first
+    bool Create(const std::string& name, int width, int height, int numSlots, bool replace, std::string& error);
+
+    // Tell readers the writer has gone, and remove the block (readers that have it open keep their view of it)
+    void Close();
+
+    bool IsOpen() const { return mBase != nullptr; }
+
+    // Copy a frame of packed colours into the next slot and publish it. Rows are rowPitch colours apart, 0 for the
+    // width. Never blocks
+    void Publish(const uint32_t* colours, size_t rowPitch = 0);
+
+    const SharedFrameStats& Stats() const { return mStats; }
+
+private:
+    std::string mName;
+    uint8_t*    mBase = nullptr; // Start of the mapped block
+    size_t      mSize = 0;
+#ifdef _WIN32
+    void*       mMapping = nullptr; // HANDLE
+#endif
+    SharedFrameStats mStats;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Reader
+//--------------------------------------------------------------------------------------
+
+// Opens a block created by a SharedFrameWriter, in this or another process, and copies frames out of it
+class SharedFrameReader
+{
+public:
+    // Result of reading
+    enum class ReadResult
+    {
+        NewFrame, // A frame later than the last one read was copied out
+        NoFrame,  // Nothing new has been published (or the writer kept overtaking the copy)
+        Closed,   // The writer has closed the ring, Open again to wait for a new writer
+    };
+
+    SharedFrameReader() = default;
+    ~SharedFrameReader() { Close(); }
+    SharedFrameReader(const SharedFrameReader&) = delete;
+    SharedFrameReader& operator=(const SharedFrameReader&) = delete;
+
+    // Open the named block. Returns false and sets error if there is no writer yet or the block is not a frame ring of
+    // this version. Any open ring is closed first
+    bool Open(const std::string& name, std::string& error);
+    void Close();
+
+    bool IsOpen() const { return mBase != nullptr; }
+    const SharedFrameInfo& Info() const { return mInfo; }
+
+    // Copy the latest frame into colours (resized to width * height) if it is newer than the last one read, and set
+    // frame to its number (counting from 0 when the writer was created)
+    ReadResult ReadLatest(std::vector<uint32_t>& colours, uint64_t& frame);
+
+    const SharedFrameStats& Stats() const { return mStats; }
+
+private:
+    uint8_t*        mBase = nullptr;
+    size_t          mSize = 0;
+#ifdef _WIN32
+    void*           mMapping = nullptr; // HANDLE
+#endif
+    SharedFrameInfo mInfo;
+    uint64_t        mNumSeen = 0; // Frames published as of the last one read
+    SharedFrameStats mStats;
+};
+
+
+#endif //_SHARED_FRAME_RING_H_INCLUDED_
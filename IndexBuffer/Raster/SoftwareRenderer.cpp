@@ -0,0 +1,1846 @@
+//--------------------------------------------------------------------------------------
+// Software renderer - the app's GPU pipeline run on the CPU
+//--------------------------------------------------------------------------------------
+
+#include "SoftwareRenderer.h"
+#include "ThreadPool.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <chrono>
+#include <limits>
+#ifdef CPU_FEATURES_X86
+#include <immintrin.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SOFTWARE_RENDERER_SSE
+#include <emmintrin.h>
+#endif
+
+const MeshIndex kStripCut     = 0xFFFFFFFF; // Index that starts a new triangle strip
+const int       kSubPixelBits = 8;          // Corners are snapped to 1/256 pixel, as on D3D11 hardware
+const int32_t   kSubPixels    = 1 << kSubPixelBits;
+const int       kMaxClippedVertices = 9;    // A triangle clipped by six planes has at most 3 + 6 corners
+const float     kGuardBand = 16384.0f;      // Pixels from the centre of the viewport that need no clipping in x and y
+const int       kTileShift = 6;             // log2 of SoftwareRenderer::kTileSize
+
+const uint32_t kShadeChunk = 4096;          // Fewest vertices shaded by one task
+const uint32_t kBinChunk   = 4096;          // Triangles set up and binned by one task
+const size_t   kMaxQueuedTriangles = 1 << 18; // Flush when the queue grows past this (about 30MB)
+
+const int      kBlockShift = 3;             // AVX2 rasterization works on blocks of 8x8 pixels
+const int      kBlockSize  = 1 << kBlockShift;
+const int64_t  kMaxBlockEdgeStep = int64_t(1) << 27; // Larger edge steps could overflow 32-bit edge values in a block
+const int      kMinBlockRasterPixels = 16;  // Triangles with smaller bounds are rasterized a pixel at a time
+
+const float    kDepthRounding = 1.0f / (1 << 18); // Rounding allowed for in depth interpolated across a pixel or two
+
+static_assert(SoftwareRenderer::kTileSize == 1 << kTileShift, "Tile size and shift do not match");
+static_assert(SoftwareRenderer::kTileSize == 64, "A row of a tile's coverage must be one 64-bit word");
+static_assert(FrameBuffer::kDepthBlockShift == kBlockShift, "AVX2 blocks must be the depth blocks of the frame buffer");
+
+// Out codes hold a bit for each plane a vertex is outside. The low six are the sides of the view frustum, used to throw
+// away triangles that are entirely outside one of them. The next six are the planes triangles are actually clipped
+// against: the near and far planes are the same, but left, right, bottom and top are the sides of the guard band, far
+// outside the viewport. A triangle inside the guard band but crossing the edge of the viewport needs no clipping, the
+// rasterizer only visits pixels inside the viewport anyway. The guard band keeps the pixel coordinates small enough for
+// the fixed point edge equations
+enum ClipPlane
+{
+    kClipLeft,
+    kClipRight,
+    kClipBottom,
+    kClipTop,
+    kClipNear,
+    kClipFar,
+    kNumClipPlanes
+};
+const uint32_t kOutsideView = (1 << kNumClipPlanes) - 1;
+const uint32_t kOutsideClip = kOutsideView << kNumClipPlanes;
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+// Compare semantic names ignoring case, as HLSL does
+static bool SameSemantic(const char* a, const char* b)
+{
+    for (; *a != '\0' && *b != '\0'; ++a, ++b)
+    {
+        if (std::tolower(static_cast<unsigned char>(*a)) != std::tolower(static_cast<unsigned char>(*b)))  return false;
+    }
+    return *a == *b;
+}
+
+// Time since start, for the stage times of RasterPipelineStats
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Number of bits set, for the pixels covered in a row of a tile
+static inline uint32_t CountBits(uint64_t bits)
+{
+    bits = bits - ((bits >> 1) & 0x5555555555555555ull);
+    bits = (bits & 0x3333333333333333ull) + ((bits >> 2) & 0x3333333333333333ull);
+    bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return static_cast<uint32_t>((bits * 0x0101010101010101ull) >> 56);
+}
+
+// Mark pixel (x, y) as written in the coverage of the tile it is in
+static inline void MarkCovered(uint64_t* tileCoverage, int x, int y)
+{
+    tileCoverage[y & (SoftwareRenderer::kTileSize - 1)] |= uint64_t(1) << (x & (SoftwareRenderer::kTileSize - 1));
+}
+
+// result = a * b for 4x4 matrices in the row vector convention (result may not be a or b)
+static void MultiplyMatrices(const float* a, const float* b, float* result)
+{
+    for (int row = 0; row < 4; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            result[row * 4 + column] = a[row * 4 + 0] * b[0 * 4 + column] + a[row * 4 + 1] * b[1 * 4 + column] +
+                                       a[row * 4 + 2] * b[2 * 4 + column] + a[row * 4 + 3] * b[3 * 4 + column];
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// State
+//--------------------------------------------------------------------------------------
+
+void SoftwareRenderer::SetRenderTarget(FrameBuffer* target)
+{
+    Flush();
+    mTarget = target;
+    if (target != nullptr)
+    {
+        mViewport = RasterViewport();
+        mViewport.width  = static_cast<float>(target->Width());
+        mViewport.height = static_cast<float>(target->Height());
+        mTilesX = (target->Width()  + kTileSize - 1) >> kTileShift;
+        mTilesY = (target->Height() + kTileSize - 1) >> kTileShift;
+    }
+    mCoverage.clear(); // Pixels covered count for one target, they start again on Flush
+}
+
+void SoftwareRenderer::SetDepthState(RasterDepthTest test, bool write)
+{
+    mDepthTest  = test;
+    mDepthWrite = write;
+}
+
+
+bool SoftwareRenderer::SetInputLayout(const VertexStream* streams, int numStreams)
+{
+    mPositionSlot = mColourSlot = -1;
+    for (int s = 0; s < numStreams; ++s)
+    {
+        const VertexStream& stream = streams[s];
+        if (stream.slot >= kMaxSlots || stream.perInstance)  continue;
+        for (uint32_t e = 0; e < stream.numElements; ++e)
+        {
+            const VertexElement& element = stream.elements[e];
+            if (SameSemantic(element.semanticName, "Position") && element.format == VertexElementFormat::Float3)
+            {
+                mPositionSlot   = static_cast<int>(stream.slot);
+                mPositionOffset = element.offset;
+            }
+            else if (SameSemantic(element.semanticName, "Colour") &&
+                     (element.format == VertexElementFormat::Float4 || element.format == VertexElementFormat::UByte4Norm))
+            {
+                mColourSlot   = static_cast<int>(stream.slot);
+                mColourOffset = element.offset;
+                mColourBytes  = element.format == VertexElementFormat::UByte4Norm;
+            }
+        }
+    }
+    return mPositionSlot >= 0 && mColourSlot >= 0;
+}
+
+void SoftwareRenderer::SetVertexBuffers(int startSlot, int numBuffers, const void* const* data, const uint32_t* strides)
+{
+    for (int i = 0; i < numBuffers && startSlot + i < kMaxSlots; ++i)
+    {
+        mVertexData[startSlot + i] = static_cast<const uint8_t*>(data[i]);
+        mStrides[startSlot + i]    = strides[i];
+    }
+}
+
+
+void SoftwareRenderer::SetRasterPath(RasterPath path)
+{
+    if (path == RasterPath::Auto)  path = CpuHasAvx2() ? RasterPath::Avx2 : RasterPath::Scalar;
+    mRasterPath = path;
+}
+
+
+void SoftwareRenderer::ResetPipelineStats()
+{
+    mPipelineStats = RasterPipelineStats();
+    std::fill(mCoverage.begin(), mCoverage.end(), uint64_t(0));
+}
+
+
+void SoftwareRenderer::SetVertexCache(VertexCacheType type, int cacheSize)
+{
+    mVertexCacheType = type;
+    mVertexCacheSize = (std::max)(cacheSize, 0);
+}
+
+
+void SoftwareRenderer::SetFrameConstants(const float* viewMatrix, const float* projectionMatrix)
+{
+    std::memcpy(mViewMatrix, viewMatrix, sizeof(mViewMatrix));
+    std::memcpy(mProjectionMatrix, projectionMatrix, sizeof(mProjectionMatrix));
+}
+
+void SoftwareRenderer::SetModelConstants(const float* worldMatrix, const float* tint)
+{
+    std::memcpy(mWorldMatrix, worldMatrix, sizeof(mWorldMatrix));
+    static const float kWhite[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    std::memcpy(mTint, (tint != nullptr) ? tint : kWhite, sizeof(mTint));
+}
+
+
+//--------------------------------------------------------------------------------------
+// Vertex shader
+//--------------------------------------------------------------------------------------
+
+// TransformColour_vs.hlsl for a range of vertices, or for the vertices in a list if vertexList is not null. The three
+// matrices are combined first, which gives the same result as the shader's three multiplications to within rounding.
+// Large draws are split across the thread pool
+void SoftwareRenderer::ShadeVertices(const uint32_t* vertexList, uint32_t firstVertex, uint32_t numVertices)
+{
+    float worldView[16], worldViewProjection[16];
+    MultiplyMatrices(mWorldMatrix, mViewMatrix, worldView);
+    MultiplyMatrices(worldView, mProjectionMatrix, worldViewProjection);
+
+    mShadedVertices.resize(numVertices);
+    mOutCodes.resize(numVertices);
+    auto shade = [&](size_t begin, size_t end, int /*threadIndex*/)
+    {
+        if (mColourBytes)  ShadeVertexRange<true> (vertexList, firstVertex, begin, end, worldViewProjection, mTint);
+        else               ShadeVertexRange<false>(vertexList, firstVertex, begin, end, worldViewProjection, mTint);
+        ClassifyVertices(mShadedVertices.data() + begin, end - begin, mOutCodes.data() + begin);
+    };
+    if (mMultithreaded)  ParallelFor(numVertices, kShadeChunk, shade);
+    else                 shade(0, numVertices, 0);
+}
+
+// Shade vertices begin to end - 1 of a draw with the combined matrix m, reading UByte4Norm colours if kColourBytes
+// and Float4 colours otherwise, then multiplying them by the tint as the shader's gTint does
+template <bool kColourBytes>
+void SoftwareRenderer::ShadeVertexRange(const uint32_t* vertexList, uint32_t firstVertex, size_t begin, size_t end,
+                                        const float* m, const float* tint)
+{
+    const uint8_t* positions = mVertexData[mPositionSlot] + mPositionOffset;
+    const uint8_t* colours   = mVertexData[mColourSlot] + mColourOffset;
+    uint32_t positionStride = mStrides[mPositionSlot];
+    uint32_t colourStride   = mStrides[mColourSlot];
+    for (size_t i = begin; i < end; ++i)
+    {
+        size_t vertex = (vertexList != nullptr) ? vertexList[i] : static_cast<size_t>(firstVertex) + i;
+        float p[3];
+        std::memcpy(p, positions + vertex * positionStride, sizeof(p));
+
+        ShadedVertex& out = mShadedVertices[i];
+        out.x = p[0] * m[0] + p[1] * m[4] + p[2] * m[8]  + m[12];
+        out.y = p[0] * m[1] + p[1] * m[5] + p[2] * m[9]  + m[13];
+        out.z = p[0] * m[2] + p[1] * m[6] + p[2] * m[10] + m[14];
+        out.w = p[0] * m[3] + p[1] * m[7] + p[2] * m[11] + m[15];
+
+        const uint8_t* colour = colours + vertex * colourStride;
+        if (kColourBytes)
+        {
+            out.r = colour[0] / 255.0f;
+            out.g = colour[1] / 255.0f;
+            out.b = colour[2] / 255.0f;
+            out.a = colour[3] / 255.0f;
+        }
+        else
+        {
+            std::memcpy(&out.r, colour, sizeof(float) * 4);
+        }
+        out.r *= tint[0];
+        out.g *= tint[1];
+        out.b *= tint[2];
+        out.a *= tint[3];
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Drawing - front end
+//--------------------------------------------------------------------------------------
+
+void SoftwareRenderer::DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex)
+{
+    if (mTarget == nullptr || mIndices == nullptr || mPositionSlot < 0 || mColourSlot < 0 ||
+        mVertexData[mPositionSlot] == nullptr || mVertexData[mColourSlot] == nullptr)  return;
+    const MeshIndex* indices = mIndices + startIndex;
+    bool strip = mTopology == RasterTopology::TriangleStrip;
+    bool lines = mTopology == RasterTopology::LineList;
+
+    // Find the range of vertices used
+    int64_t minVertex = INT64_MAX, maxVertex = INT64_MIN;
+    uint32_t numUsedIndices = 0;
+    for (uint32_t i = 0; i < indexCount; ++i)
+    {
+        if (strip && indices[i] == kStripCut)  continue;
+        int64_t vertex = static_cast<int64_t>(indices[i]) + baseVertex;
+        minVertex = (std::min)(minVertex, vertex);
+        maxVertex = (std::max)(maxVertex, vertex);
+        ++numUsedIndices;
+    }
+    if (minVertex > maxVertex || minVertex < 0)  return;
+    // The guard band is the same distance in pixels whatever the viewport size, but no smaller than the viewport
+    mGuardBandX = (std::max)(1.0f, kGuardBand / (std::max)(mViewport.width  * 0.5f, 1.0f));
+    mGuardBandY = (std::max)(1.0f, kGuardBand / (std::max)(mViewport.height * 0.5f, 1.0f));
+
+    // Run the vertex shader and find where each index's output is in mShadedVertices (strip cuts stay as kStripCut)
+    auto shadeStart = std::chrono::steady_clock::now();
+    uint32_t numRangeVertices = static_cast<uint32_t>(maxVertex - minVertex + 1);
+    uint32_t numShaded;
+    mIndexSlots.resize(indexCount);
+    if (mVertexCacheSize > 0)
+    {
+        // Through the cache model: only misses are shaded
+        numShaded = AssignCacheSlots(indices, indexCount, baseVertex, minVertex, numRangeVertices, strip);
+        ShadeVertices(mMissVertices.data(), 0, numShaded);
+    }
+    else
+    {
+        // Each vertex in the range once, an ideal cache
+        for (uint32_t i = 0; i < indexCount; ++i)
+        {
+            mIndexSlots[i] = (strip && indices[i] == kStripCut) ? kStripCut
+                           : static_cast<uint32_t>(static_cast<int64_t>(indices[i]) + baseVertex - minVertex);
+        }
+        numShaded = numRangeVertices;
+        ShadeVertices(nullptr, static_cast<uint32_t>(minVertex), numShaded);
+    }
+    double shadeMilliseconds = MillisecondsSince(shadeStart);
+    mVertexStats.numIndices        += numUsedIndices;
+    mVertexStats.numShadedVertices += numShaded;
+    mVertexStats.shadeMilliseconds += shadeMilliseconds;
+    ++mPipelineStats.numDraws;
+    mPipelineStats.numIndices        += numUsedIndices;
+    mPipelineStats.numShadedVertices += numShaded;
+    mPipelineStats.shadeMilliseconds += shadeMilliseconds;
+
+    // Assemble the triangles, three positions in mShadedVertices for each, or the lines, two for each
+    auto setupStart = std::chrono::steady_clock::now();
+    const uint32_t* slots = mIndexSlots.data();
+    mCorners.clear();
+    if (lines)
+    {
+        mCorners.assign(slots, slots + (indexCount & ~1u));
+    }
+    else if (!strip)
+    {
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            mCorners.insert(mCorners.end(), { slots[i], slots[i + 1], slots[i + 2] });
+        }
+    }
+    else
+    {
+        // Strips: each index makes a triangle with the two before it. Every other triangle has its last two corners
+        // swapped to keep the same winding
+        uint32_t window[3] = {};
+        uint32_t numInStrip = 0;
+        for (uint32_t i = 0; i < indexCount; ++i)
+        {
+            if (slots[i] == kStripCut)
+            {
+                numInStrip = 0;
+                continue;
+            }
+            window[0] = window[1];
+            window[1] = window[2];
+            window[2] = slots[i];
+            if (++numInStrip < 3)  continue;
+
+            if ((numInStrip & 1) != 0)  mCorners.insert(mCorners.end(), { window[0], window[1], window[2] });
+            else                        mCorners.insert(mCorners.end(), { window[0], window[2], window[1] });
+        }
+    }
+
+    // Set up the triangles in runs of kBinChunk, one task each. Very large draws are queued in parts, flushing in
+    // between, to limit the memory used
+    DrawState state = { mDepthTest, mDepthWrite, mColourWrites, mViewport.minDepth, mViewport.maxDepth, SelectPipeline() };
+    size_t numCorners = lines ? 2 : 3;
+    uint32_t numTriangles = static_cast<uint32_t>(mCorners.size() / numCorners);
+    mPipelineStats.numPrimitives += numTriangles;
+    for (uint32_t first = 0; first < numTriangles; )
+    {
+        uint32_t count = static_cast<uint32_t>((std::min)(static_cast<size_t>(numTriangles - first), kMaxQueuedTriangles));
+        mDrawStates.push_back(state);
+        uint32_t drawState = static_cast<uint32_t>(mDrawStates.size() - 1);
+
+        // Small draws add to the last batch while it has room, so a scene of many small draws still has few batches
+        int numChunks = static_cast<int>((count + kBinChunk - 1) / kBinChunk);
+        size_t firstBatch = mNumBatches;
+        if (numChunks == 1 && mNumBatches > 0 && mBatches[mNumBatches - 1].triangles.size() < kBinChunk)
+        {
+            firstBatch = mNumBatches - 1;
+        }
+        else
+        {
+            mNumBatches += numChunks;
+            if (mBatches.size() < mNumBatches)  mBatches.resize(mNumBatches);
+            for (size_t b = firstBatch; b < mNumBatches; ++b)
+            {
+                mBatches[b].triangles.clear();
+                mBatches[b].counts = SetupCounts();
+            }
+        }
+        const uint32_t* corners = mCorners.data() + first * numCorners;
+        RunTasks(numChunks, [&](int chunk, int /*threadIndex*/)
+        {
+            uint32_t begin = chunk * kBinChunk;
+            const uint32_t* chunkCorners = corners + begin * numCorners;
+            uint32_t chunkCount = (std::min)(kBinChunk, count - begin);
+            if (lines)  SetUpLines    (chunkCorners, chunkCount, drawState, mBatches[firstBatch + chunk]);
+            else        SetUpTriangles(chunkCorners, chunkCount, drawState, mBatches[firstBatch + chunk]);
+        });
+
+        first += count;
+        mNumQueued += count;
+        if (mNumQueued >= kMaxQueuedTriangles)
+        {
+            // The flush is timed as binning and rasterization
+            mPipelineStats.setupMilliseconds += MillisecondsSince(setupStart);
+            Flush();
+            setupStart = std::chrono::steady_clock::now();
+        }
+    }
+    mPipelineStats.setupMilliseconds += MillisecondsSince(setupStart);
+}
+
+
+// Replay a draw's indices through the post-transform cache model. Each miss adds the vertex to mMissVertices, to be
+// shaded into the next entry of mShadedVertices, and a hit reuses the entry of the earlier miss. The cache starts empty
+// for each draw, as the GPU's does. Returns the number of misses
+uint32_t SoftwareRenderer::AssignCacheSlots(const MeshIndex* indices, uint32_t indexCount, int32_t baseVertex,
+                                            int64_t minVertex, uint32_t numRangeVertices, bool strip)
+{
+    mMissVertices.clear();
+    uint32_t cacheSize = static_cast<uint32_t>(mVertexCacheSize);
+    if (mVertexCacheType == VertexCacheType::Fifo)
+    {
+        // A FIFO cache only changes on a miss, so a vertex is still cached if fewer than cacheSize misses have happened
+        // since it was added - and the miss count when it was added is also where its output is (as in VertexCache.cpp)
+        mCacheEntries.assign(numRangeVertices, kStripCut);
+        for (uint32_t i = 0; i < indexCount; ++i)
+        {
+            if (strip && indices[i] == kStripCut)
+            {
+                mIndexSlots[i] = kStripCut;
+                continue;
+            }
+            uint32_t vertex = static_cast<uint32_t>(static_cast<int64_t>(indices[i]) + baseVertex - minVertex);
+            uint32_t& added = mCacheEntries[vertex];
+            uint32_t misses = static_cast<uint32_t>(mMissVertices.size());
+            if (added == kStripCut || misses - added >= cacheSize)
+            {
+                added = misses;
+                mMissVertices.push_back(static_cast<uint32_t>(minVertex) + vertex);
+            }
+            mIndexSlots[i] = added;
+        }
+    }
+    else
+    {
+        // LRU - the entries are vertex and output pairs, most recently used first. A linear search is fine for the
+        // small sizes of real caches
+        mCacheEntries.clear();
+        for (uint32_t i = 0; i < indexCount; ++i)
+        {
+            if (strip && indices[i] == kStripCut)
+            {
+                mIndexSlots[i] = kStripCut;
+                continue;
+            }
+            uint32_t vertex = static_cast<uint32_t>(static_cast<int64_t>(indices[i]) + baseVertex);
+            size_t position = 0;
+            size_t numEntries = mCacheEntries.size() / 2;
+            while (position < numEntries && mCacheEntries[position * 2] != vertex)  ++position;
+
+            uint32_t slot;
+            if (position == numEntries)
+            {
+                slot = static_cast<uint32_t>(mMissVertices.size());
+                mMissVertices.push_back(vertex);
+                if (numEntries < cacheSize)  mCacheEntries.insert(mCacheEntries.end(), { 0, 0 });
+                position = mCacheEntries.size() / 2 - 1; // The new entry, or the least recently used one, is replaced
+            }
+            else
+            {
+                slot = mCacheEntries[position * 2 + 1];
+            }
+
+            // Move to the front
+            for (; position > 0; --position)
+            {
+                mCacheEntries[position * 2]     = mCacheEntries[position * 2 - 2];
+                mCacheEntries[position * 2 + 1] = mCacheEntries[position * 2 - 1];
+            }
+            mCacheEntries[0] = vertex;
+            mCacheEntries[1] = slot;
+            mIndexSlots[i] = slot;
+        }
+    }
+    return static_cast<uint32_t>(mMissVertices.size());
+}
+
+
+// Clip and set up a run of triangles, adding them to a batch. The corners' out codes decide what each triangle needs:
+// nothing if all three are outside one side of the view, clipping if any is outside the guard band or the near or far
+// plane, otherwise (nearly always) straight to setup
+void SoftwareRenderer::SetUpTriangles(const uint32_t* corners, uint32_t numTriangles, uint32_t drawState,
+                                      TriangleBatch& batch) const
+{
+    const uint16_t* codes = mOutCodes.data();
+    for (uint32_t i = 0; i < numTriangles; ++i, corners += 3)
+    {
+        uint32_t code0 = codes[corners[0]], code1 = codes[corners[1]], code2 = codes[corners[2]];
+        if ((code0 & code1 & code2 & kOutsideView) != 0)
+        {
+            ++batch.counts.numOutsideView;
+            continue;
+        }
+
+        const ShadedVertex& v0 = mShadedVertices[corners[0]];
+        const ShadedVertex& v1 = mShadedVertices[corners[1]];
+        const ShadedVertex& v2 = mShadedVertices[corners[2]];
+        uint32_t clipPlanes = ((code0 | code1 | code2) & kOutsideClip) >> kNumClipPlanes;
+        if (clipPlanes == 0)  AddClippedTriangle(v0, v1, v2, drawState, batch);
+        else
+        {
+            ++batch.counts.numClipped;
+            ClipTriangle(v0, v1, v2, clipPlanes, drawState, batch);
+        }
+    }
+}
+
+
+// List the triangles of a batch overlapping each tile. A triangle goes in the bin of every tile its bounding box
+// touches. The lists are built with a counting sort: count the triangles for each tile, turn the counts into start
+// positions, then write each triangle number to its tiles' positions
+void SoftwareRenderer::BinTriangles(TriangleBatch& batch) const
+{
+    int numTiles = mTilesX * mTilesY;
+    batch.binStart.assign(numTiles + 1, 0);
+    uint32_t* binStart = batch.binStart.data();
+    for (auto& triangle : batch.triangles)
+    {
+        for (int tileY = triangle.minY >> kTileShift; tileY <= triangle.maxY >> kTileShift; ++tileY)
+        {
+            for (int tileX = triangle.minX >> kTileShift; tileX <= triangle.maxX >> kTileShift; ++tileX)
+            {
+                ++binStart[tileY * mTilesX + tileX + 1];
+            }
+        }
+    }
+    for (int tile = 1; tile <= numTiles; ++tile)  binStart[tile] += binStart[tile - 1];
+
+    // Writing moves each tile's start on to the next tile's start, so move them all back by one afterwards
+    batch.binned.resize(binStart[numTiles]);
+    for (uint32_t i = 0; i < batch.triangles.size(); ++i)
+    {
+        const SetupTriangle& triangle = batch.triangles[i];
+        for (int tileY = triangle.minY >> kTileShift; tileY <= triangle.maxY >> kTileShift; ++tileY)
+        {
+            for (int tileX = triangle.minX >> kTileShift; tileX <= triangle.maxX >> kTileShift; ++tileX)
+            {
+                batch.binned[binStart[tileY * mTilesX + tileX]++] = i;
+            }
+        }
+    }
+    std::memmove(binStart + 1, binStart, numTiles * sizeof(uint32_t));
+    binStart[0] = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Clipping
+//--------------------------------------------------------------------------------------
+
+// Signed distance of a vertex (x, y, z, w) from a clip plane, positive inside. The guard band is guardX * w either side
+// in x and guardY * w in y, 1 for the view frustum
+static float PlaneDistance(const float* v, int plane, float guardX, float guardY)
+{
+    switch (plane)
+    {
+        case kClipLeft:   return guardX * v[3] + v[0];
+        case kClipRight:  return guardX * v[3] - v[0];
+        case kClipBottom: return guardY * v[3] + v[1];
+        case kClipTop:    return guardY * v[3] - v[1];
+        case kClipNear:   return v[2];
+        default:          return v[3] - v[2];
+    }
+}
+
+// Find the out codes of shaded vertices, four at a time with SSE
+void SoftwareRenderer::ClassifyVertices(const ShadedVertex* vertices, size_t count, uint16_t* codes) const
+{
+    size_t i = 0;
+#ifdef SOFTWARE_RENDERER_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 guardX = _mm_set1_ps(mGuardBandX);
+    const __m128 guardY = _mm_set1_ps(mGuardBandY);
+    for (; i + 4 <= count; i += 4)
+    {
+        // Load the positions of four vertices and transpose them into x, y, z and w of all four
+        __m128 x = _mm_loadu_ps(&vertices[i].x);
+        __m128 y = _mm_loadu_ps(&vertices[i + 1].x);
+        __m128 z = _mm_loadu_ps(&vertices[i + 2].x);
+        __m128 w = _mm_loadu_ps(&vertices[i + 3].x);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        __m128 minusW = _mm_sub_ps(zero, w);
+        __m128 guardW = _mm_mul_ps(guardX, w);
+        __m128 guardH = _mm_mul_ps(guardY, w);
+        __m128 minusGuardW = _mm_sub_ps(zero, guardW);
+        __m128 minusGuardH = _mm_sub_ps(zero, guardH);
+        __m128 near = _mm_cmplt_ps(z, zero);
+        __m128 far  = _mm_cmpgt_ps(z, w);
+        __m128 outside[2 * kNumClipPlanes] =
+        {
+            _mm_cmplt_ps(x, minusW), _mm_cmpgt_ps(x, w), _mm_cmplt_ps(y, minusW), _mm_cmpgt_ps(y, w), near, far,
+            _mm_cmplt_ps(x, minusGuardW), _mm_cmpgt_ps(x, guardW), _mm_cmplt_ps(y, minusGuardH), _mm_cmpgt_ps(y, guardH), near, far,
+        };
+
+        // Each comparison gives a bit per vertex, move them into each vertex's code
+        int masks[2 * kNumClipPlanes];
+        for (int plane = 0; plane < 2 * kNumClipPlanes; ++plane)  masks[plane] = _mm_movemask_ps(outside[plane]);
+        for (int v = 0; v < 4; ++v)
+        {
+            uint32_t code = 0;
+            for (int plane = 0; plane < 2 * kNumClipPlanes; ++plane)  code |= ((masks[plane] >> v) & 1) << plane;
+            codes[i + v] = static_cast<uint16_t>(code);
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        const float* v = &vertices[i].x;
+        uint32_t code = 0;
+        for (int plane = 0; plane < kNumClipPlanes; ++plane)
+        {
+            if (PlaneDistance(v, plane, 1.0f, 1.0f) < 0.0f)                code |= 1 << plane;
+            if (PlaneDistance(v, plane, mGuardBandX, mGuardBandY) < 0.0f)  code |= 1 << (kNumClipPlanes + plane);
+        }
+        codes[i] = static_cast<uint16_t>(code);
+    }
+}
+
+// Cut a triangle by the clip planes it crosses. Only needed for triangles crossing the near or far plane or reaching
+// outside the guard band, which is rare
+void SoftwareRenderer::ClipTriangle(const ShadedVertex& v0, const ShadedVertex& v1, const ShadedVertex& v2,
+                                    uint32_t clipPlanes, uint32_t drawState, TriangleBatch& batch) const
+{
+    // Cut the triangle by each plane it crosses (Sutherland-Hodgman). All values are interpolated linearly in clip
+    // space, which is correct for every attribute before the perspective divide
+    ShadedVertex buffers[2][kMaxClippedVertices];
+    ShadedVertex* polygon = buffers[0];
+    ShadedVertex* clipped = buffers[1];
+    polygon[0] = v0;
+    polygon[1] = v1;
+    polygon[2] = v2;
+    int numVertices = 3;
+    for (int plane = 0; plane < kNumClipPlanes && numVertices >= 3; ++plane)
+    {
+        if ((clipPlanes & (1 << plane)) == 0)  continue;
+
+        int numClipped = 0;
+        for (int i = 0; i < numVertices; ++i)
+        {
+            const ShadedVertex& a = polygon[i];
+            const ShadedVertex& b = polygon[(i + 1) % numVertices];
+            float distanceA = PlaneDistance(&a.x, plane, mGuardBandX, mGuardBandY);
+            float distanceB = PlaneDistance(&b.x, plane, mGuardBandX, mGuardBandY);
+            if (distanceA >= 0.0f)  clipped[numClipped++] = a;
+            if ((distanceA >= 0.0f) != (distanceB >= 0.0f))
+            {
+                // Always go from the inside corner to the outside one, so an edge shared by two triangles is cut at
+                // exactly the same point whichever way round they list it
+                bool aInside = distanceA >= 0.0f;
+                float t = aInside ? distanceA / (distanceA - distanceB) : distanceB / (distanceB - distanceA);
+                const float* from = aInside ? &a.x : &b.x;
+                const float* to   = aInside ? &b.x : &a.x;
+                float* out = &clipped[numClipped++].x;
+                for (int e = 0; e < 8; ++e)  out[e] = from[e] + t * (to[e] - from[e]);
+            }
+        }
+        std::swap(polygon, clipped);
+        numVertices = numClipped;
+    }
+
+    // The clipped polygon is convex, draw it as a fan
+    for (int i = 1; i + 1 < numVertices; ++i)
+    {
+        AddClippedTriangle(polygon[0], polygon[i], polygon[i + 1], drawState, batch);
+    }
+}
+
+
+// Clip and set up a run of lines, as SetUpTriangles does for triangles. A line is clipped by moving its ends in along
+// it to each plane it crosses (Liang-Barsky), interpolating in clip space as ClipTriangle does
+void SoftwareRenderer::SetUpLines(const uint32_t* corners, uint32_t numLines, uint32_t drawState,
+                                  TriangleBatch& batch) const
+{
+    const uint16_t* codes = mOutCodes.data();
+    for (uint32_t i = 0; i < numLines; ++i, corners += 2)
+    {
+        uint32_t code0 = codes[corners[0]], code1 = codes[corners[1]];
+        if ((code0 & code1 & kOutsideView) != 0)
+        {
+            ++batch.counts.numOutsideView;
+            continue;
+        }
+
+        const ShadedVertex& v0 = mShadedVertices[corners[0]];
+        const ShadedVertex& v1 = mShadedVertices[corners[1]];
+        uint32_t clipPlanes = ((code0 | code1) & kOutsideClip) >> kNumClipPlanes;
+        SetupTriangle line;
+        if (clipPlanes == 0)
+        {
+            if (!SetUpLine(v0, v1, line))
+            {
+                ++batch.counts.numEmpty;
+                continue;
+            }
+        }
+        else
+        {
+            ++batch.counts.numClipped;
+            float start = 0.0f, end = 1.0f;
+            for (int plane = 0; plane < kNumClipPlanes && start < end; ++plane)
+            {
+                if ((clipPlanes & (1 << plane)) == 0)  continue;
+                float distance0 = PlaneDistance(&v0.x, plane, mGuardBandX, mGuardBandY);
+                float distance1 = PlaneDistance(&v1.x, plane, mGuardBandX, mGuardBandY);
+                if (distance0 < 0.0f && distance1 < 0.0f)  start = end;
+                else if (distance0 < 0.0f)  start = (std::max)(start, distance0 / (distance0 - distance1));
+                else if (distance1 < 0.0f)  end   = (std::min)(end,   distance0 / (distance0 - distance1));
+            }
+            if (!(start < end))  continue;
+
+            ShadedVertex clipped[2];
+            const float* from = &v0.x;
+            const float* to   = &v1.x;
+            for (int e = 0; e < 8; ++e)
+            {
+                (&clipped[0].x)[e] = from[e] + start * (to[e] - from[e]);
+                (&clipped[1].x)[e] = from[e] + end   * (to[e] - from[e]);
+            }
+            if (!SetUpLine(clipped[0], clipped[1], line))
+            {
+                ++batch.counts.numEmpty;
+                continue;
+            }
+        }
+        line.drawState = drawState;
+        batch.triangles.push_back(line);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Triangle setup
+//--------------------------------------------------------------------------------------
+
+void SoftwareRenderer::AddClippedTriangle(const ShadedVertex& v0, const ShadedVertex& v1, const ShadedVertex& v2,
+                                          uint32_t drawState, TriangleBatch& batch) const
+{
+    const ShadedVertex* vertices[3] = { &v0, &v1, &v2 };
+    SetupTriangle triangle;
+    if (SetUpTriangle(vertices, triangle, batch.counts))
+    {
+        triangle.drawState = drawState;
+        batch.triangles.push_back(triangle);
+    }
+}
+
+
+// Perspective divide and viewport transform of a triangle corner, snapping it to the sub-pixel grid
+bool SoftwareRenderer::ProjectCorner(const ShadedVertex& v, int corner, SetupTriangle& triangle) const
+{
+    if (!(v.w > 0.0f))  return false; // Only possible for a corner exactly at the camera
+    float invW = 1.0f / v.w;
+    float screenX = mViewport.x + (v.x * invW + 1.0f) * 0.5f * mViewport.width;
+    float screenY = mViewport.y + (1.0f - v.y * invW) * 0.5f * mViewport.height;
+    triangle.x[corner] = static_cast<int32_t>(std::floor(screenX * kSubPixels + 0.5f));
+    triangle.y[corner] = static_cast<int32_t>(std::floor(screenY * kSubPixels + 0.5f));
+    triangle.z[corner] = mViewport.minDepth + v.z * invW * (mViewport.maxDepth - mViewport.minDepth);
+    triangle.invW[corner] = invW;
+    triangle.colourOverW[corner][0] = v.r * invW;
+    triangle.colourOverW[corner][1] = v.g * invW;
+    triangle.colourOverW[corner][2] = v.b * invW;
+    triangle.colourOverW[corner][3] = v.a * invW;
+    return true;
+}
+
+// Limit pixel bounds to the viewport and render target. Returns false if no pixels are left
+bool SoftwareRenderer::ClampToViewport(SetupTriangle& triangle) const
+{
+    int viewportMinX = static_cast<int>(std::ceil(mViewport.x - 0.5f));
+    int viewportMinY = static_cast<int>(std::ceil(mViewport.y - 0.5f));
+    int viewportMaxX = static_cast<int>(std::ceil(mViewport.x + mViewport.width  - 0.5f)) - 1;
+    int viewportMaxY = static_cast<int>(std::ceil(mViewport.y + mViewport.height - 0.5f)) - 1;
+    triangle.minX = (std::max)({ triangle.minX, viewportMinX, 0 });
+    triangle.minY = (std::max)({ triangle.minY, viewportMinY, 0 });
+    triangle.maxX = (std::min)({ triangle.maxX, viewportMaxX, mTarget->Width()  - 1 });
+    triangle.maxY = (std::min)({ triangle.maxY, viewportMaxY, mTarget->Height() - 1 });
+    return triangle.minX <= triangle.maxX && triangle.minY <= triangle.maxY;
+}
+
+
+// Perspective divide and viewport transform, then culling. Returns false if the triangle draws nothing, counting why
+bool SoftwareRenderer::SetUpTriangle(const ShadedVertex* vertices[3], SetupTriangle& triangle, SetupCounts& counts) const
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        if (!ProjectCorner(*vertices[i], i, triangle))
+        {
+            ++counts.numEmpty;
+            return false;
+        }
+    }
+
+    // Twice the area, positive when clockwise on screen (y is down). Zero area triangles draw nothing
+    int64_t area = static_cast<int64_t>(triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+                   static_cast<int64_t>(triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+    if (area == 0)
+    {
+        ++counts.numEmpty;
+        return false;
+    }
+    bool front = area > 0;
+    if ((mCullFace == CullFace::Back && !front) || (mCullFace == CullFace::Front && front))
+    {
+        ++counts.numCulled;
+        return false;
+    }
+
+    // Rasterize everything as clockwise
+    if (!front)
+    {
+        std::swap(triangle.x[1], triangle.x[2]);
+        std::swap(triangle.y[1], triangle.y[2]);
+        std::swap(triangle.z[1], triangle.z[2]);
+        std::swap(triangle.invW[1], triangle.invW[2]);
+        for (int c = 0; c < 4; ++c)  std::swap(triangle.colourOverW[1][c], triangle.colourOverW[2][c]);
+    }
+
+    // Depth range for the hierarchical depth test. Interpolated depths can be rounded a little outside the corners'
+    // range, more so on steep triangles where the rasterizer's planes change fast across a block
+    float dx1 = static_cast<float>(triangle.x[1] - triangle.x[0]), dy1 = static_cast<float>(triangle.y[1] - triangle.y[0]);
+    float dx2 = static_cast<float>(triangle.x[2] - triangle.x[0]), dy2 = static_cast<float>(triangle.y[2] - triangle.y[0]);
+    float dz1 = triangle.z[1] - triangle.z[0], dz2 = triangle.z[2] - triangle.z[0];
+    float slope = (std::abs(dz1 * dy2 - dz2 * dy1) + std::abs(dz2 * dx1 - dz1 * dx2)) * kSubPixels / std::abs(static_cast<float>(area));
+    triangle.depthMargin = kDepthRounding * (1.0f + 2 * kBlockSize * slope);
+    triangle.minZ = (std::min)({ triangle.z[0], triangle.z[1], triangle.z[2] }) - triangle.depthMargin;
+    triangle.maxZ = (std::max)({ triangle.z[0], triangle.z[1], triangle.z[2] }) + triangle.depthMargin;
+
+    // Pixels whose centres (x + 0.5, y + 0.5) might be inside, limited to the viewport and render target
+    const int32_t half = kSubPixels / 2;
+    int32_t minX = (std::min)({ triangle.x[0], triangle.x[1], triangle.x[2] });
+    int32_t maxX = (std::max)({ triangle.x[0], triangle.x[1], triangle.x[2] });
+    int32_t minY = (std::min)({ triangle.y[0], triangle.y[1], triangle.y[2] });
+    int32_t maxY = (std::max)({ triangle.y[0], triangle.y[1], triangle.y[2] });
+    triangle.minX = (minX - half + kSubPixels - 1) >> kSubPixelBits;
+    triangle.minY = (minY - half + kSubPixels - 1) >> kSubPixelBits;
+    triangle.maxX = (maxX - half) >> kSubPixelBits;
+    triangle.maxY = (maxY - half) >> kSubPixelBits;
+    if (!ClampToViewport(triangle))
+    {
+        ++counts.numEmpty;
+        return false;
+    }
+    return true;
+}
+
+
+// Perspective divide and viewport transform of a line. Returns false if it draws nothing
+bool SoftwareRenderer::SetUpLine(const ShadedVertex& v0, const ShadedVertex& v1, SetupTriangle& line) const
+{
+    if (!ProjectCorner(v0, 0, line) || !ProjectCorner(v1, 1, line))  return false;
+    if (line.x[0] == line.x[1] && line.y[0] == line.y[1])  return false;
+
+    // Depth along a line is found directly at each pixel, not stepped, so the rounding is small
+    line.depthMargin = kDepthRounding;
+    line.minZ = (std::min)(line.z[0], line.z[1]) - line.depthMargin;
+    line.maxZ = (std::max)(line.z[0], line.z[1]) + line.depthMargin;
+
+    // The pixels containing the ends and everything between
+    line.minX = (std::min)(line.x[0], line.x[1]) >> kSubPixelBits;
+    line.minY = (std::min)(line.y[0], line.y[1]) >> kSubPixelBits;
+    line.maxX = (std::max)(line.x[0], line.x[1]) >> kSubPixelBits;
+    line.maxY = (std::max)(line.y[0], line.y[1]) >> kSubPixelBits;
+    return ClampToViewport(line);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Pipeline variants
+//--------------------------------------------------------------------------------------
+
+// The rasterizers read the depth test, depth writes and colour writes through a PixelState class. With FixedPixelState
+// these are constants, so the compiler removes the tests and any work whose result is not used (such as interpolating
+// colour in a depth only pass) from each generated version. GeneralPixelState reads the draw's state instead, giving
+// a single version that tests the state at every pixel as the code would without templates
+template <RasterDepthTest kDepthTest, bool kDepthWrite, bool kColourWrites>
+struct SoftwareRenderer::FixedPixelState
+{
+    static const bool kInterpolateColour = kColourWrites; // False if colour is never needed
+
+    static RasterDepthTest DepthTest(const DrawState&)    { return kDepthTest; }
+    static bool            DepthWrite(const DrawState&)   { return kDepthWrite; }
+    static bool            ColourWrites(const DrawState&) { return kColourWrites; }
+};
+
+struct SoftwareRenderer::GeneralPixelState
+{
+    static const bool kInterpolateColour = true;
+
+    static RasterDepthTest DepthTest(const DrawState& state)    { return state.depthTest; }
+    static bool            DepthWrite(const DrawState& state)   { return state.depthWrite; }
+    static bool            ColourWrites(const DrawState& state) { return state.colourWrites; }
+};
+
+
+template <class PixelState, bool kLines>
+SoftwareRenderer::RasterPipeline SoftwareRenderer::MakePipeline()
+{
+    RasterPipeline pipeline;
+    pipeline.scalar = kLines ? &SoftwareRenderer::RasterizeLineScalar<PixelState>
+                             : &SoftwareRenderer::RasterizeTriangleScalar<PixelState>;
+#ifdef CPU_FEATURES_X86
+    pipeline.avx2   = kLines ? &SoftwareRenderer::RasterizeLineAvx2<PixelState>
+                             : &SoftwareRenderer::RasterizeTriangleAvx2<PixelState>;
+#endif
+    return pipeline;
+}
+
+
+// Every combination of the state, indexed by depth test, then depth write, then colour writes
+template <bool kLines>
+const SoftwareRenderer::RasterPipeline* SoftwareRenderer::PipelineTable()
+{
+    static const RasterPipeline kPipelines[] =
+    {
+        MakePipeline<FixedPixelState<RasterDepthTest::Always,    false, false>, kLines>(),
+        MakePipeline<FixedPixelState<RasterDepthTest::Always,    false, true >, kLines>(),
+        MakePipeline<FixedPixelState<RasterDepthTest::Always,    true,  false>, kLines>(),
+        MakePipeline<FixedPixelState<RasterDepthTest::Always,    true,  true >, kLines>(),
+        MakePipeline<FixedPixelState<RasterDepthTest::Less,      false, false>, kLines>(),
+        MakePipeline<FixedPixelState<RasterDepthTest::Less,      false, true >, kLines>(),
+        MakePipeline<FixedPixelState<RasterDepthTest::Less,      true,  false>, kLines>(),
+        MakePipeline<FixedPixelState<RasterDepthTest::Less,      true,  true >, kLines>(),
+        MakePipeline<FixedPixelState<RasterDepthTest::LessEqual, false, false>, kLines>(),
+        MakePipeline<FixedPixelState<RasterDepthTest::LessEqual, false, true >, kLines>(),
+        MakePipeline<FixedPixelState<RasterDepthTest::LessEqual, true,  false>, kLines>(),
+        MakePipeline<FixedPixelState<RasterDepthTest::LessEqual, true,  true >, kLines>(),
+    };
+    static_assert(static_cast<int>(RasterDepthTest::Always) == 0 && static_cast<int>(RasterDepthTest::Less) == 1 &&
+                  static_cast<int>(RasterDepthTest::LessEqual) == 2, "Pipeline table does not match RasterDepthTest");
+    return kPipelines;
+}
+
+
+// Chosen once per draw, from the table for its topology
+SoftwareRenderer::RasterPipeline SoftwareRenderer::SelectPipeline() const
+{
+    bool lines = mTopology == RasterTopology::LineList;
+    if (!mSpecialisedPipelines)
+    {
+        return lines ? MakePipeline<GeneralPixelState, true>() : MakePipeline<GeneralPixelState, false>();
+    }
+    int index = static_cast<int>(mDepthTest) * 4 + (mDepthWrite ? 2 : 0) + (mColourWrites ? 1 : 0);
+    return lines ? PipelineTable<true>()[index] : PipelineTable<false>()[index];
+}
+
+
+//--------------------------------------------------------------------------------------
+// Drawing - back end
+//--------------------------------------------------------------------------------------
+
+void SoftwareRenderer::Flush()
+{
+    if (mNumBatches == 0)  return;
+    if (mRasterPath == RasterPath::Auto)  SetRasterPath(RasterPath::Auto);
+
+    // Sort each batch's triangles into tiles
+    auto binStart = std::chrono::steady_clock::now();
+    RunTasks(static_cast<int>(mNumBatches), [&](int batch, int /*threadIndex*/) { BinTriangles(mBatches[batch]); });
+
+    // Hand out the tiles with the most triangles first, so a busy tile is not left until last while other threads have
+    // nothing to do. Tiles with no triangles are skipped
+    int numTiles = mTilesX * mTilesY;
+    mTileWork.assign(numTiles, 0);
+    for (size_t b = 0; b < mNumBatches; ++b)
+    {
+        const uint32_t* binStart = mBatches[b].binStart.data();
+        for (int tile = 0; tile < numTiles; ++tile)  mTileWork[tile] += binStart[tile + 1] - binStart[tile];
+    }
+    mTileOrder.clear();
+    for (int tile = 0; tile < numTiles; ++tile)
+    {
+        if (mTileWork[tile] > 0)  mTileOrder.push_back(tile);
+    }
+    std::sort(mTileOrder.begin(), mTileOrder.end(), [&](uint32_t a, uint32_t b) { return mTileWork[a] > mTileWork[b]; });
+    mPipelineStats.binMilliseconds += MillisecondsSince(binStart);
+
+    auto rasterStart = std::chrono::steady_clock::now();
+    mTileStats.resize(numTiles);
+    mCoverage.resize(static_cast<size_t>(numTiles) * kTileSize); // New words are zero, nothing covered yet
+    RunTasks(static_cast<int>(mTileOrder.size()), [&](int task, int /*threadIndex*/) { RasterizeTile(mTileOrder[task]); });
+    mPipelineStats.rasterMilliseconds += MillisecondsSince(rasterStart);
+
+    // Add up the counts of the batches and tiles
+    for (size_t b = 0; b < mNumBatches; ++b)
+    {
+        const TriangleBatch& batch = mBatches[b];
+        mPipelineStats.numOutsideView += batch.counts.numOutsideView;
+        mPipelineStats.numClipped     += batch.counts.numClipped;
+        mPipelineStats.numCulled      += batch.counts.numCulled;
+        mPipelineStats.numEmpty       += batch.counts.numEmpty;
+        mPipelineStats.numSetUp       += batch.triangles.size();
+        mPipelineStats.numBinned      += batch.binned.size();
+    }
+    for (uint32_t tile : mTileOrder)
+    {
+        const TileStats& tileStats = mTileStats[tile];
+        mDepthStats.numTested         += tileStats.depth.numTested;
+        mDepthStats.numRejected       += tileStats.depth.numRejected;
+        mDepthStats.numBlocksSkipped  += tileStats.depth.numBlocksSkipped;
+        mDepthStats.numBlocksAccepted += tileStats.depth.numBlocksAccepted;
+        mPipelineStats.numPixelsTested  += tileStats.numPixelsTested;
+        mPipelineStats.numPixelsWritten += tileStats.numPixelsWritten;
+    }
+
+    // Each pixel written since the reset counts once, whichever flush and however many triangles drew it
+    uint64_t numCovered = 0;
+    for (uint64_t row : mCoverage)  numCovered += CountBits(row);
+    mPipelineStats.numPixelsCovered = numCovered;
+
+    mNumBatches = 0;
+    mNumQueued = 0;
+    mDrawStates.clear();
+}
+
+
+void SoftwareRenderer::RunTasks(int numTasks, const std::function<void(int, int)>& task)
+{
+    if (mMultithreaded)
+    {
+        GetThreadPool().Run(numTasks, task);
+        return;
+    }
+    for (int i = 0; i < numTasks; ++i)  task(i, 0);
+}
+
+
+// Draw the triangles binned to a tile, batch by batch in the order they were queued, limited to the tile's pixels
+void SoftwareRenderer::RasterizeTile(int tile)
+{
+    int minX = (tile % mTilesX) << kTileShift;
+    int minY = (tile / mTilesX) << kTileShift;
+    int maxX = (std::min)(minX + kTileSize, mTarget->Width())  - 1;
+    int maxY = (std::min)(minY + kTileSize, mTarget->Height()) - 1;
+
+    // Fill the tile's depth blocks that are waiting for a clear. Tiles are the only tasks writing their blocks
+    for (int blockY = minY >> kBlockShift; blockY <= maxY >> kBlockShift; ++blockY)
+    {
+        for (int blockX = minX >> kBlockShift; blockX <= maxX >> kBlockShift; ++blockX)  mTarget->FinishDepthClear(blockX, blockY);
+    }
+
+    TileStats& tileStats = mTileStats[tile];
+    tileStats = TileStats();
+    for (size_t b = 0; b < mNumBatches; ++b)
+    {
+        const TriangleBatch& batch = mBatches[b];
+        for (uint32_t i = batch.binStart[tile]; i < batch.binStart[tile + 1]; ++i)
+        {
+            const SetupTriangle& triangle = batch.triangles[batch.binned[i]];
+            const DrawState& state = mDrawStates[triangle.drawState];
+            const RasterPipeline& pipeline = state.pipeline;
+            int triangleMinX = (std::max)(minX, triangle.minX);
+            int triangleMinY = (std::max)(minY, triangle.minY);
+            int triangleMaxX = (std::min)(maxX, triangle.maxX);
+            int triangleMaxY = (std::min)(maxY, triangle.maxY);
+            if (mHierarchicalDepth && state.depthTest != RasterDepthTest::Always)
+            {
+                ++tileStats.depth.numTested;
+                if (DepthHidden(triangle, state, triangleMinX, triangleMinY, triangleMaxX, triangleMaxY))
+                {
+                    ++tileStats.depth.numRejected;
+                    continue;
+                }
+            }
+#ifdef CPU_FEATURES_X86
+            // Triangles touching only a few pixels are quicker a pixel at a time than in blocks
+            if (mRasterPath == RasterPath::Avx2 &&
+                (triangleMaxX - triangleMinX + 1) * (triangleMaxY - triangleMinY + 1) > kMinBlockRasterPixels)
+            {
+                (this->*pipeline.avx2)(triangle, triangleMinX, triangleMinY, triangleMaxX, triangleMaxY);
+                continue;
+            }
+#endif
+            (this->*pipeline.scalar)(triangle, triangleMinX, triangleMinY, triangleMaxX, triangleMaxY);
+        }
+    }
+
+    // The rasterizers only keep the depth blocks up to date when they are used. Otherwise the depths in the tile are
+    // now unknown
+    if (!mHierarchicalDepth)
+    {
+        for (int blockY = minY >> kBlockShift; blockY <= maxY >> kBlockShift; ++blockY)
+        {
+            DepthBlock* blockRow = mTarget->DepthBlocks() + static_cast<size_t>(blockY) * mTarget->DepthBlocksX();
+            for (int blockX = minX >> kBlockShift; blockX <= maxX >> kBlockShift; ++blockX)
+            {
+                blockRow[blockX] = DepthBlock();
+                blockRow[blockX].stale = true;
+            }
+        }
+    }
+}
+
+
+// A triangle is hidden in a block if its nearest depth fails the depth test against the block's farthest depth. Most
+// visible triangles are found quickly as they are in front of the nearest depth of some block. Otherwise blocks whose
+// range may have been widened by depth writes are brought up to date from their pixels, but only if their range as it
+// is does not hide the triangle
+bool SoftwareRenderer::DepthHidden(const SetupTriangle& t, const DrawState& state, int minX, int minY, int maxX, int maxY)
+{
+    // Pixel depths are clamped to the viewport's range
+    float nearest = (std::min)((std::max)(t.minZ, state.minDepth), state.maxDepth);
+    bool lessEqual = state.depthTest == RasterDepthTest::LessEqual;
+    auto hiddenBehind = [&](float depth) { return lessEqual ? nearest > depth : nearest >= depth; };
+
+    DepthBlock* blocks = mTarget->DepthBlocks();
+    int blocksX = mTarget->DepthBlocksX();
+    int firstBlockX = minX >> kBlockShift, lastBlockX = maxX >> kBlockShift;
+    int firstBlockY = minY >> kBlockShift, lastBlockY = maxY >> kBlockShift;
+    bool needUpdate = false;
+    for (int blockY = firstBlockY; blockY <= lastBlockY; ++blockY)
+    {
+        const DepthBlock* blockRow = blocks + static_cast<size_t>(blockY) * blocksX;
+        for (int blockX = firstBlockX; blockX <= lastBlockX; ++blockX)
+        {
+            const DepthBlock& block = blockRow[blockX];
+            if (!hiddenBehind(block.minDepth))  return false;
+            if (!hiddenBehind(block.maxDepth))
+            {
+                if (!block.stale)  return false;
+                needUpdate = true;
+            }
+        }
+    }
+    if (!needUpdate)  return true;
+
+    for (int blockY = firstBlockY; blockY <= lastBlockY; ++blockY)
+    {
+        DepthBlock* blockRow = blocks + static_cast<size_t>(blockY) * blocksX;
+        for (int blockX = firstBlockX; blockX <= lastBlockX; ++blockX)
+        {
+            if (hiddenBehind(blockRow[blockX].maxDepth))  continue;
+            mTarget->UpdateDepthBlock(blockX, blockY);
+            if (!hiddenBehind(blockRow[blockX].maxDepth))  return false;
+        }
+    }
+    return true;
+}
+
+
+// Widen a depth block's range to include a depth written to one of its pixels
+static inline void WidenDepthBlock(DepthBlock& block, float minDepth, float maxDepth)
+{
+    block.minDepth = (std::min)(block.minDepth, minDepth);
+    block.maxDepth = (std::max)(block.maxDepth, maxDepth);
+    block.stale = true;
+}
+
+
+// Visit each pixel in part of the triangle's bounds (its overlap with a tile), testing its centre against the three
+// edges. Edge function E_ab(p) is positive when p is inside edge a->b of a clockwise triangle, and is stepped with
+// additions from pixel to pixel
+template <class PixelState>
+void SoftwareRenderer::RasterizeTriangleScalar(const SetupTriangle& t, int minX, int minY, int maxX, int maxY)
+{
+    const DrawState& state = mDrawStates[t.drawState];
+    RasterDepthTest depthTest = PixelState::DepthTest(state);
+    int64_t stepX[3], stepY[3], rowStart[3], bias[3];
+    for (int edge = 0; edge < 3; ++edge)
+    {
+        // Edge opposite corner "edge", from corner a to corner b
+        int a = (edge + 1) % 3;
+        int b = (edge + 2) % 3;
+        int64_t dx = t.x[b] - t.x[a];
+        int64_t dy = t.y[b] - t.y[a];
+
+        // Top-left rule: a pixel centre exactly on an edge is drawn only if the edge is a top edge (horizontal, above
+        // the triangle) or a left edge. Other edges are moved in by the smallest step
+        bool topLeft = (dy == 0 && dx > 0) || dy < 0;
+        bias[edge] = topLeft ? 0 : -1;
+
+        int64_t px = (static_cast<int64_t>(minX) << kSubPixelBits) + kSubPixels / 2;
+        int64_t py = (static_cast<int64_t>(minY) << kSubPixelBits) + kSubPixels / 2;
+        rowStart[edge] = dx * (py - t.y[a]) - dy * (px - t.x[a]) + bias[edge];
+        stepX[edge] = -dy * kSubPixels;
+        stepY[edge] =  dx * kSubPixels;
+    }
+
+    // Barycentric weights of corners 1 and 2 are E_20 / area and E_01 / area. The three edge functions add up to twice
+    // the area everywhere
+    float invArea = 1.0f / static_cast<float>(rowStart[0] - bias[0] + rowStart[1] - bias[1] + rowStart[2] - bias[2]);
+    float dz1 = t.z[1] - t.z[0], dz2 = t.z[2] - t.z[0];
+    float dw1 = t.invW[1] - t.invW[0], dw2 = t.invW[2] - t.invW[0];
+    float dc1[4], dc2[4];
+    for (int c = 0; c < 4; ++c)
+    {
+        dc1[c] = t.colourOverW[1][c] - t.colourOverW[0][c];
+        dc2[c] = t.colourOverW[2][c] - t.colourOverW[0][c];
+    }
+
+    int width = mTarget->Width();
+    DepthBlock* depthBlocks = mHierarchicalDepth ? mTarget->DepthBlocks() : nullptr;
+    int tile = (minY >> kTileShift) * mTilesX + (minX >> kTileShift);
+    uint64_t* coverage = &mCoverage[static_cast<size_t>(tile) * kTileSize];
+    uint32_t numTested = 0, numWritten = 0;
+    for (int y = minY; y <= maxY; ++y)
+    {
+        int64_t e0 = rowStart[0], e1 = rowStart[1], e2 = rowStart[2];
+        uint32_t* colourRow = mTarget->Colour()      + static_cast<size_t>(y) * width;
+        float*    depthRow  = mTarget->DepthPixels() + static_cast<size_t>(y) * width;
+        DepthBlock* blockRow = depthBlocks != nullptr ? depthBlocks + static_cast<size_t>(y >> kBlockShift) * mTarget->DepthBlocksX()
+                                                      : nullptr;
+        for (int x = minX; x <= maxX; ++x)
+        {
+            if ((e0 | e1 | e2) >= 0)
+            {
+                float b1 = static_cast<float>(e1 - bias[1]) * invArea;
+                float b2 = static_cast<float>(e2 - bias[2]) * invArea;
+
+                // Depth is linear in screen space. It is clamped to the viewport depth range as on the GPU
+                float z = t.z[0] + b1 * dz1 + b2 * dz2;
+                z = (std::min)((std::max)(z, state.minDepth), state.maxDepth);
+                bool pass = depthTest == RasterDepthTest::Always ||
+                            (depthTest == RasterDepthTest::Less      && z <  depthRow[x]) ||
+                            (depthTest == RasterDepthTest::LessEqual && z <= depthRow[x]);
+                ++numTested;
+                if (pass)
+                {
+                    ++numWritten;
+                    MarkCovered(coverage, x, y);
+                    if (PixelState::DepthWrite(state))
+                    {
+                        depthRow[x] = z;
+                        if (depthBlocks != nullptr)  WidenDepthBlock(blockRow[x >> kBlockShift], z, z);
+                    }
+                    if (PixelState::ColourWrites(state))
+                    {
+                        // OneColour_ps.hlsl: the interpolated vertex colour
+                        float w = 1.0f / (t.invW[0] + b1 * dw1 + b2 * dw2);
+                        colourRow[x] = PackColour((t.colourOverW[0][0] + b1 * dc1[0] + b2 * dc2[0]) * w,
+                                                  (t.colourOverW[0][1] + b1 * dc1[1] + b2 * dc2[1]) * w,
+                                                  (t.colourOverW[0][2] + b1 * dc1[2] + b2 * dc2[2]) * w,
+                                                  (t.colourOverW[0][3] + b1 * dc1[3] + b2 * dc2[3]) * w);
+                    }
+                }
+            }
+            e0 += stepX[0];
+            e1 += stepX[1];
+            e2 += stepX[2];
+        }
+        rowStart[0] += stepY[0];
+        rowStart[1] += stepY[1];
+        rowStart[2] += stepY[2];
+    }
+
+    TileStats& tileStats = mTileStats[tile];
+    tileStats.numPixelsTested  += numTested;
+    tileStats.numPixelsWritten += numWritten;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Line rasterization
+//--------------------------------------------------------------------------------------
+
+// Lines step along their major axis - x if they are at least as wide as they are tall, otherwise y - drawing one pixel
+// for each pixel centre along it from the lower end up to but not including the upper end. The pixel drawn is the one
+// containing the line's position on the minor axis at that centre. The position is a fraction, kept as a whole number
+// of sub-pixels (rounded down) and a remainder and stepped exactly in integers, so the scalar and AVX2 versions draw
+// the same pixels and a line crossing several tiles has no breaks. Depth, 1/w and colour / w are interpolated by the
+// distance along the major axis
+struct LineSpan
+{
+    bool    xMajor;
+    int     start;            // 0 or 1, the end with the lower major coordinate
+    int32_t majorStart;       // Major coordinate of that end in sub-pixels
+    int32_t length;           // Major length of the line in sub-pixels, always positive
+    int64_t minorDelta;       // Change in the minor coordinate from the start to the end, in sub-pixels
+    float   invLength;
+    int     first, last;      // Major pixels to visit, inclusive
+    int     minMinor, maxMinor; // Minor pixels that may be drawn, inclusive
+    int32_t minor, remainder; // Minor position at the centre of pixel "first" in sub-pixels, and remainder (of length)
+    int32_t minorStep, remainderStep; // Change from one pixel to the next
+};
+
+// Division rounding towards minus infinity, for a positive divisor
+static int64_t FloorDivide(int64_t a, int64_t b)
+{
+    int64_t quotient = a / b;
+    return (a % b < 0) ? quotient - 1 : quotient;
+}
+
+// Find the pixels of a line with ends x, y (in sub-pixels) within a rectangle of pixels. Returns false if there are
+// none. The guard band keeps all the values in 32 bits
+static bool FindLineSpan(const int32_t* x, const int32_t* y, int minX, int minY, int maxX, int maxY, LineSpan& span)
+{
+    span.xMajor = std::abs(x[1] - x[0]) >= std::abs(y[1] - y[0]);
+    const int32_t* major = span.xMajor ? x : y;
+    const int32_t* minor = span.xMajor ? y : x;
+    span.start = major[1] >= major[0] ? 0 : 1;
+    int end = 1 - span.start;
+    span.majorStart = major[span.start];
+    span.length     = major[end] - major[span.start];
+    span.minorDelta = static_cast<int64_t>(minor[end]) - minor[span.start];
+    if (span.length == 0)  return false;
+    span.invLength = 1.0f / span.length;
+
+    // Pixels whose centres are from the start up to but not including the end, inside the rectangle
+    span.first = static_cast<int>(FloorDivide(major[span.start] - kSubPixels / 2 + kSubPixels - 1, kSubPixels));
+    span.last  = static_cast<int>(FloorDivide(major[end]        - kSubPixels / 2 + kSubPixels - 1, kSubPixels)) - 1;
+    span.first = (std::max)(span.first, span.xMajor ? minX : minY);
+    span.last  = (std::min)(span.last,  span.xMajor ? maxX : maxY);
+    span.minMinor = span.xMajor ? minY : minX;
+    span.maxMinor = span.xMajor ? maxY : maxX;
+    if (span.first > span.last)  return false;
+
+    // Minor position at a pixel centre: minor start + (centre - major start) * minor delta / length
+    auto minorAt = [&](int pixel, int64_t& remainder)
+    {
+        int64_t numerator = static_cast<int64_t>(minor[span.start]) * span.length +
+                            (static_cast<int64_t>(pixel) * kSubPixels + kSubPixels / 2 - span.majorStart) * span.minorDelta;
+        int64_t position = FloorDivide(numerator, span.length);
+        remainder = numerator - position * span.length;
+        return position;
+    };
+    int64_t firstRemainder, lastRemainder;
+    int64_t firstPosition = minorAt(span.first, firstRemainder);
+    int64_t firstMinor = firstPosition >> kSubPixelBits;
+    int64_t lastMinor  = minorAt(span.last, lastRemainder) >> kSubPixelBits;
+
+    // The minor pixel only moves one way, so the line misses the rectangle if both ends of the span are on one side
+    if ((std::max)(firstMinor, lastMinor) < span.minMinor || (std::min)(firstMinor, lastMinor) > span.maxMinor)  return false;
+
+    span.minor     = static_cast<int32_t>(firstPosition);
+    span.remainder = static_cast<int32_t>(firstRemainder);
+    int64_t step = kSubPixels * span.minorDelta;
+    span.minorStep     = static_cast<int32_t>(FloorDivide(step, span.length));
+    span.remainderStep = static_cast<int32_t>(step - static_cast<int64_t>(span.minorStep) * span.length);
+    return true;
+}
+
+
+template <class PixelState>
+void SoftwareRenderer::RasterizeLineScalar(const SetupTriangle& t, int minX, int minY, int maxX, int maxY)
+{
+    LineSpan span;
+    if (!FindLineSpan(t.x, t.y, minX, minY, maxX, maxY, span))  return;
+
+    const DrawState& state = mDrawStates[t.drawState];
+    RasterDepthTest depthTest = PixelState::DepthTest(state);
+    int a = span.start, b = 1 - span.start;
+    float dz = t.z[b] - t.z[a], dw = t.invW[b] - t.invW[a];
+    float dc[4];
+    for (int c = 0; c < 4; ++c)  dc[c] = t.colourOverW[b][c] - t.colourOverW[a][c];
+
+    int width = mTarget->Width();
+    size_t majorStride = span.xMajor ? 1 : width;
+    size_t minorStride = span.xMajor ? width : 1;
+    DepthBlock* depthBlocks = mHierarchicalDepth ? mTarget->DepthBlocks() : nullptr;
+    int tile = (minY >> kTileShift) * mTilesX + (minX >> kTileShift);
+    uint64_t* coverage = &mCoverage[static_cast<size_t>(tile) * kTileSize];
+    uint32_t numTested = 0, numWritten = 0;
+    int32_t minor = span.minor, remainder = span.remainder;
+    for (int p = span.first; p <= span.last; ++p)
+    {
+        int minorPixel = minor >> kSubPixelBits;
+        if (minorPixel >= span.minMinor && minorPixel <= span.maxMinor)
+        {
+            size_t pixel = p * majorStride + minorPixel * minorStride;
+            float along = static_cast<float>(p * kSubPixels + kSubPixels / 2 - span.majorStart) * span.invLength;
+            float z = t.z[a] + along * dz;
+            z = (std::min)((std::max)(z, state.minDepth), state.maxDepth);
+            float* depth = mTarget->DepthPixels() + pixel;
+            bool pass = depthTest == RasterDepthTest::Always ||
+                        (depthTest == RasterDepthTest::Less      && z <  *depth) ||
+                        (depthTest == RasterDepthTest::LessEqual && z <= *depth);
+            ++numTested;
+            if (pass)
+            {
+                ++numWritten;
+                int x = span.xMajor ? p : minorPixel, y = span.xMajor ? minorPixel : p;
+                MarkCovered(coverage, x, y);
+                if (PixelState::DepthWrite(state))
+                {
+                    *depth = z;
+                    if (depthBlocks != nullptr)
+                    {
+                        WidenDepthBlock(depthBlocks[static_cast<size_t>(y >> kBlockShift) * mTarget->DepthBlocksX() +
+                                                    (x >> kBlockShift)], z, z);
+                    }
+                }
+                if (PixelState::ColourWrites(state))
+                {
+                    float w = 1.0f / (t.invW[a] + along * dw);
+                    mTarget->Colour()[pixel] = PackColour((t.colourOverW[a][0] + along * dc[0]) * w,
+                                                          (t.colourOverW[a][1] + along * dc[1]) * w,
+                                                          (t.colourOverW[a][2] + along * dc[2]) * w,
+                                                          (t.colourOverW[a][3] + along * dc[3]) * w);
+                }
+            }
+        }
+        minor += span.minorStep;
+        remainder += span.remainderStep;
+        if (remainder >= span.length)
+        {
+            remainder -= span.length;
+            ++minor;
+        }
+    }
+
+    TileStats& tileStats = mTileStats[tile];
+    tileStats.numPixelsTested  += numTested;
+    tileStats.numPixelsWritten += numWritten;
+}
+
+
+//--------------------------------------------------------------------------------------
+// AVX2 rasterization
+//--------------------------------------------------------------------------------------
+#ifdef CPU_FEATURES_X86
+
+// Colours from colour / w and w, clamped and converted as PackColour (max first so NaN becomes 0)
+AVX2_FUNCTION
+static inline __m256i PackColoursAvx2(const __m256* colourOverW, __m256 w)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one  = _mm256_set1_ps(1.0f);
+    const __m256 scale255 = _mm256_set1_ps(255.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    __m256i packed = _mm256_setzero_si256();
+    for (int c = 0; c < 4; ++c)
+    {
+        __m256 value = _mm256_mul_ps(colourOverW[c], w);
+        value = _mm256_min_ps(_mm256_max_ps(value, zero), one);
+        __m256i byte = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(value, scale255), half));
+        packed = _mm256_or_si256(packed, _mm256_sll_epi32(byte, _mm_cvtsi32_si128(c * 8)));
+    }
+    return packed;
+}
+
+// Number of lanes set in an 8-bit mask from _mm256_movemask_ps
+static inline uint32_t CountLanes(uint32_t mask)
+{
+    mask = mask - ((mask >> 1) & 0x55);
+    mask = (mask & 0x33) + ((mask >> 2) & 0x33);
+    return (mask + (mask >> 4)) & 0x0F;
+}
+
+// Smallest of the eight values
+AVX2_FUNCTION
+static inline float HorizontalMinAvx2(__m256 values)
+{
+    __m128 half = _mm_min_ps(_mm256_castps256_ps128(values), _mm256_extractf128_ps(values, 1));
+    half = _mm_min_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_min_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half);
+}
+
+// The area to draw is split into 8x8 pixel blocks. Each edge function is stepped from block to block in 64-bit
+// integers and compared with its smallest and largest change across a block: if a block is wholly outside any edge it
+// is skipped, and edges the block is wholly inside are not tested. Within the block the edge functions of the edges it
+// crosses fit in 32 bits, so a row of 8 pixels is tested with one register per edge. Depth, 1/w and colour / w are
+// planes in screen space, stepped across rows and blocks with additions
+template <class PixelState>
+AVX2_FUNCTION
+void SoftwareRenderer::RasterizeTriangleAvx2(const SetupTriangle& t, int minX, int minY, int maxX, int maxY)
+{
+    const DrawState& state = mDrawStates[t.drawState];
+    RasterDepthTest depthTest = PixelState::DepthTest(state);
+
+    // Edge functions at the centre of the top-left pixel of the first block, as RasterizeTriangleScalar
+    int firstBlockX = minX & ~(kBlockSize - 1);
+    int firstBlockY = minY & ~(kBlockSize - 1);
+    int64_t blockRowStart[3], stepX[3], stepY[3], bias[3], minOffset[3], maxOffset[3];
+    for (int edge = 0; edge < 3; ++edge)
+    {
+        int a = (edge + 1) % 3;
+        int b = (edge + 2) % 3;
+        int64_t dx = t.x[b] - t.x[a];
+        int64_t dy = t.y[b] - t.y[a];
+        bool topLeft = (dy == 0 && dx > 0) || dy < 0;
+        bias[edge] = topLeft ? 0 : -1;
+
+        int64_t px = (static_cast<int64_t>(firstBlockX) << kSubPixelBits) + kSubPixels / 2;
+        int64_t py = (static_cast<int64_t>(firstBlockY) << kSubPixelBits) + kSubPixels / 2;
+        blockRowStart[edge] = dx * (py - t.y[a]) - dy * (px - t.x[a]) + bias[edge];
+        stepX[edge] = -dy * kSubPixels;
+        stepY[edge] =  dx * kSubPixels;
+
+        // Very large render targets could overflow the 32-bit values used within a block
+        if ((std::max)(std::abs(stepX[edge]), std::abs(stepY[edge])) >= kMaxBlockEdgeStep)
+        {
+            RasterizeTriangleScalar<PixelState>(t, minX, minY, maxX, maxY);
+            return;
+        }
+
+        // Change in the edge function from the first pixel of a block to each of its other pixels
+        minOffset[edge] = (std::min)(int64_t(0), stepX[edge] * (kBlockSize - 1)) + (std::min)(int64_t(0), stepY[edge] * (kBlockSize - 1));
+        maxOffset[edge] = (std::max)(int64_t(0), stepX[edge] * (kBlockSize - 1)) + (std::max)(int64_t(0), stepY[edge] * (kBlockSize - 1));
+    }
+
+    // Attribute planes: the change per pixel across and down, and each attribute at a point from its barycentrics.
+    // Only depth is needed if colour is not written
+    float invArea = 1.0f / static_cast<float>(blockRowStart[0] - bias[0] + blockRowStart[1] - bias[1] +
+                                              blockRowStart[2] - bias[2]);
+    const int kAllAttributes = 6; // Depth, 1/w, colour / w
+    const int kNumAttributes = PixelState::kInterpolateColour ? kAllAttributes : 1;
+    float corner0[kAllAttributes], delta1[kAllAttributes], delta2[kAllAttributes];
+    corner0[0] = t.z[0];     delta1[0] = t.z[1] - t.z[0];         delta2[0] = t.z[2] - t.z[0];
+    corner0[1] = t.invW[0];  delta1[1] = t.invW[1] - t.invW[0];   delta2[1] = t.invW[2] - t.invW[0];
+    for (int c = 0; c < 4; ++c)
+    {
+        corner0[2 + c] = t.colourOverW[0][c];
+        delta1[2 + c]  = t.colourOverW[1][c] - t.colourOverW[0][c];
+        delta2[2 + c]  = t.colourOverW[2][c] - t.colourOverW[0][c];
+    }
+    float db1dx = stepX[1] * invArea, db2dx = stepX[2] * invArea;
+    float db1dy = stepY[1] * invArea, db2dy = stepY[2] * invArea;
+    __m256 laneIndex = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 laneDdx[kAllAttributes], rowDdy[kAllAttributes];
+    for (int i = 0; i < kNumAttributes; ++i)
+    {
+        laneDdx[i] = _mm256_mul_ps(laneIndex, _mm256_set1_ps(db1dx * delta1[i] + db2dx * delta2[i]));
+        rowDdy[i]  = _mm256_set1_ps(db1dy * delta1[i] + db2dy * delta2[i]);
+    }
+
+    // Edge function steps across a row of a block
+    __m256i laneIndexInt = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i laneStepX[3], rowStepY[3];
+    for (int edge = 0; edge < 3; ++edge)
+    {
+        laneStepX[edge] = _mm256_mullo_epi32(laneIndexInt, _mm256_set1_epi32(static_cast<int32_t>(stepX[edge])));
+        rowStepY[edge]  = _mm256_set1_epi32(static_cast<int32_t>(stepY[edge]));
+    }
+
+    __m256 minDepth = _mm256_set1_ps(state.minDepth);
+    __m256 maxDepth = _mm256_set1_ps(state.maxDepth);
+    __m256 one  = _mm256_set1_ps(1.0f);
+    __m256i minXLanes = _mm256_set1_epi32(minX - 1);
+    __m256i maxXLanes = _mm256_set1_epi32(maxX + 1);
+    int width = mTarget->Width();
+
+    // Depth blocks, and the change in depth across a block for testing against them
+    DepthBlock* depthBlocks = mHierarchicalDepth ? mTarget->DepthBlocks() : nullptr;
+    int tile = (minY >> kTileShift) * mTilesX + (minX >> kTileShift);
+    TileStats& tileStats = mTileStats[tile];
+    uint64_t* coverage = &mCoverage[static_cast<size_t>(tile) * kTileSize];
+    uint32_t numTested = 0, numWritten = 0;
+    float blockDzdx = (db1dx * delta1[0] + db2dx * delta2[0]) * (kBlockSize - 1);
+    float blockDzdy = (db1dy * delta1[0] + db2dy * delta2[0]) * (kBlockSize - 1);
+    const __m256 infinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    const __m256 minusInfinity = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+
+    for (int blockY = firstBlockY; blockY <= maxY; blockY += kBlockSize)
+    {
+        int64_t blockStart[3] = { blockRowStart[0], blockRowStart[1], blockRowStart[2] };
+        for (int blockX = firstBlockX; blockX <= maxX; blockX += kBlockSize)
+        {
+            // Skip the block if it is outside an edge, and note which edges need testing
+            bool outside = false;
+            __m256i rowEdge[3], edgeStepY[3];
+            for (int edge = 0; edge < 3; ++edge)
+            {
+                outside |= blockStart[edge] + maxOffset[edge] < 0;
+                if (blockStart[edge] + minOffset[edge] >= 0)
+                {
+                    rowEdge[edge]   = _mm256_setzero_si256(); // Whole block inside this edge
+                    edgeStepY[edge] = _mm256_setzero_si256();
+                }
+                else
+                {
+                    rowEdge[edge]   = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int32_t>(blockStart[edge])), laneStepX[edge]);
+                    edgeStepY[edge] = rowStepY[edge];
+                }
+            }
+
+            // Compare the triangle's depth range across the block with the depths there: skip the block if the triangle
+            // is hidden, and do not read depth if it is in front of them all
+            float b1 = static_cast<float>(blockStart[1] - bias[1]) * invArea;
+            float b2 = static_cast<float>(blockStart[2] - bias[2]) * invArea;
+            bool readDepth = depthTest != RasterDepthTest::Always;
+            DepthBlock* depthBlock = nullptr;
+            if (!outside && depthBlocks != nullptr)
+            {
+                depthBlock = &depthBlocks[static_cast<size_t>(blockY >> kBlockShift) * mTarget->DepthBlocksX() + (blockX >> kBlockShift)];
+                if (readDepth)
+                {
+                    float blockZ = corner0[0] + b1 * delta1[0] + b2 * delta2[0];
+                    float nearest  = blockZ + (std::min)(0.0f, blockDzdx) + (std::min)(0.0f, blockDzdy) - t.depthMargin;
+                    float farthest = blockZ + (std::max)(0.0f, blockDzdx) + (std::max)(0.0f, blockDzdy) + t.depthMargin;
+                    nearest  = (std::min)((std::max)((std::max)(nearest,  t.minZ), state.minDepth), state.maxDepth);
+                    farthest = (std::min)((std::max)((std::min)(farthest, t.maxZ), state.minDepth), state.maxDepth);
+                    bool lessEqual = depthTest == RasterDepthTest::LessEqual;
+                    if (lessEqual ? nearest > depthBlock->maxDepth : nearest >= depthBlock->maxDepth)
+                    {
+                        outside = true;
+                        ++tileStats.depth.numBlocksSkipped;
+                    }
+                    else if (lessEqual ? farthest <= depthBlock->minDepth : farthest < depthBlock->minDepth)
+                    {
+                        readDepth = false;
+                        ++tileStats.depth.numBlocksAccepted;
+                    }
+                }
+            }
+
+            if (!outside)
+            {
+                // Attributes at the first pixel of the block
+                __m256 rowValue[kAllAttributes];
+                for (int i = 0; i < kNumAttributes; ++i)
+                {
+                    rowValue[i] = _mm256_add_ps(_mm256_set1_ps(corner0[i] + b1 * delta1[i] + b2 * delta2[i]), laneDdx[i]);
+                }
+
+                // Pixels of the block inside the area being drawn (the block may overhang it at the sides)
+                __m256i x = _mm256_add_epi32(_mm256_set1_epi32(blockX), laneIndexInt);
+                __m256i columns = _mm256_and_si256(_mm256_cmpgt_epi32(x, minXLanes), _mm256_cmpgt_epi32(maxXLanes, x));
+
+                __m256 writtenMin = infinity, writtenMax = minusInfinity;
+                int lastY = (std::min)(blockY + kBlockSize - 1, maxY);
+                for (int y = blockY; y <= lastY; ++y)
+                {
+                    // A pixel is covered if no edge function is negative, i.e. the sign bit of their OR is clear
+                    __m256i edges = _mm256_or_si256(_mm256_or_si256(rowEdge[0], rowEdge[1]), rowEdge[2]);
+                    __m256i covered = _mm256_andnot_si256(_mm256_srai_epi32(edges, 31), columns);
+                    if (y >= minY && !_mm256_testz_si256(covered, covered))
+                    {
+                        size_t pixel = static_cast<size_t>(y) * width + blockX;
+                        float* depthRow = mTarget->DepthPixels() + pixel;
+
+                        // Depth test, as the scalar version. Masked loads and stores do not touch pixels outside the mask
+                        __m256 z = _mm256_min_ps(_mm256_max_ps(rowValue[0], minDepth), maxDepth);
+                        __m256 write = _mm256_castsi256_ps(covered);
+                        if (readDepth)
+                        {
+                            __m256 depth = _mm256_maskload_ps(depthRow, covered);
+                            __m256 pass = depthTest == RasterDepthTest::Less ? _mm256_cmp_ps(z, depth, _CMP_LT_OQ)
+                                                                             : _mm256_cmp_ps(z, depth, _CMP_LE_OQ);
+                            write = _mm256_and_ps(write, pass);
+                        }
+                        __m256i writeMask = _mm256_castps_si256(write);
+                        uint32_t writeLanes = _mm256_movemask_ps(write);
+                        numTested  += CountLanes(_mm256_movemask_ps(_mm256_castsi256_ps(covered)));
+                        numWritten += CountLanes(writeLanes);
+
+                        // Blocks are aligned within the tile, so the row's eight bits are in one word
+                        coverage[y & (kTileSize - 1)] |= static_cast<uint64_t>(writeLanes) << (blockX & (kTileSize - 1));
+                        if (PixelState::DepthWrite(state))
+                        {
+                            _mm256_maskstore_ps(depthRow, writeMask, z);
+                            writtenMin = _mm256_min_ps(writtenMin, _mm256_blendv_ps(infinity, z, write));
+                            writtenMax = _mm256_max_ps(writtenMax, _mm256_blendv_ps(minusInfinity, z, write));
+                        }
+
+                        if (PixelState::kInterpolateColour && PixelState::ColourWrites(state) &&
+                            !_mm256_testz_si256(writeMask, writeMask))
+                        {
+                            // Perspective correct colour
+                            __m256i packed = PackColoursAvx2(rowValue + 2, _mm256_div_ps(one, rowValue[1]));
+                            _mm256_maskstore_epi32(reinterpret_cast<int*>(mTarget->Colour() + pixel), writeMask, packed);
+                        }
+                    }
+
+                    for (int edge = 0; edge < 3; ++edge)  rowEdge[edge] = _mm256_add_epi32(rowEdge[edge], edgeStepY[edge]);
+                    for (int i = 0; i < kNumAttributes; ++i)  rowValue[i] = _mm256_add_ps(rowValue[i], rowDdy[i]);
+                }
+
+                if (PixelState::DepthWrite(state) && depthBlock != nullptr)
+                {
+                    float blockMin = HorizontalMinAvx2(writtenMin);
+                    if (blockMin != std::numeric_limits<float>::infinity())
+                    {
+                        WidenDepthBlock(*depthBlock, blockMin, -HorizontalMinAvx2(_mm256_sub_ps(_mm256_setzero_ps(), writtenMax)));
+                    }
+                }
+            }
+
+            for (int edge = 0; edge < 3; ++edge)  blockStart[edge] += stepX[edge] * kBlockSize;
+        }
+        for (int edge = 0; edge < 3; ++edge)  blockRowStart[edge] += stepY[edge] * kBlockSize;
+    }
+    tileStats.numPixelsTested  += numTested;
+    tileStats.numPixelsWritten += numWritten;
+}
+
+// Eight pixels along the line at a time, as RasterizeLineScalar. The minor positions and remainders of the eight are
+// stepped together by eight pixels, depth is read with a gather, and the pixels that pass are written one by one as
+// they may be in different rows (or columns)
+template <class PixelState>
+AVX2_FUNCTION
+void SoftwareRenderer::RasterizeLineAvx2(const SetupTriangle& t, int minX, int minY, int maxX, int maxY)
+{
+    LineSpan span;
+    if (!FindLineSpan(t.x, t.y, minX, minY, maxX, maxY, span))  return;
+
+    const DrawState& state = mDrawStates[t.drawState];
+    RasterDepthTest depthTest = PixelState::DepthTest(state);
+    int a = span.start, b = 1 - span.start;
+
+    // Positions of the first eight pixels, then the steps for eight pixels
+    alignas(32) int32_t laneMinor[8], laneRemainder[8];
+    int32_t minor = span.minor, remainder = span.remainder;
+    for (int lane = 0; lane < 8; ++lane)
+    {
+        laneMinor[lane] = minor;
+        laneRemainder[lane] = remainder;
+        minor += span.minorStep;
+        remainder += span.remainderStep;
+        if (remainder >= span.length)
+        {
+            remainder -= span.length;
+            ++minor;
+        }
+    }
+    int64_t step = 8 * kSubPixels * span.minorDelta;
+    int32_t minorStep8 = static_cast<int32_t>(FloorDivide(step, span.length));
+    int32_t remainderStep8 = static_cast<int32_t>(step - static_cast<int64_t>(minorStep8) * span.length);
+
+    __m256i minorLanes     = _mm256_load_si256(reinterpret_cast<const __m256i*>(laneMinor));
+    __m256i remainderLanes = _mm256_load_si256(reinterpret_cast<const __m256i*>(laneRemainder));
+    __m256i pixelLanes     = _mm256_add_epi32(_mm256_set1_epi32(span.first), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i lastPixel      = _mm256_set1_epi32(span.last + 1);
+    __m256i minMinor       = _mm256_set1_epi32(span.minMinor - 1);
+    __m256i maxMinor       = _mm256_set1_epi32(span.maxMinor + 1);
+    __m256i lengthLanes    = _mm256_set1_epi32(span.length);
+    __m256i lengthMinusOne = _mm256_set1_epi32(span.length - 1);
+    int width = mTarget->Width();
+    __m256i majorStride    = _mm256_set1_epi32(span.xMajor ? 1 : width);
+    __m256i minorStride    = _mm256_set1_epi32(span.xMajor ? width : 1);
+    __m256i alongOffset    = _mm256_set1_epi32(kSubPixels / 2 - span.majorStart);
+    __m256  invLength      = _mm256_set1_ps(span.invLength);
+
+    __m256 z0 = _mm256_set1_ps(t.z[a]), dz = _mm256_set1_ps(t.z[b] - t.z[a]);
+    __m256 w0 = _mm256_set1_ps(t.invW[a]), dw = _mm256_set1_ps(t.invW[b] - t.invW[a]);
+    __m256 c0[4], dc[4];
+    for (int c = 0; c < 4; ++c)
+    {
+        c0[c] = _mm256_set1_ps(t.colourOverW[a][c]);
+        dc[c] = _mm256_set1_ps(t.colourOverW[b][c] - t.colourOverW[a][c]);
+    }
+    __m256 minDepth = _mm256_set1_ps(state.minDepth);
+    __m256 maxDepth = _mm256_set1_ps(state.maxDepth);
+    __m256 one = _mm256_set1_ps(1.0f);
+    float*      depthBuffer  = mTarget->DepthPixels();
+    uint32_t*   colourBuffer = mTarget->Colour();
+    DepthBlock* depthBlocks  = mHierarchicalDepth ? mTarget->DepthBlocks() : nullptr;
+    int tile = (minY >> kTileShift) * mTilesX + (minX >> kTileShift);
+    uint64_t* coverage = &mCoverage[static_cast<size_t>(tile) * kTileSize];
+    uint32_t numTested = 0, numWritten = 0;
+
+    for (int p = span.first; p <= span.last; p += 8)
+    {
+        __m256i minorPixel = _mm256_srai_epi32(minorLanes, kSubPixelBits);
+        __m256i inside = _mm256_and_si256(_mm256_cmpgt_epi32(lastPixel, pixelLanes),
+                                          _mm256_and_si256(_mm256_cmpgt_epi32(minorPixel, minMinor),
+                                                           _mm256_cmpgt_epi32(maxMinor, minorPixel)));
+        if (!_mm256_testz_si256(inside, inside))
+        {
+            __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(pixelLanes, majorStride),
+                                             _mm256_mullo_epi32(minorPixel, minorStride));
+            __m256 along = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_slli_epi32(pixelLanes, kSubPixelBits),
+                                                                             alongOffset)), invLength);
+            __m256 z = _mm256_add_ps(z0, _mm256_mul_ps(along, dz));
+            z = _mm256_min_ps(_mm256_max_ps(z, minDepth), maxDepth);
+            __m256 write = _mm256_castsi256_ps(inside);
+            if (depthTest != RasterDepthTest::Always)
+            {
+                __m256 depth = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), depthBuffer, index, write, 4);
+                __m256 pass = depthTest == RasterDepthTest::Less ? _mm256_cmp_ps(z, depth, _CMP_LT_OQ)
+                                                                 : _mm256_cmp_ps(z, depth, _CMP_LE_OQ);
+                write = _mm256_and_ps(write, pass);
+            }
+            int writeLanes = _mm256_movemask_ps(write);
+            numTested  += CountLanes(_mm256_movemask_ps(_mm256_castsi256_ps(inside)));
+            numWritten += CountLanes(writeLanes);
+            if (writeLanes != 0)
+            {
+                alignas(32) int32_t pixels[8], minorPixels[8], majorPixels[8];
+                alignas(32) float depths[8];
+                alignas(32) uint32_t colours[8];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(pixels), index);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(minorPixels), minorPixel);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(majorPixels), pixelLanes);
+                _mm256_store_ps(depths, z);
+                bool writeColour = PixelState::kInterpolateColour && PixelState::ColourWrites(state);
+                if (writeColour)
+                {
+                    __m256 colourOverW[4];
+                    for (int c = 0; c < 4; ++c)  colourOverW[c] = _mm256_add_ps(c0[c], _mm256_mul_ps(along, dc[c]));
+                    __m256 w = _mm256_div_ps(one, _mm256_add_ps(w0, _mm256_mul_ps(along, dw)));
+                    _mm256_store_si256(reinterpret_cast<__m256i*>(colours), PackColoursAvx2(colourOverW, w));
+                }
+                for (int lane = 0; lane < 8; ++lane)
+                {
+                    if ((writeLanes & (1 << lane)) == 0)  continue;
+                    int x = span.xMajor ? majorPixels[lane] : minorPixels[lane];
+                    int y = span.xMajor ? minorPixels[lane] : majorPixels[lane];
+                    MarkCovered(coverage, x, y);
+                    if (PixelState::DepthWrite(state))
+                    {
+                        depthBuffer[pixels[lane]] = depths[lane];
+                        if (depthBlocks != nullptr)
+                        {
+                            WidenDepthBlock(depthBlocks[static_cast<size_t>(y >> kBlockShift) * mTarget->DepthBlocksX() +
+                                                        (x >> kBlockShift)], depths[lane], depths[lane]);
+                        }
+                    }
+                    if (writeColour)  colourBuffer[pixels[lane]] = colours[lane];
+                }
+            }
+        }
+
+        // Step eight pixels on, carrying from the remainders into the positions
+        pixelLanes     = _mm256_add_epi32(pixelLanes, _mm256_set1_epi32(8));
+        minorLanes     = _mm256_add_epi32(minorLanes, _mm256_set1_epi32(minorStep8));
+        remainderLanes = _mm256_add_epi32(remainderLanes, _mm256_set1_epi32(remainderStep8));
+        __m256i carry  = _mm256_cmpgt_epi32(remainderLanes, lengthMinusOne);
+        minorLanes     = _mm256_sub_epi32(minorLanes, carry);
+        remainderLanes = _mm256_sub_epi32(remainderLanes, _mm256_and_si256(carry, lengthLanes));
+    }
+
+    TileStats& tileStats = mTileStats[tile];
+    tileStats.numPixelsTested  += numTested;
+    tileStats.numPixelsWritten += numWritten;
+}
+
+
+#endif
@@ -0,0 +1,431 @@
+//--------------------------------------------------------------------------------------
+// Software renderer - the app's GPU pipeline run on the CPU
+//--------------------------------------------------------------------------------------
+// Renders the same vertex and index buffers as the Direct3D code into a FrameBuffer in CPU
+// memory, so rendering can be tested and timed on machines with no GPU (or no Windows). The
+// calls mirror the ID3D11DeviceContext functions used in Scene.cpp: set the input layout,
+// vertex buffers, index buffer, topology, viewport and constants, then DrawIndexed.
+//
+// The shaders are fixed: the vertex shader is TransformColour_vs.hlsl and the pixel shader is
+// OneColour_ps.hlsl. The steps are the ones the GPU takes:
+// - Vertex shader: position * world * view * projection gives the clip space position, the
+//   colour is passed on
+// - Clipping against the near and far planes (0 <= z <= w). Triangles are not clipped to the
+//   sides of the view but to a guard band far outside them, as GPUs do, since the rasterizer
+//   only visits pixels inside the viewport anyway. Each vertex's out code (the planes it is
+//   outside) is found as it is shaded, four at a time, so most triangles are accepted or thrown
+//   away with a few bit operations and only those crossing the near plane are actually clipped
+// - Perspective divide by w and viewport transform to pixel coordinates
+// - Culling by winding, clockwise on screen is the front (as the default rasterizer state)
+// - Rasterization: a pixel is covered if its centre is inside the triangle. Corners are snapped
+//   to 1/256 pixel, and pixel centres exactly on an edge follow the top-left rule, so triangles
+//   sharing an edge never both draw a pixel or leave a gap
+// - Depth interpolated linearly across the screen, depth test and write (DXGI_FORMAT_D32_FLOAT)
+// - Colour interpolated with perspective correction, then written by the pixel shader
+//
+// Work is split over the cores of the machine. Draws only queue work: each draw's vertices are
+// shaded in parallel, then its triangles are clipped and set up, again in parallel. Flush sorts
+// the queued triangles into the 64x64 pixel tiles of the render target they overlap ("binning")
+// and rasterizes them - each tile is a separate task, so threads never write the same pixels,
+// and a tile draws its triangles in the order they were submitted. The picture is therefore exactly the
+// same whatever the number of threads.
+//
+// Triangles are rasterized in blocks of 8x8 pixels with AVX2 where the processor has it. The
+// edge functions are found at the corner of each block, and a block entirely outside one edge is
+// skipped while a block entirely inside an edge needs no tests against it. Rows of 8 pixels are
+// then tested, depth tested and coloured together. Coverage is exactly the same as the plain
+// C++ version (the edge tests are integer), depth and colour can differ in the last bit.
+//
+// Lines (RasterTopology::LineList) go through the same stages: they are clipped, binned into
+// tiles and depth tested like triangles, and draw one pixel per column (or per row for steep
+// lines). A wireframe view draws a mesh's edge list from MeshAdjacency::GetEdges, so an edge
+// shared by two triangles is drawn once rather than once for each. Pixels along a line are found
+// with exact integer steps, eight at a time with AVX2. For very large meshes this is a debug view
+// rather than an interactive one: a wireframe of 10 million triangles (15 million edges) takes
+// about 3 seconds a frame on one thread of a Xeon server core with AVX2, against 1.7 seconds for
+// the triangles (SoftRender --benchmark). Shading, setup and tiles are spread over the thread
+// pool, so more cores cut that, but it has only been measured on one.
+//
+// The depth buffer keeps the range of depths in each 8x8 block (see FrameBuffer.h). Before a
+// triangle is drawn in a tile, its nearest depth is compared with the farthest depth of the blocks
+// it overlaps there, and if it is behind them all it is thrown away without reading a pixel. The
+// AVX2 rasterizer also compares the triangle's depth across each block: blocks where it is hidden
+// are skipped, and blocks where it is in front of everything are drawn without reading depth.
+// Writing depth widens a block's range, and a block's range is found again from its pixels only
+// when a test needs it. Clearing depth only resets the blocks, and each tile fills its own blocks
+// when it is first drawn, so the clear is done in parallel and only where something is drawn.
+//
+// State that would otherwise be checked at every pixel - the depth test, depth writes and colour
+// writes - is instead built into the rasterization code: templates generate a version of each
+// rasterizer for every combination, and each draw picks the right one when it is queued. A depth
+// only pass, for example, does not interpolate colour at all. The vertex shader is specialised
+// on the colour format the same way.
+//
+// Each stage counts its work and times itself (see PipelineStats.h), so the effect of a change on
+// every stage can be seen.
+//
+// Matrices are 16 floats in the row vector convention of CMatrix4x4, pass &matrix.e00. This file
+// does not use DirectX.
+
+#ifndef _SOFTWARE_RENDERER_H_INCLUDED_
+#define _SOFTWARE_RENDERER_H_INCLUDED_
+
+#include "FrameBuffer.h"
+#include "TriangleCulling.h"
+#include "VertexLayout.h"
+#include "MeshData.h"
+#include "VertexCache.h"
+#include "PipelineStats.h"
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+// How the index buffer is read, as D3D11_PRIMITIVE_TOPOLOGY
+enum class RasterTopology
+{
+    TriangleList,
+    TriangleStrip, // An index of 0xFFFFFFFF starts a new strip, as on the GPU
+    LineList,      // A line for each pair of indices
+};
+
+// Depth comparison, as D3D11_COMPARISON_FUNC. A pixel is drawn if the comparison of its depth with the depth buffer
+// passes
+enum class RasterDepthTest
+{
+    Always,    // Depth testing off
+    Less,      // The default depth state
+    LessEqual, // As gDepthLessEqual in Scene.cpp
+};
+
+// Version of the rasterization code to use
+enum class RasterPath
+{
+    Auto,   // AVX2 if the processor supports it, otherwise Scalar
+    Scalar, // A pixel at a time
+    Avx2,   // 8x8 pixel blocks. Must only be selected if CpuHasAvx2() is true
+};
+
+// Vertex shader work done by draws, see SoftwareRenderer::SetVertexCache
+struct RasterVertexStats
+{
+    uint64_t numIndices        = 0;   // Vertices referred to by draws (not counting strip cuts)
+    uint64_t numShadedVertices = 0;   // Vertex shader runs
+    double   shadeMilliseconds = 0.0; // Time spent finding the vertices to shade and shading them
+
+    // Proportion of indices whose vertex did not need shading again
+    float HitRate() const { return numIndices > 0 ? 1.0f - static_cast<float>(numShadedVertices) / numIndices : 0.0f; }
+};
+
+// Work saved by the hierarchical depth test, see SoftwareRenderer::SetHierarchicalDepth. A triangle (or line) is
+// tested separately in each tile it is drawn in
+struct RasterDepthStats
+{
+    uint64_t numTested         = 0; // Triangles tested against the depth blocks of a tile
+    uint64_t numRejected       = 0; // Triangles behind everything already drawn there, so not drawn in the tile
+    uint64_t numBlocksSkipped  = 0; // 8x8 blocks where a triangle drawn was hidden, so skipped (AVX2 only)
+    uint64_t numBlocksAccepted = 0; // 8x8 blocks where a triangle was in front of everything, so drawn without reading
+                                    // depth (AVX2 only)
+
+    float RejectionRate() const { return numTested > 0 ? static_cast<float>(numRejected) / numTested : 0.0f; }
+};
+
+// Area of the render target drawn to, as D3D11_VIEWPORT
+struct RasterViewport
+{
+    float x = 0.0f;
+    float y = 0.0f;
+    float width = 0.0f;
+    float height = 0.0f;
+    float minDepth = 0.0f;
+    float maxDepth = 1.0f;
+};
+
+
+class SoftwareRenderer
+{
+public:
+    static const int kMaxSlots = 4;  // Vertex buffer slots
+    static const int kTileSize = 64; // Pixels along each side of a tile
+
+    // Output merger //
+
+    // Select the buffers to draw to, as OMSetRenderTargets. Also sets the viewport to the whole buffer
+    void SetRenderTarget(FrameBuffer* target);
+
+    // Depth state, as OMSetDepthStencilState
+    void SetDepthState(RasterDepthTest test, bool write);
+
+    // Turn colour writes off for a depth-only pass, like setting a null pixel shader
+    void SetColourWrites(bool write) { mColourWrites = write; }
+
+
+    // Input assembler //
+
+    // Describe the vertex buffers, as IASetInputLayout. The vertex shader needs a "Position" element (Float3) and a
+    // "Colour" element (Float4 or UByte4Norm), in any streams. Returns false if either is missing
+    bool SetInputLayout(const VertexStream* streams, int numStreams);
+
+    // Select vertex data for consecutive slots, as IASetVertexBuffers. The data must stay in place until drawn
+    void SetVertexBuffers(int startSlot, int numBuffers, const void* const* data, const uint32_t* strides);
+
+    // Select the indices (32-bit), as IASetIndexBuffer. The data must stay in place until drawn
+    void SetIndexBuffer(const MeshIndex* indices) { mIndices = indices; }
+
+    void SetTopology(RasterTopology topology) { mTopology = topology; }
+
+
+    // Rasterizer //
+
+    void SetViewport(const RasterViewport& viewport) { mViewport = viewport; }
+
+    // Which side of triangles is removed, as D3D11_RASTERIZER_DESC::CullMode. gTwoSided in Scene.cpp is CullFace::None
+    void SetCullFace(CullFace cull) { mCullFace = cull; }
+
+
+    // Constants //
+
+    // Camera matrices, as the PerFrameConstants constant buffer
+    void SetFrameConstants(const float* viewMatrix, const float* projectionMatrix);
+
+    // World matrix and tint, as the PerModelConstants constant buffer. The tint is four floats (RGBA) multiplying the
+    // vertex colours; null leaves them unchanged
+    void SetModelConstants(const float* worldMatrix, const float* tint = nullptr);
+
+
+    // Drawing //
+
+    // Draw using the index buffer, as DrawIndexed. baseVertex is added to each index. The triangles are queued and
+    // only reach the render target on Flush
+    void DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex);
+
+    // Rasterize all queued triangles, as ID3D11DeviceContext::Flush. Call before reading or clearing the render
+    // target. Also happens when the render target changes and when the queue gets large
+    void Flush();
+
+    // Use the shared thread pool (default) or do all the work on the calling thread, to compare timings. The picture
+    // is the same either way
+    void SetMultithreaded(bool multithreaded) { mMultithreaded = multithreaded; }
+
+    // Choose the rasterization code, to compare timings. Takes effect from the next Flush
+    void SetRasterPath(RasterPath path);
+
+    // Rasterize with the versions generated for each draw's depth and colour state (default), or with one general
+    // version that checks the state at every pixel, to compare timings. The picture is the same either way. Takes
+    // effect from the next draw
+    void SetSpecialisedPipelines(bool specialised) { mSpecialisedPipelines = specialised; }
+
+    // Test triangles against the depth range of each block of the depth buffer before drawing them (default), or
+    // test every pixel only, to compare timings. The picture is the same either way. Takes effect from the next Flush
+    void SetHierarchicalDepth(bool hierarchical) { mHierarchicalDepth = hierarchical; }
+
+    // Counts for the flushes since the last reset
+    const RasterDepthStats& DepthStats() const { return mDepthStats; }
+    void ResetDepthStats() { mDepthStats = RasterDepthStats(); }
+
+    // Counts and times of each stage, for the draws and flushes since the last reset. Rasterization is only counted on
+    // Flush, so flush before reading them for a frame. The pixels covered are those of the current render target written
+    // since the reset (or since the target was set), so reset once a frame for each frame's overdraw
+    const RasterPipelineStats& PipelineStats() const { return mPipelineStats; }
+    void ResetPipelineStats();
+
+
+    // Vertex cache //
+
+    // By default each vertex in the range a draw uses is shaded once, an ideal cache. With a cache size, vertices are
+    // instead looked up in index order in a model of the GPU's post-transform cache (see VertexCache.h), empty at the
+    // start of each draw, and shaded only on a miss - so the work done depends on the order of the indices as it does
+    // on the GPU. The picture is the same either way. A size of 0 goes back to the default
+    void SetVertexCache(VertexCacheType type, int cacheSize);
+
+    // Counts and time for the draws since the last reset
+    const RasterVertexStats& VertexStats() const { return mVertexStats; }
+    void ResetVertexStats() { mVertexStats = RasterVertexStats(); }
+
+
+private:
+    // Output of the vertex shader
+    struct ShadedVertex
+    {
+        float x, y, z, w;   // Clip space position
+        float r, g, b, a;   // Colour
+    };
+
+    // A triangle ready to rasterize. Lines use the first two corners
+    struct SetupTriangle
+    {
+        int32_t  x[3], y[3];            // Corners in pixels, 8 bits of fraction, clockwise on screen
+        int      minX, minY, maxX, maxY; // Pixel bounds, inclusive, inside the viewport and render target
+        float    z[3];                  // Depth after the viewport transform
+        float    invW[3];               // 1/w, for perspective correct interpolation
+        float    colourOverW[3][4];     // Colour / w
+        float    minZ, maxZ;            // Depth range of the corners, widened by depthMargin
+        float    depthMargin;           // Most the interpolated depth of a pixel may be out by from rounding
+        uint32_t drawState;             // Index into mDrawStates
+    };
+
+    // Rasterization code for one combination of pixel state, with the scalar and AVX2 versions. Called with a
+    // triangle and the part of its bounds to draw
+    using RasterizeFunction = void (SoftwareRenderer::*)(const SetupTriangle&, int, int, int, int);
+    struct RasterPipeline
+    {
+        RasterizeFunction scalar = nullptr;
+        RasterizeFunction avx2   = nullptr; // Null if not built for x86
+    };
+
+    // Output merger state of a draw, kept with its queued triangles
+    struct DrawState
+    {
+        RasterDepthTest depthTest;
+        bool            depthWrite;
+        bool            colourWrites;
+        float           minDepth, maxDepth;
+        RasterPipeline  pipeline;  // Chosen for the state above
+    };
+
+    // Template arguments of the rasterizers giving the pixel state of a draw: fixed when compiled, or read from the
+    // DrawState at every pixel (see SoftwareRenderer.cpp)
+    template <RasterDepthTest kDepthTest, bool kDepthWrite, bool kColourWrites> struct FixedPixelState;
+    struct GeneralPixelState;
+
+    // Triangles thrown away or clipped while setting up a batch, see RasterPipelineStats
+    struct SetupCounts
+    {
+        uint64_t numOutsideView = 0;
+        uint64_t numClipped     = 0;
+        uint64_t numCulled      = 0;
+        uint64_t numEmpty       = 0;
+    };
+
+    // Triangles set up by the front end, consecutive in submission order: a run of a large draw's triangles, or several
+    // small draws. On Flush their numbers are sorted by tile: those overlapping tile t are binned[binStart[t]] to
+    // binned[binStart[t + 1] - 1], in order
+    struct TriangleBatch
+    {
+        std::vector<SetupTriangle> triangles;
+        std::vector<uint32_t>      binStart;
+        std::vector<uint32_t>      binned;
+        SetupCounts                counts;
+    };
+
+    // Counts from drawing one tile
+    struct TileStats
+    {
+        RasterDepthStats depth;
+        uint64_t         numPixelsTested  = 0;
+        uint64_t         numPixelsWritten = 0;
+    };
+
+    // Run the vertex shader on the vertices used by a draw, on part of them for each colour format
+    void ShadeVertices(const uint32_t* vertexList, uint32_t firstVertex, uint32_t numVertices);
+    template <bool kColourBytes>
+    void ShadeVertexRange(const uint32_t* vertexList, uint32_t firstVertex, size_t begin, size_t end, const float* matrix,
+                          const float* tint);
+
+    // Replay a draw's indices through the vertex cache model, listing the vertices to shade. Returns how many
+    uint32_t AssignCacheSlots(const MeshIndex* indices, uint32_t indexCount, int32_t baseVertex, int64_t minVertex,
+                              uint32_t numRangeVertices, bool strip);
+
+    // Clip and set up a run of assembled triangles or lines, then later sort a batch of them into tiles
+    void SetUpTriangles(const uint32_t* corners, uint32_t numTriangles, uint32_t drawState, TriangleBatch& batch) const;
+    void SetUpLines(const uint32_t* corners, uint32_t numLines, uint32_t drawState, TriangleBatch& batch) const;
+    void BinTriangles(TriangleBatch& batch) const;
+
+    // Find the clip planes each vertex is outside
+    void ClassifyVertices(const ShadedVertex* vertices, size_t count, uint16_t* codes) const;
+
+    // Clip a triangle to the chosen planes and set up the pieces
+    void ClipTriangle(const ShadedVertex& v0, const ShadedVertex& v1, const ShadedVertex& v2, uint32_t clipPlanes,
+                      uint32_t drawState, TriangleBatch& batch) const;
+
+    // Perspective divide, viewport transform and culling of a triangle inside the frustum
+    void AddClippedTriangle(const ShadedVertex& v0, const ShadedVertex& v1, const ShadedVertex& v2, uint32_t drawState,
+                            TriangleBatch& batch) const;
+    bool SetUpTriangle(const ShadedVertex* vertices[3], SetupTriangle& triangle, SetupCounts& counts) const;
+    bool SetUpLine(const ShadedVertex& v0, const ShadedVertex& v1, SetupTriangle& line) const;
+
+    // Perspective divide and viewport transform of one corner, and limiting pixel bounds to the viewport. Both return
+    // false if nothing can be drawn
+    bool ProjectCorner(const ShadedVertex& vertex, int corner, SetupTriangle& triangle) const;
+    bool ClampToViewport(SetupTriangle& triangle) const;
+
+    // The rasterization code for the current state, and for a PixelState drawing triangles or lines
+    RasterPipeline SelectPipeline() const;
+    template <class PixelState, bool kLines> static RasterPipeline MakePipeline();
+    template <bool kLines> static const RasterPipeline* PipelineTable();
+
+    // Draw the queued triangles of one tile
+    void RasterizeTile(int tile);
+
+    // Whether a triangle is hidden in the depth blocks covering part of its bounds
+    bool DepthHidden(const SetupTriangle& triangle, const DrawState& state, int minX, int minY, int maxX, int maxY);
+    template <class PixelState>
+    void RasterizeTriangleScalar(const SetupTriangle& triangle, int minX, int minY, int maxX, int maxY);
+    template <class PixelState>
+    void RasterizeTriangleAvx2(const SetupTriangle& triangle, int minX, int minY, int maxX, int maxY);
+    template <class PixelState>
+    void RasterizeLineScalar(const SetupTriangle& line, int minX, int minY, int maxX, int maxY);
+    template <class PixelState>
+    void RasterizeLineAvx2(const SetupTriangle& line, int minX, int minY, int maxX, int maxY);
+
+    // Call task(taskIndex, threadIndex) for each task, on the thread pool if multithreaded
+    void RunTasks(int numTasks, const std::function<void(int, int)>& task);
+
+    // State
+    FrameBuffer*    mTarget = nullptr;
+    RasterDepthTest mDepthTest = RasterDepthTest::Less;
+    bool            mDepthWrite = true;
+    bool            mColourWrites = true;
+
+    const uint8_t* mVertexData[kMaxSlots] = {};
+    uint32_t       mStrides[kMaxSlots] = {};
+    int            mPositionSlot = -1;
+    uint32_t       mPositionOffset = 0;
+    int            mColourSlot = -1;
+    uint32_t       mColourOffset = 0;
+    bool           mColourBytes = false; // Colour is UByte4Norm rather than Float4
+    const MeshIndex* mIndices = nullptr;
+    RasterTopology   mTopology = RasterTopology::TriangleList;
+
+    RasterViewport mViewport;
+    CullFace       mCullFace = CullFace::Back;
+    float          mGuardBandX = 1.0f, mGuardBandY = 1.0f; // Size of the guard band relative to the viewport
+
+    float mViewMatrix[16] = {};
+    float mProjectionMatrix[16] = {};
+    float mWorldMatrix[16] = {};
+    float mTint[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    bool       mMultithreaded = true;
+    RasterPath mRasterPath = RasterPath::Auto; // Auto is replaced by the path it selects on the first Flush
+    bool       mSpecialisedPipelines = true;
+    bool       mHierarchicalDepth = true;
+    RasterDepthStats mDepthStats;
+
+    VertexCacheType   mVertexCacheType = VertexCacheType::Fifo;
+    int               mVertexCacheSize = 0;
+    RasterVertexStats mVertexStats;
+    RasterPipelineStats mPipelineStats;
+
+    // Queue
+    int                        mTilesX = 0, mTilesY = 0;
+    std::vector<DrawState>     mDrawStates;
+    std::vector<TriangleBatch> mBatches;     // Reused between flushes, only the first mNumBatches are queued
+    size_t                     mNumBatches = 0;
+    size_t                     mNumQueued = 0; // Triangles in the queue
+
+    // Scratch memory
+    std::vector<ShadedVertex> mShadedVertices;
+    std::vector<uint16_t>     mOutCodes;     // For each of mShadedVertices
+    std::vector<uint32_t>     mIndexSlots;   // Entry in mShadedVertices for each index of a draw
+    std::vector<uint32_t>     mMissVertices; // Vertices to shade, in cache miss order
+    std::vector<uint32_t>     mCacheEntries; // State of the cache model
+    std::vector<uint32_t>     mCorners;      // Three mShadedVertices entries for each triangle of a draw, two for lines
+    std::vector<uint32_t>     mTileOrder;    // Tiles, most work first
+    std::vector<uint32_t>     mTileWork;
+    std::vector<TileStats>    mTileStats;    // Counts from each tile in the current flush
+    std::vector<uint64_t>     mCoverage;     // A bit for each pixel written since the stats were reset: kTileSize words
+                                             // for each tile, a word for each of its rows
+};
+
+
+#endif //_SOFTWARE_RENDERER_H_INCLUDED_
@@ -0,0 +1,281 @@
+//--------------------------------------------------------------------------------------
+// Streaming rendered frames to a video file or pipe, for looking at long runs
+//--------------------------------------------------------------------------------------
+
+#include "VideoCapture.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <csignal>
+#endif
+
+#ifdef _WIN32
+#define popen  _popen
+#define pclose _pclose
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+// Full range BT.601 luma and chroma of a packed colour, as JPEG, in 16.16 fixed point. Chroma is centred on 128
+static inline int Luma(uint32_t colour)
+{
+    int r = colour & 0xFF, g = (colour >> 8) & 0xFF, b = (colour >> 16) & 0xFF;
+    return 19595 * r + 38470 * g + 7471 * b;
+}
+static inline int ChromaBlue(int r, int g, int b)
+{
+    return -11059 * r - 21709 * g + 32768 * b;
+}
+static inline int ChromaRed(int r, int g, int b)
+{
+    return 32768 * r - 27439 * g - 5329 * b;
+}
+
+// Round a 16.16 fixed point value (offset by 128 if chroma) to a byte
+static inline uint8_t ToByte(int value, int offset)
+{
+    int rounded = ((value + 32768) >> 16) + offset;
+    return static_cast<uint8_t>((std::min)((std::max)(rounded, 0), 255));
+}
+
+
+//--------------------------------------------------------------------------------------
+// Opening and closing
+//--------------------------------------------------------------------------------------
+
+VideoCapture::~VideoCapture()
+{
+    std::string error;
+    Close(error);
+}
+
+
+bool VideoCapture::Open(const std::string& destination, int width, int height, int framesPerSecond, VideoFormat format,
+                        int numBuffers, CaptureOverflow overflow, std::string& error)
+{
+    std::string closeError;
+    Close(closeError);
+
+    if (width <= 0 || height <= 0 || framesPerSecond <= 0)
+    {
+        error = "Invalid video size or frame rate";
+        return false;
+    }
+    if (format == VideoFormat::Y4m && (width % 2 != 0 || height % 2 != 0))
+    {
+        error = "Y4M video needs an even width and height";
+        return false;
+    }
+
+    mPipe = false;
+    if (destination == "-")
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        mFile = stdout;
+    }
+    else if (!destination.empty() && destination[0] == '|')
+    {
+#ifdef _WIN32
+        mFile = popen(destination.c_str() + 1, "wb");
+#else
+        // A command that exits early would otherwise end this process with SIGPIPE rather than fail the write
+        std::signal(SIGPIPE, SIG_IGN);
+        mFile = popen(destination.c_str() + 1, "w");
+#endif
+        mPipe = true;
+    }
+    else
+    {
+        mFile = std::fopen(destination.c_str(), "wb");
+    }
+    if (mFile == nullptr)
+    {
+        error = "Cannot open " + destination;
+        return false;
+    }
+
+    mWidth    = width;
+    mHeight   = height;
+    mFormat   = format;
+    mOverflow = overflow;
+    numBuffers = (std::max)(numBuffers, kMinBuffers);
+    mBuffers.assign(numBuffers, std::vector<uint32_t>(static_cast<size_t>(width) * height));
+    mFreeBuffers.clear();
+    for (int i = numBuffers - 1; i >= 0; --i)  mFreeBuffers.push_back(i);
+    mQueuedBuffers.clear();
+    mClosing = false;
+    mWriteFailed = false;
+    mStats = VideoCaptureStats();
+
+    if (format == VideoFormat::Y4m)
+    {
+        // Progressive, square pixels, chroma sited between pixels as JPEG
+        std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) + " F" +
+                             std::to_string(framesPerSecond) + ":1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n";
+        mWriteFailed = std::fwrite(header.data(), 1, header.size(), mFile) != header.size();
+    }
+
+    mWriter = std::thread(&VideoCapture::WriterLoop, this);
+    return true;
+}
+
+
+bool VideoCapture::Close(std::string& error)
+{
+    if (!mWriter.joinable())  return true;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClosing = true;
+    }
+    mFrameQueued.notify_one();
+    mWriter.join();
+
+    bool ok = !mWriteFailed && std::fflush(mFile) == 0;
+    if (mPipe)  ok = (pclose(mFile) == 0) && ok;
+    else if (mFile != stdout)  ok = (std::fclose(mFile) == 0) && ok;
+    mFile = nullptr;
+    if (!ok)  error = "Error writing video";
+    return ok;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Adding frames
+//--------------------------------------------------------------------------------------
+
+bool VideoCapture::AddFrame(const uint32_t* colours, size_t rowPitch)
+{
+    if (!IsOpen())  return false;
+    if (rowPitch == 0)  rowPitch = mWidth;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    int buffer;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        ++mStats.numAdded;
+        if (mOverflow == CaptureOverflow::Wait)
+        {
+            mBufferFree.wait(lock, [this] { return !mFreeBuffers.empty() || mWriteFailed; });
+        }
+        if (mWriteFailed || mFreeBuffers.empty())
+        {
+            if (!mWriteFailed)  ++mStats.numDropped;
+            mStats.addMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            return false;
+        }
+        buffer = mFreeBuffers.back();
+        mFreeBuffers.pop_back();
+    }
+
+    // The buffer belongs to this thread until it is queued, so it is filled without holding the lock
+    uint32_t* copy = mBuffers[buffer].data();
+    for (int y = 0; y < mHeight; ++y)
+    {
+        std::memcpy(copy + static_cast<size_t>(y) * mWidth, colours + y * rowPitch, mWidth * sizeof(uint32_t));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueuedBuffers.push_back(buffer);
+        mStats.maxQueued = (std::max)(mStats.maxQueued, mQueuedBuffers.size());
+        mStats.addMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+    mFrameQueued.notify_one();
+    return true;
+}
+
+
+VideoCaptureStats VideoCapture::Stats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writer thread
+//--------------------------------------------------------------------------------------
+
+void VideoCapture::WriterLoop()
+{
+    for (;;)
+    {
+        int buffer;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mFrameQueued.wait(lock, [this] { return !mQueuedBuffers.empty() || mClosing; });
+            if (mQueuedBuffers.empty())  return; // Closing with nothing left to write
+            buffer = mQueuedBuffers.front();
+            mQueuedBuffers.pop_front();
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        bool written = !mWriteFailed && WriteFrame(mBuffers[buffer].data());
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFreeBuffers.push_back(buffer);
+            mStats.writeMilliseconds += ms;
+            if (written)  ++mStats.numWritten;
+            else          mWriteFailed = true;
+        }
+        mBufferFree.notify_one();
+    }
+}
+
+
+bool VideoCapture::WriteFrame(const uint32_t* colours)
+{
+    if (mFormat == VideoFormat::RawRgba)
+    {
+        size_t size = static_cast<size_t>(mWidth) * mHeight * sizeof(uint32_t);
+        return std::fwrite(colours, 1, size, mFile) == size;
+    }
+
+    // Y4M: a frame marker, then the luma plane and the two chroma planes at half size. Chroma is the average of each
+    // 2x2 block of pixels
+    static const char kFrameMarker[] = "FRAME\n";
+    size_t lumaSize = static_cast<size_t>(mWidth) * mHeight;
+    size_t chromaWidth = mWidth / 2, chromaHeight = mHeight / 2;
+    size_t chromaSize = chromaWidth * chromaHeight;
+    mConverted.resize(lumaSize + chromaSize * 2);
+    uint8_t* lumaPlane = mConverted.data();
+    uint8_t* bluePlane = lumaPlane + lumaSize;
+    uint8_t* redPlane  = bluePlane + chromaSize;
+
+    for (size_t p = 0; p < lumaSize; ++p)  lumaPlane[p] = ToByte(Luma(colours[p]), 0);
+
+    for (size_t y = 0; y < chromaHeight; ++y)
+    {
+        const uint32_t* row0 = colours + (y * 2) * mWidth;
+        const uint32_t* row1 = row0 + mWidth;
+        for (size_t x = 0; x < chromaWidth; ++x)
+        {
+            uint32_t block[4] = { row0[x * 2], row0[x * 2 + 1], row1[x * 2], row1[x * 2 + 1] };
+            int r = 0, g = 0, b = 0;
+            for (uint32_t colour : block)
+            {
+                r += colour & 0xFF;
+                g += (colour >> 8) & 0xFF;
+                b += (colour >> 16) & 0xFF;
+            }
+            // Sums of four pixels, so shift by two more
+            bluePlane[y * chromaWidth + x] = ToByte(ChromaBlue(r, g, b) >> 2, 128);
+            redPlane [y * chromaWidth + x] = ToByte(ChromaRed (r, g, b) >> 2, 128);
+        }
+    }
+
+    return std::fwrite(kFrameMarker, 1, sizeof(kFrameMarker) - 1, mFile) == sizeof(kFrameMarker) - 1 &&
+           std::fwrite(mConverted.data(), 1, mConverted.size(), mFile) == mConverted.size();
+}
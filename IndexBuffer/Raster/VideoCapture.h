@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------------
+// Streaming rendered frames to a video file or pipe, for looking at long runs
+//--------------------------------------------------------------------------------------
+// Saving a long run as one image file per frame (see ImageFile.h) soon fills a folder, so frames
+// can instead be streamed one after another into a single uncompressed video:
+// - Y4M ("YUV4MPEG2"), 8-bit YUV 4:2:0 with full range BT.601 colours as JPEG uses. Most video
+//   players and tools open it directly, e.g. "ffmpeg -i capture.y4m capture.mp4"
+// - Raw RGBA, the bytes of the FrameBuffer as they are with no header. Tools need to be told the
+//   size, e.g. "ffmpeg -f rawvideo -pix_fmt rgba -s 1280x960 -r 60 -i capture.rgba ..."
+// The destination is a file name, "-" for standard output, or "|" followed by a command to start
+// and write to, such as "|ffmpeg -y -i - capture.mp4", so nothing uncompressed reaches the disk.
+//
+// Converting and writing a frame takes a while, longer than drawing it at large sizes, so it is
+// done on a thread of its own. AddFrame only copies the frame into one of a fixed number of
+// buffers and queues it. While the writer works through one buffer the render loop fills the
+// next (double buffering with two buffers, more give room for the writer to fall behind for a
+// few frames). If every buffer is still queued, AddFrame either drops the frame, so a slow disk
+// never holds up an interactive app, or waits for the writer, so a command line tool gets every
+// frame.
+
+#ifndef _VIDEO_CAPTURE_H_INCLUDED_
+#define _VIDEO_CAPTURE_H_INCLUDED_
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+// Format of the stream
+enum class VideoFormat
+{
+    Y4m,     // YUV4MPEG2, YUV 4:2:0
+    RawRgba, // Frames of packed colours as stored in FrameBuffer, no header
+};
+
+// What AddFrame does when every buffer is queued
+enum class CaptureOverflow
+{
+    Drop, // Throw the frame away
+    Wait, // Wait until the writer has finished with a buffer
+};
+
+// Counts since the stream was opened
+struct VideoCaptureStats
+{
+    uint64_t numAdded     = 0;   // Frames passed to AddFrame
+    uint64_t numWritten   = 0;   // Frames written out
+    uint64_t numDropped   = 0;   // Frames thrown away with every buffer queued
+    size_t   maxQueued    = 0;   // Most frames waiting at once
+    double   addMilliseconds   = 0.0; // Time spent in AddFrame, copying frames and waiting for buffers
+    double   writeMilliseconds = 0.0; // Time the writer thread spent converting and writing
+};
+
+
+class VideoCapture
+{
+public:
+    static const int kMinBuffers = 2; // Double buffering
+
+    VideoCapture() = default;
+    ~VideoCapture(); // Closes the stream, waiting for queued frames to be written
+
+    // Prevent copying
+    VideoCapture(const VideoCapture&) = delete;
+    VideoCapture& operator=(const VideoCapture&) = delete;
+
+
+    // Start a stream of frames of the given size to a file, "-" (standard output) or "|command". Y4M needs an even
+    // width and height. Returns false and sets error if the destination cannot be opened. Any open stream is closed
+    // first
+    bool Open(const std::string& destination, int width, int height, int framesPerSecond, VideoFormat format,
+              int numBuffers, CaptureOverflow overflow, std::string& error);
+
+    // Finish writing the queued frames and close the stream. Returns false and sets error if any frame could not be
+    // written
+    bool Close(std::string& error);
+
+    bool IsOpen() const { return mWriter.joinable(); }
+
+
+    // Copy a frame of packed colours (the FrameBuffer format) into a buffer and queue it to be written. Rows are
+    // rowPitch colours apart, 0 for the width. Returns false if the frame was dropped or writing has failed
+    bool AddFrame(const uint32_t* colours, size_t rowPitch = 0);
+
+    // Counts so far, safe to call while frames are being written
+    VideoCaptureStats Stats() const;
+
+
+private:
+    // Main function of the writer thread: write queued frames until the stream is closed
+    void WriterLoop();
+
+    // Convert and write one frame. Returns false on a write error
+    bool WriteFrame(const uint32_t* colours);
+
+    FILE*       mFile = nullptr;
+    bool        mPipe = false;
+    int         mWidth = 0;
+    int         mHeight = 0;
+    VideoFormat mFormat = VideoFormat::Y4m;
+    CaptureOverflow mOverflow = CaptureOverflow::Drop;
+
+    // Frame buffers: each is free, being filled by AddFrame, queued or being written
+    std::vector<std::vector<uint32_t>> mBuffers;
+    std::vector<int> mFreeBuffers;
+    std::deque<int>  mQueuedBuffers; // In the order the frames were added
+    std::vector<uint8_t> mConverted; // Writer thread's output for one frame
+
+    std::thread             mWriter;
+    mutable std::mutex      mMutex; // Guards the buffer lists, the flags and the stats
+    std::condition_variable mFrameQueued;
+    std::condition_variable mBufferFree;
+    bool                    mClosing = false;
+    bool                    mWriteFailed = false;
+    VideoCaptureStats       mStats;
+};
+
+
+#endif //_VIDEO_CAPTURE_H_INCLUDED_
@@ -14,8 +14,22 @@
 #include "MathHelpers.h" // Some additional helper functions for maths - have a look
 
 #include "ColourRGBA.h" 
+#include "VertexFormats.h"
+#include "MeshStreams.h"
+#include "GeometryPool.h"
+#include "TriangleCulling.h"
+#include "MeshFile.h"
+#include "Skinning.h"
+#include "MorphTargets.h"
+#include "DrawRecorder.h"
+#include "SoftwareRenderer.h"
+#include "OcclusionCulling.h"
+#include "ImageFile.h"
+#include "VideoCapture.h"
+#include "MeshAdjacency.h"
 
 #include <sstream>
+#include <vector>
 
 //--------------------------------------------------------------------------------------
 // Global Variables
@@ -23,15 +37,157 @@
 // Globals used to keep code simpler, but try to architect your own code in a better way
 
 // DirectX objects controlling the vertex & index buffers (mesh data on GPU) and vertex layout (description of a single vertex)
+// All meshes share the vertex and index buffers of a geometry pool (see GeometryPool.h), so the buffers are bound once
+// and each mesh is drawn from its own part of them. There is one vertex buffer per stream - one for interleaved
+// vertices, two for split streams (see MeshStreams.h)
 ID3D11InputLayout* gSimpleVertexLayout = nullptr;
-ID3D11Buffer*      gSimpleVertexBuffer = nullptr;
-ID3D11Buffer*      gSimpleIndexBuffer = nullptr;
+ID3D11InputLayout* gDepthOnlyVertexLayout = nullptr; // Layout for the depth-only pass - positions only
+ID3D11Buffer*      gPoolVertexBuffers[MeshStreams::kMaxStreams] = {};
+ID3D11Buffer*      gPoolIndexBuffer = nullptr;
+
+// CPU-side copy of the pool's buffers, and the location of the cube in them
+GeometryPool gGeometryPool;
+PoolMeshId   gCubePoolMesh = kInvalidPoolMesh;
 
 ID3D11RasterizerState* gTwoSided; // This is used to make sure both sides of a triangle are drawn - useful for early tutorials
+ID3D11DepthStencilState* gDepthLessEqual; // Depth test that passes pixels at the depth already written by the depth-only pass
+
+// CPU-side copy of the cube's vertex and index data, arranged in the stream layout selected below
+MeshStreams gCubeMesh;
+
+// Whether the cube's vertex data is held interleaved (one SimpleVertex buffer) or split into a position buffer and a
+// colour buffer (toggle with T). Split streams let the depth-only pass read 12 bytes per vertex instead of 28
+VertexStreamLayout gCubeStreamLayout = VertexStreamLayout::Split;
+
+// Render a depth-only pass before the colour pass (toggle with P). Only positions are needed to fill the depth buffer
+bool gDepthPrePass = true;
+
+// Counts the vertex/index data read by each pass, shown in the window title pass by pass
+VertexFetchCounter gVertexFetchCounter;
+
+// CPU triangle culling (toggle with C). Each frame the cube's triangles are tested on the CPU and only those that
+// can be seen are copied to a dynamic index buffer and drawn (see TriangleCulling.h). The GPU still draws both sides
+// of the triangles it is given (gTwoSided), so the picture is the same with culling on or off
+bool gCpuCulling = false;
+std::vector<MeshIndex>    gCubeListIndices;   // The cube's strip converted to a triangle list, culling works on lists
+std::vector<MeshIndex>    gCulledIndices;     // Triangles that passed the tests this frame
+std::vector<ClipPosition> gCubeClipPositions; // The cube's vertices transformed to clip space this frame
+ID3D11Buffer*             gCulledIndexBuffer = nullptr;
+TriangleCullStats         gCullStats;
 
 // The world matrix for the cube - this positions and orients the cube and is updated every frame
 CMatrix4x4 gCubeMatrix;
 
+// A tube beside the cube, bent by a chain of bones each frame. Its vertices are skinned on the CPU (see Skinning.h)
+// straight into a dynamic vertex buffer of positions. The colours do not change so they are in a separate static
+// buffer, and only the positions are sent to the GPU each frame
+const int kTubeBones    = 4;  // Bones in a chain up the tube, one unit long each
+const int kTubeRings    = 33; // Rings of vertices along the tube
+const int kTubeSegments = 16; // Vertices around each ring
+std::vector<SkinnedVertex> gTubeVertices; // CPU-side copy of the tube in its bind pose (straight)
+std::vector<MeshIndex>     gTubeIndices;
+ID3D11Buffer*      gTubePositionBuffer = nullptr; // Dynamic, written by the skinning each frame
+ID3D11Buffer*      gTubeColourBuffer = nullptr;
+ID3D11Buffer*      gTubeIndexBuffer = nullptr;
+ID3D11InputLayout* gTubeVertexLayout = nullptr;   // Positions in slot 0, colours in slot 1
+CMatrix4x4 gTubeBoneMatrices[kTubeBones];          // Skinning matrices for this frame, from the bind pose to the animated pose
+CMatrix4x4 gTubeMatrix;                            // World matrix for the whole tube
+
+// A flat patch on the other side of the cube animated with morph targets (see MorphTargets.h), like a small face with
+// bulges and a blush. The blended vertices are copied to two vertex buffers used alternately: each frame the buffer
+// not drawn last frame is brought up to date with only the vertices that changed since it was written, so the CPU
+// never writes to a buffer the GPU may still be reading
+const int kMorphGridSize = 48; // Vertices along each side of the patch
+const int kMorphTargets  = 4;
+MorphBlender               gMorphBlender;
+std::vector<MeshIndex>     gMorphIndices;
+ID3D11Buffer*              gMorphVertexBuffers[2] = {};
+uint64_t                   gMorphBufferFrames[2] = {}; // The blender frame each buffer was last brought up to date with
+int                        gMorphDrawBuffer = 0;       // Buffer drawn last frame
+std::vector<MorphRange>    gMorphRanges;
+ID3D11Buffer*              gMorphIndexBuffer = nullptr;
+ID3D11InputLayout*         gMorphVertexLayout = nullptr;
+float                      gMorphWeights[kMorphTargets] = {};
+CMatrix4x4                 gMorphMatrix;
+
+// A grid of small cubes in the distance, more copies of the pool's cube mesh. They are drawn with a single instanced
+// draw, taking their world matrices and tints from a per-instance vertex stream, or one draw per cube with a constant
+// buffer update for each to compare (key I). Both draw the same picture
+const int kCubeGridSize = 32; // Cubes along each side of the grid
+bool gInstancing = true;
+std::vector<CMatrix4x4>   gCubeGridMatrices;
+std::vector<InstanceData> gCubeGridInstances;
+ID3D11Buffer*      gInstanceBuffer = nullptr;        // Dynamic, rewritten with the instance data every frame
+ID3D11InputLayout* gInstancedVertexLayout = nullptr; // The cube's streams plus the instance stream
+VertexStream       gInstancedStreams[MeshStreams::kMaxStreams + 1];
+int                gNumInstancedStreams = 0;
+
+// Follows the input assembler and draw calls for the cube grid, counting and checking them (see DrawRecorder.h)
+DrawRecorder gDrawRecorder;
+uint32_t     gRecordedPoolVertexBuffers[MeshStreams::kMaxStreams] = { DrawRecorder::kNoBuffer, DrawRecorder::kNoBuffer };
+uint32_t     gRecordedPoolIndexBuffer = DrawRecorder::kNoBuffer;
+uint32_t     gRecordedInstanceBuffer = DrawRecorder::kNoBuffer;
+uint32_t     gRecordedModelConstants = DrawRecorder::kNoBuffer;
+
+// Draw the scene on the CPU with the software renderer instead of the GPU (toggle with R), to compare the two (see
+// SoftwareRenderer.h). The picture is drawn into a frame buffer in CPU memory, then copied through a texture to the back
+// buffer. The cube, morph patch and cube grid are drawn, the grid with its tints. The skinned tube is left out as its
+// vertices are only ever written to GPU memory
+bool             gSoftwareRendering = false;
+FrameBuffer      gSoftwareFrame;
+SoftwareRenderer gSoftwareRenderer;
+ID3D11Texture2D* gSoftwareFrameTexture = nullptr;
+
+// Draw triangle edges only (toggle with L). The GPU uses a wireframe rasterizer state. The software renderer draws line
+// lists of each mesh's edges instead, each edge once (see MeshAdjacency::GetEdges), so shared edges are not drawn twice
+bool                   gWireframe = false;
+ID3D11RasterizerState* gWireframeState = nullptr;
+std::vector<MeshIndex> gCubeEdgeIndices;  // Relative to the cube's first vertex in the geometry pool
+std::vector<MeshIndex> gMorphEdgeIndices;
+
+// Occlusion culling of the cube grid (toggle with O, see OcclusionCulling.h). The spinning cube is drawn into a small
+// depth buffer on the CPU, then the bounding box of each grid cube is tested against it and hidden cubes are not drawn
+bool                      gOcclusionCulling = false;
+OcclusionBuffer           gOcclusionBuffer;
+OcclusionStats            gOcclusionStats;
+std::vector<OcclusionBox> gCubeGridBoxes;          // World space bounds of each grid cube
+std::vector<uint8_t>      gCubeGridVisible;        // 1 for each grid cube that is drawn
+std::vector<InstanceData> gVisibleCubeInstances;   // Instance data of the cubes drawn
+
+// Saving the picture to a file (key F), to look at or compare outside the app (see ImageFile.h). The software renderer's
+// colour and depth are saved directly. The GPU's back buffer is copied to a staging texture the CPU can read first
+bool                  gCaptureFrame = false;
+int                   gNumCaptures = 0;
+std::string           gCaptureMessage;
+ID3D11Texture2D*      gCaptureTexture = nullptr;
+std::vector<uint32_t> gCaptureColours;
+
+// Recording a video of every frame (toggle with V, see VideoCapture.h). Frames are written on a thread of their own and
+// dropped if it falls behind, so recording does not slow the app down. The GPU's back buffer is copied to one of two
+// staging textures each frame while the other, copied the frame before, is read. That copy has finished by then, so
+// reading it does not wait for the GPU
+VideoCapture     gVideoCapture;
+int              gNumVideos = 0;
+std::string      gVideoMessage;
+ID3D11Texture2D* gVideoTextures[2] = {};
+int              gVideoTextureIndex = 0;   // Texture to copy the next frame to
+int              gNumVideoTexturesCopied = 0;
+
+// Counts of the work done at each stage of the pipeline (see PipelineStats.h). Key K starts and stops writing them to
+// PipelineStatsN.csv, a row per frame. The software renderer counts its own stages. The GPU's counts come from pipeline
+// statistics queries, read a few frames later so the CPU does not wait for the GPU. The GPU has no counts for some of
+// the columns (triangles outside the view, clipped or culled, binning, pixels tested and the times), these are 0
+const int           kNumStatsQueries = 4;  // Frames the GPU's counts may be behind by
+uint64_t            gFrameNumber = 0;
+RasterPipelineStats gFrameStats;           // Last frame counted, shown in the window title
+FILE*               gStatsFile = nullptr;
+int                 gNumStatsFiles = 0;
+std::string         gStatsMessage;
+ID3D11Query*        gStatsQueries[kNumStatsQueries] = {};
+uint64_t            gStatsQueryFrames[kNumStatsQueries] = {};
+int                 gFirstStatsQuery = 0;  // Oldest query waiting for the GPU
+int                 gNumStatsQueries = 0;  // Queries waiting
+
 
 //--------------------------------------------------------------------------------------
 // Constant Buffers
@@ -51,10 +207,9 @@ ID3D11Buffer* gPerFrameConstantBuffer; // This variable controls the GPU-side co
 
 // This is the matrix that positions the cube in the scene. Unlike the structure above this data can be updated and
 // sent to the GPU several times every frame (once per cube). However, apart from that it works in the same way.
-struct
-{
-	CMatrix4x4 worldMatrix;
-} gPerModelConstants;
+// The tint multiplies the vertex colours, as InstanceData::tint does for instanced draws. White leaves them unchanged
+// (see PerModelConstants in VertexFormats.h)
+PerModelConstants gPerModelConstants;
 ID3D11Buffer* gPerModelConstantBuffer; // This variable controls the GPU-side constant buffer related to the above structure
 
 
@@ -63,35 +218,21 @@ ID3D11Buffer* gPerModelConstantBuffer; // This variable controls the GPU-side co
 // Geometry definitions and data
 //--------------------------------------------------------------------------------------
 
-// The content of a single vertex in the geometry to render. Currently just stores the position of the vertex (x,y,z). 
-// However, we can store other information for each vertex (for example, a colour for the vertex) so we use a structure.
-struct SimpleVertex
-{
-	CVector3 position;
-	ColourRGBA colour;
-};
-
+// The content of a single vertex in the geometry to render is described by the SimpleVertex structure in VertexFormats.h
+// That file also has a NormalVertex structure for lit geometry, see MeshNormals.h for how to generate its normals.
 
 
 // Describe the "input layout" //
 
-// This describes the contents of the SimpleVertex structure above so DirectX will know what to expect when reading vertex data.
+// DirectX needs to know what to expect when reading vertex data. Rather than describing the SimpleVertex structure by
+// hand here (semantic names, formats and byte offsets that must exactly match the structure), the description is
+// generated from the kSimpleVertexElements list in VertexFormats.h (and the split stream versions next to it).
+// See InitGeometry below.
 //
-// There is one row in the layout array below for each data element in our SimpleVertex structure. So the first row below describes
-// the fact that each vertex has a "Position" which is made of three 32-bit floats, that is offset 0 bytes from the start of the
-// vertex structure. The next row says there is a "Colour" made of four floats, offset 12 bytse from the start (i.e. after the
-// position). Note that in this array the floats are referred to as RGB colours even though they will hold x,y,z values.
-// The "slot", and other values in the array below can be ignored in most cases.
-//
-// This structure should also match the vertex shader input structure
-//
-D3D11_INPUT_ELEMENT_DESC gSimpleVertexDesc[] =
-{
-	// Data Type,  Type Index,  Data format                      Slot  Offset    Other values can be ignored for now 
-	{ "Position",  0,           DXGI_FORMAT_R32G32B32_FLOAT,     0,    0,        D3D11_INPUT_PER_VERTEX_DATA, 0 },
-	{ "Colour",    0,           DXGI_FORMAT_R32G32B32A32_FLOAT,  0,    12,       D3D11_INPUT_PER_VERTEX_DATA,  0 },
-};
-int gSimpleVertexDescCount = sizeof(gSimpleVertexDesc) / sizeof(gSimpleVertexDesc[0]); // This gives a count of rows in the array above
+// The vertex shader input structure (SimpleVertex in Common.hlsli) must also match. MakeHlslVertexStruct in
+// VertexLayout.h generates the matching HLSL if you change the vertex structure, and "MeshCheck --hlsl Common.hlsli"
+// checks every vertex structure in the shaders against the layouts bound for it. Shaders match vertex data by
+// semantic name, not by buffer, so the same shader works with interleaved or split streams.
 
 
 
@@ -118,7 +259,7 @@ int gCubeNumVertices = sizeof(gCubeVertices) / sizeof(gCubeVertices[0]); // Tota
 // The index buffer shows how to join together the vertices above into triangles. As this is a triangle list, each triplet
 // of vertices define a single triangle. This is just the front square of a cube. You will build the rest as an exercise
 //
-DWORD gCubeIndices[] =
+MeshIndex gCubeIndices[] =
 {
 	//0, 1, 2,	//ABC
 	//1, 2, 3,	//BCD
@@ -140,65 +281,641 @@ int gCubeNumIndices = sizeof(gCubeIndices) / sizeof(gCubeIndices[0]);
 
 
 //--------------------------------------------------------------------------------------
-// Initialise scene geometry, constant buffers and states
+// Geometry pool buffers
 //--------------------------------------------------------------------------------------
 
-// Prepare the geometry required for the scene
+// Create a GPU buffer holding a copy of the given data
+static ID3D11Buffer* CreatePoolBuffer(UINT bindFlags, const void* data, size_t size)
+{
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = bindFlags;
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT; // Default usage - the buffer is only changed with UpdateSubresource
+	bufferDesc.ByteWidth = static_cast<UINT>(size);
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	D3D11_SUBRESOURCE_DATA initData;
+	initData.pSysMem = data;
+	ID3D11Buffer* buffer = nullptr;
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, &initData, &buffer)))  return nullptr;
+	return buffer;
+}
+
+// Copy part of a buffer's CPU-side data to the GPU
+static void UpdatePoolBuffer(ID3D11Buffer* buffer, const uint8_t* data, uint32_t firstByte, uint32_t numBytes)
+{
+	D3D11_BOX box = {};
+	box.left   = firstByte;
+	box.right  = firstByte + numBytes;
+	box.bottom = 1;
+	box.back   = 1;
+	gD3DContext->UpdateSubresource(buffer, 0, &box, data + firstByte, 0, 0);
+}
+
+// Bring the GPU buffers up to date with any meshes added to the pool or moved by defragmenting. If the pool has
+// grown the buffers are created again at the new size, otherwise only the changed parts are copied over
 // Returns true on success
-bool InitGeometry()
+bool UpdateGeometryPoolBuffers()
 {
-	HRESULT hr; // To hold DirectX return values
+	const uint8_t* indexData = reinterpret_cast<const uint8_t*>(gGeometryPool.IndexData());
 
-	//// Create a vertex and index buffer on the GPU ////
+	if (gGeometryPool.CapacityChanged())
+	{
+		for (auto& vertexBuffer : gPoolVertexBuffers)
+		{
+			if (vertexBuffer)  vertexBuffer->Release();
+			vertexBuffer = nullptr;
+		}
+		if (gPoolIndexBuffer)  gPoolIndexBuffer->Release();
+		gPoolIndexBuffer = nullptr;
+
+		for (int stream = 0; stream < gGeometryPool.NumStreams(); ++stream)
+		{
+			size_t size = static_cast<size_t>(gGeometryPool.VertexCapacity()) * gGeometryPool.GetStream(stream).stride;
+			gPoolVertexBuffers[stream] = CreatePoolBuffer(D3D11_BIND_VERTEX_BUFFER, gGeometryPool.StreamData(stream), size);
+			if (gPoolVertexBuffers[stream] == nullptr)
+			{
+				gLastError = "Error creating vertex buffer";
+				return false;
+			}
+		}
+		gPoolIndexBuffer = CreatePoolBuffer(D3D11_BIND_INDEX_BUFFER, indexData, gGeometryPool.IndexCapacity() * sizeof(MeshIndex));
+		if (gPoolIndexBuffer == nullptr)
+		{
+			gLastError = "Error creating index buffer";
+			return false;
+		}
+
+		// Tell the draw recorder the new sizes
+		for (int stream = 0; stream < gGeometryPool.NumStreams(); ++stream)
+		{
+			uint64_t size = static_cast<uint64_t>(gGeometryPool.VertexCapacity()) * gGeometryPool.GetStream(stream).stride;
+			uint32_t& recorded = gRecordedPoolVertexBuffers[stream];
+			if (recorded == DrawRecorder::kNoBuffer)  recorded = gDrawRecorder.AddBuffer("Pool vertices", size);
+			else                                      gDrawRecorder.ResizeBuffer(recorded, size);
+		}
+		uint64_t indexSize = gGeometryPool.IndexCapacity() * sizeof(MeshIndex);
+		if (gRecordedPoolIndexBuffer == DrawRecorder::kNoBuffer)  gRecordedPoolIndexBuffer = gDrawRecorder.AddBuffer("Pool indices", indexSize);
+		else                                                      gDrawRecorder.ResizeBuffer(gRecordedPoolIndexBuffer, indexSize);
+	}
+	else
+	{
+		const PoolDirtyRange& vertices = gGeometryPool.DirtyVertices();
+		if (vertices.count > 0)
+		{
+			for (int stream = 0; stream < gGeometryPool.NumStreams(); ++stream)
+			{
+				uint32_t stride = gGeometryPool.GetStream(stream).stride;
+				UpdatePoolBuffer(gPoolVertexBuffers[stream], gGeometryPool.StreamData(stream), vertices.first * stride, vertices.count * stride);
+			}
+		}
+		const PoolDirtyRange& indices = gGeometryPool.DirtyIndices();
+		if (indices.count > 0)
+		{
+			UpdatePoolBuffer(gPoolIndexBuffer, indexData, indices.first * sizeof(MeshIndex), indices.count * sizeof(MeshIndex));
+		}
+	}
+
+	gGeometryPool.ClearChanges();
+	return true;
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Skinned tube
+//--------------------------------------------------------------------------------------
+
+// Bone b's world matrix when the tube is in its bind pose. The bones are stacked up the y axis from y = -2
+static CMatrix4x4 TubeBoneBindMatrix(int bone)
+{
+	return MatrixTranslation(CVector3(0.0f, -2.0f + bone, 0.0f));
+}
+
+// Build the tube's vertices and indices. Each ring of vertices is attached to the two bones nearest to it, with
+// weights that change smoothly along the tube so that it bends in a curve rather than kinking at the joints
+static void BuildTube()
+{
+	const float radius = 0.4f;
+	const float length = static_cast<float>(kTubeBones);
+	gTubeVertices.clear();
+	for (int ring = 0; ring < kTubeRings; ++ring)
+	{
+		float height = length * ring / (kTubeRings - 1); // 0 at the bottom of the tube
+
+		// Position between the middles of the bones, bone b's middle is at height b + 0.5
+		float bonePosition = (std::max)(0.0f, (std::min)(height - 0.5f, kTubeBones - 1.0f));
+		int   bone0 = (std::min)(static_cast<int>(bonePosition), kTubeBones - 1);
+		int   bone1 = (std::min)(bone0 + 1, kTubeBones - 1);
+		int   weight1 = static_cast<int>((bonePosition - bone0) * 255.0f + 0.5f);
+
+		for (int segment = 0; segment < kTubeSegments; ++segment)
+		{
+			float angle = ToRadians(360.0f) * segment / kTubeSegments;
+			SkinnedVertex vertex;
+			vertex.normal   = CVector3(std::cos(angle), 0.0f, std::sin(angle));
+			vertex.position = CVector3(vertex.normal.x * radius, height - 2.0f, vertex.normal.z * radius);
+			vertex.colour   = ColourRGBA(0.3f + 0.7f * height / length, 0.8f, 0.3f + 0.3f * (segment % 2), 1.0f);
+			vertex.boneIndices[0] = static_cast<uint8_t>(bone0);
+			vertex.boneIndices[1] = static_cast<uint8_t>(bone1);
+			vertex.boneIndices[2] = vertex.boneIndices[3] = 0;
+			vertex.boneWeights[0] = static_cast<uint8_t>(255 - weight1);
+			vertex.boneWeights[1] = static_cast<uint8_t>(weight1);
+			vertex.boneWeights[2] = vertex.boneWeights[3] = 0;
+			gTubeVertices.push_back(vertex);
+		}
+	}
+
+	// Two triangles for each segment between neighbouring rings, clockwise when seen from outside
+	gTubeIndices.clear();
+	for (int ring = 0; ring < kTubeRings - 1; ++ring)
+	{
+		for (int segment = 0; segment < kTubeSegments; ++segment)
+		{
+			MeshIndex a = ring * kTubeSegments + segment;
+			MeshIndex b = ring * kTubeSegments + (segment + 1) % kTubeSegments;
+			MeshIndex c = a + kTubeSegments;
+			MeshIndex d = b + kTubeSegments;
+			MeshIndex quad[] = { a, c, b,  b, c, d };
+			gTubeIndices.insert(gTubeIndices.end(), quad, quad + 6);
+		}
+	}
+}
+
+// Create the tube's GPU buffers and input layout
+// Returns true on success
+static bool InitTube()
+{
+	BuildTube();
 
-	//****
+	// Static buffers for the colours and indices
+	std::vector<ColourAttributes> colours(gTubeVertices.size());
+	for (size_t v = 0; v < gTubeVertices.size(); ++v)  colours[v].colour = gTubeVertices[v].colour;
+	gTubeColourBuffer = CreatePoolBuffer(D3D11_BIND_VERTEX_BUFFER, colours.data(), colours.size() * sizeof(ColourAttributes));
+	gTubeIndexBuffer  = CreatePoolBuffer(D3D11_BIND_INDEX_BUFFER, gTubeIndices.data(), gTubeIndices.size() * sizeof(MeshIndex));
 
-	// This is just a way to copy the vertex array above into GPU memory. When rendering, data needs to be in GPU memory.
+	// Dynamic buffer for the skinned positions, no initial data as it is written every frame
 	D3D11_BUFFER_DESC bufferDesc;
-	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Indicate it is a vertex buffer
-	bufferDesc.Usage = D3D11_USAGE_DEFAULT;      // Default usage for this buffer - we'll see other usages later
-	bufferDesc.ByteWidth = gCubeNumVertices * sizeof(SimpleVertex); // Size of the buffer in bytes
-	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = static_cast<UINT>(gTubeVertices.size() * sizeof(PositionVertex));
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 	bufferDesc.MiscFlags = 0;
-	D3D11_SUBRESOURCE_DATA initData; // Fill the new vertex buffer with the array above as initial data
-	initData.pSysMem = gCubeVertices;
-	hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &gSimpleVertexBuffer);
-	if (FAILED(hr))
+	if (gTubeColourBuffer == nullptr || gTubeIndexBuffer == nullptr ||
+		FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &gTubePositionBuffer)))
 	{
-		gLastError = "Error creating vertex buffer";
+		gLastError = "Error creating tube buffers";
 		return false;
 	}
 
+	VertexStream streams[] = { MakeVertexStream<PositionVertex>(kPositionVertexElements, 0),
+	                           MakeVertexStream<ColourAttributes>(kColourAttributesElements, 1) };
+	gTubeVertexLayout = CreateVertexLayout(streams, 2);
+	if (gTubeVertexLayout == nullptr)
+	{
+		gLastError = "Error creating input layout";
+		return false;
+	}
 
-	//****NEW
+	for (auto& bone : gTubeBoneMatrices)  bone = MatrixIdentity();
+	return true;
+}
 
-	// Create index buffer. Same as above code - but this copies the index array from above into GPU memory.
-	bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER; // Indicate it is a index buffer
-	bufferDesc.Usage = D3D11_USAGE_DEFAULT;         // Default usage for this buffer - we'll see other usages later
-	bufferDesc.ByteWidth = gCubeNumIndices * sizeof(DWORD); // Size of the buffer in bytes - each index is a DWORD (32-bit integer)
-	bufferDesc.CPUAccessFlags = 0;
+// Skin the tube into its dynamic vertex buffer and draw it
+static void RenderTube()
+{
+	// Map with "discard" gives fresh memory to write while the GPU may still be reading last frame's positions
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(gD3DContext->Map(gTubePositionBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))  return;
+	SkinningTarget target = { mapped.pData, nullptr, sizeof(PositionVertex) };
+	SkinVertices(gTubeVertices.data(), gTubeVertices.size(), &gTubeBoneMatrices[0].e00, target);
+	gD3DContext->Unmap(gTubePositionBuffer, 0);
+
+	memcpy(gPerModelConstants.worldMatrix, &gTubeMatrix.e00, sizeof(gPerModelConstants.worldMatrix));
+	gPerModelConstants.tint = ColourRGBA(1.0f, 1.0f, 1.0f, 1.0f);
+	gD3DContext->Map(gPerModelConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	memcpy(mapped.pData, &gPerModelConstants, sizeof(gPerModelConstants));
+	gD3DContext->Unmap(gPerModelConstantBuffer, 0);
+
+	ID3D11Buffer* buffers[] = { gTubePositionBuffer, gTubeColourBuffer };
+	UINT strides[] = { sizeof(PositionVertex), sizeof(ColourAttributes) };
+	UINT offsets[] = { 0, 0 };
+	gD3DContext->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	gD3DContext->IASetIndexBuffer(gTubeIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	gD3DContext->IASetInputLayout(gTubeVertexLayout);
+	gD3DContext->VSSetShader(gSimpleVertexShader, nullptr, 0);
+	gD3DContext->PSSetShader(gSimplePixelShader, nullptr, 0);
+	gD3DContext->DrawIndexed(static_cast<UINT>(gTubeIndices.size()), 0, 0);
+}
+
+// Bend the tube - each bone turns a little further from its parent
+static void UpdateTube(float frameTime)
+{
+	static float time = 0.0f;
+	time += frameTime;
+	float bend = std::sin(time) * ToRadians(25.0f);
+
+	CMatrix4x4 boneWorld = MatrixIdentity();
+	for (int bone = 0; bone < kTubeBones; ++bone)
+	{
+		// A bone's world matrix is its matrix relative to its parent bone times the parent's world matrix. The first
+		// bone is relative to the tube
+		CMatrix4x4 parentRelative = bone == 0 ? TubeBoneBindMatrix(0) : MatrixTranslation(CVector3(0.0f, 1.0f, 0.0f));
+		boneWorld = MatrixRotationZ(bend) * parentRelative * (bone == 0 ? MatrixIdentity() : boneWorld);
+
+		// The skinning matrix takes a vertex from the bind pose to the bone's current pose
+		gTubeBoneMatrices[bone] = InverseAffine(TubeBoneBindMatrix(bone)) * boneWorld;
+	}
+	gTubeMatrix = MatrixTranslation(CVector3(3.0f, 0.0f, 0.0f));
+}
+
+
+//--------------------------------------------------------------------------------------
+// Morphing patch
+//--------------------------------------------------------------------------------------
+
+// Add a morph target that changes the vertices of the patch near a point, fading out to nothing at the given radius.
+// Only the vertices inside the radius get a delta, so blending the target does not touch the rest of the patch
+static void AddMorphPatchTarget(const std::vector<SimpleVertex>& vertices, float x, float y, float radius,
+                                float depth, const ColourRGBA& colour)
+{
+	std::vector<MorphDelta> deltas;
+	for (uint32_t v = 0; v < vertices.size(); ++v)
+	{
+		float dx = vertices[v].position.x - x;
+		float dy = vertices[v].position.y - y;
+		float distance = std::sqrt(dx * dx + dy * dy) / radius;
+		if (distance >= 1.0f)  continue;
+
+		float amount = 0.5f + 0.5f * std::cos(distance * ToRadians(180.0f)); // Smooth fall-off to 0 at the radius
+		MorphDelta delta = { v, CVector3(0.0f, 0.0f, -depth * amount),
+		                     ColourRGBA(colour.r * amount, colour.g * amount, colour.b * amount, 0.0f) };
+		deltas.push_back(delta);
+	}
+	gMorphBlender.AddTarget(deltas.data(), deltas.size());
+}
+
+// Create the patch, its morph targets and GPU buffers
+// Returns true on success
+static bool InitMorphPatch()
+{
+	// A flat grid of vertices two units across
+	std::vector<SimpleVertex> vertices;
+	for (int row = 0; row < kMorphGridSize; ++row)
+	{
+		for (int column = 0; column < kMorphGridSize; ++column)
+		{
+			SimpleVertex vertex;
+			vertex.position = CVector3(2.0f * column / (kMorphGridSize - 1) - 1.0f, 1.0f - 2.0f * row / (kMorphGridSize - 1), 0.0f);
+			vertex.colour   = ColourRGBA(0.8f, 0.65f, 0.5f, 1.0f);
+			vertices.push_back(vertex);
+		}
+	}
+	gMorphIndices.clear();
+	for (int row = 0; row < kMorphGridSize - 1; ++row)
+	{
+		for (int column = 0; column < kMorphGridSize - 1; ++column)
+		{
+			MeshIndex a = row * kMorphGridSize + column;
+			MeshIndex b = a + 1;
+			MeshIndex c = a + kMorphGridSize;
+			MeshIndex d = c + 1;
+			MeshIndex quad[] = { a, b, c,  b, d, c };
+			gMorphIndices.insert(gMorphIndices.end(), quad, quad + 6);
+		}
+	}
+
+	MeshAdjacency morphAdjacency;
+	morphAdjacency.Build(gMorphIndices.data(), gMorphIndices.size(), vertices.size());
+	morphAdjacency.GetEdges(gMorphEdgeIndices);
+
+	// Two bulges, a crease and a blush that only changes colour
+	gMorphBlender.Init(vertices.data(), static_cast<uint32_t>(vertices.size()));
+	AddMorphPatchTarget(vertices, -0.45f,  0.35f, 0.3f,  0.25f, ColourRGBA(0.0f, 0.2f, 0.3f));
+	AddMorphPatchTarget(vertices,  0.45f,  0.35f, 0.3f,  0.25f, ColourRGBA(0.0f, 0.2f, 0.3f));
+	AddMorphPatchTarget(vertices,  0.0f,  -0.45f, 0.4f, -0.2f,  ColourRGBA(-0.3f, -0.3f, -0.2f));
+	AddMorphPatchTarget(vertices,  0.0f,   0.0f,  0.5f,  0.0f,  ColourRGBA(0.2f, -0.3f, -0.2f));
+
+	// Both vertex buffers start as the base mesh, which is blender frame 0
+	for (auto& vertexBuffer : gMorphVertexBuffers)
+	{
+		vertexBuffer = CreatePoolBuffer(D3D11_BIND_VERTEX_BUFFER, gMorphBlender.Vertices(), gMorphBlender.NumVertices() * sizeof(SimpleVertex));
+	}
+	gMorphIndexBuffer = CreatePoolBuffer(D3D11_BIND_INDEX_BUFFER, gMorphIndices.data(), gMorphIndices.size() * sizeof(MeshIndex));
+	if (gMorphVertexBuffers[0] == nullptr || gMorphVertexBuffers[1] == nullptr || gMorphIndexBuffer == nullptr)
+	{
+		gLastError = "Error creating morph patch buffers";
+		return false;
+	}
+
+	VertexStream stream = MakeVertexStream<SimpleVertex>(kSimpleVertexElements, 0);
+	gMorphVertexLayout = CreateVertexLayout(&stream, 1);
+	if (gMorphVertexLayout == nullptr)
+	{
+		gLastError = "Error creating input layout";
+		return false;
+	}
+	return true;
+}
+
+// Bring the vertex buffer not drawn last frame up to date with the blended patch and draw it
+static void RenderMorphPatch()
+{
+	int drawBuffer = 1 - gMorphDrawBuffer;
+	ID3D11Buffer* vertexBuffer = gMorphVertexBuffers[drawBuffer];
+	gMorphBlender.ChangedRanges(gMorphBufferFrames[drawBuffer], gMorphRanges);
+	const uint8_t* vertexData = reinterpret_cast<const uint8_t*>(gMorphBlender.Vertices());
+	for (auto& range : gMorphRanges)
+	{
+		UpdatePoolBuffer(vertexBuffer, vertexData, static_cast<uint32_t>(range.first * sizeof(SimpleVertex)),
+		                 static_cast<uint32_t>(range.count * sizeof(SimpleVertex)));
+	}
+	gMorphBufferFrames[drawBuffer] = gMorphBlender.Frame();
+	gMorphDrawBuffer = drawBuffer;
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	memcpy(gPerModelConstants.worldMatrix, &gMorphMatrix.e00, sizeof(gPerModelConstants.worldMatrix));
+	gPerModelConstants.tint = ColourRGBA(1.0f, 1.0f, 1.0f, 1.0f);
+	gD3DContext->Map(gPerModelConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	memcpy(mapped.pData, &gPerModelConstants, sizeof(gPerModelConstants));
+	gD3DContext->Unmap(gPerModelConstantBuffer, 0);
+
+	UINT stride = sizeof(SimpleVertex);
+	UINT offset = 0;
+	gD3DContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+	gD3DContext->IASetIndexBuffer(gMorphIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	gD3DContext->IASetInputLayout(gMorphVertexLayout);
+	gD3DContext->VSSetShader(gSimpleVertexShader, nullptr, 0);
+	gD3DContext->PSSetShader(gSimplePixelShader, nullptr, 0);
+	gD3DContext->DrawIndexed(static_cast<UINT>(gMorphIndices.size()), 0, 0);
+}
+
+// Animate the morph target weights. Each weight is zero for part of its cycle, when its target costs nothing
+static void UpdateMorphPatch(float frameTime)
+{
+	static float time = 0.0f;
+	time += frameTime;
+	for (int target = 0; target < kMorphTargets; ++target)
+	{
+		gMorphWeights[target] = (std::max)(0.0f, std::sin(time * (0.7f + 0.3f * target) + target));
+	}
+	gMorphBlender.Blend(gMorphWeights);
+	gMorphMatrix = MatrixTranslation(CVector3(-3.0f, 0.0f, 0.0f));
+}
+
+
+//--------------------------------------------------------------------------------------
+// Instanced cube grid
+//--------------------------------------------------------------------------------------
+
+// Create the instance buffer and the layout that reads it alongside the cube's own streams
+// Returns true on success
+static bool InitCubeGrid()
+{
+	const int numCubes = kCubeGridSize * kCubeGridSize;
+	gCubeGridMatrices.resize(numCubes);
+	gCubeGridInstances.resize(numCubes);
+	gCubeGridBoxes.resize(numCubes);
+	gCubeGridVisible.assign(numCubes, 1);
+	gVisibleCubeInstances.reserve(numCubes);
+
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;             // Rewritten every frame
+	bufferDesc.ByteWidth = numCubes * sizeof(InstanceData);
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 	bufferDesc.MiscFlags = 0;
-	initData.pSysMem = gCubeIndices;
-	hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &gSimpleIndexBuffer);
-	if (FAILED(hr))
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &gInstanceBuffer)))
 	{
-		gLastError = "Error creating index buffer";
+		gLastError = "Error creating instance buffer";
 		return false;
 	}
 
-	//****
+	gRecordedInstanceBuffer = gDrawRecorder.AddBuffer("Instances", bufferDesc.ByteWidth);
+	gRecordedModelConstants = gDrawRecorder.AddBuffer("Per-model constants", sizeof(gPerModelConstants));
+	return true;
+}
+
+// Draw the grid of cubes, either as instances in one draw or one draw per cube. Each call is also given to the draw
+// recorder so the two ways can be compared
+static void RenderCubeGrid()
+{
+	gDrawRecorder.BeginFrame();
+	const PoolMeshRange& range = gGeometryPool.GetRange(gCubePoolMesh);
+	UINT numCubes = static_cast<UINT>(gCubeGridMatrices.size());
+
+	// The pool's cube with the per-instance stream after its own streams
+	ID3D11Buffer* buffers[MeshStreams::kMaxStreams + 1];
+	UINT     strides[MeshStreams::kMaxStreams + 1];
+	UINT     offsets[MeshStreams::kMaxStreams + 1] = {};
+	uint32_t recordedBuffers[MeshStreams::kMaxStreams + 1];
+	int numMeshStreams = gNumInstancedStreams - 1;
+	for (int i = 0; i < numMeshStreams; ++i)
+	{
+		buffers[i] = gPoolVertexBuffers[i];
+		recordedBuffers[i] = gRecordedPoolVertexBuffers[i];
+		strides[i] = gInstancedStreams[i].stride;
+	}
+	buffers[numMeshStreams] = gInstanceBuffer;
+	recordedBuffers[numMeshStreams] = gRecordedInstanceBuffer;
+	strides[numMeshStreams] = sizeof(InstanceData);
+
+	gD3DContext->IASetIndexBuffer(gPoolIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	gDrawRecorder.SetIndexBuffer(gRecordedPoolIndexBuffer, sizeof(MeshIndex));
+	gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	gD3DContext->PSSetShader(gSimplePixelShader, nullptr, 0);
 
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (gInstancing)
+	{
+		// Gather the instance data of the cubes that are not hidden, then one write and one draw
+		gVisibleCubeInstances.clear();
+		for (UINT cube = 0; cube < numCubes; ++cube)
+		{
+			if (gCubeGridVisible[cube])  gVisibleCubeInstances.push_back(gCubeGridInstances[cube]);
+		}
+		numCubes = static_cast<UINT>(gVisibleCubeInstances.size());
+		if (numCubes == 0)  return;
+
+		if (FAILED(gD3DContext->Map(gInstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))  return;
+		memcpy(mapped.pData, gVisibleCubeInstances.data(), numCubes * sizeof(InstanceData));
+		gD3DContext->Unmap(gInstanceBuffer, 0);
+		gDrawRecorder.WriteBuffer(gRecordedInstanceBuffer, numCubes * sizeof(InstanceData));
+
+		gD3DContext->IASetVertexBuffers(0, gNumInstancedStreams, buffers, strides, offsets);
+		gDrawRecorder.SetVertexBuffers(0, gNumInstancedStreams, recordedBuffers, strides, offsets);
+		gD3DContext->IASetInputLayout(gInstancedVertexLayout);
+		gDrawRecorder.SetInputLayout(gInstancedStreams, gNumInstancedStreams);
+		gD3DContext->VSSetShader(gInstancedVertexShader, nullptr, 0);
+
+		gD3DContext->DrawIndexedInstanced(range.numIndices, numCubes, range.startIndex, range.baseVertex, 0);
+		gDrawRecorder.DrawIndexedInstanced(range.numIndices, numCubes, range.startIndex, range.baseVertex, 0, range.numVertices);
+	}
+	else
+	{
+		// A constant buffer update and a draw for every cube
+		gD3DContext->IASetVertexBuffers(0, numMeshStreams, buffers, strides, offsets);
+		gDrawRecorder.SetVertexBuffers(0, numMeshStreams, recordedBuffers, strides, offsets);
+		gD3DContext->IASetInputLayout(gSimpleVertexLayout);
+		gDrawRecorder.SetInputLayout(gInstancedStreams, numMeshStreams);
+		gD3DContext->VSSetShader(gSimpleVertexShader, nullptr, 0);
+
+		for (UINT cube = 0; cube < numCubes; ++cube)
+		{
+			if (!gCubeGridVisible[cube])  continue;
+
+			memcpy(gPerModelConstants.worldMatrix, &gCubeGridMatrices[cube].e00, sizeof(gPerModelConstants.worldMatrix));
+			gPerModelConstants.tint = gCubeGridInstances[cube].tint;
+			gD3DContext->Map(gPerModelConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+			memcpy(mapped.pData, &gPerModelConstants, sizeof(gPerModelConstants));
+			gD3DContext->Unmap(gPerModelConstantBuffer, 0);
+			gDrawRecorder.WriteBuffer(gRecordedModelConstants, sizeof(gPerModelConstants));
+
+			gD3DContext->DrawIndexed(range.numIndices, range.startIndex, range.baseVertex);
+			gDrawRecorder.DrawIndexed(range.numIndices, range.startIndex, range.baseVertex, range.numVertices);
+		}
+	}
+}
 
-	// These lines convert the vertex layout described above into an object (gSimpleVertexLayout) used when rendering
-	auto shaderSignature = CreateSignatureForVertexLayout(gSimpleVertexDesc, gSimpleVertexDescCount);
-	hr = gD3DDevice->CreateInputLayout(gSimpleVertexDesc, gSimpleVertexDescCount,
-		shaderSignature->GetBufferPointer(), shaderSignature->GetBufferSize(), &gSimpleVertexLayout);
-	if (shaderSignature)  shaderSignature->Release();
-	if (FAILED(hr))
+// Spin each cube of the grid at its own speed and fill in the instance data
+static void UpdateCubeGrid(float frameTime)
+{
+	static float time = 0.0f;
+	time += frameTime;
+	for (int row = 0; row < kCubeGridSize; ++row)
+	{
+		for (int column = 0; column < kCubeGridSize; ++column)
+		{
+			int cube = row * kCubeGridSize + column;
+			float spin = time * (0.5f + 0.05f * (cube % 23));
+			CVector3 position((column - (kCubeGridSize - 1) * 0.5f) * 0.8f, (row - (kCubeGridSize - 1) * 0.5f) * 0.8f, 20.0f);
+			CMatrix4x4& world = gCubeGridMatrices[cube];
+			world = MatrixScaling(0.25f) * MatrixRotationX(spin) * MatrixRotationY(spin * 0.7f) * MatrixTranslation(position);
+
+			// The instance data holds the rows of the world matrix, which are stored one after another in CMatrix4x4
+			InstanceData& instance = gCubeGridInstances[cube];
+			memcpy(instance.worldRow0, &world.e00, sizeof(float) * 16);
+			instance.tint = ColourRGBA(0.4f + 0.6f * column / (kCubeGridSize - 1), 0.4f + 0.6f * row / (kCubeGridSize - 1), 1.0f, 1.0f);
+
+			// The cube mesh spans -1 to 1 on each axis
+			const OcclusionBox cubeBounds = { CVector3(-1.0f, -1.0f, -1.0f), CVector3(1.0f, 1.0f, 1.0f) };
+			gCubeGridBoxes[cube] = TransformBox(cubeBounds, &world.e00);
+		}
+	}
+}
+
+// Find which grid cubes are hidden behind the spinning cube. Needs the camera, the cube and the grid to be updated first
+static void CullCubeGrid()
+{
+	if (!gOcclusionCulling)
+	{
+		std::fill(gCubeGridVisible.begin(), gCubeGridVisible.end(), uint8_t(1));
+		return;
+	}
+
+	CMatrix4x4 viewProjection = gPerFrameConstants.viewMatrix * gPerFrameConstants.projectionMatrix;
+	gOcclusionBuffer.BeginFrame(&viewProjection.e00);
+	gOcclusionBuffer.AddOccluder(PositionArray(gCubeVertices, gCubeNumVertices), gCubeListIndices.data(),
+	                             gCubeListIndices.size(), &gCubeMatrix.e00);
+	gOcclusionBuffer.EndOccluders();
+
+	gOcclusionStats = OcclusionStats();
+	gOcclusionBuffer.TestBoxes(gCubeGridBoxes.data(), gCubeGridBoxes.size(), gCubeGridVisible.data(), &gOcclusionStats);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Initialise scene geometry, constant buffers and states
+//--------------------------------------------------------------------------------------
+
+// Arrange the cube's vertices in gCubeStreamLayout, place them in the geometry pool and copy the pool to the GPU, then
+// create the input layouts that read the cube's streams. Called again to switch layouts, which starts the pool afresh
+// Returns true on success
+static bool InitCubeStreams()
+{
+	// First arrange the vertex data into the selected stream layout - either one array of SimpleVertex or separate
+	// arrays of positions and colours
+	BuildMeshStreams(gCubeVertices, gCubeNumVertices, gCubeIndices, gCubeNumIndices, gCubeStreamLayout, gCubeMesh);
+
+	// Then place it in the geometry pool. Further meshes with the same streams can be added to the pool and will
+	// share its buffers. The starting size is only a guess, the pool grows if necessary
+	gGeometryPool.Init(gCubeMesh.streams, gCubeMesh.numStreams, 65536, 65536);
+	gCubePoolMesh = gGeometryPool.Add(gCubeMesh);
+	if (gCubePoolMesh == kInvalidPoolMesh)
+	{
+		gLastError = "Error adding mesh to geometry pool";
+		return false;
+	}
+
+	// Copy the pool into GPU memory. When rendering, data needs to be in GPU memory
+	if (!UpdateGeometryPoolBuffers())  return false;
+
+	// These lines convert the vertex layouts described above into objects used when rendering. The depth-only pass
+	// has its own layout that reads only positions
+	if (gSimpleVertexLayout)     gSimpleVertexLayout->Release();
+	if (gDepthOnlyVertexLayout)  gDepthOnlyVertexLayout->Release();
+	if (gInstancedVertexLayout)  gInstancedVertexLayout->Release();
+	VertexStream passStreams[MeshStreams::kMaxStreams];
+	int numPassStreams = gCubeMesh.GetPassStreams(PassInputs::AllAttributes, passStreams);
+	gSimpleVertexLayout = CreateVertexLayout(passStreams, numPassStreams);
+	numPassStreams = gCubeMesh.GetPassStreams(PassInputs::PositionOnly, passStreams);
+	gDepthOnlyVertexLayout = CreateVertexLayout(passStreams, numPassStreams);
+
+	// The cube grid's instance data goes in the slot after the cube's streams and steps once per instance rather than
+	// per vertex
+	int numStreams = gCubeMesh.GetPassStreams(PassInputs::AllAttributes, gInstancedStreams);
+	gInstancedStreams[numStreams] = MakeVertexStream<InstanceData>(kInstanceDataElements, numStreams, true);
+	gNumInstancedStreams = numStreams + 1;
+	gInstancedVertexLayout = CreateVertexLayout(gInstancedStreams, gNumInstancedStreams);
+
+	if (gSimpleVertexLayout == nullptr || gDepthOnlyVertexLayout == nullptr || gInstancedVertexLayout == nullptr)
 	{
 		gLastError = "Error creating input layout";
 		return false;
 	}
+	return true;
+}
+
+
+// Prepare the geometry required for the scene
+// Returns true on success
+bool InitGeometry()
+{
+	//// Create a vertex and index buffer on the GPU ////
+
+	// The cube's vertex and index buffers and the input layouts that read them, in the selected stream layout
+	if (!InitCubeStreams())  return false;
+
+	// For CPU culling, a triangle list version of the cube's indices and a dynamic index buffer that is rewritten
+	// each frame with the triangles that pass
+	TriangleStripToList(gCubeIndices, gCubeNumIndices, gCubeListIndices);
+	gCulledIndices.resize(gCubeListIndices.size());
+	gCubeClipPositions.resize(gCubeNumVertices);
+	MeshAdjacency cubeAdjacency;
+	cubeAdjacency.Build(gCubeListIndices.data(), gCubeListIndices.size(), gCubeNumVertices);
+	cubeAdjacency.GetEdges(gCubeEdgeIndices);
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;             // Rewritten every frame
+	bufferDesc.ByteWidth = static_cast<UINT>(gCubeListIndices.size() * sizeof(MeshIndex));
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &gCulledIndexBuffer)))
+	{
+		gLastError = "Error creating index buffer";
+		return false;
+	}
+
+
+	// The skinned tube has its own buffers
+	if (!InitTube())  return false;
+
+	// So does the morphing patch
+	if (!InitMorphPatch())  return false;
+
+	// The cube grid reuses the pool's cube mesh, adding an instance buffer
+	if (!InitCubeGrid())  return false;
 
 
 	return true;
@@ -238,6 +955,50 @@ bool InitScene()
 	// Immediately enable this"two-sided" state
 	gD3DContext->RSSetState(gTwoSided);
 
+	// The same, drawing only the edges of triangles
+	rasteriserState.FillMode = D3D11_FILL_WIREFRAME;
+	hr = gD3DDevice->CreateRasterizerState(&rasteriserState, &gWireframeState);
+	if (FAILED(hr))
+	{
+		gLastError = "Error creating wireframe state";
+		return false;
+	}
+
+
+	// The default depth test only passes pixels nearer than the depth buffer. After a depth-only pass the colour
+	// pass draws at exactly the depths already written, so it needs a "less or equal" test. No need to write depth again
+	D3D11_DEPTH_STENCIL_DESC depthState = {};
+	depthState.DepthEnable = true;
+	depthState.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	depthState.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+	hr = gD3DDevice->CreateDepthStencilState(&depthState, &gDepthLessEqual);
+	if (FAILED(hr))
+	{
+		gLastError = "Error creating depth state";
+		return false;
+	}
+
+
+	// The software renderer draws into a frame buffer the size of the back buffer. Its pictures are uploaded to a texture
+	// of the same size and format, which can then be copied to the back buffer in one call
+	gSoftwareFrame.Init(gViewportWidth, gViewportHeight);
+	gOcclusionBuffer.Init(gViewportWidth / 4, gViewportHeight / 4); // A quarter of the size each way is plenty to find hidden cubes
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = gViewportWidth;
+	textureDesc.Height = gViewportHeight;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Same as the back buffer
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	hr = gD3DDevice->CreateTexture2D(&textureDesc, nullptr, &gSoftwareFrameTexture);
+	if (FAILED(hr))
+	{
+		gLastError = "Error creating software frame texture";
+		return false;
+	}
+
 
 	return true;
 }
@@ -246,11 +1007,43 @@ bool InitScene()
 // Release the geometry and scene resources created above
 void ReleaseResources()
 {
+	if (gSoftwareFrameTexture)    gSoftwareFrameTexture->Release();
+	if (gCaptureTexture)          gCaptureTexture->Release();
+	for (auto videoTexture : gVideoTextures)
+	{
+		if (videoTexture)         videoTexture->Release();
+	}
+	std::string videoError;
+	gVideoCapture.Close(videoError); // Write any frames still queued
+	for (auto statsQuery : gStatsQueries)
+	{
+		if (statsQuery)           statsQuery->Release();
+	}
+	if (gStatsFile)               fclose(gStatsFile);
+	if (gDepthLessEqual)          gDepthLessEqual->Release();
+	if (gWireframeState)          gWireframeState->Release();
 	if (gTwoSided)                gTwoSided->Release();
 	if (gPerModelConstantBuffer)  gPerModelConstantBuffer->Release();
 	if (gPerFrameConstantBuffer)  gPerFrameConstantBuffer->Release();
-	if (gSimpleIndexBuffer)       gSimpleIndexBuffer->Release();
-	if (gSimpleVertexBuffer)      gSimpleVertexBuffer->Release();
+	if (gInstancedVertexLayout)   gInstancedVertexLayout->Release();
+	if (gInstanceBuffer)          gInstanceBuffer->Release();
+	if (gMorphVertexLayout)       gMorphVertexLayout->Release();
+	if (gMorphIndexBuffer)        gMorphIndexBuffer->Release();
+	for (auto& vertexBuffer : gMorphVertexBuffers)
+	{
+		if (vertexBuffer)  vertexBuffer->Release();
+	}
+	if (gTubeVertexLayout)        gTubeVertexLayout->Release();
+	if (gTubeIndexBuffer)         gTubeIndexBuffer->Release();
+	if (gTubeColourBuffer)        gTubeColourBuffer->Release();
+	if (gTubePositionBuffer)      gTubePositionBuffer->Release();
+	if (gCulledIndexBuffer)       gCulledIndexBuffer->Release();
+	if (gPoolIndexBuffer)         gPoolIndexBuffer->Release();
+	for (auto vertexBuffer : gPoolVertexBuffers)
+	{
+		if (vertexBuffer)         vertexBuffer->Release();
+	}
+	if (gDepthOnlyVertexLayout)   gDepthOnlyVertexLayout->Release();
 	if (gSimpleVertexLayout)      gSimpleVertexLayout->Release();
 }
 
@@ -259,9 +1052,301 @@ void ReleaseResources()
 // Scene Rendering
 //--------------------------------------------------------------------------------------
 
+// Draw the scene with the software renderer and copy the picture to the back buffer. The renderer is given the same
+// data as the GPU: the CPU-side copies of the vertex and index buffers and the same matrices
+static void RenderSceneSoftware(const float clearColour[4])
+{
+	gSoftwareRenderer.ResetPipelineStats();
+	gSoftwareFrame.ClearColour(clearColour);
+	gSoftwareFrame.ClearDepth(1.0f);
+	gSoftwareRenderer.SetRenderTarget(&gSoftwareFrame);
+	gSoftwareRenderer.SetCullFace(CullFace::None); // As gTwoSided
+	gSoftwareRenderer.SetDepthState(RasterDepthTest::Less, true);
+	gSoftwareRenderer.SetFrameConstants(&gPerFrameConstants.viewMatrix.e00, &gPerFrameConstants.projectionMatrix.e00);
+
+	// The cube and the cube grid come from the geometry pool, a triangle strip
+	VertexStream passStreams[MeshStreams::kMaxStreams];
+	const void*  streamData[MeshStreams::kMaxStreams];
+	uint32_t     strides[MeshStreams::kMaxStreams];
+	int numStreams = gCubeMesh.GetPassStreams(PassInputs::AllAttributes, passStreams);
+	for (int i = 0; i < numStreams; ++i)
+	{
+		streamData[i] = gGeometryPool.StreamData(i);
+		strides[i] = passStreams[i].stride;
+	}
+	gSoftwareRenderer.SetInputLayout(passStreams, numStreams);
+	gSoftwareRenderer.SetVertexBuffers(0, numStreams, streamData, strides);
+	const PoolMeshRange& cubeRange = gGeometryPool.GetRange(gCubePoolMesh);
+	uint32_t cubeNumIndices = cubeRange.numIndices;
+	uint32_t cubeStartIndex = cubeRange.startIndex;
+	if (gWireframe)
+	{
+		gSoftwareRenderer.SetIndexBuffer(gCubeEdgeIndices.data());
+		gSoftwareRenderer.SetTopology(RasterTopology::LineList);
+		cubeNumIndices = static_cast<uint32_t>(gCubeEdgeIndices.size());
+		cubeStartIndex = 0;
+	}
+	else
+	{
+		gSoftwareRenderer.SetIndexBuffer(gGeometryPool.IndexData());
+		gSoftwareRenderer.SetTopology(RasterTopology::TriangleStrip);
+	}
+
+	const ColourRGBA white(1.0f, 1.0f, 1.0f, 1.0f);
+	gSoftwareRenderer.SetModelConstants(&gCubeMatrix.e00, &white.r);
+	gSoftwareRenderer.DrawIndexed(cubeNumIndices, cubeStartIndex, cubeRange.baseVertex);
+	for (size_t cube = 0; cube < gCubeGridMatrices.size(); ++cube)
+	{
+		if (!gCubeGridVisible[cube])  continue;
+
+		gSoftwareRenderer.SetModelConstants(&gCubeGridMatrices[cube].e00, &gCubeGridInstances[cube].tint.r);
+		gSoftwareRenderer.DrawIndexed(cubeNumIndices, cubeStartIndex, cubeRange.baseVertex);
+	}
+
+	// The morph patch is drawn straight from the blender's vertices, a triangle list
+	VertexStream morphStream = MakeVertexStream<SimpleVertex>(kSimpleVertexElements, 0);
+	const void*  morphData = gMorphBlender.Vertices();
+	uint32_t     morphStride = sizeof(SimpleVertex);
+	gSoftwareRenderer.SetInputLayout(&morphStream, 1);
+	gSoftwareRenderer.SetVertexBuffers(0, 1, &morphData, &morphStride);
+	const std::vector<MeshIndex>& morphIndices = gWireframe ? gMorphEdgeIndices : gMorphIndices;
+	gSoftwareRenderer.SetIndexBuffer(morphIndices.data());
+	gSoftwareRenderer.SetTopology(gWireframe ? RasterTopology::LineList : RasterTopology::TriangleList);
+	gSoftwareRenderer.SetModelConstants(&gMorphMatrix.e00, &white.r);
+	gSoftwareRenderer.DrawIndexed(static_cast<uint32_t>(morphIndices.size()), 0, 0);
+
+	// The draws above only queued their triangles, rasterize them all (in parallel, tile by tile)
+	gSoftwareRenderer.Flush();
+
+	// Upload the picture and copy it to the back buffer
+	gD3DContext->UpdateSubresource(gSoftwareFrameTexture, 0, nullptr, gSoftwareFrame.Colour(),
+	                               gSoftwareFrame.Width() * sizeof(uint32_t), 0);
+	ID3D11Texture2D* backBuffer;
+	if (SUCCEEDED(gSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&backBuffer)))
+	{
+		gD3DContext->CopyResource(backBuffer, gSoftwareFrameTexture);
+		backBuffer->Release();
+	}
+}
+
+
+// Save the picture just drawn as CaptureN.ppm, and the depth buffer as CaptureN_depth.pfm when software rendering.
+// Must be called before Present
+static void CaptureFrame()
+{
+	++gNumCaptures;
+	std::string name = "Capture" + std::to_string(gNumCaptures);
+	std::string error;
+	bool saved = false;
+	if (gSoftwareRendering)
+	{
+		saved = SaveColourImage(name + ".ppm", gSoftwareFrame.Colour(), gViewportWidth, gViewportHeight, error) &&
+		        SaveDepthImage(name + "_depth.pfm", gSoftwareFrame.Depth(), gViewportWidth, gViewportHeight, error);
+	}
+	else
+	{
+		if (gCaptureTexture == nullptr)
+		{
+			D3D11_TEXTURE2D_DESC textureDesc = {};
+			textureDesc.Width = gViewportWidth;
+			textureDesc.Height = gViewportHeight;
+			textureDesc.MipLevels = 1;
+			textureDesc.ArraySize = 1;
+			textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Same as the back buffer
+			textureDesc.SampleDesc.Count = 1;
+			textureDesc.Usage = D3D11_USAGE_STAGING;
+			textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+			if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, nullptr, &gCaptureTexture)))  gCaptureTexture = nullptr;
+		}
+		ID3D11Texture2D* backBuffer;
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (gCaptureTexture != nullptr &&
+		    SUCCEEDED(gSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&backBuffer)))
+		{
+			gD3DContext->CopyResource(gCaptureTexture, backBuffer);
+			backBuffer->Release();
+			if (SUCCEEDED(gD3DContext->Map(gCaptureTexture, 0, D3D11_MAP_READ, 0, &mapped)))
+			{
+				// Rows of the mapped texture may be padded
+				gCaptureColours.resize(gViewportWidth * gViewportHeight);
+				for (int y = 0; y < gViewportHeight; ++y)
+				{
+					memcpy(&gCaptureColours[y * gViewportWidth], static_cast<uint8_t*>(mapped.pData) + y * mapped.RowPitch,
+					       gViewportWidth * sizeof(uint32_t));
+				}
+				gD3DContext->Unmap(gCaptureTexture, 0);
+				saved = SaveColourImage(name + ".ppm", gCaptureColours.data(), gViewportWidth, gViewportHeight, error);
+			}
+		}
+		if (!saved && error.empty())  error = "Error reading the back buffer";
+	}
+	gCaptureMessage = saved ? "saved " + name : error;
+}
+
+
+// Start or stop recording VideoN.y4m
+static void ToggleVideo()
+{
+	std::string error;
+	if (gVideoCapture.IsOpen())
+	{
+		bool written = gVideoCapture.Close(error);
+		VideoCaptureStats stats = gVideoCapture.Stats();
+		gVideoMessage = written ? "saved Video" + std::to_string(gNumVideos) + ".y4m, " + std::to_string(stats.numWritten) +
+		                          " frames, " + std::to_string(stats.numDropped) + " dropped" : error;
+		return;
+	}
+
+	++gNumVideos;
+	std::string name = "Video" + std::to_string(gNumVideos) + ".y4m";
+	gVideoMessage = gVideoCapture.Open(name, gViewportWidth, gViewportHeight, 60, VideoFormat::Y4m, 4, CaptureOverflow::Drop, error) ?
+	                "recording " + name : error;
+	gNumVideoTexturesCopied = 0;
+}
+
+
+// Queue the picture just drawn for the video being recorded. Must be called before Present
+static void CaptureVideoFrame()
+{
+	if (gSoftwareRendering)
+	{
+		gVideoCapture.AddFrame(gSoftwareFrame.Colour());
+		gNumVideoTexturesCopied = 0; // The staging textures no longer hold the latest frames
+		return;
+	}
+
+	if (gVideoTextures[0] == nullptr)
+	{
+		D3D11_TEXTURE2D_DESC textureDesc = {};
+		textureDesc.Width = gViewportWidth;
+		textureDesc.Height = gViewportHeight;
+		textureDesc.MipLevels = 1;
+		textureDesc.ArraySize = 1;
+		textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Same as the back buffer
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.Usage = D3D11_USAGE_STAGING;
+		textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		for (auto& videoTexture : gVideoTextures)
+		{
+			if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, nullptr, &videoTexture)))  videoTexture = nullptr;
+		}
+		if (gVideoTextures[0] == nullptr || gVideoTextures[1] == nullptr)
+		{
+			std::string error;
+			gVideoCapture.Close(error);
+			gVideoMessage = "Error creating textures to read the back buffer";
+			return;
+		}
+	}
+
+	ID3D11Texture2D* backBuffer;
+	if (FAILED(gSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&backBuffer)))  return;
+	gD3DContext->CopyResource(gVideoTextures[gVideoTextureIndex], backBuffer);
+	backBuffer->Release();
+	gVideoTextureIndex = 1 - gVideoTextureIndex;
+	++gNumVideoTexturesCopied;
+
+	// Read the frame before, in the texture to be copied to next. The video starts a frame late
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (gNumVideoTexturesCopied >= 2 &&
+	    SUCCEEDED(gD3DContext->Map(gVideoTextures[gVideoTextureIndex], 0, D3D11_MAP_READ, 0, &mapped)))
+	{
+		gVideoCapture.AddFrame(static_cast<const uint32_t*>(mapped.pData), mapped.RowPitch / sizeof(uint32_t));
+		gD3DContext->Unmap(gVideoTextures[gVideoTextureIndex], 0);
+	}
+}
+
+
+// Keep a frame's counts for the window title, and write them to the stats file if one is open
+static void RecordFrameStats(uint64_t frame, const char* renderer, const RasterPipelineStats& stats)
+{
+	gFrameStats = stats;
+	if (gStatsFile != nullptr)
+	{
+		fputs(PipelineStatsCsvRow(frame, renderer, stats, gViewportWidth * gViewportHeight).c_str(), gStatsFile);
+	}
+}
+
+
+// Start or stop writing the counts of each frame to PipelineStatsN.csv
+static void ToggleStatsFile()
+{
+	std::string name = "PipelineStats" + std::to_string(gNumStatsFiles) + ".csv";
+	if (gStatsFile != nullptr)
+	{
+		bool written = fclose(gStatsFile) == 0;
+		gStatsFile = nullptr;
+		gStatsMessage = written ? "saved " + name : "Error writing " + name;
+		return;
+	}
+
+	++gNumStatsFiles;
+	name = "PipelineStats" + std::to_string(gNumStatsFiles) + ".csv";
+	gStatsFile = fopen(name.c_str(), "w");
+	if (gStatsFile == nullptr)
+	{
+		gStatsMessage = "Cannot open " + name;
+		return;
+	}
+	fputs(PipelineStatsCsvHeader().c_str(), gStatsFile);
+	gStatsMessage = "writing " + name;
+}
+
+
+// Start counting the GPU's work for this frame. Returns the query used, or -1 if every query is still waiting for the
+// GPU and this frame is not counted
+static int BeginGpuStats()
+{
+	if (gStatsQueries[0] == nullptr)
+	{
+		D3D11_QUERY_DESC queryDesc = {};
+		queryDesc.Query = D3D11_QUERY_PIPELINE_STATISTICS;
+		for (auto& statsQuery : gStatsQueries)
+		{
+			if (FAILED(gD3DDevice->CreateQuery(&queryDesc, &statsQuery)))  statsQuery = nullptr;
+		}
+	}
+	if (gNumStatsQueries == kNumStatsQueries)  return -1;
+
+	int query = (gFirstStatsQuery + gNumStatsQueries) % kNumStatsQueries;
+	if (gStatsQueries[query] == nullptr)  return -1;
+	gD3DContext->Begin(gStatsQueries[query]);
+	gStatsQueryFrames[query] = gFrameNumber;
+	return query;
+}
+
+// Finish counting this frame, then record the counts of any earlier frames the GPU has finished
+static void EndGpuStats(int query)
+{
+	if (query >= 0)
+	{
+		gD3DContext->End(gStatsQueries[query]);
+		++gNumStatsQueries;
+	}
+
+	D3D11_QUERY_DATA_PIPELINE_STATISTICS gpuStats;
+	while (gNumStatsQueries > 0 &&
+	       gD3DContext->GetData(gStatsQueries[gFirstStatsQuery], &gpuStats, sizeof(gpuStats), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+	{
+		// The pixel shader runs for pixels that pass the depth test, as it does not change depth
+		RasterPipelineStats stats;
+		stats.numIndices        = gpuStats.IAVertices;
+		stats.numShadedVertices = gpuStats.VSInvocations;
+		stats.numPrimitives     = gpuStats.IAPrimitives;
+		stats.numSetUp          = gpuStats.CPrimitives;
+		stats.numPixelsWritten  = gpuStats.PSInvocations;
+		RecordFrameStats(gStatsQueryFrames[gFirstStatsQuery], "gpu", stats);
+		gFirstStatsQuery = (gFirstStatsQuery + 1) % kNumStatsQueries;
+		--gNumStatsQueries;
+	}
+}
+
+
 // Called once a frame, from the loop in Main.cpp
 void RenderScene()
 {
+	++gFrameNumber;
+
 	//// Per-frame set-up ////
 
 	// Set the "back buffer" as the target for rendering. The "back buffer" is an off-screen viewport. When
@@ -282,6 +1367,7 @@ void RenderScene()
 	vp.TopLeftX = 0;
 	vp.TopLeftY = 0;
 	gD3DContext->RSSetViewports(1, &vp);
+	gD3DContext->RSSetState(gWireframe ? gWireframeState : gTwoSided);
 
 
 	// Send per-frame data (camera matrices here) over to the shaders on the GPU
@@ -301,40 +1387,77 @@ void RenderScene()
 
 
 
-	//// Prepare for cube rendering ////
+	//// Software rendering ////
 
-	// Select the vertex buffer created with our geometry in it - D3D will now use that data for rendering
-	// Only needs to be done once unless we want to use a different buffer
-	UINT stride = sizeof(SimpleVertex); // Size of a single vertex in the buffer
-	UINT offset = 0;
-	gD3DContext->IASetVertexBuffers(0, 1, &gSimpleVertexBuffer, &stride, &offset);
+	// The CPU draws the whole picture, the GPU only displays it
+	if (gSoftwareRendering)
+	{
+		gVertexFetchCounter.BeginFrame();
+		RenderSceneSoftware(ClearColor);
+		RecordFrameStats(gFrameNumber, "software", gSoftwareRenderer.PipelineStats());
+		if (gCaptureFrame)  CaptureFrame();
+		gCaptureFrame = false;
+		if (gVideoCapture.IsOpen())  CaptureVideoFrame();
+		gSwapChain->Present(0, 0);
+		return;
+	}
 
-	//****NEW
-	// Select the index buffer created above to go along with the vertex buffer - indicate it uses 32-bit integers
-	gD3DContext->IASetIndexBuffer(gSimpleIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
-	//****
 
-		// Indicate the layout of our vertex buffer. Only needs to be done once unless we want to use a different buffer
-	gD3DContext->IASetInputLayout(gSimpleVertexLayout);
+	//// Prepare for cube rendering ////
 
-	// Also indicate the primitive topology of the buffer. Our buffer holds a triangle list - each set of 3 vertices
-	// will be connected into a triangle. Again, there is no need to do this more than once if you are not changing topology
-	gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	gVertexFetchCounter.BeginFrame();
+	int statsQuery = BeginGpuStats();
 
-	// Select which shaders to use when rendering. Only need to do once if you are not changing shader
-	gD3DContext->VSSetShader(gSimpleVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gSimplePixelShader, nullptr, 0);
+	// Copy any meshes added to or moved in the geometry pool since the last frame over to the GPU. Does nothing if
+	// the pool has not changed
+	UpdateGeometryPoolBuffers();
 
+	const PoolMeshRange& cubeRange = gGeometryPool.GetRange(gCubePoolMesh); // Where the cube is in the pool buffers
+	uint32_t cubeNumIndices = cubeRange.numIndices;
+	uint32_t cubeStartIndex = cubeRange.startIndex;
 
+	if (gCpuCulling)
+	{
+		// Transform the cube's positions with the same matrices the vertex shader will use, remove the triangles that
+		// face away, have no area, are off screen or miss every pixel centre, then copy the rest to the GPU
+		CMatrix4x4 worldViewProjection = gCubeMatrix * gPerFrameConstants.viewMatrix * gPerFrameConstants.projectionMatrix;
+		TransformToClipSpace(PositionArray(gCubeVertices, gCubeNumVertices), &worldViewProjection.e00, gCubeClipPositions.data());
+
+		TriangleCullOptions cullOptions;
+		cullOptions.viewportWidth  = static_cast<float>(gViewportWidth);
+		cullOptions.viewportHeight = static_cast<float>(gViewportHeight);
+		size_t numCulledIndices = CullTriangles(gCubeClipPositions.data(), gCubeListIndices.data(), gCubeListIndices.size(),
+		                                        cullOptions, gCulledIndices.data(), &gCullStats);
+
+		gD3DContext->Map(gCulledIndexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &cb);
+		memcpy(cb.pData, gCulledIndices.data(), numCulledIndices * sizeof(MeshIndex));
+		gD3DContext->Unmap(gCulledIndexBuffer, 0);
+
+		// The culled indices are a triangle list starting at the beginning of their own buffer. They still refer to
+		// the cube's vertices in the pool, so the cube's base vertex is used as normal
+		gD3DContext->IASetIndexBuffer(gCulledIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+		gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		cubeNumIndices = static_cast<uint32_t>(numCulledIndices);
+		cubeStartIndex = 0;
+	}
+	else
+	{
+		// Select the pool's index buffer - indicate it uses 32-bit integers. The same index buffer is used by both passes
+		// below and by every mesh in the pool
+		gD3DContext->IASetIndexBuffer(gPoolIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
 
-	//// Render cube ////
+		// Also indicate the primitive topology of the buffer. Our buffer holds a triangle strip - each new index makes a
+		// triangle with the two before it. Again, there is no need to do this more than once if you are not changing topology
+		gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	}
 
 	// Send the world matrix for the cube over to the shaders on the GPU
 	// See the section commented as "Constant Buffers" near the top of the file for more info about the data being sent here
 	// - "Map" basically opens the GPU's constant buffer for writing
 	// - "memcpy" copies the C++ data over to the GPU's constant buffer
 	// - "Unmap" closes the GPU's buffer again - we must do this as soon as possible
-	gPerModelConstants.worldMatrix = gCubeMatrix;
+	memcpy(gPerModelConstants.worldMatrix, &gCubeMatrix.e00, sizeof(gPerModelConstants.worldMatrix));
+	gPerModelConstants.tint = ColourRGBA(1.0f, 1.0f, 1.0f, 1.0f);
 	gD3DContext->Map(gPerModelConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &cb);
 	memcpy(cb.pData, &gPerModelConstants, sizeof(gPerModelConstants));
 	gD3DContext->Unmap(gPerModelConstantBuffer, 0);
@@ -344,17 +1467,79 @@ void RenderScene()
 	// The first parameter must match constant buffer number in the shader, so this is constant buffer 0 on the vertex shader
 	gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
 
+	// Vertex buffers, strides and offsets for each pass come from the mesh's stream descriptions
+	VertexStream passStreams[MeshStreams::kMaxStreams];
+	UINT strides[MeshStreams::kMaxStreams];
+	UINT offsets[MeshStreams::kMaxStreams] = {};
+
+
+	//// Depth-only pass ////
+
+	// Fill the depth buffer without running a pixel shader. Only positions are read - with split streams that is just
+	// the position buffer. With interleaved vertices the GPU still fetches whole vertices, colours included
+	if (gDepthPrePass)
+	{
+		int numStreams = gCubeMesh.GetPassStreams(PassInputs::PositionOnly, passStreams);
+		for (int i = 0; i < numStreams; ++i)  strides[i] = passStreams[i].stride;
+		gD3DContext->IASetVertexBuffers(0, numStreams, gPoolVertexBuffers, strides, offsets);
+		gD3DContext->IASetInputLayout(gDepthOnlyVertexLayout);
+		gD3DContext->VSSetShader(gDepthOnlyVertexShader, nullptr, 0);
+		gD3DContext->PSSetShader(nullptr, nullptr, 0);
+
+		gD3DContext->DrawIndexed(cubeNumIndices, cubeStartIndex, cubeRange.baseVertex);
+		gVertexFetchCounter.RecordDraw("Depth-only", gCubeMesh, PassInputs::PositionOnly);
+
+		// The colour pass draws at exactly the depths written above
+		gD3DContext->OMSetDepthStencilState(gDepthLessEqual, 0);
+	}
+
+
+	//// Colour pass ////
+
+	// Bind every stream and select the layout that reads all of them. Only needs to be done once unless we want to use
+	// a different buffer
+	int numStreams = gCubeMesh.GetPassStreams(PassInputs::AllAttributes, passStreams);
+	for (int i = 0; i < numStreams; ++i)  strides[i] = passStreams[i].stride;
+	gD3DContext->IASetVertexBuffers(0, numStreams, gPoolVertexBuffers, strides, offsets);
+	gD3DContext->IASetInputLayout(gSimpleVertexLayout);
+
+	// Select which shaders to use when rendering. Only need to do once if you are not changing shader
+	gD3DContext->VSSetShader(gSimpleVertexShader, nullptr, 0);
+	gD3DContext->PSSetShader(gSimplePixelShader, nullptr, 0);
+
+	// Draw the geometry using the index buffer. The cube's indices start at startIndex in the pool's index buffer (or at
+	// the start of the culled index buffer), and baseVertex is added to each index to find the cube's vertices in the
+	// pool's vertex buffers
+	gD3DContext->DrawIndexed(cubeNumIndices, cubeStartIndex, cubeRange.baseVertex);
+	gVertexFetchCounter.RecordDraw("Colour", gCubeMesh, PassInputs::AllAttributes);
+
+	// Return to the default depth state for anything rendered after this
+	gD3DContext->OMSetDepthStencilState(nullptr, 0);
 
-	//****NEW
-	// Draw the geometry - but this week using an index buffer
-	gD3DContext->DrawIndexed(36, 0, 0); // Draw the first 6 indexed vertices (2 triangles in a triangle list), 
-									   // starting at the beginning of the index list (second parameter 0) and with
-									   // no offset (third parameter 0 - an advanced topic)
-	//****
+
+	//// Skinned tube ////
+
+	// Not in the depth-only pass so drawn with the default depth state, which writes depth
+	RenderTube();
+
+
+	//// Morphing patch ////
+
+	RenderMorphPatch();
+
+
+	//// Cube grid ////
+
+	RenderCubeGrid();
 
 
 	//// Scene completion ////
 
+	if (gCaptureFrame)  CaptureFrame();
+	gCaptureFrame = false;
+	if (gVideoCapture.IsOpen())  CaptureVideoFrame();
+	EndGpuStats(statsQuery);
+
 	// When drawing to the off-screen back buffer is complete, we "present" the image to the front buffer (the screen)
 	gSwapChain->Present(0, 0);
 }
@@ -399,6 +1584,81 @@ void UpdateScene(float frameTime)
 	}
 	gCubeMatrix = MatrixRotationX(rotationX) * MatrixRotationY(rotationY);
 
+	//// Update the skinned tube ////
+
+	UpdateTube(frameTime);
+
+	//// Update the morphing patch ////
+
+	UpdateMorphPatch(frameTime);
+
+	//// Update the cube grid ////
+
+	UpdateCubeGrid(frameTime);
+	CullCubeGrid();
+
+	// Toggle the depth-only pass to compare the vertex data read with and without it
+	if (KeyHit(Key_P))
+	{
+		gDepthPrePass = !gDepthPrePass;
+	}
+
+	// Toggle CPU triangle culling
+	if (KeyHit(Key_C))
+	{
+		gCpuCulling = !gCpuCulling;
+	}
+
+	// Toggle between drawing the cube grid as instances or one cube at a time
+	if (KeyHit(Key_I))
+	{
+		gInstancing = !gInstancing;
+	}
+
+	// Switch the cube between interleaved and split vertex streams, to compare the bytes each pass reads
+	if (KeyHit(Key_T))
+	{
+		gCubeStreamLayout = gCubeStreamLayout == VertexStreamLayout::Split ? VertexStreamLayout::Interleaved
+		                                                                   : VertexStreamLayout::Split;
+		InitCubeStreams();
+	}
+
+	// Toggle occlusion culling of the cube grid
+	if (KeyHit(Key_O))
+	{
+		gOcclusionCulling = !gOcclusionCulling;
+	}
+
+	// Save the next frame to a file
+	if (KeyHit(Key_F))
+	{
+		gCaptureFrame = true;
+	}
+
+	// Start or stop recording a video
+	if (KeyHit(Key_V))
+	{
+		ToggleVideo();
+	}
+
+	// Start or stop writing the counts of each pipeline stage to a file
+	if (KeyHit(Key_K))
+	{
+		ToggleStatsFile();
+	}
+
+	// Toggle between drawing on the GPU and drawing with the software renderer
+	if (KeyHit(Key_R))
+	{
+		gSoftwareRendering = !gSoftwareRendering;
+	}
+
+	// Toggle drawing triangle edges only
+	if (KeyHit(Key_L))
+	{
+		gWireframe = !gWireframe;
+	}
+
 
 	// Show frame time / FPS in the window title //
 
@@ -414,8 +1674,48 @@ void UpdateScene(float frameTime)
 		std::ostringstream frameTimeMs;
 		frameTimeMs.precision(2);
 		frameTimeMs << std::fixed << avgFrameTime * 1000;
+		// The fetch report has a line per pass, joined up to fit in the title
+		std::string fetchReport = gVertexFetchCounter.Report();
+		if (!fetchReport.empty() && fetchReport.back() == '\n')  fetchReport.pop_back();
+		for (size_t newLine = fetchReport.find('\n'); newLine != std::string::npos; newLine = fetchReport.find('\n', newLine))
+		{
+			fetchReport.replace(newLine, 1, "; ");
+		}
 		std::string windowTitle = "CO2409 Week 9: Index Buffers - Frame Time: " + frameTimeMs.str() +
-			"ms, FPS: " + std::to_string(static_cast<int>(1 / avgFrameTime + 0.5f));
+			"ms, FPS: " + std::to_string(static_cast<int>(1 / avgFrameTime + 0.5f)) +
+			", Vertex/index reads per frame " +
+			(gCubeStreamLayout == VertexStreamLayout::Split ? "(split streams): " : "(interleaved): ") + fetchReport;
+		if (gCpuCulling)
+		{
+			windowTitle += ", CPU culling: " + std::to_string(gCullStats.numVisible) + " of " +
+			               std::to_string(gCullStats.numTriangles) + " triangles drawn";
+		}
+		const DrawCallCounts& gridCalls = gDrawRecorder.Counts();
+		windowTitle += ", Cube grid: " + std::to_string(gridCalls.numDraws) + " draws, " +
+		               std::to_string(gridCalls.numBufferWrites) + " buffer writes" + (gInstancing ? " (instanced)" : "");
+		if (gOcclusionCulling)
+		{
+			windowTitle += ", Occlusion culling: " + std::to_string(gOcclusionStats.numVisible) + " of " +
+			               std::to_string(gOcclusionStats.numTested) + " cubes drawn";
+		}
+		if (!gDrawRecorder.Errors().empty())  windowTitle += ", " + gDrawRecorder.Errors().front();
+		if (gSoftwareRendering)  windowTitle += " (software rendering)";
+		if (gWireframe)  windowTitle += " (wireframe)";
+		if (!gCaptureMessage.empty())  windowTitle += ", Capture: " + gCaptureMessage;
+		if (gVideoCapture.IsOpen())
+		{
+			VideoCaptureStats videoStats = gVideoCapture.Stats();
+			windowTitle += ", Video: " + gVideoMessage + ", " + std::to_string(videoStats.numWritten) + " frames written, " +
+			               std::to_string(videoStats.numDropped) + " dropped";
+		}
+		else if (!gVideoMessage.empty())  windowTitle += ", Video: " + gVideoMessage;
+		if (gStatsFile != nullptr)
+		{
+			windowTitle += ", Pipeline stats: " + gStatsMessage + ", " + std::to_string(gFrameStats.numPrimitives) +
+			               " primitives, " + std::to_string(gFrameStats.numSetUp) + " set up, " +
+			               std::to_string(gFrameStats.numPixelsWritten) + " pixels written";
+		}
+		else if (!gStatsMessage.empty())  windowTitle += ", Pipeline stats: " + gStatsMessage;
 		SetWindowTextA(gHWnd, windowTitle.c_str());
 		totalFrameTime = 0;
 		frameCount = 0;
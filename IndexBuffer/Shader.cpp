@@ -92,6 +92,9 @@ ID3DBlob* CreateSignatureForVertexLayout(const D3D11_INPUT_ELEMENT_DESC vertexLa
         else if (format == DXGI_FORMAT_R32G32B32_FLOAT)    shaderSource += "float3";
         else if (format == DXGI_FORMAT_R32G32_FLOAT)       shaderSource += "float2";
         else if (format == DXGI_FORMAT_R32_FLOAT)          shaderSource += "float";
+        else if (format == DXGI_FORMAT_R8G8B8A8_UNORM)     shaderSource += "float4";
+        else if (format == DXGI_FORMAT_R8G8B8A8_UINT)      shaderSource += "uint4";
+        else if (format == DXGI_FORMAT_R32_UINT)           shaderSource += "uint";
         else return nullptr; // Unsupported type in layout
 
         uint8_t index = static_cast<uint8_t>(vertexLayout[elt].SemanticIndex);
@@ -118,6 +121,72 @@ ID3DBlob* CreateSignatureForVertexLayout(const D3D11_INPUT_ELEMENT_DESC vertexLa
 }
 
 
+// Convert a vertex element format (see VertexLayout.h) to the matching DirectX format
+static DXGI_FORMAT ToDXGIFormat(VertexElementFormat format)
+{
+    switch (format)
+    {
+    case VertexElementFormat::Float1:     return DXGI_FORMAT_R32_FLOAT;
+    case VertexElementFormat::Float2:     return DXGI_FORMAT_R32G32_FLOAT;
+    case VertexElementFormat::Float3:     return DXGI_FORMAT_R32G32B32_FLOAT;
+    case VertexElementFormat::Float4:     return DXGI_FORMAT_R32G32B32A32_FLOAT;
+    case VertexElementFormat::UByte4:     return DXGI_FORMAT_R8G8B8A8_UINT;
+    case VertexElementFormat::UByte4Norm: return DXGI_FORMAT_R8G8B8A8_UNORM;
+    case VertexElementFormat::UInt1:      return DXGI_FORMAT_R32_UINT;
+    }
+    return DXGI_FORMAT_UNKNOWN;
+}
+
+// Fill a D3D11_INPUT_ELEMENT_DESC array from vertex structure descriptions (see VertexLayout.h). This replaces
+// typing in the array by hand - the formats and byte offsets come from the vertex structures themselves
+void MakeInputElementDescs(const VertexStream* streams, int numStreams, std::vector<D3D11_INPUT_ELEMENT_DESC>& descs)
+{
+    descs.clear();
+    for (int s = 0; s < numStreams; ++s)
+    {
+        for (uint32_t e = 0; e < streams[s].numElements; ++e)
+        {
+            const VertexElement& element = streams[s].elements[e];
+            D3D11_INPUT_ELEMENT_DESC desc;
+            desc.SemanticName         = element.semanticName;
+            desc.SemanticIndex        = element.semanticIndex;
+            desc.Format               = ToDXGIFormat(element.format);
+            desc.InputSlot            = streams[s].slot;
+            desc.AlignedByteOffset    = element.offset;
+            desc.InputSlotClass       = streams[s].perInstance ? D3D11_INPUT_PER_INSTANCE_DATA : D3D11_INPUT_PER_VERTEX_DATA;
+            desc.InstanceDataStepRate = streams[s].perInstance ? 1 : 0;
+            descs.push_back(desc);
+        }
+    }
+}
+
+// Create a DirectX vertex layout object for the given vertex structure descriptions
+// The returned pointer needs to be released before quitting. Returns nullptr on failure
+ID3D11InputLayout* CreateVertexLayout(const VertexStream* streams, int numStreams)
+{
+    std::vector<D3D11_INPUT_ELEMENT_DESC> descs;
+    MakeInputElementDescs(streams, numStreams, descs);
+    int numElements = static_cast<int>(descs.size());
+
+    auto shaderSignature = CreateSignatureForVertexLayout(descs.data(), numElements);
+    if (shaderSignature == nullptr)
+    {
+        return nullptr;
+    }
+
+    ID3D11InputLayout* layout;
+    HRESULT hr = gD3DDevice->CreateInputLayout(descs.data(), numElements, shaderSignature->GetBufferPointer(),
+                                               shaderSignature->GetBufferSize(), &layout);
+    shaderSignature->Release();
+    if (FAILED(hr))
+    {
+        return nullptr;
+    }
+
+    return layout;
+}
+
+
 // Constant Buffers are a way of passing data from C++ to the GPU. They are called constants but that only means
 // they are constant for the duration of a single GPU draw call. The "constants" correspond to variables in C++
 // that we will change per-model, or per-frame etc.
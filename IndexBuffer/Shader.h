@@ -5,6 +5,7 @@
 #ifndef _SHADER_H_INCLUDED_
 #define _SHADER_H_INCLUDED_
 
+#include "VertexLayout.h"
 #include <d3d11.h>
 #include <string>
 #include <vector>
@@ -22,5 +23,14 @@ ID3D11PixelShader*  LoadPixelShader (std::string shaderName);
 // Helper function. Returns nullptr on failure.
 ID3DBlob* CreateSignatureForVertexLayout(const D3D11_INPUT_ELEMENT_DESC vertexLayout[], int numElements);
 
+// Fill a D3D11_INPUT_ELEMENT_DESC array from vertex structure descriptions (see VertexLayout.h). The semantic
+// name pointers in the array point into the element lists, which are usually constants
+void MakeInputElementDescs(const VertexStream* streams, int numStreams, std::vector<D3D11_INPUT_ELEMENT_DESC>& descs);
+
+// Create a DirectX vertex layout object for the given vertex structure descriptions. Most geometry has a single
+// stream made with MakeVertexStream, e.g. MakeVertexStream<SimpleVertex>(kSimpleVertexElements)
+// The returned pointer needs to be released before quitting. Returns nullptr on failure
+ID3D11InputLayout* CreateVertexLayout(const VertexStream* streams, int numStreams);
+
 
 #endif //_SHADER_H_INCLUDED_
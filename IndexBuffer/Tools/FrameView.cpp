@@ -0,0 +1,194 @@
+//--------------------------------------------------------------------------------------
+// Command line frame viewer - reads the frames a renderer publishes to shared memory
+//--------------------------------------------------------------------------------------
+// A command line program, not part of the Visual Studio project (it has its own main).
+// To build on Linux from this folder (add -lrt on older systems):
+//   g++ -std=c++14 -O2 -pthread -I../Raster FrameView.cpp ../Raster/SharedFrameRing.cpp
+//       ../Raster/ImageFile.cpp ../Raster/VideoCapture.cpp -o FrameView
+//
+// Usage: FrameView [options]
+//
+// Watches the frames of a renderer running in another process, such as "SoftRender --shared
+// NAME" (see SharedFrameRing.h), without slowing it down: the renderer never waits for this
+// program, so if it draws faster than they are read some frames are missed. Waits for the
+// renderer to start, then reads the latest frame whenever a new one is published until the
+// renderer closes. The frames read and missed are shown once a second and at the end.
+//
+// Options:
+//   --name NAME    Name of the shared memory (default IndexBuffer)
+//   --frames N     Stop after reading N frames (default 0, until the renderer closes)
+//   --timeout S    Give up after S seconds with no new frame (default 10)
+//   --wait         When the renderer closes, wait for it to start again rather than stop
+//   --dump NAME    Save every frame read as NAME_N.ppm, where N is the renderer's frame number
+//   --save NAME    Save the last frame read as NAME.ppm
+//   --video FILE   Stream the frames read to FILE as Y4M video, or to a command with "|command"
+//                  (see VideoCapture.h). For example, to watch a renderer on a server from a desktop:
+//                    ssh server FrameView --video - | ffplay -
+//
+// Returns 0 if any frame was read, 1 if none was, 2 if the command line is wrong or a file cannot be written.
+
+#include "SharedFrameRing.h"
+#include "ImageFile.h"
+#include "VideoCapture.h"
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+// How often to look for a new frame or for the renderer to start. Short, as a frame may be overwritten a few frames
+// after it is published
+static const std::chrono::milliseconds kPollInterval(1);
+static const std::chrono::milliseconds kOpenInterval(100);
+
+
+// Open the ring, retrying until it exists or the timeout passes
+static bool WaitForWriter(SharedFrameReader& reader, const std::string& name, double timeoutSeconds)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::string error;
+    while (!reader.Open(name, error))
+    {
+        if (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > timeoutSeconds)
+        {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+        std::this_thread::sleep_for(kOpenInterval);
+    }
+    const SharedFrameInfo& info = reader.Info();
+    std::fprintf(stderr, "%s: %dx%d frames, %d slots\n", name.c_str(), info.width, info.height, info.numSlots);
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    std::string name = "IndexBuffer", dumpName, saveName, videoName;
+    int maxFrames = 0;
+    double timeoutSeconds = 10.0;
+    bool waitForRestart = false;
+    bool valid = true;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if      (arg == "--name" && hasValue)     name = argv[++i];
+        else if (arg == "--frames" && hasValue)   maxFrames = std::atoi(argv[++i]);
+        else if (arg == "--timeout" && hasValue)  timeoutSeconds = std::atof(argv[++i]);
+        else if (arg == "--wait")                 waitForRestart = true;
+        else if (arg == "--dump" && hasValue)     dumpName = argv[++i];
+        else if (arg == "--save" && hasValue)     saveName = argv[++i];
+        else if (arg == "--video" && hasValue)    videoName = argv[++i];
+        else                                      valid = false;
+    }
+    if (!valid || name.empty() || maxFrames < 0 || timeoutSeconds <= 0.0)
+    {
+        std::fprintf(stderr, "Usage: FrameView [--name NAME] [--frames N] [--timeout S] [--wait] [--dump NAME] [--save NAME] [--video FILE]\n");
+        return 2;
+    }
+
+    SharedFrameReader reader;
+    if (!WaitForWriter(reader, name, timeoutSeconds))  return 1;
+
+    VideoCapture video;
+    std::vector<uint32_t> colours;
+    SharedFrameInfo info; // Of the last frame read, kept when the reader is closed
+    uint64_t frame = 0;
+    uint64_t numRead = 0, numMissed = 0, numRetries = 0;
+    uint64_t numReadShown = 0, numMissedShown = 0;
+    auto lastFrameTime = std::chrono::steady_clock::now();
+    auto lastShownTime = lastFrameTime;
+    bool writeFailed = false;
+    std::string error;
+
+    while (maxFrames == 0 || numRead < static_cast<uint64_t>(maxFrames))
+    {
+        SharedFrameReader::ReadResult result = reader.ReadLatest(colours, frame);
+        auto now = std::chrono::steady_clock::now();
+        if (result == SharedFrameReader::ReadResult::NewFrame)
+        {
+            lastFrameTime = now;
+            info = reader.Info();
+            if (!dumpName.empty() &&
+                !SaveColourImage(dumpName + "_" + std::to_string(frame) + ".ppm", colours.data(), info.width, info.height, error))
+            {
+                writeFailed = true;
+                break;
+            }
+            if (!videoName.empty())
+            {
+                // The video is opened at the first frame's size. A renderer restarted at another size cannot be added
+                if (!video.IsOpen() &&
+                    !video.Open(videoName, info.width, info.height, 60, VideoFormat::Y4m, 4, CaptureOverflow::Wait, error))
+                {
+                    writeFailed = true;
+                    break;
+                }
+                if (!video.AddFrame(colours.data()))
+                {
+                    error = "Error writing video";
+                    writeFailed = true;
+                    break;
+                }
+            }
+            ++numRead;
+        }
+        else if (result == SharedFrameReader::ReadResult::Closed ||
+                 std::chrono::duration<double>(now - lastFrameTime).count() > timeoutSeconds)
+        {
+            // Keep the counts of this writer before the reader is reopened for another
+            const SharedFrameStats& stats = reader.Stats();
+            numMissed  += stats.numMissed;
+            numRetries += stats.numRetries;
+            if (result == SharedFrameReader::ReadResult::Closed)  std::fprintf(stderr, "%s: closed\n", name.c_str());
+            else                                                  std::fprintf(stderr, "%s: no new frames\n", name.c_str());
+            reader.Close();
+            if (!waitForRestart || !WaitForWriter(reader, name, timeoutSeconds))  break;
+            lastFrameTime = std::chrono::steady_clock::now();
+            continue;
+        }
+        else
+        {
+            std::this_thread::sleep_for(kPollInterval);
+        }
+
+        if (std::chrono::duration<double>(now - lastShownTime).count() >= 1.0)
+        {
+            uint64_t missed = numMissed + reader.Stats().numMissed;
+            std::fprintf(stderr, "Frame %llu: %llu read, %llu missed in the last second\n",
+                         static_cast<unsigned long long>(frame), static_cast<unsigned long long>(numRead - numReadShown),
+                         static_cast<unsigned long long>(missed - numMissedShown));
+            numReadShown = numRead;
+            numMissedShown = missed;
+            lastShownTime = now;
+        }
+    }
+    if (reader.IsOpen())
+    {
+        numMissed  += reader.Stats().numMissed;
+        numRetries += reader.Stats().numRetries;
+    }
+
+    std::string videoError;
+    if (!video.Close(videoError) && !writeFailed)
+    {
+        error = videoError;
+        writeFailed = true;
+    }
+    if (!writeFailed && !saveName.empty() && numRead > 0)
+    {
+        writeFailed = !SaveColourImage(saveName + ".ppm", colours.data(), info.width, info.height, error);
+    }
+    if (writeFailed)
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 2;
+    }
+
+    std::fprintf(stderr, "%llu frames read, %llu missed, %llu copies overtaken by the renderer\n",
+                 static_cast<unsigned long long>(numRead), static_cast<unsigned long long>(numMissed),
+                 static_cast<unsigned long long>(numRetries));
+    return numRead > 0 ? 0 : 1;
+}
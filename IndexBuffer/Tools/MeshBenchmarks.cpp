@@ -0,0 +1,649 @@
+//--------------------------------------------------------------------------------------
+// Timings for the CPU-side mesh processing in the Mesh folder on large generated meshes
+//--------------------------------------------------------------------------------------
+// A command line program, not part of the Visual Studio project (it has its own main).
+// To build on Linux from this folder:
+//   g++ -std=c++14 -O2 -pthread -I../Utility -I../Mesh MeshBenchmarks.cpp ../Mesh/*.cpp
+//       ../Utility/ThreadPool.cpp ../Utility/RadixSort.cpp ../Utility/CpuFeatures.cpp -o MeshBenchmarks
+//
+// Usage: MeshBenchmarks [triangle count in millions]...   (default is 1 and 10)
+//
+// For each size: adjacency, normal generation and triangle culling, then spatial reordering of a shuffled mesh
+// compared with the shuffled order. Then geometry pool, skinning, morph target and draw call tests that do not depend
+// on the size.
+
+#include "MeshAdjacency.h"
+#include "MeshNormals.h"
+#include "GeometryPool.h"
+#include "MeshReorder.h"
+#include "VertexCache.h"
+#include "TriangleCulling.h"
+#include "Skinning.h"
+#include "MorphTargets.h"
+#include "DrawRecorder.h"
+#include "CpuFeatures.h"
+#include "CMatrix4x4.h"
+#include "MathHelpers.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Test meshes
+//--------------------------------------------------------------------------------------
+
+struct BenchmarkMesh
+{
+    std::vector<SimpleVertex> vertices;
+    std::vector<MeshIndex>    indices;
+};
+
+// A wavy square grid with about the given number of triangles, in the row-by-row order a simple generator or
+// scanner would produce
+BenchmarkMesh MakeGrid(size_t numTriangles)
+{
+    size_t side = static_cast<size_t>(std::sqrt(numTriangles / 2.0)) + 1;
+    BenchmarkMesh mesh;
+    mesh.vertices.resize(side * side);
+    for (size_t y = 0; y < side; ++y)
+    {
+        for (size_t x = 0; x < side; ++x)
+        {
+            SimpleVertex& v = mesh.vertices[y * side + x];
+            v.position = CVector3(static_cast<float>(x), static_cast<float>(y), std::sin(x * 0.1f) * std::cos(y * 0.1f));
+            v.colour   = ColourRGBA(1.0f, 1.0f, 1.0f);
+        }
+    }
+    mesh.indices.reserve((side - 1) * (side - 1) * 6);
+    for (size_t y = 0; y < side - 1; ++y)
+    {
+        for (size_t x = 0; x < side - 1; ++x)
+        {
+            MeshIndex a = static_cast<MeshIndex>(y * side + x);
+            MeshIndex b = a + 1;
+            MeshIndex c = a + static_cast<MeshIndex>(side);
+            MeshIndex d = c + 1;
+            MeshIndex quad[] = { a, c, b,  b, c, d };
+            mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+        }
+    }
+    return mesh;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Timing
+//--------------------------------------------------------------------------------------
+
+// Run a function a few times and report the fastest time, in milliseconds and millions of triangles per second
+void Benchmark(const char* name, size_t numTriangles, const std::function<void()>& func)
+{
+    const int numRuns = 3;
+    double best = 1e30;
+    for (int run = 0; run < numRuns; ++run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (ms < best)  best = ms;
+    }
+    std::printf("  %-32s %9.2f ms  %8.1f Mtri/s\n", name, best, numTriangles / (best * 1000.0));
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmarks
+//--------------------------------------------------------------------------------------
+
+void RunBenchmarks(size_t targetTriangles)
+{
+    BenchmarkMesh mesh = MakeGrid(targetTriangles);
+    size_t numTriangles = mesh.indices.size() / 3;
+    std::printf("%zu triangles, %zu vertices, %d threads\n", numTriangles, mesh.vertices.size(),
+                GetThreadPool().GetNumThreads());
+
+    // Adjacency
+    MeshAdjacency adjacency;
+    Benchmark("Adjacency build", numTriangles, [&]
+    {
+        adjacency.Build(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+    });
+    std::printf("  (%zu boundary, %zu non-manifold half-edges)\n", adjacency.NumBoundaryEdges(), adjacency.NumNonManifoldEdges());
+
+    // Normals
+    PositionArray positions(mesh.vertices.data(), mesh.vertices.size());
+    std::vector<CVector3> normals(mesh.vertices.size());
+    Benchmark("Normals (area weighted)", numTriangles, [&]
+    {
+        GenerateNormals(positions, mesh.indices.data(), mesh.indices.size(), NormalWeighting::Area, normals.data());
+    });
+    Benchmark("Normals (angle weighted)", numTriangles, [&]
+    {
+        GenerateNormals(positions, mesh.indices.data(), mesh.indices.size(), NormalWeighting::Angle, normals.data());
+    });
+
+    // CPU triangle culling. The camera looks down on the middle of the grid so its edges are off screen. With many
+    // triangles most are smaller than a pixel
+    float side = std::sqrt(static_cast<float>(mesh.vertices.size()));
+    CMatrix4x4 viewProjection = InverseAffine(MatrixTranslation(CVector3(side * 0.5f, side * 0.5f, -side * 0.4f))) *
+                                MakeProjectionMatrix();
+    std::vector<ClipPosition> clipPositions(mesh.vertices.size());
+    std::vector<MeshIndex> culledIndices(mesh.indices.size());
+    TriangleCullOptions cullOptions;
+    TriangleCullStats cullStats;
+    Benchmark("Transform to clip space", numTriangles, [&]
+    {
+        TransformToClipSpace(positions, &viewProjection.e00, clipPositions.data());
+    });
+    Benchmark("Triangle culling", numTriangles, [&]
+    {
+        CullTriangles(clipPositions.data(), mesh.indices.data(), mesh.indices.size(), cullOptions, culledIndices.data(), &cullStats);
+    });
+    std::printf("  (%zu visible, %zu off screen, %zu facing away, %zu zero area, %zu smaller than a pixel)\n",
+                cullStats.numVisible, cullStats.numOffScreen, cullStats.numFacingAway, cullStats.numZeroArea, cullStats.numSmall);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Spatial reordering
+//--------------------------------------------------------------------------------------
+
+// Shuffle the triangles and vertices of a mesh, as if it came from a source with no useful order
+void ShuffleMesh(BenchmarkMesh& mesh)
+{
+    std::mt19937 random(1);
+    size_t numTriangles = mesh.indices.size() / 3;
+    for (size_t t = numTriangles - 1; t > 0; --t)
+    {
+        size_t other = random() % (t + 1);
+        for (int c = 0; c < 3; ++c)  std::swap(mesh.indices[t * 3 + c], mesh.indices[other * 3 + c]);
+    }
+    std::vector<MeshIndex> remap(mesh.vertices.size());
+    for (size_t v = 0; v < remap.size(); ++v)  remap[v] = static_cast<MeshIndex>(v);
+    std::shuffle(remap.begin(), remap.end(), random);
+    std::vector<SimpleVertex> shuffled(mesh.vertices.size());
+    RemapVertices(mesh.vertices.data(), mesh.vertices.size(), remap, shuffled.data());
+    mesh.vertices.swap(shuffled);
+    RemapIndices(mesh.indices.data(), mesh.indices.size(), remap);
+}
+
+// Cache lines missed when reading the vertices used by the indices through a 32KB direct-mapped cache with 64-byte
+// lines, per triangle. A rough model of a CPU or GPU data cache
+float SimulateVertexFetchMisses(const BenchmarkMesh& mesh)
+{
+    const size_t kLineSize = 64;
+    const size_t kNumLines = 32768 / kLineSize;
+    std::vector<size_t> lines(kNumLines, ~size_t(0));
+    size_t misses = 0;
+    for (MeshIndex index : mesh.indices)
+    {
+        size_t firstByte = index * sizeof(SimpleVertex);
+        for (size_t line = firstByte / kLineSize; line <= (firstByte + sizeof(SimpleVertex) - 1) / kLineSize; ++line)
+        {
+            size_t& cached = lines[line % kNumLines];
+            if (cached != line)
+            {
+                cached = line;
+                ++misses;
+            }
+        }
+    }
+    return static_cast<float>(misses) / (mesh.indices.size() / 3);
+}
+
+// A typical CPU pass over every triangle: back-face and view-volume test, reading the positions through the indices
+size_t CullPass(const BenchmarkMesh& mesh, const CVector3& viewDirection, float maxX)
+{
+    size_t numVisible = 0;
+    for (size_t t = 0; t < mesh.indices.size(); t += 3)
+    {
+        const CVector3& p0 = mesh.vertices[mesh.indices[t    ]].position;
+        const CVector3& p1 = mesh.vertices[mesh.indices[t + 1]].position;
+        const CVector3& p2 = mesh.vertices[mesh.indices[t + 2]].position;
+        if (Dot(Cross(p1 - p0, p2 - p0), viewDirection) >= 0.0f)  continue;
+        if (p0.x > maxX && p1.x > maxX && p2.x > maxX)  continue;
+        ++numVisible;
+    }
+    return numVisible;
+}
+
+// Cast rays straight down onto the mesh using a one-level hierarchy: the bounds of each run of 64 consecutive triangles
+// in the index buffer. The tighter the runs are in space, the fewer triangles each ray has to test. Returns the number
+// of triangle tests, and counts the triangles hit
+size_t RaycastPass(const BenchmarkMesh& mesh, int numRays, float size, size_t& numHits)
+{
+    numHits = 0;
+    const size_t kRunLength = 64;
+    size_t numTriangles = mesh.indices.size() / 3;
+    size_t numRuns = (numTriangles + kRunLength - 1) / kRunLength;
+    std::vector<float> runBounds(numRuns * 4); // Min x, max x, min y, max y
+    for (size_t run = 0; run < numRuns; ++run)
+    {
+        float* bounds = &runBounds[run * 4];
+        bounds[0] = bounds[2] = 1e30f;
+        bounds[1] = bounds[3] = -1e30f;
+        for (size_t i = run * kRunLength * 3; i < (std::min)((run + 1) * kRunLength, numTriangles) * 3; ++i)
+        {
+            const CVector3& p = mesh.vertices[mesh.indices[i]].position;
+            bounds[0] = (std::min)(bounds[0], p.x);  bounds[1] = (std::max)(bounds[1], p.x);
+            bounds[2] = (std::min)(bounds[2], p.y);  bounds[3] = (std::max)(bounds[3], p.y);
+        }
+    }
+
+    std::mt19937 random(2);
+    std::uniform_real_distribution<float> coordinate(0.0f, size);
+    size_t numTests = 0;
+    for (int ray = 0; ray < numRays; ++ray)
+    {
+        float x = coordinate(random), y = coordinate(random);
+        for (size_t run = 0; run < numRuns; ++run)
+        {
+            const float* bounds = &runBounds[run * 4];
+            if (x < bounds[0] || x > bounds[1] || y < bounds[2] || y > bounds[3])  continue;
+            for (size_t t = run * kRunLength; t < (std::min)((run + 1) * kRunLength, numTriangles); ++t)
+            {
+                // Is the point inside the triangle in the xy plane (either winding)
+                const CVector3& p0 = mesh.vertices[mesh.indices[t * 3    ]].position;
+                const CVector3& p1 = mesh.vertices[mesh.indices[t * 3 + 1]].position;
+                const CVector3& p2 = mesh.vertices[mesh.indices[t * 3 + 2]].position;
+                float e0 = (p1.x - p0.x) * (y - p0.y) - (p1.y - p0.y) * (x - p0.x);
+                float e1 = (p2.x - p1.x) * (y - p1.y) - (p2.y - p1.y) * (x - p1.x);
+                float e2 = (p0.x - p2.x) * (y - p2.y) - (p0.y - p2.y) * (x - p2.x);
+                ++numTests;
+                if ((e0 >= 0 && e1 >= 0 && e2 >= 0) || (e0 <= 0 && e1 <= 0 && e2 <= 0))  ++numHits;
+            }
+        }
+    }
+    return numTests;
+}
+
+// Compare a shuffled mesh with the same mesh sorted along Morton and Hilbert curves
+void RunReorderBenchmarks(size_t targetTriangles)
+{
+    BenchmarkMesh shuffled = MakeGrid(targetTriangles);
+    ShuffleMesh(shuffled);
+    size_t numTriangles = shuffled.indices.size() / 3;
+    float gridSize = std::sqrt(static_cast<float>(shuffled.vertices.size()));
+    std::printf("Spatial reordering, %zu shuffled triangles\n", numTriangles);
+
+    struct Variant
+    {
+        const char*   name;
+        BenchmarkMesh mesh;
+    };
+    std::vector<Variant> variants = { { "Shuffled", shuffled }, { "Morton", shuffled }, { "Hilbert", shuffled } };
+    for (size_t v = 1; v < variants.size(); ++v)
+    {
+        BenchmarkMesh& mesh = variants[v].mesh;
+        SpatialOrder order = (v == 1 ? SpatialOrder::Morton : SpatialOrder::Hilbert);
+        PositionArray positions(mesh.vertices.data(), mesh.vertices.size());
+        std::vector<MeshIndex> sortedIndices;
+        Benchmark(v == 1 ? "Morton sort" : "Hilbert sort", numTriangles, [&]
+        {
+            sortedIndices = shuffled.indices;
+            SortTrianglesSpatially(positions, sortedIndices.data(), sortedIndices.size(), order);
+        });
+        mesh.indices.swap(sortedIndices);
+
+        // Renumber the vertices to match so vertex reads are in order too
+        std::vector<MeshIndex> remap;
+        MakeFirstUseVertexRemap(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), remap);
+        std::vector<SimpleVertex> remapped(mesh.vertices.size());
+        RemapVertices(mesh.vertices.data(), mesh.vertices.size(), remap, remapped.data());
+        mesh.vertices.swap(remapped);
+        RemapIndices(mesh.indices.data(), mesh.indices.size(), remap);
+    }
+
+    const int numRays = 32;
+    std::printf("  %-10s %10s %10s %12s %12s %14s\n", "Order", "Cull ms", "Rays ms", "Tests/ray", "ACMR FIFO32", "Lines/tri 32K");
+    for (auto& variant : variants)
+    {
+        const BenchmarkMesh& mesh = variant.mesh;
+        VertexCacheStats cache = SimulateVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(),
+                                                     VertexCacheType::Fifo, 32);
+        float lineMisses = SimulateVertexFetchMisses(mesh);
+
+        auto time = [](const std::function<void()>& func)
+        {
+            auto start = std::chrono::steady_clock::now();
+            func();
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+        size_t numVisible = 0, numTests = 0, numHits = 0;
+        double cullMs = time([&] { numVisible = CullPass(mesh, CVector3(0.3f, 0.2f, 1.0f), gridSize * 0.75f); });
+        double rayMs  = time([&] { numTests   = RaycastPass(mesh, numRays, gridSize, numHits); });
+        std::printf("  %-10s %10.2f %10.2f %12.0f %12.3f %14.2f   (%zu visible, %zu hits)\n", variant.name, cullMs, rayMs,
+                    static_cast<double>(numTests) / numRays, cache.ACMR(), lineMisses, numVisible, numHits);
+    }
+}
+
+
+// Churn a geometry pool the way a streaming scene would: fill it with thousands of meshes of different sizes, then
+// repeatedly remove a random tenth and add new ones, and finally defragment
+void RunPoolBenchmark(uint32_t numMeshes)
+{
+    std::printf("Geometry pool, %u meshes\n", numMeshes);
+
+    const uint32_t maxVertices = 2000;
+    std::vector<SimpleVertex> vertices(maxVertices);
+    std::vector<MeshIndex>    indices(maxVertices * 3);
+    for (uint32_t i = 0; i < indices.size(); ++i)  indices[i] = i % maxVertices;
+
+    VertexStream stream = MakeVertexStream<SimpleVertex>(kSimpleVertexElements);
+    GeometryPool pool;
+    std::vector<PoolMeshId> meshes;
+    std::mt19937 random(1);
+    auto addMesh = [&]
+    {
+        uint32_t numVertices = 24 + random() % (maxVertices - 24);
+        const void* streamData[] = { vertices.data() };
+        meshes.push_back(pool.Add(streamData, numVertices, indices.data(), numVertices * 3 / 2));
+    };
+
+    auto time = [](const char* name, const std::function<void()>& func)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::printf("  %-32s %9.2f ms\n", name, ms);
+    };
+
+    time("Fill", [&]
+    {
+        pool.Init(&stream, 1, 65536, 65536);
+        for (uint32_t m = 0; m < numMeshes; ++m)  addMesh();
+    });
+    time("Remove/add 10% x 10", [&]
+    {
+        for (int round = 0; round < 10; ++round)
+        {
+            for (uint32_t m = 0; m < numMeshes / 10; ++m)
+            {
+                size_t victim = random() % meshes.size();
+                pool.Remove(meshes[victim]);
+                meshes[victim] = meshes.back();
+                meshes.pop_back();
+            }
+            for (uint32_t m = 0; m < numMeshes / 10; ++m)  addMesh();
+        }
+    });
+    std::printf("  (%.1f MB vertices, %.1f MB indices, fragmentation %.2f)\n",
+                pool.VertexCapacity() * sizeof(SimpleVertex) / 1048576.0, pool.IndexCapacity() * sizeof(MeshIndex) / 1048576.0,
+                pool.Fragmentation());
+    uint32_t moved = 0;
+    time("Defragment", [&] { moved = pool.Defragment(); });
+    std::printf("  (%u meshes moved, fragmentation %.2f)\n", moved, pool.Fragmentation());
+}
+
+
+//--------------------------------------------------------------------------------------
+// Skinning
+//--------------------------------------------------------------------------------------
+
+// Skin a mesh with four bones per vertex into an array laid out like a dynamic vertex buffer of NormalVertex
+void RunSkinningBenchmark(size_t numVertices, int numBones)
+{
+    std::printf("Skinning, %zu vertices, %d bones, 4 bones per vertex, %d threads\n", numVertices, numBones,
+                GetThreadPool().GetNumThreads());
+
+    // A palette of rotations and translations
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> angle(-3.14f, 3.14f), offset(-1.0f, 1.0f);
+    std::vector<CMatrix4x4> palette(numBones);
+    for (auto& bone : palette)
+    {
+        bone = MatrixRotationX(angle(random)) * MatrixRotationY(angle(random)) *
+               MatrixTranslation(CVector3(offset(random), offset(random), offset(random)));
+    }
+
+    // Each vertex uses a bone and its neighbours in the palette, as in a real skeleton
+    std::vector<SkinnedVertex> vertices(numVertices);
+    for (auto& vertex : vertices)
+    {
+        vertex.position = CVector3(offset(random), offset(random), offset(random));
+        vertex.normal   = Normalise(CVector3(offset(random), offset(random), offset(random)));
+        vertex.colour   = ColourRGBA(1.0f, 1.0f, 1.0f);
+        int firstBone = random() % numBones;
+        int remaining = 255;
+        for (int b = 0; b < 4; ++b)
+        {
+            int weight = (b == 3) ? remaining : static_cast<int>(random() % (remaining + 1));
+            vertex.boneIndices[b] = static_cast<uint8_t>((firstBone + b) % numBones);
+            vertex.boneWeights[b] = static_cast<uint8_t>(weight);
+            remaining -= weight;
+        }
+    }
+
+    std::vector<NormalVertex> scalarOutput(numVertices), simdOutput(numVertices);
+    auto time = [&](const char* name, SkinningPath path, std::vector<NormalVertex>& output, bool normals)
+    {
+        SkinningTarget target = { &output[0].position, normals ? &output[0].normal : nullptr, sizeof(NormalVertex) };
+        double best = 1e30;
+        for (int run = 0; run < 5; ++run)
+        {
+            auto start = std::chrono::steady_clock::now();
+            SkinVertices(vertices.data(), numVertices, &palette[0].e00, target, path);
+            best = (std::min)(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::printf("  %-32s %9.2f ms  %8.1f Mvert/s\n", name, best, numVertices / (best * 1000.0));
+        return best;
+    };
+
+    time("Scalar, positions", SkinningPath::Scalar, scalarOutput, false);
+    double scalarMs = time("Scalar, positions and normals", SkinningPath::Scalar, scalarOutput, true);
+    if (!CpuHasAvx2())
+    {
+        std::printf("  (AVX2 not supported on this processor)\n");
+        return;
+    }
+    time("AVX2, positions", SkinningPath::Avx2, simdOutput, false);
+    double simdMs = time("AVX2, positions and normals", SkinningPath::Avx2, simdOutput, true);
+
+    float maxDifference = 0.0f;
+    for (size_t v = 0; v < numVertices; ++v)
+    {
+        CVector3 difference = simdOutput[v].position - scalarOutput[v].position;
+        maxDifference = (std::max)({ maxDifference, std::fabs(difference.x), std::fabs(difference.y), std::fabs(difference.z) });
+    }
+    std::printf("  (AVX2 %.1fx faster, largest difference from scalar %g)\n", scalarMs / simdMs, maxDifference);
+}
+
+
+// Morph targets on a face-sized mesh: many targets that each change a small patch of vertices, with a few active at a
+// time. Compared with dense blending, which stores every target as a full array of deltas and adds all of them
+void RunMorphBenchmark(uint32_t numVertices, int numTargets, uint32_t verticesPerTarget, int numActive)
+{
+    std::printf("Morph targets, %u vertices, %d targets of %u vertices, %d active\n", numVertices, numTargets,
+                verticesPerTarget, numActive);
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> value(-0.1f, 0.1f);
+    std::vector<SimpleVertex> base(numVertices);
+    for (auto& vertex : base)
+    {
+        vertex.position = CVector3(value(random), value(random), value(random));
+        vertex.colour   = ColourRGBA(0.5f, 0.5f, 0.5f);
+    }
+
+    // Each target moves a contiguous patch of vertices, as a region of a face would be after reordering
+    MorphBlender blender;
+    blender.Init(base.data(), numVertices);
+    std::vector<float> denseDeltas(static_cast<size_t>(numTargets) * numVertices * 7, 0.0f);
+    for (int t = 0; t < numTargets; ++t)
+    {
+        std::vector<MorphDelta> deltas(verticesPerTarget);
+        uint32_t first = random() % (numVertices - verticesPerTarget);
+        for (uint32_t i = 0; i < verticesPerTarget; ++i)
+        {
+            deltas[i] = { first + i, CVector3(value(random), value(random), value(random)),
+                          ColourRGBA(value(random), 0.0f, 0.0f, 0.0f) };
+            float* dense = &denseDeltas[(static_cast<size_t>(t) * numVertices + first + i) * 7];
+            const float* delta = &deltas[i].position.x;
+            for (int e = 0; e < 7; ++e)  dense[e] = delta[e];
+        }
+        blender.AddTarget(deltas.data(), deltas.size());
+    }
+
+    // A different set of active targets each frame
+    const int kFrames = 64;
+    std::vector<float> weights(static_cast<size_t>(kFrames) * numTargets, 0.0f);
+    for (int frame = 0; frame < kFrames; ++frame)
+    {
+        for (int a = 0; a < numActive; ++a)  weights[frame * numTargets + random() % numTargets] = 0.5f + value(random);
+    }
+
+    std::vector<SimpleVertex> dense(numVertices);
+    auto denseBlend = [&](const float* frameWeights)
+    {
+        dense = base;
+        float* out = &dense[0].position.x;
+        for (int t = 0; t < numTargets; ++t)
+        {
+            const float* deltas = &denseDeltas[static_cast<size_t>(t) * numVertices * 7];
+            for (size_t e = 0; e < static_cast<size_t>(numVertices) * 7; ++e)  out[e] += frameWeights[t] * deltas[e];
+        }
+    };
+
+    auto time = [&](const char* name, const std::function<void(const float*)>& blend)
+    {
+        double best = 1e30;
+        for (int run = 0; run < 5; ++run)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < kFrames; ++frame)  blend(&weights[frame * numTargets]);
+            best = (std::min)(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::printf("  %-32s %9.3f ms per frame\n", name, best / kFrames);
+        return best;
+    };
+
+    double denseMs  = time("Dense", denseBlend);
+    double scalarMs = time("Sparse, scalar", [&](const float* w) { blender.Blend(w, false); });
+    double simdMs   = time("Sparse, SSE",    [&](const float* w) { blender.Blend(w, true); });
+
+    // The last frame of each should agree
+    float maxDifference = 0.0f;
+    for (uint32_t v = 0; v < numVertices; ++v)
+    {
+        const float* a = &dense[v].position.x;
+        const float* b = &blender.Vertices()[v].position.x;
+        for (int e = 0; e < 7; ++e)  maxDifference = (std::max)(maxDifference, std::fabs(a[e] - b[e]));
+    }
+
+    std::vector<MorphRange> ranges;
+    blender.ChangedRanges(blender.Frame() - 2, ranges);
+    uint32_t changed = 0;
+    for (auto& range : ranges)  changed += range.count;
+    std::printf("  (sparse SSE %.0fx faster than dense, %.1fx faster than scalar, largest difference %g)\n",
+                denseMs / simdMs, scalarMs / simdMs, maxDifference);
+    std::printf("  (a double-buffered copy is updated with %zu ranges, %u vertices)\n", ranges.size(), changed);
+}
+
+
+// The calls made to draw many copies of a mesh one at a time (a constant buffer write and a draw each) and as
+// instances (one write of the instance data and one draw), recorded without a GPU. Times the recording of the
+// calls and the filling of the data, and checks the recorded calls are valid
+void RunDrawCallBenchmark(uint32_t numObjects)
+{
+    std::printf("Draw calls, %u copies of a cube\n", numObjects);
+
+    // A cube in a pool of the usual size, with an instance buffer and a constant buffer
+    const uint32_t numVertices = 8, numIndices = 14;
+    VertexStream streams[] = { MakeVertexStream<SimpleVertex>(kSimpleVertexElements, 0),
+                               MakeVertexStream<InstanceData>(kInstanceDataElements, 1, true) };
+    DrawRecorder recorder;
+    uint32_t vertexBuffer   = recorder.AddBuffer("Vertices", 65536 * sizeof(SimpleVertex));
+    uint32_t indexBuffer    = recorder.AddBuffer("Indices", 65536 * sizeof(MeshIndex));
+    uint32_t instanceBuffer = recorder.AddBuffer("Instances", numObjects * sizeof(InstanceData));
+    uint32_t constantBuffer = recorder.AddBuffer("Per-model constants", sizeof(PerModelConstants));
+    uint32_t buffers[] = { vertexBuffer, instanceBuffer };
+    uint32_t strides[] = { sizeof(SimpleVertex), sizeof(InstanceData) };
+    uint32_t offsets[] = { 0, 0 };
+
+    std::vector<CMatrix4x4> matrices(numObjects);
+    for (uint32_t i = 0; i < numObjects; ++i)  matrices[i] = MatrixTranslation(CVector3(static_cast<float>(i), 0.0f, 0.0f));
+    std::vector<InstanceData> instances(numObjects);
+    PerModelConstants constants;
+
+    auto time = [&](const char* name, const std::function<void()>& frame)
+    {
+        double best = 1e30;
+        for (int run = 0; run < 5; ++run)
+        {
+            auto start = std::chrono::steady_clock::now();
+            frame();
+            best = (std::min)(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::printf("  %-32s %9.3f ms  %s", name, best, recorder.Report().c_str());
+        return recorder.Errors().empty();
+    };
+
+    bool valid = time("One draw per object", [&]()
+    {
+        recorder.BeginFrame();
+        recorder.SetIndexBuffer(indexBuffer, sizeof(MeshIndex));
+        recorder.SetVertexBuffers(0, 1, buffers, strides, offsets);
+        recorder.SetInputLayout(streams, 1);
+        for (uint32_t i = 0; i < numObjects; ++i)
+        {
+            std::memcpy(constants.worldMatrix, &matrices[i].e00, sizeof(constants.worldMatrix));
+            constants.tint = ColourRGBA(1.0f, 1.0f, 1.0f);
+            recorder.WriteBuffer(constantBuffer, sizeof(constants));
+            recorder.DrawIndexed(numIndices, 0, 0, numVertices);
+        }
+    });
+
+    valid &= time("Instanced", [&]()
+    {
+        recorder.BeginFrame();
+        for (uint32_t i = 0; i < numObjects; ++i)
+        {
+            std::memcpy(instances[i].worldRow0, &matrices[i].e00, sizeof(float) * 16);
+            instances[i].tint = ColourRGBA(1.0f, 1.0f, 1.0f);
+        }
+        recorder.WriteBuffer(instanceBuffer, numObjects * sizeof(InstanceData));
+        recorder.SetIndexBuffer(indexBuffer, sizeof(MeshIndex));
+        recorder.SetVertexBuffers(0, 2, buffers, strides, offsets);
+        recorder.SetInputLayout(streams, 2);
+        recorder.DrawIndexedInstanced(numIndices, numObjects, 0, 0, 0, numVertices);
+    });
+
+    // The checks should catch an instance too many
+    recorder.BeginFrame();
+    recorder.DrawIndexedInstanced(numIndices, numObjects + 1, 0, 0, 0, numVertices);
+    bool caught = !recorder.Errors().empty();
+    std::printf("  (recorded calls %s, overrun %s: %s)\n", valid ? "valid" : "INVALID", caught ? "detected" : "NOT DETECTED",
+                caught ? recorder.Errors().front().c_str() : "");
+}
+
+
+int main(int argc, char* argv[])
+{
+    std::vector<double> millions;
+    for (int i = 1; i < argc; ++i)  millions.push_back(std::atof(argv[i]));
+    if (millions.empty())  millions = { 1.0, 10.0 };
+
+    for (double m : millions)
+    {
+        RunBenchmarks(static_cast<size_t>(m * 1000000.0));
+        std::printf("\n");
+        RunReorderBenchmarks(static_cast<size_t>(m * 1000000.0));
+        std::printf("\n");
+    }
+    RunPoolBenchmark(10000);
+    std::printf("\n");
+    RunSkinningBenchmark(1000000, 100);
+    std::printf("\n");
+    RunMorphBenchmark(30000, 150, 800, 12);
+    std::printf("\n");
+    RunDrawCallBenchmark(10000);
+    return 0;
+}
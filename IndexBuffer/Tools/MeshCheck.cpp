@@ -0,0 +1,248 @@
+//--------------------------------------------------------------------------------------
+// Command line mesh checker - validation and statistics for OBJ files or raw buffer dumps
+//--------------------------------------------------------------------------------------
+// A command line program, not part of the Visual Studio project (it has its own main).
+// To build on Linux from this folder:
+//   g++ -std=c++14 -O2 -pthread -I../Utility -I../Mesh MeshCheck.cpp ../Mesh/*.cpp
+//       ../Utility/ThreadPool.cpp ../Utility/RadixSort.cpp ../Utility/CpuFeatures.cpp -o MeshCheck
+//
+// Usage:
+//   MeshCheck [options] file.obj...                    Check OBJ files (several are checked in parallel)
+//   MeshCheck [options] --raw vertices.bin indices.bin Check raw vertex and index buffer contents
+//   MeshCheck --hlsl Common.hlsli                      Check the shaders' vertex input structures
+//
+// Options:
+//   --stride N           Bytes per vertex in raw vertex data (default 28, SimpleVertex)
+//   --position-offset N  Offset of the float x,y,z position in each raw vertex (default 0)
+//   --index-size 2|4     Bytes per raw index (default 4)
+//   --strip              Raw indices are a triangle strip (e.g. the cube in Scene.cpp)
+//   --overdraw-res N     Size of the image used to estimate overdraw (default 256, 0 to skip)
+//   --sort morton|hilbert  Sort the triangles along a space-filling curve and renumber the vertices
+//                        before the statistics are gathered, to see the effect of reordering
+//   --strict             Treat warnings (degenerate, duplicate triangles, unused vertices or positions) as failures
+//   --quiet              Only print files with problems
+//
+// --hlsl compares each vertex shader input structure in the file with the HLSL generated from
+// the vertex element lists in VertexFormats.h (see CheckHlslVertexStruct), so a change to a C++
+// vertex structure that is not made in the shaders too fails here rather than drawing garbage.
+//
+// Exit code: 0 if all meshes pass, 1 if any has errors (or warnings with --strict), 2 if a file cannot be loaded or
+// the command line is wrong. Suitable for running over an asset folder in a build script.
+
+#include "MeshFile.h"
+#include "MeshValidation.h"
+#include "MeshReorder.h"
+#include "VertexFormats.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+
+struct CheckOptions
+{
+    uint32_t stride         = 28;
+    uint32_t positionOffset = 0;
+    uint32_t indexSize      = 4;
+    bool     isStrip        = false;
+    int      overdrawResolution = 256;
+    bool     strict         = false;
+    bool     quiet          = false;
+    bool     sort           = false;
+    SpatialOrder sortOrder  = SpatialOrder::Hilbert;
+};
+
+// Outcome of checking one mesh
+struct CheckResult
+{
+    int         status = 0; // 0 passed, 1 failed checks, 2 could not load
+    std::string output;
+};
+
+
+// Validate a loaded mesh and describe the results
+CheckResult CheckMesh(const std::string& name, LoadedMesh& mesh, const CheckOptions& options)
+{
+    // Reorder if asked. Out of range indices would be read as positions, so only valid meshes are sorted
+    PositionArray positions(mesh.positions.data(), mesh.positions.size());
+    bool indicesInRange = std::all_of(mesh.indices.begin(), mesh.indices.end(),
+                                      [&](MeshIndex index) { return index < mesh.positions.size(); });
+    if (options.sort && indicesInRange)
+    {
+        SortTrianglesSpatially(positions, mesh.indices.data(), mesh.indices.size(), options.sortOrder);
+        std::vector<MeshIndex> remap;
+        MakeFirstUseVertexRemap(mesh.indices.data(), mesh.indices.size(), mesh.positions.size(), remap);
+        std::vector<CVector3> remappedPositions(mesh.positions.size());
+        RemapVertices(mesh.positions.data(), mesh.positions.size(), remap, remappedPositions.data());
+        mesh.positions.swap(remappedPositions);
+        RemapIndices(mesh.indices.data(), mesh.indices.size(), remap);
+        positions = PositionArray(mesh.positions.data(), mesh.positions.size());
+    }
+
+    MeshValidationOptions validationOptions;
+    validationOptions.vertexSize = mesh.vertexSize;
+    validationOptions.indexSize  = mesh.indexSize;
+    validationOptions.overdrawResolution = options.overdrawResolution;
+
+    MeshValidationReport report;
+    ValidateMesh(positions, mesh.indices.data(), mesh.indices.size(), validationOptions, report);
+
+    // Positions in the file that no face uses make no vertex, so only the loader can count them
+    bool hasWarnings = report.HasWarnings() || mesh.numUnusedFilePositions > 0;
+
+    CheckResult result;
+    bool failed = report.HasErrors() || (options.strict && hasWarnings);
+    result.status = failed ? 1 : 0;
+    if (!options.quiet || failed || hasWarnings)
+    {
+        result.output = (failed ? "FAIL " : "ok   ") + name + "\n" + report.ToString();
+        if (mesh.numUnusedFilePositions > 0)
+        {
+            result.output += "  WARNING: " + std::to_string(mesh.numUnusedFilePositions) + " of the file's " +
+                             std::to_string(mesh.numFilePositions) + " positions are not used by any face\n";
+        }
+    }
+    return result;
+}
+
+
+// Check the vertex shader input structures in an HLSL file against the vertex layouts Scene.cpp binds for them.
+// Returns the exit code
+int CheckShaderStructs(const std::string& fileName)
+{
+    std::ifstream file(fileName);
+    if (!file)
+    {
+        std::printf("ERROR Cannot open %s\n", fileName.c_str());
+        return 2;
+    }
+    std::stringstream source;
+    source << file.rdbuf();
+
+    struct ShaderStruct
+    {
+        const char*  name;
+        VertexStream streams[2];
+        int          numStreams;
+    };
+    const ShaderStruct shaderStructs[] =
+    {
+        { "SimpleVertex",       { MakeVertexStream<SimpleVertex>(kSimpleVertexElements) }, 1 },
+        { "PositionOnlyVertex", { MakeVertexStream<PositionVertex>(kPositionVertexElements) }, 1 },
+        { "InstancedVertex",    { MakeVertexStream<SimpleVertex>(kSimpleVertexElements),
+                                  MakeVertexStream<InstanceData>(kInstanceDataElements, 1, true) }, 2 },
+    };
+
+    int exitCode = 0;
+    for (const ShaderStruct& shaderStruct : shaderStructs)
+    {
+        std::string error;
+        if (CheckHlslVertexStruct(source.str(), shaderStruct.name, shaderStruct.streams, shaderStruct.numStreams, error))
+        {
+            std::printf("ok   %s %s\n", fileName.c_str(), shaderStruct.name);
+        }
+        else
+        {
+            std::printf("FAIL %s %s\n", fileName.c_str(), error.c_str());
+            exitCode = 1;
+        }
+    }
+    return exitCode;
+}
+
+
+void PrintUsage()
+{
+    std::fprintf(stderr, "Usage: MeshCheck [--stride N] [--position-offset N] [--index-size 2|4] [--strip]\n"
+                         "                 [--overdraw-res N] [--sort morton|hilbert] [--strict] [--quiet]\n"
+                         "                 (file.obj... | --raw vertices.bin indices.bin)\n"
+                         "       MeshCheck --hlsl Common.hlsli\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    CheckOptions options;
+    std::vector<std::string> objFiles;
+    std::string rawVertexFile, rawIndexFile;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if      (arg == "--stride"          && hasValue)  options.stride             = std::atoi(argv[++i]);
+        else if (arg == "--position-offset" && hasValue)  options.positionOffset     = std::atoi(argv[++i]);
+        else if (arg == "--index-size"      && hasValue)  options.indexSize          = std::atoi(argv[++i]);
+        else if (arg == "--overdraw-res"    && hasValue)  options.overdrawResolution = std::atoi(argv[++i]);
+        else if (arg == "--strip")   options.isStrip = true;
+        else if (arg == "--strict")  options.strict  = true;
+        else if (arg == "--sort" && hasValue)
+        {
+            std::string order = argv[++i];
+            options.sort = true;
+            if      (order == "morton")   options.sortOrder = SpatialOrder::Morton;
+            else if (order == "hilbert")  options.sortOrder = SpatialOrder::Hilbert;
+            else
+            {
+                PrintUsage();
+                return 2;
+            }
+        }
+        else if (arg == "--quiet")   options.quiet   = true;
+        else if (arg == "--hlsl" && hasValue)  return CheckShaderStructs(argv[++i]);
+        else if (arg == "--raw" && i + 2 < argc)
+        {
+            rawVertexFile = argv[++i];
+            rawIndexFile  = argv[++i];
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            PrintUsage();
+            return 2;
+        }
+        else
+        {
+            objFiles.push_back(arg);
+        }
+    }
+    if (objFiles.empty() == rawVertexFile.empty()) // Need one or the other
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    // Check every file, several at once. Each mesh is checked on one thread, the results are printed in order
+    std::vector<CheckResult> results(rawVertexFile.empty() ? objFiles.size() : 1);
+    GetThreadPool().Run(static_cast<int>(results.size()), [&](int f, int)
+    {
+        LoadedMesh mesh;
+        std::string error;
+        bool loaded = rawVertexFile.empty() ?
+                      LoadObjMesh(objFiles[f], mesh, error) :
+                      LoadRawMesh(rawVertexFile, rawIndexFile, options.stride, options.positionOffset,
+                                  options.indexSize, options.isStrip, mesh, error);
+        if (!loaded)
+        {
+            results[f].status = 2;
+            results[f].output = "ERROR " + error + "\n";
+            return;
+        }
+        results[f] = CheckMesh(rawVertexFile.empty() ? objFiles[f] : rawIndexFile, mesh, options);
+    });
+
+    int exitCode = 0;
+    int numFailed = 0;
+    for (auto& result : results)
+    {
+        std::fputs(result.output.c_str(), stdout);
+        if (result.status != 0)  ++numFailed;
+        if (result.status > exitCode)  exitCode = result.status;
+    }
+    if (results.size() > 1)  std::printf("%zu meshes checked, %d failed\n", results.size(), numFailed);
+    return exitCode;
+}
@@ -0,0 +1,227 @@
+//--------------------------------------------------------------------------------------
+// Command line out-of-core mesh processor - welds and reindexes raw buffers of any size
+//--------------------------------------------------------------------------------------
+// A command line program, not part of the Visual Studio project (it has its own main).
+// To build on Linux from this folder:
+//   g++ -std=c++14 -O2 -pthread -I../Utility -I../Mesh MeshStream.cpp ../Mesh/*.cpp
+//       ../Utility/ThreadPool.cpp ../Utility/RadixSort.cpp ../Utility/CpuFeatures.cpp -o MeshStream
+//
+// Usage:
+//   MeshStream [options] vertices.bin indices.bin outVertices.bin outIndices.bin
+//
+// Finds the bounds, welds identical vertices and renumbers the indices, all within a fixed
+// memory budget (see OutOfCoreMesh.h). Prints the time for each step and the peak memory used.
+//
+// Options:
+//   --stride N           Bytes per vertex (default 28, SimpleVertex)
+//   --position-offset N  Offset of the float x,y,z position in each vertex (default 0)
+//   --index-size 2|4     Bytes per index (default 4)
+//   --budget MB          Memory budget in MB (default 256)
+//   --temp folder        Folder for temporary files (default the current folder)
+//   --quantize           Convert positions to 16-bit integers over the bounds before welding, which welds vertices
+//                        within one grid step. The output vertices are then 8-byte quantised positions
+//   --keep-degenerate    Keep triangles that welding collapses (and allow strips or other non-list indices)
+//   --generate N         First write a test mesh of N million triangles to the two input files, with three separate
+//                        vertices for every triangle as if from a triangle soup
+//                        (SimpleVertex and 32-bit indices, other options are ignored)
+
+#include "OutOfCoreMesh.h"
+#include "VertexFormats.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+
+// Largest amount of memory the process has had resident so far, in MB
+static double PeakMemoryMB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); // Bytes on macOS
+#else
+    return usage.ru_maxrss / 1024.0;            // KB on Linux
+#endif
+#endif
+}
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+// Write a wavy grid as a triangle soup - every triangle has its own three vertices - streamed to the files so that
+// generating a mesh larger than memory is possible
+static bool GenerateSoup(const std::string& vertexFileName, const std::string& indexFileName, double millionsOfTriangles)
+{
+    uint64_t numTriangles = static_cast<uint64_t>(millionsOfTriangles * 1000000.0);
+    uint32_t gridSize = (std::max)(1u, static_cast<uint32_t>(std::sqrt(numTriangles / 2.0)));
+    std::FILE* vertexFile = std::fopen(vertexFileName.c_str(), "wb");
+    std::FILE* indexFile  = std::fopen(indexFileName.c_str(), "wb");
+    if (vertexFile == nullptr || indexFile == nullptr)
+    {
+        if (vertexFile != nullptr)  std::fclose(vertexFile);
+        if (indexFile != nullptr)   std::fclose(indexFile);
+        return false;
+    }
+
+    auto gridVertex = [&](uint32_t x, uint32_t z)
+    {
+        SimpleVertex vertex;
+        vertex.position = CVector3(static_cast<float>(x), std::sin(x * 0.1f) * std::cos(z * 0.1f), static_cast<float>(z));
+        vertex.colour = ColourRGBA(x / static_cast<float>(gridSize), 0.5f, z / static_cast<float>(gridSize), 1.0f);
+        return vertex;
+    };
+
+    uint32_t nextIndex = 0;
+    for (uint32_t z = 0; z < gridSize; ++z)
+    {
+        for (uint32_t x = 0; x < gridSize; ++x)
+        {
+            SimpleVertex corners[6] = { gridVertex(x, z), gridVertex(x, z + 1), gridVertex(x + 1, z),
+                                        gridVertex(x + 1, z), gridVertex(x, z + 1), gridVertex(x + 1, z + 1) };
+            uint32_t indices[6] = { nextIndex, nextIndex + 1, nextIndex + 2, nextIndex + 3, nextIndex + 4, nextIndex + 5 };
+            nextIndex += 6;
+            std::fwrite(corners, sizeof(corners), 1, vertexFile);
+            std::fwrite(indices, sizeof(indices), 1, indexFile);
+        }
+    }
+    bool ok = (std::fclose(vertexFile) == 0);
+    ok = (std::fclose(indexFile) == 0) && ok;
+    std::printf("Generated %llu triangles, %llu vertices\n", 2ull * gridSize * gridSize, 6ull * gridSize * gridSize);
+    return ok;
+}
+
+
+void PrintUsage()
+{
+    std::fprintf(stderr, "Usage: MeshStream [--stride N] [--position-offset N] [--index-size 2|4] [--budget MB]\n"
+                         "                  [--temp folder] [--quantize] [--keep-degenerate] [--generate N]\n"
+                         "                  vertices.bin indices.bin outVertices.bin outIndices.bin\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    RawVertexFormat  format;
+    OutOfCoreOptions options;
+    uint32_t indexSize = 4;
+    bool quantize = false;
+    bool dropDegenerate = true;
+    double generateMillions = 0.0;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if      (arg == "--stride"          && hasValue)  format.stride         = std::atoi(argv[++i]);
+        else if (arg == "--position-offset" && hasValue)  format.positionOffset = std::atoi(argv[++i]);
+        else if (arg == "--index-size"      && hasValue)  indexSize             = std::atoi(argv[++i]);
+        else if (arg == "--budget"          && hasValue)  options.memoryBudget  = std::strtoull(argv[++i], nullptr, 10) << 20;
+        else if (arg == "--temp"            && hasValue)  options.tempDirectory = argv[++i];
+        else if (arg == "--generate"        && hasValue)  generateMillions      = std::atof(argv[++i]);
+        else if (arg == "--quantize")        quantize       = true;
+        else if (arg == "--keep-degenerate") dropDegenerate = false;
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            PrintUsage();
+            return 2;
+        }
+        else
+        {
+            files.push_back(arg);
+        }
+    }
+    if (files.size() != 4 || options.memoryBudget == 0)
+    {
+        PrintUsage();
+        return 2;
+    }
+    const std::string& vertexFile    = files[0];
+    const std::string& indexFile     = files[1];
+    const std::string& outVertexFile = files[2];
+    const std::string& outIndexFile  = files[3];
+    std::string remapFile = options.tempDirectory + "/remap.tmp";
+
+    if (generateMillions > 0.0)
+    {
+        if (!GenerateSoup(vertexFile, indexFile, generateMillions))
+        {
+            std::fprintf(stderr, "ERROR Cannot write the test mesh\n");
+            return 2;
+        }
+        format = RawVertexFormat();
+        indexSize = 4;
+    }
+
+    std::string error;
+    auto fail = [&]()
+    {
+        std::fprintf(stderr, "ERROR %s\n", error.c_str());
+        std::remove(remapFile.c_str());
+        return 1;
+    };
+
+    // Bounds
+    auto start = std::chrono::steady_clock::now();
+    MeshBounds bounds;
+    if (!ComputeBoundsOutOfCore(vertexFile, format, options, bounds, error))  return fail();
+    std::printf("Bounds:   %.1fs  %llu vertices, (%g, %g, %g) to (%g, %g, %g)\n", SecondsSince(start),
+                static_cast<unsigned long long>(bounds.numVertices),
+                bounds.minimum.x, bounds.minimum.y, bounds.minimum.z, bounds.maximum.x, bounds.maximum.y, bounds.maximum.z);
+
+    // Optional quantisation, the quantised vertices are welded instead of the originals
+    std::string weldInput  = vertexFile;
+    uint32_t    weldStride = format.stride;
+    if (quantize)
+    {
+        start = std::chrono::steady_clock::now();
+        weldInput  = options.tempDirectory + "/quantized.tmp";
+        weldStride = sizeof(uint16_t) * 4;
+        if (!QuantizePositionsOutOfCore(vertexFile, format, bounds, weldInput, options, error))  return fail();
+        std::printf("Quantize: %.1fs\n", SecondsSince(start));
+    }
+
+    // Weld
+    start = std::chrono::steady_clock::now();
+    uint64_t numWelded = 0;
+    bool welded = WeldVerticesOutOfCore(weldInput, weldStride, outVertexFile, remapFile, options, numWelded, error);
+    if (quantize)  std::remove(weldInput.c_str());
+    if (!welded)  return fail();
+    std::printf("Weld:     %.1fs  %llu vertices -> %llu\n", SecondsSince(start),
+                static_cast<unsigned long long>(bounds.numVertices), static_cast<unsigned long long>(numWelded));
+
+    // Reindex
+    start = std::chrono::steady_clock::now();
+    uint64_t numIndices = 0;
+    if (!RemapIndicesOutOfCore(indexFile, indexSize, remapFile, outIndexFile, dropDegenerate, options, numIndices, error))
+    {
+        return fail();
+    }
+    std::remove(remapFile.c_str());
+    std::printf("Reindex:  %.1fs  %llu indices written\n", SecondsSince(start), static_cast<unsigned long long>(numIndices));
+
+    std::printf("Peak memory %.0fMB with a budget of %lluMB\n", PeakMemoryMB(),
+                static_cast<unsigned long long>(options.memoryBudget >> 20));
+    return 0;
+}
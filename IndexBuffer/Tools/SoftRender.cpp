@@ -0,0 +1,1055 @@
+//--------------------------------------------------------------------------------------
+// Command line software rendering - the app's pipeline drawn on the CPU with no window
+//--------------------------------------------------------------------------------------
+// A command line program, not part of the Visual Studio project (it has its own main).
+// To build on Linux from this folder:
+//   g++ -std=c++14 -O2 -pthread -I../Utility -I../Mesh -I../Raster SoftRender.cpp ../Raster/*.cpp ../Mesh/*.cpp
+//       ../Utility/ThreadPool.cpp ../Utility/RadixSort.cpp ../Utility/CpuFeatures.cpp -o SoftRender
+//
+// Usage: SoftRender [options] [file.obj]
+//
+// Without a file a grid of cubes is drawn, like the cube grid in Scene.cpp. An OBJ file is drawn
+// once, scaled to fit in front of the camera and coloured by position. The camera and projection
+// are the ones Scene.cpp uses. The scene turns a little each frame.
+//
+// Options:
+//   --size WxH     Size of the frame buffer (default 1280x960, the app's window)
+//   --frames N     Frames to draw (default 100)
+//   --grid N       Cubes along each side of the grid (default 32)
+//   --cull none|back|front  Triangles removed (default none, as gTwoSided in Scene.cpp)
+//   --serial       Draw on one thread rather than the whole thread pool
+//   --scalar       Rasterize a pixel at a time rather than in AVX2 blocks
+//   --benchmark    Time the scalar and AVX2 rasterizers on small and large triangles instead, then a
+//                  wireframe view of a 10 million triangle mesh
+//   --pipelines    Time the rasterizers specialised for the draw state against the general version instead,
+//                  writing colour and depth only
+//   --occlusion    Time occlusion culling of 10000 boxes behind a few large occluders instead, and
+//                  return 1 if any box culled should have been seen
+//   --hierarchical-depth  Time depth complex scenes with and without the hierarchical depth test instead
+//   --flat-depth   Test depth a pixel at a time only, without the depth blocks of the frame buffer
+//   --save NAME    Save the last frame's colour as NAME.ppm and its depth as NAME.pfm
+//   --golden DIR   Draw the reference scenes instead and compare them with the images in DIR
+//   --update-golden  With --golden, save the scenes drawn as the new reference images instead
+//   --tolerance N  Largest colour difference (0-255) allowed by --golden (default 1)
+//   --wireframe    Draw each edge of the meshes once as a line instead of the triangles
+//   --vertex-cache fifo16|fifo32|lru16|lru32  Shade vertices through a model of the GPU's vertex
+//                  cache rather than once each (see SoftwareRenderer::SetVertexCache)
+//   --video FILE   Stream every frame drawn to FILE as a video, or to a command with "|command"
+//                  (see VideoCapture.h)
+//   --video-format y4m|rgba  Y4M (default) or headerless RGBA frames
+//   --stats FILE   Write the counts and times of each pipeline stage for every frame to FILE as comma
+//                  separated values (see PipelineStats.h), "-" for the standard output
+//   --shared NAME  Publish every frame drawn to shared memory called NAME, for FrameView to watch
+//                  from another process (see SharedFrameRing.h). Fails if NAME already exists
+//   --shared-replace  With --shared, first remove shared memory called NAME left by a run that did
+//                  not close (it must not still be running)
+//
+// Prints the time per frame, the pixels drawn in the last frame and a checksum of its colours, so
+// changes to the renderer can be checked for a different picture as well as for speed. The
+// checksum is the same with and without --serial. A grid of 290 has about a million triangles.
+//
+// --golden is a regression check for changes to the renderer. Each reference scene (the cube at
+// fixed rotations, one crossing the near plane, and the cube grid) is drawn and compared with
+// DIR/scene.ppm and DIR/scene.pfm. The references are kept in Tools/Golden, drawn at 320x240,
+// the size used unless --size is given:
+//   SoftRender --golden Golden
+// A scene fails if any pixel differs by more than the tolerance, and the picture drawn is then
+// saved as DIR/scene.actual.ppm to look at. A scene with no reference fails too. When a change is
+// meant to alter the pictures, check the .actual images and replace the references with
+// --update-golden. The time per frame of each scene is shown too. Returns 1 if any scene fails.
+//
+// The vertex shader work is shown on a second line: vertices shaded per mesh drawn, the cache hit
+// rate and the time spent shading. A third line shows the triangles thrown away by the
+// hierarchical depth test. With --vertex-cache the count is checked against
+// SimulateVertexCache, which the renderer must agree with exactly. A fourth line shows the work
+// of each stage per frame: triangles thrown away or clipped before rasterizing, pixels depth
+// tested and written, the different pixels written and so the overdraw, and the time spent in
+// each stage, to see where a change to the meshes, the culling or the draw order makes a
+// difference. --stats gives the same counts for every frame.
+//
+// With --video the frames are written on a thread of their own while the next ones are drawn, and
+// the time per frame includes only queueing each frame for the writer. Every frame is kept, so a
+// writer that falls behind holds up drawing. The queueing and writing times are shown at the end.
+// For example, to make an MP4 without a large file in between:
+//   SoftRender --frames 600 --video "|ffmpeg -y -i - spin.mp4"
+//
+// --shared never holds up drawing: each frame is copied into a ring of slots in shared memory and
+// a viewer that falls behind misses frames instead. The copying time is shown at the end too. To
+// watch a long run on a machine with no display:
+//   SoftRender --frames 100000 --shared IndexBuffer &
+//   FrameView --name IndexBuffer --video "|ffplay -"
+
+#include "SoftwareRenderer.h"
+#include "OcclusionCulling.h"
+#include "ImageFile.h"
+#include "VideoCapture.h"
+#include "SharedFrameRing.h"
+#include "VertexCache.h"
+#include "MeshAdjacency.h"
+#include "VertexFormats.h"
+#include "MeshFile.h"
+#include "CMatrix4x4.h"
+#include "MathHelpers.h"
+#include "ThreadPool.h"
+#include "CpuFeatures.h"
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <random>
+
+
+//--------------------------------------------------------------------------------------
+// Scenes
+//--------------------------------------------------------------------------------------
+
+// Vertices and triangle list (or line list) indices with a world matrix for each copy drawn
+struct SoftScene
+{
+    std::vector<SimpleVertex> vertices;
+    std::vector<MeshIndex>    indices;
+    std::vector<CMatrix4x4>   placements;
+    RasterTopology            topology = RasterTopology::TriangleList;
+};
+
+// A cube two units across with a colour at each corner, at the origin like the cube in Scene.cpp
+static void BuildCube(SoftScene& scene)
+{
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        float x = (corner & 1) ? 1.0f : -1.0f;
+        float y = (corner & 2) ? 1.0f : -1.0f;
+        float z = (corner & 4) ? 1.0f : -1.0f;
+        SimpleVertex vertex;
+        vertex.position = CVector3(x, y, z);
+        vertex.colour   = ColourRGBA((x + 1.0f) * 0.5f, (y + 1.0f) * 0.5f, (z + 1.0f) * 0.5f, 1.0f);
+        scene.vertices.push_back(vertex);
+    }
+    const MeshIndex cubeIndices[] = { 0,2,1, 1,2,3,  4,5,6, 5,7,6,  0,4,2, 2,4,6,
+                                      1,3,5, 3,7,5,  0,1,4, 1,5,4,  2,6,3, 3,6,7 };
+    scene.indices.assign(cubeIndices, cubeIndices + 36);
+    scene.placements.push_back(MatrixIdentity());
+}
+
+// The cube copied in a grid of gridSize x gridSize at the distance of the cube grid in Scene.cpp
+static void BuildCubeGrid(int gridSize, SoftScene& scene)
+{
+    BuildCube(scene);
+    scene.placements.clear();
+    float spacing = 40.0f / gridSize;
+    for (int row = 0; row < gridSize; ++row)
+    {
+        for (int column = 0; column < gridSize; ++column)
+        {
+            CVector3 position((column - (gridSize - 1) * 0.5f) * spacing, (row - (gridSize - 1) * 0.5f) * spacing, 20.0f);
+            scene.placements.push_back(MatrixScaling(spacing * 0.3f) * MatrixTranslation(position));
+        }
+    }
+}
+
+// Replace a scene's triangles with its edges, each once
+static void MakeWireframe(SoftScene& scene)
+{
+    MeshAdjacency adjacency;
+    adjacency.Build(scene.indices.data(), scene.indices.size(), scene.vertices.size());
+    adjacency.GetEdges(scene.indices);
+    scene.topology = RasterTopology::LineList;
+}
+
+// A mesh from a file, scaled to a radius of two units at the origin and coloured by position
+static bool BuildFileScene(const std::string& fileName, SoftScene& scene)
+{
+    LoadedMesh mesh;
+    std::string error;
+    if (!LoadObjMesh(fileName, mesh, error))
+    {
+        std::fprintf(stderr, "%s: %s\n", fileName.c_str(), error.c_str());
+        return false;
+    }
+    if (mesh.positions.empty())  return false;
+
+    CVector3 minPosition = mesh.positions[0], maxPosition = mesh.positions[0];
+    for (auto& position : mesh.positions)
+    {
+        minPosition = CVector3((std::min)(minPosition.x, position.x), (std::min)(minPosition.y, position.y), (std::min)(minPosition.z, position.z));
+        maxPosition = CVector3((std::max)(maxPosition.x, position.x), (std::max)(maxPosition.y, position.y), (std::max)(maxPosition.z, position.z));
+    }
+    CVector3 centre = (minPosition + maxPosition) * 0.5f;
+    CVector3 size = maxPosition - minPosition;
+    float scale = 4.0f / (std::max)({ size.x, size.y, size.z, 1e-6f });
+    for (auto& position : mesh.positions)
+    {
+        SimpleVertex vertex;
+        vertex.position = (position - centre) * scale;
+        vertex.colour   = ColourRGBA((position.x - minPosition.x) / (std::max)(size.x, 1e-6f),
+                                     (position.y - minPosition.y) / (std::max)(size.y, 1e-6f),
+                                     (position.z - minPosition.z) / (std::max)(size.z, 1e-6f), 1.0f);
+        scene.vertices.push_back(vertex);
+    }
+
+    // Indices to missing positions would read outside the vertices, drop their triangles
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        if (mesh.indices[i] < scene.vertices.size() && mesh.indices[i + 1] < scene.vertices.size() &&
+            mesh.indices[i + 2] < scene.vertices.size())
+        {
+            scene.indices.insert(scene.indices.end(), mesh.indices.begin() + i, mesh.indices.begin() + i + 3);
+        }
+    }
+    scene.placements.push_back(MatrixIdentity());
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Rasterizer benchmark
+//--------------------------------------------------------------------------------------
+
+// Draw random triangles of about the given size in pixels straight in clip space (no transforms), on one thread with
+// the chosen rasterizer, specialised for the draw state or not, writing colour or only depth. Returns the milliseconds
+// taken by the flush, which is the rasterization
+static double DrawRandomTriangles(FrameBuffer& frame, RasterPath path, float size, int numTriangles, int repeats,
+                                  bool specialised = true, bool colourWrites = true)
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<SimpleVertex> vertices;
+    for (int i = 0; i < numTriangles; ++i)
+    {
+        float centreX = unit(random) * frame.Width(), centreY = unit(random) * frame.Height();
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            float depth = unit(random);
+            float x = centreX + (unit(random) - 0.5f) * size, y = centreY + (unit(random) - 0.5f) * size;
+            SimpleVertex vertex;
+            vertex.position = CVector3(x / frame.Width() * 2.0f - 1.0f, 1.0f - y / frame.Height() * 2.0f, depth);
+            vertex.colour   = ColourRGBA(unit(random), unit(random), unit(random), 1.0f);
+            vertices.push_back(vertex);
+        }
+    }
+    std::vector<MeshIndex> indices(vertices.size());
+    for (size_t i = 0; i < indices.size(); ++i)  indices[i] = static_cast<MeshIndex>(i);
+
+    CMatrix4x4 identity = MatrixIdentity();
+    SoftwareRenderer renderer;
+    renderer.SetRenderTarget(&frame);
+    renderer.SetMultithreaded(false);
+    renderer.SetRasterPath(path);
+    renderer.SetSpecialisedPipelines(specialised);
+    renderer.SetColourWrites(colourWrites);
+    renderer.SetCullFace(CullFace::None);
+    renderer.SetFrameConstants(&identity.e00, &identity.e00);
+    renderer.SetModelConstants(&identity.e00);
+    VertexStream stream = MakeVertexStream<SimpleVertex>(kSimpleVertexElements, 0);
+    const void* vertexData = vertices.data();
+    uint32_t stride = sizeof(SimpleVertex);
+    renderer.SetInputLayout(&stream, 1);
+    renderer.SetVertexBuffers(0, 1, &vertexData, &stride);
+    renderer.SetIndexBuffer(indices.data());
+
+    const float clearColour[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    double ms = 0.0;
+    for (int r = 0; r < repeats; ++r)
+    {
+        frame.ClearColour(clearColour);
+        frame.ClearDepth(1.0f);
+        renderer.DrawIndexed(static_cast<uint32_t>(indices.size()), 0, 0);
+        auto start = std::chrono::high_resolution_clock::now();
+        renderer.Flush();
+        ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+    return ms / repeats;
+}
+
+static void RunRasterBenchmark(int width, int height)
+{
+    if (!CpuHasAvx2())
+    {
+        std::printf("No AVX2 on this processor, nothing to compare\n");
+        return;
+    }
+
+    struct Test { const char* name; float size; int numTriangles; int repeats; };
+    const Test tests[] = { { "Tiny (2px)",     2.0f,   200000, 5 },
+                           { "Small (6px)",    6.0f,   200000, 5 },
+                           { "Medium (32px)",  32.0f,  20000,  5 },
+                           { "Large (400px)",  400.0f, 200,    5 } };
+    for (auto& test : tests)
+    {
+        FrameBuffer scalarFrame, avx2Frame;
+        scalarFrame.Init(width, height);
+        avx2Frame.Init(width, height);
+        double scalarMs = DrawRandomTriangles(scalarFrame, RasterPath::Scalar, test.size, test.numTriangles, test.repeats);
+        double avx2Ms   = DrawRandomTriangles(avx2Frame,   RasterPath::Avx2,   test.size, test.numTriangles, test.repeats);
+
+        // Coverage must match exactly. Colour and depth may differ slightly as they are interpolated differently
+        size_t numCovered = 0, coverageDifferences = 0;
+        int maxColourDifference = 0;
+        float maxDepthDifference = 0.0f;
+        for (size_t p = 0; p < static_cast<size_t>(width) * height; ++p)
+        {
+            uint32_t a = scalarFrame.Colour()[p], b = avx2Frame.Colour()[p];
+            if (a != 0)  ++numCovered;
+            if ((a == 0) != (b == 0))  ++coverageDifferences;
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                maxColourDifference = (std::max)(maxColourDifference, std::abs(int((a >> shift) & 0xFF) - int((b >> shift) & 0xFF)));
+            }
+            maxDepthDifference = (std::max)(maxDepthDifference, std::abs(scalarFrame.Depth()[p] - avx2Frame.Depth()[p]));
+        }
+        std::printf("%-14s %7d triangles: scalar %8.3f ms, AVX2 %8.3f ms (%.1fx), %zu pixels covered, "
+                    "%zu coverage differences, colour within %d, depth within %g\n",
+                    test.name, test.numTriangles, scalarMs, avx2Ms, scalarMs / avx2Ms, numCovered, coverageDifferences,
+                    maxColourDifference, maxDepthDifference);
+    }
+}
+
+
+// Time a wireframe view of one mesh of about 10 million triangles against drawing its triangles, with the whole thread
+// pool. The mesh is a rippled grid filling most of the frame, drawn straight in clip space, so most of its 15 million
+// edges are a pixel or two long. The time per frame includes shading the vertices, and the edge list is found once
+// beforehand as the app would
+static void RunWireframeBenchmark(int width, int height)
+{
+    const uint32_t kGridSize = 2238; // Vertices along each side, (kGridSize - 1)^2 * 2 triangles
+    const int kFrames = 3;
+    SoftScene scene;
+    scene.vertices.resize(static_cast<size_t>(kGridSize) * kGridSize);
+    for (uint32_t row = 0; row < kGridSize; ++row)
+    {
+        for (uint32_t column = 0; column < kGridSize; ++column)
+        {
+            float u = static_cast<float>(column) / (kGridSize - 1), v = static_cast<float>(row) / (kGridSize - 1);
+            SimpleVertex& vertex = scene.vertices[static_cast<size_t>(row) * kGridSize + column];
+            vertex.position = CVector3(u * 1.8f - 0.9f, v * 1.8f - 0.9f, 0.5f + 0.2f * std::sin(u * 40.0f) * std::sin(v * 30.0f));
+            vertex.colour   = ColourRGBA(u, v, 1.0f, 1.0f);
+        }
+    }
+    scene.indices.reserve(static_cast<size_t>(kGridSize - 1) * (kGridSize - 1) * 6);
+    for (uint32_t row = 0; row + 1 < kGridSize; ++row)
+    {
+        for (uint32_t column = 0; column + 1 < kGridSize; ++column)
+        {
+            MeshIndex corner = row * kGridSize + column;
+            const MeshIndex quad[] = { corner, corner + kGridSize, corner + 1,  corner + 1, corner + kGridSize, corner + kGridSize + 1 };
+            scene.indices.insert(scene.indices.end(), quad, quad + 6);
+        }
+    }
+    size_t numTriangles = scene.indices.size() / 3;
+    std::vector<MeshIndex> triangleIndices = scene.indices;
+
+    auto edgesStart = std::chrono::high_resolution_clock::now();
+    MakeWireframe(scene);
+    double edgesMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - edgesStart).count();
+
+    FrameBuffer frame;
+    frame.Init(width, height);
+    CMatrix4x4 identity = MatrixIdentity();
+    SoftwareRenderer renderer;
+    renderer.SetRenderTarget(&frame);
+    renderer.SetCullFace(CullFace::None);
+    renderer.SetFrameConstants(&identity.e00, &identity.e00);
+    renderer.SetModelConstants(&identity.e00);
+    VertexStream stream = MakeVertexStream<SimpleVertex>(kSimpleVertexElements, 0);
+    const void* vertexData = scene.vertices.data();
+    uint32_t stride = sizeof(SimpleVertex);
+    renderer.SetInputLayout(&stream, 1);
+    renderer.SetVertexBuffers(0, 1, &vertexData, &stride);
+
+    // Best of a few frames of the given list
+    auto time = [&](const std::vector<MeshIndex>& indices, RasterTopology topology)
+    {
+        const float clearColour[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        renderer.SetIndexBuffer(indices.data());
+        renderer.SetTopology(topology);
+        double best = 1e30;
+        for (int f = 0; f < kFrames; ++f)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            frame.ClearColour(clearColour);
+            frame.ClearDepth(1.0f);
+            renderer.DrawIndexed(static_cast<uint32_t>(indices.size()), 0, 0);
+            renderer.Flush();
+            best = (std::min)(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+        return best;
+    };
+    double wireframeMs = time(scene.indices, RasterTopology::LineList);
+    double solidMs     = time(triangleIndices, RasterTopology::TriangleList);
+    std::printf("Wireframe      %zu triangles, %zu edges (found in %.0f ms), %d threads, %s: wireframe %8.3f ms per frame, "
+                "triangles %8.3f ms\n",
+                numTriangles, scene.indices.size() / 2, edgesMs, GetThreadPool().GetNumThreads(),
+                CpuHasAvx2() ? "AVX2" : "scalar", wireframeMs, solidMs);
+}
+
+
+// Time the rasterizers specialised for the draw state against the general version that checks the state at every
+// pixel, drawing SimpleVertex triangles with the default depth state, with colour and depth only. The two are run in
+// turn several times: the best time of each is shown with the median and range of the speedup over the rounds, so a
+// difference can be told from noise. The pictures must be identical
+static void RunPipelineBenchmark(int width, int height)
+{
+    struct Test { const char* name; float size; int numTriangles; int repeats; };
+    const Test tests[] = { { "Small (6px)",    6.0f,   200000, 5 },
+                           { "Medium (32px)",  32.0f,  20000,  5 },
+                           { "Large (400px)",  400.0f, 200,    5 } };
+    const RasterPath paths[] = { RasterPath::Scalar, RasterPath::Avx2 };
+    const int kRounds = 9;
+    for (RasterPath path : paths)
+    {
+        if (path == RasterPath::Avx2 && !CpuHasAvx2())  continue;
+        for (int colour = 1; colour >= 0; --colour)
+        {
+            for (auto& test : tests)
+            {
+                FrameBuffer generalFrame, specialisedFrame;
+                generalFrame.Init(width, height);
+                specialisedFrame.Init(width, height);
+                double generalMs = 1e30, specialisedMs = 1e30;
+                std::vector<double> speedups;
+                for (int round = 0; round < kRounds; ++round)
+                {
+                    double general     = DrawRandomTriangles(generalFrame,     path, test.size, test.numTriangles,
+                                                             test.repeats, false, colour != 0);
+                    double specialised = DrawRandomTriangles(specialisedFrame, path, test.size, test.numTriangles,
+                                                             test.repeats, true,  colour != 0);
+                    generalMs     = (std::min)(generalMs, general);
+                    specialisedMs = (std::min)(specialisedMs, specialised);
+                    speedups.push_back(general / specialised);
+                }
+                std::sort(speedups.begin(), speedups.end());
+
+                size_t numPixels = static_cast<size_t>(width) * height;
+                bool same = std::memcmp(generalFrame.Colour(), specialisedFrame.Colour(), numPixels * sizeof(uint32_t)) == 0 &&
+                            std::memcmp(generalFrame.Depth(),  specialisedFrame.Depth(),  numPixels * sizeof(float)) == 0;
+                std::printf("%-6s %-6s %-14s %7d triangles: general %8.3f ms, specialised %8.3f ms, speedup %.2fx "
+                            "(%.2f-%.2fx over %d rounds), %s\n",
+                            path == RasterPath::Avx2 ? "AVX2" : "Scalar", colour ? "colour" : "depth", test.name,
+                            test.numTriangles, generalMs, specialisedMs, speedups[kRounds / 2], speedups.front(),
+                            speedups.back(), kRounds, same ? "pictures identical" : "PICTURES DIFFER");
+            }
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Occlusion culling benchmark
+//--------------------------------------------------------------------------------------
+
+// Cull random boxes behind a few large cubes using a quarter size occlusion buffer and time it. Then check the result by
+// drawing the occluders at full size and the boxes found hidden on top of them: any pixel a hidden box draws is a
+// mistake. Returns false if there are any
+static bool RunOcclusionBenchmark(int width, int height)
+{
+    const int numBoxes = 10000;
+    const int repeats = 100;
+
+    SoftScene cube;
+    BuildCube(cube);
+    std::vector<CMatrix4x4> occluders = { MatrixScaling(CVector3(6.0f, 4.0f, 0.5f)) * MatrixTranslation(CVector3(-5.0f, 0.0f, 15.0f)),
+                                          MatrixScaling(CVector3(3.0f, 6.0f, 0.5f)) * MatrixTranslation(CVector3( 6.0f, 2.0f, 12.0f)),
+                                          MatrixScaling(CVector3(1.0f, 1.0f, 1.0f)) * MatrixRotationY(0.6f) * MatrixTranslation(CVector3(0.0f, -1.0f, 3.0f)) };
+
+    // Small boxes spread through the view, mostly behind the occluders
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<CMatrix4x4>   boxMatrices;
+    std::vector<OcclusionBox> boxes;
+    const OcclusionBox cubeBox = { CVector3(-1.0f, -1.0f, -1.0f), CVector3(1.0f, 1.0f, 1.0f) };
+    for (int i = 0; i < numBoxes; ++i)
+    {
+        float z = 16.0f + unit(random) * 60.0f;
+        CVector3 position((unit(random) - 0.5f) * z * 1.6f, (unit(random) - 0.5f) * z * 1.2f, z);
+        boxMatrices.push_back(MatrixScaling(0.1f + unit(random) * 0.4f) * MatrixRotationY(unit(random) * 3.0f) * MatrixTranslation(position));
+        boxes.push_back(TransformBox(cubeBox, &boxMatrices.back().e00));
+    }
+
+    CMatrix4x4 viewMatrix = InverseAffine(MatrixTranslation(CVector3(0, 0, -5.0f)));
+    CMatrix4x4 projectionMatrix = MakeProjectionMatrix(static_cast<float>(width) / height);
+    CMatrix4x4 viewProjection = viewMatrix * projectionMatrix;
+
+    OcclusionBuffer occlusion;
+    occlusion.Init(width / 4, height / 4);
+    std::vector<uint8_t> visible(numBoxes);
+    OcclusionStats stats;
+    double occluderMs = 0.0, testMs = 0.0;
+    for (int r = 0; r < repeats; ++r)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        occlusion.BeginFrame(&viewProjection.e00);
+        for (auto& world : occluders)
+        {
+            occlusion.AddOccluder(PositionArray(cube.vertices.data(), cube.vertices.size()), cube.indices.data(), cube.indices.size(), &world.e00);
+        }
+        occlusion.EndOccluders();
+        auto middle = std::chrono::high_resolution_clock::now();
+        stats = OcclusionStats();
+        occlusion.TestBoxes(boxes.data(), boxes.size(), visible.data(), &stats);
+        auto end = std::chrono::high_resolution_clock::now();
+        occluderMs += std::chrono::duration<double, std::milli>(middle - start).count();
+        testMs     += std::chrono::duration<double, std::milli>(end - middle).count();
+    }
+    std::printf("%dx%d occlusion buffer, %zu occluder triangles: %.3f ms, %zu boxes tested: %.3f ms (%d threads)\n"
+                "%zu visible, %zu off screen, %zu occluded\n",
+                occlusion.LevelWidth(0), occlusion.LevelHeight(0), stats.numOccluderTriangles, occluderMs / repeats,
+                stats.numTested, testMs / repeats, GetThreadPool().GetNumThreads(), stats.numVisible, stats.numOffScreen,
+                stats.numOccluded);
+
+    // Occluders at full size, then the hidden boxes with depth testing but no depth writes
+    FrameBuffer frame;
+    frame.Init(width, height);
+    const float clearColour[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    frame.ClearColour(clearColour);
+    frame.ClearDepth(1.0f);
+    SoftwareRenderer renderer;
+    renderer.SetRenderTarget(&frame);
+    renderer.SetCullFace(CullFace::None);
+    renderer.SetFrameConstants(&viewMatrix.e00, &projectionMatrix.e00);
+    VertexStream stream = MakeVertexStream<SimpleVertex>(kSimpleVertexElements, 0);
+    const void* vertexData = cube.vertices.data();
+    uint32_t stride = sizeof(SimpleVertex);
+    renderer.SetInputLayout(&stream, 1);
+    renderer.SetVertexBuffers(0, 1, &vertexData, &stride);
+    renderer.SetIndexBuffer(cube.indices.data());
+    for (auto& world : occluders)
+    {
+        renderer.SetModelConstants(&world.e00);
+        renderer.DrawIndexed(static_cast<uint32_t>(cube.indices.size()), 0, 0);
+    }
+    renderer.Flush();
+    std::vector<uint32_t> occluderColours(frame.Colour(), frame.Colour() + static_cast<size_t>(width) * height);
+
+    renderer.SetDepthState(RasterDepthTest::Less, false);
+    for (int i = 0; i < numBoxes; ++i)
+    {
+        if (visible[i])  continue;
+        renderer.SetModelConstants(&boxMatrices[i].e00);
+        renderer.DrawIndexed(static_cast<uint32_t>(cube.indices.size()), 0, 0);
+    }
+    renderer.Flush();
+    size_t numWrong = 0;
+    for (size_t p = 0; p < occluderColours.size(); ++p)
+    {
+        if (frame.Colour()[p] != occluderColours[p])  ++numWrong;
+    }
+    std::printf("Pixels of culled boxes that should have been seen: %zu of %zu\n", numWrong, occluderColours.size());
+    return numWrong == 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Drawing
+//--------------------------------------------------------------------------------------
+
+const float kClearColour[4] = { 0.0f, 0.125f, 0.3f, 1.0f }; // As Scene.cpp
+
+// Give the renderer a frame buffer, a scene's vertex and index data and the camera of Scene.cpp
+static void SetUpRenderer(SoftwareRenderer& renderer, FrameBuffer& frame, const SoftScene& scene)
+{
+    CMatrix4x4 viewMatrix = InverseAffine(MatrixTranslation(CVector3(0, 0, -5.0f)));
+    CMatrix4x4 projectionMatrix = MakeProjectionMatrix(static_cast<float>(frame.Width()) / frame.Height());
+    renderer.SetRenderTarget(&frame);
+    renderer.SetFrameConstants(&viewMatrix.e00, &projectionMatrix.e00);
+    VertexStream stream = MakeVertexStream<SimpleVertex>(kSimpleVertexElements, 0);
+    const void* vertexData = scene.vertices.data();
+    uint32_t stride = sizeof(SimpleVertex);
+    renderer.SetInputLayout(&stream, 1);
+    renderer.SetVertexBuffers(0, 1, &vertexData, &stride);
+    renderer.SetIndexBuffer(scene.indices.data());
+    renderer.SetTopology(scene.topology);
+}
+
+// Clear the frame and draw every copy of a scene turned by a rotation matrix, as the cube matrix in Scene.cpp
+static void DrawScene(SoftwareRenderer& renderer, FrameBuffer& frame, const SoftScene& scene, const CMatrix4x4& rotation)
+{
+    frame.ClearColour(kClearColour);
+    frame.ClearDepth(1.0f);
+    for (auto& placement : scene.placements)
+    {
+        CMatrix4x4 world = rotation * placement;
+        renderer.SetModelConstants(&world.e00);
+        renderer.DrawIndexed(static_cast<uint32_t>(scene.indices.size()), 0, 0);
+    }
+    renderer.Flush();
+}
+
+// Save a frame's colour as name.ppm and depth as name.pfm
+static bool SaveFrame(const FrameBuffer& frame, const std::string& name)
+{
+    std::string error;
+    if (!SaveColourImage(name + ".ppm", frame.Colour(), frame.Width(), frame.Height(), error) ||
+        !SaveDepthImage(name + ".pfm", frame.Depth(), frame.Width(), frame.Height(), error))
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Hierarchical depth benchmark
+//--------------------------------------------------------------------------------------
+
+// Walls filling the view one behind another, each a square of 16x16 quads, drawn nearest first or farthest first
+static void BuildWalls(int numWalls, bool frontToBack, SoftScene& scene)
+{
+    const int kQuads = 16;
+    for (int row = 0; row <= kQuads; ++row)
+    {
+        for (int column = 0; column <= kQuads; ++column)
+        {
+            float u = static_cast<float>(column) / kQuads, v = static_cast<float>(row) / kQuads;
+            SimpleVertex vertex;
+            vertex.position = CVector3(u * 2.0f - 1.0f, 1.0f - v * 2.0f, 0.0f);
+            vertex.colour   = ColourRGBA(u, v, 1.0f - u * v, 1.0f);
+            scene.vertices.push_back(vertex);
+        }
+    }
+    for (int row = 0; row < kQuads; ++row)
+    {
+        for (int column = 0; column < kQuads; ++column)
+        {
+            MeshIndex a = row * (kQuads + 1) + column, b = a + 1, c = a + kQuads + 1, d = c + 1;
+            MeshIndex quad[] = { a, b, c,  b, d, c };
+            scene.indices.insert(scene.indices.end(), quad, quad + 6);
+        }
+    }
+    for (int wall = 0; wall < numWalls; ++wall)
+    {
+        int layer = frontToBack ? wall : numWalls - 1 - wall;
+        float z = 2.0f + layer * 0.5f;
+        scene.placements.push_back(MatrixScaling(z + 5.0f) * MatrixRotationY(0.1f * (layer % 3 - 1)) * MatrixTranslation(CVector3(0.0f, 0.0f, z)));
+    }
+}
+
+// Several cube grids one behind another, nearest first
+static void BuildCubeGridLayers(int numLayers, int gridSize, SoftScene& scene)
+{
+    for (int layer = 0; layer < numLayers; ++layer)
+    {
+        SoftScene grid;
+        BuildCubeGrid(gridSize, grid);
+        if (layer == 0)  scene = grid;
+        for (auto& placement : grid.placements)
+        {
+            if (layer > 0)  scene.placements.push_back(placement * MatrixTranslation(CVector3(0.3f * layer, 0.2f * layer, 4.0f * layer)));
+        }
+    }
+}
+
+// Draw scenes with many layers of hidden surfaces with the per-pixel depth test only and with the hierarchical depth
+// test, on one thread. The pictures must be identical
+static void RunDepthBenchmark(int width, int height, bool scalar)
+{
+    struct Test { const char* name; SoftScene scene; };
+    Test tests[3] = { { "Walls, front to back", {} }, { "Walls, back to front", {} }, { "Cube grids, 8 deep", {} } };
+    BuildWalls(16, true,  tests[0].scene);
+    BuildWalls(16, false, tests[1].scene);
+    BuildCubeGridLayers(8, 48, tests[2].scene);
+
+    const int repeats = 5;
+    for (auto& test : tests)
+    {
+        FrameBuffer frames[2];
+        SoftwareRenderer renderers[2];
+        double bestMs[2] = { 1e30, 1e30 };
+        for (int i = 0; i < 2; ++i)
+        {
+            frames[i].Init(width, height);
+            SetUpRenderer(renderers[i], frames[i], test.scene);
+            renderers[i].SetMultithreaded(false);
+            renderers[i].SetRasterPath(scalar ? RasterPath::Scalar : RasterPath::Auto);
+            renderers[i].SetHierarchicalDepth(i == 1);
+        }
+
+        // Alternate the two and keep the best time of each, so other work on the machine affects both alike
+        for (int round = 0; round < repeats; ++round)
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                renderers[i].ResetDepthStats();
+                auto start = std::chrono::high_resolution_clock::now();
+                DrawScene(renderers[i], frames[i], test.scene, MatrixIdentity());
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+                bestMs[i] = (std::min)(bestMs[i], ms);
+            }
+        }
+
+        size_t numPixels = static_cast<size_t>(width) * height;
+        bool same = std::memcmp(frames[0].Colour(), frames[1].Colour(), numPixels * sizeof(uint32_t)) == 0 &&
+                    std::memcmp(frames[0].Depth(),  frames[1].Depth(),  numPixels * sizeof(float)) == 0;
+        const RasterDepthStats& stats = renderers[1].DepthStats();
+        std::printf("%-22s %7zu triangles: flat %8.3f ms, hierarchical %8.3f ms (%.2fx), %.1f%% of %llu tile triangles "
+                    "rejected, %llu blocks skipped, %llu drawn without reading depth, %s\n",
+                    test.name, test.scene.indices.size() / 3 * test.scene.placements.size(), bestMs[0], bestMs[1],
+                    bestMs[0] / bestMs[1], 100.0f * stats.RejectionRate(), static_cast<unsigned long long>(stats.numTested),
+                    static_cast<unsigned long long>(stats.numBlocksSkipped),
+                    static_cast<unsigned long long>(stats.numBlocksAccepted), same ? "pictures identical" : "PICTURES DIFFER");
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Golden image regression check
+//--------------------------------------------------------------------------------------
+
+// Draw each reference scene, compare it with its saved images (or save it as them with update) and time it. Returns
+// false if any scene differs or has no images, or an image cannot be read or written
+static bool RunGoldenImages(const std::string& directory, int width, int height, int numFrames, CullFace cull,
+                            bool serial, bool scalar, int tolerance, bool update)
+{
+    const float kDepthTolerance = 1e-5f;
+    struct GoldenScene { const char* name; float rotationX, rotationY, distance; int gridSize; bool wireframe; };
+    const GoldenScene goldenScenes[] =
+    {
+        { "cube_front",   0.0f,  0.0f,  0.0f, 0, false },
+        { "cube_30_45",   30.0f, 45.0f, 0.0f, 0, false },
+        { "cube_-60_120", -60.0f, 120.0f, 0.0f, 0, false },
+        { "cube_near",    20.0f, 35.0f, -3.3f, 0, false }, // Corners behind the camera, clipped by the near plane
+        { "cube_grid",    10.0f, 20.0f, 0.0f, 32, false },
+        { "wire_30_45",   30.0f, 45.0f, 0.0f, 0, true },
+        { "wire_near",    20.0f, 35.0f, -3.3f, 0, true },
+        { "wire_grid",    10.0f, 20.0f, 0.0f, 32, true },
+    };
+
+    bool allPassed = true;
+    for (auto& golden : goldenScenes)
+    {
+        SoftScene scene;
+        if (golden.gridSize > 0)  BuildCubeGrid(golden.gridSize, scene);
+        else                      BuildCube(scene);
+        if (golden.wireframe)  MakeWireframe(scene);
+
+        FrameBuffer frame;
+        frame.Init(width, height);
+        SoftwareRenderer renderer;
+        SetUpRenderer(renderer, frame, scene);
+        renderer.SetCullFace(cull);
+        renderer.SetMultithreaded(!serial);
+        renderer.SetRasterPath(scalar ? RasterPath::Scalar : RasterPath::Auto);
+        CMatrix4x4 rotation = MatrixRotationX(ToRadians(golden.rotationX)) * MatrixRotationY(ToRadians(golden.rotationY)) *
+                              MatrixTranslation(CVector3(0.0f, 0.0f, golden.distance));
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int f = 0; f < numFrames; ++f)  DrawScene(renderer, frame, scene, rotation);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::string path = directory + "/" + golden.name;
+        if (update)
+        {
+            if (!SaveFrame(frame, path))  return false;
+            std::printf("%-14s %8.3f ms per frame  SAVED %s.ppm/.pfm\n", golden.name, ms / numFrames, path.c_str());
+            continue;
+        }
+
+        std::vector<uint32_t> goldenColours;
+        std::vector<float>    goldenDepths;
+        int goldenWidth = 0, goldenHeight = 0, depthWidth = 0, depthHeight = 0;
+        std::string error;
+        if (!LoadColourImage(path + ".ppm", goldenColours, goldenWidth, goldenHeight, error) ||
+            !LoadDepthImage(path + ".pfm", goldenDepths, depthWidth, depthHeight, error))
+        {
+            // A missing reference is a failure, not a new one: otherwise a wrong directory would pass every scene
+            std::printf("%-14s FAIL  %s (use --update-golden to save the current picture as the reference)\n",
+                        golden.name, error.c_str());
+            allPassed = false;
+            continue;
+        }
+        if (goldenWidth != width || goldenHeight != height || depthWidth != width || depthHeight != height)
+        {
+            std::printf("%-14s FAIL  reference is %dx%d, drawn at %dx%d\n", golden.name, goldenWidth, goldenHeight, width, height);
+            allPassed = false;
+            continue;
+        }
+
+        size_t numPixels = static_cast<size_t>(width) * height;
+        ImageDifference colourDifference = CompareColours(frame.Colour(), goldenColours.data(), numPixels, tolerance);
+        ImageDifference depthDifference  = CompareDepths(frame.Depth(), goldenDepths.data(), numPixels, kDepthTolerance);
+        bool passed = colourDifference.numDifferent == 0 && depthDifference.numDifferent == 0;
+        std::printf("%-14s %8.3f ms per frame  %s  %zu colour and %zu depth differences (largest %d and %g)\n",
+                    golden.name, ms / numFrames, passed ? "PASS" : "FAIL", colourDifference.numDifferent,
+                    depthDifference.numDifferent, colourDifference.maxColourDifference, depthDifference.maxDepthDifference);
+        if (!passed)
+        {
+            SaveFrame(frame, path + ".actual");
+            allPassed = false;
+        }
+    }
+    return allPassed;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    int width = 1280, height = 960, numFrames = 100, gridSize = 32;
+    bool sizeGiven = false;
+    CullFace cull = CullFace::None;
+    bool serial = false, scalar = false, benchmark = false, pipelines = false, occlusion = false, wireframe = false;
+    bool depthBenchmark = false, flatDepth = false, updateGolden = false, replaceShared = false;
+    int tolerance = 1;
+    VertexCacheType cacheType = VertexCacheType::Fifo;
+    int cacheSize = 0;
+    std::string fileName, saveName, goldenDirectory, videoName, statsName, sharedName;
+    VideoFormat videoFormat = VideoFormat::Y4m;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if      (arg == "--size" && hasValue)
+        {
+            if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2)  width = 0;
+            sizeGiven = true;
+        }
+        else if (arg == "--frames" && hasValue)  numFrames = std::atoi(argv[++i]);
+        else if (arg == "--grid" && hasValue)    gridSize = std::atoi(argv[++i]);
+        else if (arg == "--cull" && hasValue)
+        {
+            std::string value = argv[++i];
+            cull = value == "back" ? CullFace::Back : value == "front" ? CullFace::Front : CullFace::None;
+        }
+        else if (arg == "--serial")              serial = true;
+        else if (arg == "--wireframe")           wireframe = true;
+        else if (arg == "--scalar")              scalar = true;
+        else if (arg == "--benchmark")           benchmark = true;
+        else if (arg == "--pipelines")           pipelines = true;
+        else if (arg == "--occlusion")           occlusion = true;
+        else if (arg == "--hierarchical-depth")  depthBenchmark = true;
+        else if (arg == "--flat-depth")          flatDepth = true;
+        else if (arg == "--save" && hasValue)    saveName = argv[++i];
+        else if (arg == "--golden" && hasValue)  goldenDirectory = argv[++i];
+        else if (arg == "--update-golden")       updateGolden = true;
+        else if (arg == "--tolerance" && hasValue)  tolerance = std::atoi(argv[++i]);
+        else if (arg == "--vertex-cache" && hasValue)
+        {
+            std::string value = argv[++i];
+            bool lru = value.compare(0, 3, "lru") == 0;
+            if (!lru && value.compare(0, 4, "fifo") != 0)  value = "fifo0";
+            cacheType = lru ? VertexCacheType::Lru : VertexCacheType::Fifo;
+            cacheSize = std::atoi(value.c_str() + (lru ? 3 : 4));
+            if (cacheSize <= 0)  width = 0; // Show usage
+        }
+        else if (arg == "--video" && hasValue)   videoName = argv[++i];
+        else if (arg == "--stats" && hasValue)   statsName = argv[++i];
+        else if (arg == "--shared" && hasValue)  sharedName = argv[++i];
+        else if (arg == "--shared-replace")      replaceShared = true;
+        else if (arg == "--video-format" && hasValue)
+        {
+            std::string value = argv[++i];
+            videoFormat = value == "rgba" ? VideoFormat::RawRgba : VideoFormat::Y4m;
+            if (value != "rgba" && value != "y4m")  width = 0; // Show usage
+        }
+        else if (arg.compare(0, 2, "--") != 0)   fileName = arg;
+        else
+        {
+            std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return 2;
+        }
+    }
+    if (width <= 0 || height <= 0 || numFrames <= 0 || gridSize <= 0 || (updateGolden && goldenDirectory.empty()) ||
+        (replaceShared && sharedName.empty()))
+    {
+        std::fprintf(stderr, "Usage: SoftRender [--size WxH] [--frames N] [--grid N] [--cull none|back|front] [--serial] [--scalar] [--benchmark] [--pipelines] [--occlusion] [--hierarchical-depth] [--flat-depth] [--save NAME] [--golden DIR] [--update-golden] [--tolerance N] [--wireframe] [--vertex-cache fifo16|fifo32|lru16|lru32] [--video FILE] [--video-format y4m|rgba] [--stats FILE] [--shared NAME] [--shared-replace] [file.obj]\n");
+        return 2;
+    }
+    if (benchmark)
+    {
+        RunRasterBenchmark(width, height);
+        RunWireframeBenchmark(width, height);
+        return 0;
+    }
+    if (pipelines)
+    {
+        RunPipelineBenchmark(width, height);
+        return 0;
+    }
+    if (occlusion)
+    {
+        return RunOcclusionBenchmark(width, height) ? 0 : 1;
+    }
+    if (depthBenchmark)
+    {
+        RunDepthBenchmark(width, height, scalar);
+        return 0;
+    }
+    if (!goldenDirectory.empty())
+    {
+        // Fewer frames by default, there are several scenes. The references in Tools/Golden are small to keep them cheap
+        // to store
+        if (!sizeGiven)
+        {
+            width  = 320;
+            height = 240;
+        }
+        bool passed = RunGoldenImages(goldenDirectory, width, height, (std::min)(numFrames, 10), cull, serial, scalar,
+                                      tolerance, updateGolden);
+        return passed ? 0 : 1;
+    }
+
+    SoftScene scene;
+    if (fileName.empty())  BuildCubeGrid(gridSize, scene);
+    else if (!BuildFileScene(fileName, scene))  return 2;
+    if (wireframe)  MakeWireframe(scene);
+
+    FrameBuffer frame;
+    frame.Init(width, height);
+    SoftwareRenderer renderer;
+    SetUpRenderer(renderer, frame, scene);
+    renderer.SetCullFace(cull);
+    renderer.SetMultithreaded(!serial);
+    renderer.SetRasterPath(scalar ? RasterPath::Scalar : RasterPath::Auto);
+    renderer.SetVertexCache(cacheType, cacheSize);
+    renderer.SetHierarchicalDepth(!flatDepth);
+
+    VideoCapture video;
+    if (!videoName.empty())
+    {
+        std::string error;
+        if (!video.Open(videoName, width, height, 60, videoFormat, 4, CaptureOverflow::Wait, error))
+        {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 2;
+        }
+    }
+
+    SharedFrameWriter shared;
+    if (!sharedName.empty())
+    {
+        std::string error;
+        if (!shared.Create(sharedName, width, height, 4, replaceShared, error))
+        {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            if (!replaceShared)  std::fprintf(stderr, "If no other run is using it, remove it with --shared-replace\n");
+            return 2;
+        }
+    }
+
+    FILE* statsFile = nullptr;
+    if (!statsName.empty())
+    {
+        statsFile = statsName == "-" ? stdout : std::fopen(statsName.c_str(), "w");
+        if (statsFile == nullptr)
+        {
+            std::fprintf(stderr, "Cannot open %s\n", statsName.c_str());
+            return 2;
+        }
+        std::fputs(PipelineStatsCsvHeader().c_str(), statsFile);
+    }
+
+    size_t numPixels = static_cast<size_t>(width) * height;
+    RasterPipelineStats pipelineStats; // Total for all frames
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int f = 0; f < numFrames; ++f)
+    {
+        renderer.ResetPipelineStats();
+        DrawScene(renderer, frame, scene, MatrixRotationX(0.01f * f) * MatrixRotationY(0.02f * f));
+        if (video.IsOpen())  video.AddFrame(frame.Colour());
+        if (shared.IsOpen())  shared.Publish(frame.Colour());
+        pipelineStats += renderer.PipelineStats();
+        if (statsFile != nullptr)
+        {
+            std::fputs(PipelineStatsCsvRow(f, "software", renderer.PipelineStats(), numPixels).c_str(), statsFile);
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    if (!saveName.empty() && !SaveFrame(frame, saveName))  return 2;
+    if (statsFile != nullptr && statsFile != stdout)  std::fclose(statsFile);
+    shared.Close();
+
+    // Finish writing before printing, as the writer may still be a few frames behind
+    std::string videoError;
+    bool videoWritten = video.Close(videoError);
+    VideoCaptureStats videoStats = video.Stats();
+    if (!videoWritten)
+    {
+        std::fprintf(stderr, "%s: %s\n", videoName.c_str(), videoError.c_str());
+        return 2;
+    }
+
+    // Pixels that are not the clear colour, and an FNV-1a hash of the colour buffer
+    uint32_t background = PackColour(kClearColour[0], kClearColour[1], kClearColour[2], kClearColour[3]);
+    size_t numDrawn = 0;
+    uint64_t checksum = 14695981039346656037ull;
+    for (size_t p = 0; p < numPixels; ++p)
+    {
+        uint32_t colour = frame.Colour()[p];
+        if (colour != background)  ++numDrawn;
+        checksum = (checksum ^ colour) * 1099511628211ull;
+    }
+
+    bool lines = scene.topology == RasterTopology::LineList;
+    std::printf("%dx%d, %zu %s x %zu copies, %d threads: %.3f ms per frame, %zu pixels drawn (%.1f%%), checksum %016llx\n",
+                width, height, scene.indices.size() / (lines ? 2 : 3), lines ? "lines" : "triangles", scene.placements.size(),
+                serial ? 1 : GetThreadPool().GetNumThreads(), ms / numFrames, numDrawn,
+                100.0 * numDrawn / numPixels, static_cast<unsigned long long>(checksum));
+
+    // The cache is empty at the start of each draw, so every copy shades the same vertices as one replay of the indices
+    const RasterVertexStats& vertexStats = renderer.VertexStats();
+    uint64_t numDraws = static_cast<uint64_t>(numFrames) * scene.placements.size();
+    std::string cacheName = cacheSize == 0 ? "no cache model" :
+                            (cacheType == VertexCacheType::Lru ? "LRU " : "FIFO ") + std::to_string(cacheSize);
+    std::printf("Vertices (%s): %llu indices, %llu shaded per mesh drawn (hit rate %.1f%%), shading %.3f ms per frame",
+                cacheName.c_str(), static_cast<unsigned long long>(vertexStats.numIndices / numDraws),
+                static_cast<unsigned long long>(vertexStats.numShadedVertices / numDraws), 100.0f * vertexStats.HitRate(),
+                vertexStats.shadeMilliseconds / numFrames);
+    if (cacheSize > 0 && !lines)
+    {
+        VertexCacheStats simulated = SimulateVertexCache(scene.indices.data(), scene.indices.size(), scene.vertices.size(),
+                                                         cacheType, cacheSize);
+        bool matches = simulated.numTransforms * numDraws == vertexStats.numShadedVertices;
+        std::printf(", %s SimulateVertexCache (%llu)", matches ? "matches" : "DIFFERS FROM",
+                    static_cast<unsigned long long>(simulated.numTransforms));
+        if (!matches)
+        {
+            std::printf("\n");
+            return 1;
+        }
+    }
+    std::printf("\n");
+
+    const RasterDepthStats& depthStats = renderer.DepthStats();
+    if (flatDepth)  std::printf("Hierarchical depth test off\n");
+    else
+    {
+        std::printf("Hierarchical depth: %.1f%% of triangles rejected in the tiles they touch, %.0f blocks skipped and "
+                    "%.0f drawn without reading depth per frame\n", 100.0f * depthStats.RejectionRate(),
+                    static_cast<double>(depthStats.numBlocksSkipped) / numFrames,
+                    static_cast<double>(depthStats.numBlocksAccepted) / numFrames);
+    }
+
+    // Per frame, so it can be compared between runs of different lengths
+    const double perFrame = 1.0 / numFrames;
+    std::printf("Stages per frame: %.0f %s (%.0f outside the view, %.0f clipped, %.0f culled, %.0f empty), %.0f set up, "
+                "%.0f binned, %.0f pixels tested, %.0f written to %.0f pixels (overdraw %.2f, fill ratio %.2f); "
+                "shade %.3f ms, setup %.3f ms, bin %.3f ms, raster %.3f ms\n",
+                pipelineStats.numPrimitives * perFrame, lines ? "lines" : "triangles",
+                pipelineStats.numOutsideView * perFrame, pipelineStats.numClipped * perFrame,
+                pipelineStats.numCulled * perFrame, pipelineStats.numEmpty * perFrame, pipelineStats.numSetUp * perFrame,
+                pipelineStats.numBinned * perFrame, pipelineStats.numPixelsTested * perFrame,
+                pipelineStats.numPixelsWritten * perFrame, pipelineStats.numPixelsCovered * perFrame,
+                pipelineStats.Overdraw(), pipelineStats.FillRatio(numPixels) * perFrame,
+                pipelineStats.shadeMilliseconds * perFrame, pipelineStats.setupMilliseconds * perFrame,
+                pipelineStats.binMilliseconds * perFrame, pipelineStats.rasterMilliseconds * perFrame);
+
+    if (!videoName.empty())
+    {
+        std::printf("Video: %llu frames, %.3f ms per frame queueing (up to %zu waiting), %.3f ms per frame writing on "
+                    "its own thread\n", static_cast<unsigned long long>(videoStats.numWritten),
+                    videoStats.addMilliseconds / numFrames, videoStats.maxQueued, videoStats.writeMilliseconds / numFrames);
+    }
+    if (!sharedName.empty())
+    {
+        std::printf("Shared memory %s: %llu frames published, %.3f ms per frame copying\n", sharedName.c_str(),
+                    static_cast<unsigned long long>(shared.Stats().numPublished), shared.Stats().copyMilliseconds / numFrames);
+    }
+    return 0;
+}
@@ -30,6 +30,7 @@ cbuffer PerFrameConstants : register(b0) // The register part ensures that this
 cbuffer PerModelConstants : register(b1) // The register part ensures that this constant buffer is numbered 1 - needed for C++ code
 {
     float4x4 gWorldMatrix;
+    float4   gTint; // Multiplies the vertex colour, white for no change
 }
 
 
@@ -52,8 +53,8 @@ PixelShaderInput main(SimpleVertex modelVertex)
     float4 viewPos           = mul(gViewMatrix,       worldPos);
     output.projectedPosition = mul(gProjectionMatrix, viewPos);
 
-    // Also get the colour from the mesh vertex
-    output.colour = modelVertex.colour;
+    // Also get the colour from the mesh vertex, tinted as the instanced shader does
+    output.colour = modelVertex.colour * gTint;
 
     return output; // Ouput data sent down the pipeline (to the pixel shader)
 }
@@ -0,0 +1,44 @@
+//--------------------------------------------------------------------------------------
+// Instanced Transformation and Colour Vertex Shader
+//--------------------------------------------------------------------------------------
+// Shaders - we won't look at shaders until later in the module, but they are needed to render anything
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Constant Buffers
+//--------------------------------------------------------------------------------------
+
+// The camera matrices, as in TransformColour_vs.hlsl. There is no per-model constant buffer - each copy of the mesh
+// gets its world matrix from the per-instance vertex data instead
+// These variables must match exactly the gPerFrameConstants structure in Scene.cpp
+cbuffer PerFrameConstants : register(b0) // The register part ensures that this constant buffer is numbered 0 - needed for C++ code
+{
+    float4x4 gViewMatrix;
+    float4x4 gProjectionMatrix;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Same as TransformColour_vs, but the world matrix and a tint colour come with the vertex. The GPU runs this shader
+// for every vertex of every instance, reading the next InstanceData each time it starts a new copy of the mesh
+PixelShaderInput main(InstancedVertex modelVertex)
+{
+    PixelShaderInput output;
+
+    float4 modelPosition = float4(modelVertex.position, 1);
+
+    // The rows are those of the C++ matrix, which is built for multiplying a row vector on the left
+    float4x4 worldMatrix = float4x4(modelVertex.worldRow0, modelVertex.worldRow1, modelVertex.worldRow2, modelVertex.worldRow3);
+    float4 worldPos          = mul(modelPosition, worldMatrix);
+    float4 viewPos           = mul(gViewMatrix,       worldPos);
+    output.projectedPosition = mul(gProjectionMatrix, viewPos);
+
+    output.colour = modelVertex.colour * modelVertex.tint;
+
+    return output;
+}
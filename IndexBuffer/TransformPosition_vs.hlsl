@@ -0,0 +1,58 @@
+//--------------------------------------------------------------------------------------
+// Transformation Only Vertex Shader for the Depth-Only Pass
+//--------------------------------------------------------------------------------------
+// Shaders - we won't look at shaders until later in the module, but they are needed to render anything
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Constant Buffers
+//--------------------------------------------------------------------------------------
+
+// These structures are "constant buffers" - a way of passing variables over from C++ to the GPU
+// They are called constants but that only means they are constant for the duration of a single GPU draw call.
+// These "constants" correspond to variables in C++ that we will change per-model, or per-frame etc.
+
+// In this exercise the matrices used to position the camera are updated from C++ to GPU every frame
+// These variables must match exactly the gPerFrameConstants structure in Scene.cpp
+cbuffer PerFrameConstants : register(b0) // The register part ensures that this constant buffer is numbered 0 - needed for C++ code
+{
+    float4x4 gViewMatrix;
+    float4x4 gProjectionMatrix;
+}
+// Note we don't need the name of the constant buffer to access the variables inside, so we can just write gViewMatrix for example
+
+
+// In this exercise the matrices used to position the model are updated from C++ to GPU multiple times per frame,
+// Because this data is updated more frequently it is kept in a different buffer (better performance).
+// These variables must match exactly the gPerModelConstants structure in Scene.cpp
+cbuffer PerModelConstants : register(b1) // The register part ensures that this constant buffer is numbered 1 - needed for C++ code
+{
+    float4x4 gWorldMatrix;
+    float4   gTint; // Multiplies the vertex colour, white for no change
+}
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Same transformation as TransformColour_vs, but the vertex only has a position. Used for the
+// depth-only pass, which fills the depth buffer before the colour pass. No pixel shader is used
+// in that pass so there is nothing else to output.
+// Keep the constant buffers above in step with TransformColour_vs.hlsl
+PixelShaderInput main(PositionOnlyVertex modelVertex)
+{
+    PixelShaderInput output;
+
+    float4 modelPosition = float4(modelVertex.position, 1);
+
+    float4 worldPos          = mul(gWorldMatrix,      modelPosition);
+    float4 viewPos           = mul(gViewMatrix,       worldPos);
+    output.projectedPosition = mul(gProjectionMatrix, viewPos);
+
+    output.colour = float4(0, 0, 0, 1); // Unused, there is no pixel shader in the depth-only pass
+
+    return output;
+}
@@ -42,8 +42,50 @@ public:
 	{
 	    return x*v.x + y*v.y + z*v.z;
 	}
+
+	// Add / scale this vector in place
+	CVector3& operator+=( const CVector3& v )
+	{
+		x += v.x;
+		y += v.y;
+		z += v.z;
+		return *this;
+	}
+	CVector3& operator*=( const float s )
+	{
+		x *= s;
+		y *= s;
+		z *= s;
+		return *this;
+	}
 };
-	
+
+
+/*-----------------------------------------------------------------------------------------
+    Operators
+-----------------------------------------------------------------------------------------*/
+
+inline CVector3 operator+( const CVector3& v, const CVector3& w )
+{
+	return CVector3( v.x + w.x, v.y + w.y, v.z + w.z );
+}
+
+inline CVector3 operator-( const CVector3& v, const CVector3& w )
+{
+	return CVector3( v.x - w.x, v.y - w.y, v.z - w.z );
+}
+
+inline CVector3 operator*( const CVector3& v, const float s )
+{
+	return CVector3( v.x * s, v.y * s, v.z * s );
+}
+
+inline CVector3 operator*( const float s, const CVector3& v )
+{
+	return CVector3( v.x * s, v.y * s, v.z * s );
+}
+
+
 // Subtracting of two given vectors (order is important - non-member version)
 inline CVector3 Subtract( const CVector3& v,  const CVector3& w  )
 {
@@ -78,8 +120,14 @@ inline float InvSqrt( const float x )
 	return 1.0f / std::sqrt( x );
 }
 
+// Length of a vector
+inline float Length( const CVector3& v )
+{
+	return std::sqrt( v.x*v.x + v.y*v.y + v.z*v.z );
+}
+
 // Return unit length vector in the same direction as given one
-CVector3 Normalise( const CVector3& v )
+inline CVector3 Normalise( const CVector3& v )
 {
 	float lengthSq = v.x*v.x + v.y*v.y + v.z*v.z;
 
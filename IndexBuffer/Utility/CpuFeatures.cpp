@@ -0,0 +1,72 @@
+//--------------------------------------------------------------------------------------
+// Detection of optional CPU instruction sets
+//--------------------------------------------------------------------------------------
+
+#include "CpuFeatures.h"
+
+#ifdef CPU_FEATURES_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+
+#ifdef CPU_FEATURES_X86
+
+// Read the processor's feature flags for the given leaf. Registers are returned as eax, ebx, ecx, edx
+static void CpuId(int leaf, int subLeaf, unsigned int registers[4])
+{
+#ifdef _MSC_VER
+    int values[4];
+    __cpuidex(values, leaf, subLeaf);
+    for (int i = 0; i < 4; ++i)  registers[i] = static_cast<unsigned int>(values[i]);
+#else
+    __cpuid_count(leaf, subLeaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// Registers the operating system saves on a thread switch. AVX registers are only usable if it saves them
+static unsigned long long ReadXcr0()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int low, high;
+    __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    return (static_cast<unsigned long long>(high) << 32) | low;
+#endif
+}
+
+static bool DetectAvx2()
+{
+    unsigned int registers[4];
+    CpuId(0, 0, registers);
+    if (registers[0] < 7)  return false;
+
+    CpuId(1, 0, registers);
+    bool hasFma     = (registers[2] & (1u << 12)) != 0;
+    bool hasOsxsave = (registers[2] & (1u << 27)) != 0;
+    bool hasAvx     = (registers[2] & (1u << 28)) != 0;
+    if (!hasFma || !hasOsxsave || !hasAvx)  return false;
+    if ((ReadXcr0() & 0x6) != 0x6)  return false; // SSE and AVX register state
+
+    CpuId(7, 0, registers);
+    return (registers[1] & (1u << 5)) != 0;
+}
+
+bool CpuHasAvx2()
+{
+    static const bool hasAvx2 = DetectAvx2();
+    return hasAvx2;
+}
+
+#else
+
+bool CpuHasAvx2()
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,28 @@
+//--------------------------------------------------------------------------------------
+// Detection of optional CPU instruction sets
+//--------------------------------------------------------------------------------------
+// x64 processors all support SSE2, so code can use it freely. Newer instruction sets such as
+// AVX2 (8-wide float and integer operations, plus FMA - fused multiply-add) are not on every
+// machine the program might run on. Code using them is compiled alongside a fallback, and the
+// faster version is chosen at run time with these functions.
+//
+// To compile AVX2 code without building the whole program for AVX2, put AVX2_FUNCTION before
+// the function. Visual Studio allows AVX2 intrinsics anywhere, GCC and Clang need the attribute.
+
+#ifndef _CPU_FEATURES_H_INCLUDED_
+#define _CPU_FEATURES_H_INCLUDED_
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_FEATURES_X86
+#endif
+
+#if defined(CPU_FEATURES_X86) && (defined(__GNUC__) || defined(__clang__))
+#define AVX2_FUNCTION __attribute__((target("avx2,fma")))
+#else
+#define AVX2_FUNCTION
+#endif
+
+// True if the processor and operating system support AVX2 and FMA instructions. Always false on non-x86 processors
+bool CpuHasAvx2();
+
+#endif //_CPU_FEATURES_H_INCLUDED_
@@ -0,0 +1,121 @@
+//--------------------------------------------------------------------------------------
+// Parallel radix sort for integer keys, optionally carrying a 32-bit value with each key
+//--------------------------------------------------------------------------------------
+// Least-significant digit first, 11 bits per pass. Each pass:
+// - Splits the data into one chunk per task and counts how many keys of each digit are in each chunk
+// - Works out from the counts where each chunk writes each digit (digit order, then chunk order)
+// - Copies every key to its place in the temporary array, then the arrays swap roles
+// Chunks are contiguous and processed in order within each digit, so the sort is stable.
+
+#include "RadixSort.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+const int    kDigitBits = 11;
+const int    kNumDigits = 1 << kDigitBits;
+const size_t kMinItemsPerChunk = 65536;
+
+
+template <class Key>
+static void RadixSortImpl(Key* keys, uint32_t* values, size_t count, int keyBits)
+{
+    if (count < 2 || keyBits <= 0)  return;
+    if (keyBits > static_cast<int>(sizeof(Key) * 8))  keyBits = static_cast<int>(sizeof(Key) * 8);
+
+    ThreadPool& pool = GetThreadPool();
+    size_t numChunksWanted = count / kMinItemsPerChunk;
+    size_t maxChunks = static_cast<size_t>(pool.GetNumThreads());
+    int numChunks = static_cast<int>(numChunksWanted < maxChunks ? numChunksWanted : maxChunks);
+    if (numChunks < 1)  numChunks = 1;
+
+    std::vector<Key>      tempKeys(count);
+    std::vector<uint32_t> tempValues(values != nullptr ? count : 0);
+    std::vector<size_t>   counts(static_cast<size_t>(numChunks) * kNumDigits);
+
+    Key*      srcKeys   = keys;
+    Key*      dstKeys   = tempKeys.data();
+    uint32_t* srcValues = values;
+    uint32_t* dstValues = tempValues.data();
+
+    for (int shift = 0; shift < keyBits; shift += kDigitBits)
+    {
+        // Count digits in each chunk
+        std::fill(counts.begin(), counts.end(), size_t(0));
+        pool.Run(numChunks, [&](int chunk, int)
+        {
+            size_t* chunkCounts = &counts[static_cast<size_t>(chunk) * kNumDigits];
+            size_t begin = count *  chunk      / numChunks;
+            size_t end   = count * (chunk + 1) / numChunks;
+            for (size_t i = begin; i < end; ++i)
+            {
+                ++chunkCounts[(srcKeys[i] >> shift) & (kNumDigits - 1)];
+            }
+        });
+
+        // Convert counts to write positions. If every key has the same digit the pass would not move anything
+        size_t total = 0;
+        bool allSameDigit = false;
+        for (int digit = 0; digit < kNumDigits; ++digit)
+        {
+            size_t digitStart = total;
+            for (int chunk = 0; chunk < numChunks; ++chunk)
+            {
+                size_t& c = counts[static_cast<size_t>(chunk) * kNumDigits + digit];
+                size_t start = total;
+                total += c;
+                c = start;
+            }
+            if (total - digitStart == count)  allSameDigit = true;
+        }
+        if (allSameDigit)  continue;
+
+        // Scatter to the other array
+        pool.Run(numChunks, [&](int chunk, int)
+        {
+            size_t* writePos = &counts[static_cast<size_t>(chunk) * kNumDigits];
+            size_t begin = count *  chunk      / numChunks;
+            size_t end   = count * (chunk + 1) / numChunks;
+            if (srcValues != nullptr)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    size_t pos = writePos[(srcKeys[i] >> shift) & (kNumDigits - 1)]++;
+                    dstKeys[pos]   = srcKeys[i];
+                    dstValues[pos] = srcValues[i];
+                }
+            }
+            else
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    dstKeys[writePos[(srcKeys[i] >> shift) & (kNumDigits - 1)]++] = srcKeys[i];
+                }
+            }
+        });
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+
+    // Odd number of passes leaves the result in the temporary arrays
+    if (srcKeys != keys)
+    {
+        ParallelFor(count, kMinItemsPerChunk, [&](size_t begin, size_t end, int)
+        {
+            std::memcpy(keys + begin, srcKeys + begin, (end - begin) * sizeof(Key));
+            if (values != nullptr)  std::memcpy(values + begin, srcValues + begin, (end - begin) * sizeof(uint32_t));
+        });
+    }
+}
+
+
+void RadixSort(uint32_t* keys, uint32_t* values, size_t count, int keyBits)
+{
+    RadixSortImpl(keys, values, count, keyBits);
+}
+
+void RadixSort(uint64_t* keys, uint32_t* values, size_t count, int keyBits)
+{
+    RadixSortImpl(keys, values, count, keyBits);
+}
@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// Parallel radix sort for integer keys, optionally carrying a 32-bit value with each key
+//--------------------------------------------------------------------------------------
+// Sorting integers by their digits takes linear time, unlike comparison sorts such as
+// std::sort, and each pass splits easily across threads. Used to group mesh data (edges,
+// vertex corners, spatial codes) for large meshes.
+
+#ifndef _RADIX_SORT_H_INCLUDED_
+#define _RADIX_SORT_H_INCLUDED_
+
+#include <cstdint>
+#include <cstddef>
+
+// Sort count keys into ascending order. If values is not nullptr, each value is moved along with its key. The sort
+// is stable - equal keys keep their original order. keyBits is the number of low bits of the keys that can be
+// non-zero, passing a smaller number when possible saves passes over the data.
+// Uses the shared thread pool and temporary memory the size of the data
+void RadixSort(uint32_t* keys, uint32_t* values, size_t count, int keyBits = 32);
+void RadixSort(uint64_t* keys, uint32_t* values, size_t count, int keyBits = 64);
+
+// Number of bits needed to hold the given value (0 for 0)
+inline int BitsNeeded(uint64_t value)
+{
+    int bits = 0;
+    while (value != 0)
+    {
+        ++bits;
+        value >>= 1;
+    }
+    return bits;
+}
+
+
+#endif //_RADIX_SORT_H_INCLUDED_
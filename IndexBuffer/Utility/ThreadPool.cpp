@@ -0,0 +1,128 @@
+//--------------------------------------------------------------------------------------
+// Thread pool - a fixed set of worker threads used to split large CPU jobs (mesh
+// processing, software rendering) across all the cores of the machine
+//--------------------------------------------------------------------------------------
+
+#include "ThreadPool.h"
+
+// Set on threads that are currently running a task, so nested jobs can be detected
+static thread_local bool tInsideTask = false;
+
+
+// Constructor / destructor //
+
+ThreadPool::ThreadPool(int numThreads)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = static_cast<int>(std::thread::hardware_concurrency());
+        if (numThreads <= 0)  numThreads = 1; // hardware_concurrency can return 0 if it doesn't know
+    }
+    mNumThreads = numThreads;
+
+    mTask = nullptr;
+    mNumTasks = 0;
+    mNextTask = 0;
+    mJobNumber = 0;
+    mBusyWorkers = 0;
+    mQuit = false;
+
+    // The calling thread is thread 0, so create one fewer worker
+    for (int i = 1; i < mNumThreads; ++i)
+    {
+        mWorkers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mJobReady.notify_all();
+    for (auto& worker : mWorkers)
+    {
+        worker.join();
+    }
+}
+
+
+// Usage //
+
+void ThreadPool::Run(int numTasks, const std::function<void(int taskIndex, int threadIndex)>& task)
+{
+    if (numTasks <= 0)  return;
+
+    // Nested job or only one thread - no point waking the workers
+    if (tInsideTask || mWorkers.empty() || numTasks == 1)
+    {
+        for (int i = 0; i < numTasks; ++i)  task(i, 0);
+        return;
+    }
+
+    std::lock_guard<std::mutex> runLock(mRunMutex);
+
+    // Publish the job and wake the workers
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTask = &task;
+        mNumTasks = numTasks;
+        mNextTask = 0;
+        mBusyWorkers = static_cast<int>(mWorkers.size());
+        ++mJobNumber;
+    }
+    mJobReady.notify_all();
+
+    // This thread works on the job too
+    DoTasks(0);
+
+    // Wait for the workers to finish their last tasks
+    std::unique_lock<std::mutex> lock(mMutex);
+    mJobDone.wait(lock, [this] { return mBusyWorkers == 0; });
+    mTask = nullptr;
+}
+
+
+// Private functions //
+
+void ThreadPool::WorkerLoop(int threadIndex)
+{
+    unsigned int lastJob = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mJobReady.wait(lock, [&] { return mQuit || mJobNumber != lastJob; });
+            if (mQuit)  return;
+            lastJob = mJobNumber;
+        }
+
+        DoTasks(threadIndex);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (--mBusyWorkers == 0)
+        {
+            mJobDone.notify_one();
+        }
+    }
+}
+
+void ThreadPool::DoTasks(int threadIndex)
+{
+    tInsideTask = true;
+    int taskIndex;
+    while ((taskIndex = mNextTask.fetch_add(1, std::memory_order_relaxed)) < mNumTasks)
+    {
+        (*mTask)(taskIndex, threadIndex);
+    }
+    tInsideTask = false;
+}
+
+
+// The pool shared by the whole app - created on first use with one thread per core
+ThreadPool& GetThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,102 @@
+//--------------------------------------------------------------------------------------
+// Thread pool - a fixed set of worker threads used to split large CPU jobs (mesh
+// processing, software rendering) across all the cores of the machine
+//--------------------------------------------------------------------------------------
+
+#ifndef _THREAD_POOL_H_INCLUDED_
+#define _THREAD_POOL_H_INCLUDED_
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+class ThreadPool
+{
+public:
+    // Constructor / destructor //
+
+    // Create a pool that runs jobs on the given number of threads, which includes the thread that calls Run.
+    // Pass 0 to use one thread per core
+    ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+
+    // Prevent copying
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+
+    // Usage //
+
+    // Number of threads that work on each job (including the calling thread)
+    int GetNumThreads() const { return mNumThreads; }
+
+    // Call task(taskIndex, threadIndex) once for each taskIndex from 0 to numTasks-1 and return when all are done.
+    // Tasks are handed out one at a time from a shared counter, so threads that finish early pick up the remaining
+    // tasks - use more tasks than threads when task sizes vary. threadIndex is in the range 0 to GetNumThreads()-1
+    // and is the same for all tasks run by one thread, so it can be used to select per-thread scratch memory.
+    // Calling Run from inside a task is allowed, but the inner job runs on the calling thread only
+    void Run(int numTasks, const std::function<void(int taskIndex, int threadIndex)>& task);
+
+
+private:
+    // Main function for each worker thread
+    void WorkerLoop(int threadIndex);
+
+    // Take tasks from the current job until there are none left
+    void DoTasks(int threadIndex);
+
+    int mNumThreads;
+    std::vector<std::thread> mWorkers;
+
+    // Current job
+    const std::function<void(int, int)>* mTask;
+    int              mNumTasks;
+    std::atomic<int> mNextTask;
+
+    // Signalling between Run and the workers
+    std::mutex              mRunMutex;   // Only one job can run at a time
+    std::mutex              mMutex;
+    std::condition_variable mJobReady;
+    std::condition_variable mJobDone;
+    unsigned int            mJobNumber;  // Incremented for each new job so workers can spot it
+    int                     mBusyWorkers;
+    bool                    mQuit;
+};
+
+
+// The pool shared by the whole app - created on first use with one thread per core
+ThreadPool& GetThreadPool();
+
+
+// Split the range 0 to count-1 into chunks of at least minChunkSize items and call func(begin, end, threadIndex)
+// for each chunk, in parallel using the shared pool. Uses a few chunks per thread to balance uneven work
+template <class Func>
+void ParallelFor(size_t count, size_t minChunkSize, Func func)
+{
+    if (count == 0)  return;
+
+    ThreadPool& pool = GetThreadPool();
+    if (minChunkSize == 0)  minChunkSize = 1;
+    size_t numChunks = count / minChunkSize;
+    size_t maxChunks = static_cast<size_t>(pool.GetNumThreads()) * 4;
+    if (numChunks > maxChunks)  numChunks = maxChunks;
+    if (numChunks <= 1)
+    {
+        func(size_t(0), count, 0);
+        return;
+    }
+
+    pool.Run(static_cast<int>(numChunks), [&](int chunk, int threadIndex)
+    {
+        size_t begin = count *  chunk      / numChunks;
+        size_t end   = count * (chunk + 1) / numChunks;
+        func(begin, end, threadIndex);
+    });
+}
+
+
+#endif //_THREAD_POOL_H_INCLUDED_